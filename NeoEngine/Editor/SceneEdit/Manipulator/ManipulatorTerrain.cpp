@@ -4,6 +4,7 @@
 #include "../EditorDefine.h"
 #include "Utility.h"
 #include "Scene.h"
+#include "Terrain/TerrainGroup.h"
 
 
 ManipulatorTerrain::ManipulatorTerrain()
@@ -42,26 +43,19 @@ void ManipulatorTerrain::OnSceneOpen()
 
 void ManipulatorTerrain::Serialize( rapidxml::xml_document<>* doc, rapidxml::xml_node<>* XMLNode )
 {
-// 	String strWorldSize = Ogre::StringConverter::toString(GetWorldSize());
-// 	String strTerrainSize = Ogre::StringConverter::toString(GetMapSize());
-// 
-// 	float pixelError = ManipulatorSystem.GetScene()->GetTerrainOption()->getMaxPixelError();
-// 	String strPixelError = Ogre::StringConverter::toString(pixelError);
-// 
-// 	XMLNode->append_attribute(doc->allocate_attribute("worldSize", doc->allocate_string(strWorldSize.c_str())));
-// 	XMLNode->append_attribute(doc->allocate_attribute("mapSize", doc->allocate_string(strTerrainSize.c_str())));
-// 	XMLNode->append_attribute(doc->allocate_attribute("tuningMaxPixelError", doc->allocate_string(strPixelError.c_str())));
-// 
-// 	//
-// 	std::wstring fullPath(ManipulatorSystem.GenerateSceneFullPath());
-// 	fullPath += L"terrain.dat";
-// 	Ogre::DataStreamPtr stream = Ogre::Root::getSingleton().createFileStream(Utility::UnicodeToEngine(fullPath), 
-// 		Ogre::ResourceGroupManager::DEFAULT_RESOURCE_GROUP_NAME, true);
-// 
-// 	Ogre::DataStreamPtr compressStream(new Ogre::DeflateStream(Utility::UnicodeToEngine(fullPath), stream));
-// 	Ogre::StreamSerialiser ser(compressStream);
-// 
-// 	ManipulatorSystem.GetScene()->GetTerrain()->save(ser);
+	char szWorldSize[32], szTerrainSize[32], szPixelError[32];
+	sprintf_s(szWorldSize, sizeof(szWorldSize), "%g", GetWorldSize());
+	sprintf_s(szTerrainSize, sizeof(szTerrainSize), "%u", (uint32)GetMapSize());
+	sprintf_s(szPixelError, sizeof(szPixelError), "%g", GetMaxPixelError());
+
+	XMLNode->append_attribute(doc->allocate_attribute("worldSize", doc->allocate_string(szWorldSize)));
+	XMLNode->append_attribute(doc->allocate_attribute("mapSize", doc->allocate_string(szTerrainSize)));
+	XMLNode->append_attribute(doc->allocate_attribute("tuningMaxPixelError", doc->allocate_string(szPixelError)));
+
+	//,ÿһļ: Ŀ¼\terrain_xxxxxxxx.dat
+	Neo::TerrainGroup* pTerrainGroup = g_env.pSceneMgr->GetTerrain();
+	pTerrainGroup->setFilenameConvention(Utility::UnicodeToEngine(ManipulatorSystem.GenerateSceneFullPath()) + "terrain", "dat");
+	pTerrainGroup->saveAllTerrains(false);
 }
 
 float ManipulatorTerrain::GetHeightAt( const VEC2& worldPos )
@@ -113,17 +107,17 @@ void ManipulatorTerrain::SetBrushPosition( const VEC3& pos )
 // 	m_brush[m_curBrushIndex]->SetPosition(clampPos);
 }
 
-// bool ManipulatorTerrain::GetRayIntersectPoint( const RAY& worldRay, VEC3& retHitPos )
-// {
-// 	irr::scene::ITerrainSceneNode* terrain = ManipulatorScene::GetSingleton().GetScene()->GetTerrain();
-// 	assert(terrain);
-// 
-// 	irr::core::triangle3df hitTri;
-// 	SCENENODE* hitNode = RenderSys.GetSceneManager()->getSceneCollisionManager()->getSceneNodeAndCollisionPointFromRay(
-// 		worldRay, retHitPos, hitTri, Kratos::eQueryMask_Terrain);
-// 
-// 	return hitNode != nullptr;
-// }
+bool ManipulatorTerrain::GetRayIntersectPoint( const RAY& worldRay, VEC3& retHitPos )
+{
+	Neo::TerrainGroup* pTerrain = g_env.pSceneMgr->GetTerrain();
+	assert(pTerrain);
+
+	Neo::TerrainGroup::RayResult result = pTerrain->rayIntersects(worldRay);
+	if (result.hit)
+		retHitPos = result.position;
+
+	return result.hit;
+}
 
 void ManipulatorTerrain::OnGizmoNodeReset()
 {
@@ -319,20 +313,17 @@ const std::string ManipulatorTerrain::GetLayerNormalMap( int nLayer ) const
 
 float ManipulatorTerrain::GetWorldSize() const
 {
-	//return ManipulatorSystem.GetScene()->GetTerrainGroup()->getTerrainWorldSize();
-	return 0;
+	return g_env.pSceneMgr->GetTerrain()->getTerrainWorldSize();
 }
 
 size_t ManipulatorTerrain::GetMapSize() const
 {
-	//return ManipulatorSystem.GetScene()->GetTerrainGroup()->getTerrainSize();
-	return 0;
+	return g_env.pSceneMgr->GetTerrain()->getTerrainSize();
 }
 
 float ManipulatorTerrain::GetMaxPixelError() const
 {
-	//return ManipulatorSystem.GetScene()->GetTerrainOption()->getMaxPixelError();
-	return 0;
+	return g_env.pSceneMgr->GetTerrainOptions()->getMaxPixelError();
 }
 
 float ManipulatorTerrain::GetSkirtSize() const
@@ -35,7 +35,7 @@ public:
 	void	Serialize(rapidxml::xml_document<>* doc, rapidxml::xml_node<>* XMLNode);
 	void	OnGizmoNodeReset();
 	float	GetHeightAt(const VEC2& worldPos);
-	//bool	GetRayIntersectPoint(const RAY& worldRay, VEC3& retHitPos);
+	bool	GetRayIntersectPoint(const RAY& worldRay, VEC3& retHitPos);
 	float	GetWorldSize() const;
 	size_t	GetMapSize() const;
 	float	GetMaxPixelError() const;
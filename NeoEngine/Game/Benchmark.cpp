@@ -0,0 +1,109 @@
+#include "stdafx.h"
+#include "Benchmark.h"
+#include "Octree.h"
+#include "MathDef.h"
+#include "MeshLoader.h"
+#include "SkinModel.h"
+#include "Terrain/TerrainRenderQueue.h"
+
+#if USE_BENCHMARK
+
+using namespace Neo;
+
+namespace
+{
+	//----------------------------------------------------------------------------------------
+	bool _RunOctreeBenchmark()
+	{
+		std::vector<SOctreeBenchResult> results;
+		const bool bOk = RunOctreeBenchmark(results);
+
+		for (uint32 i = 0; i < results.size(); ++i)
+		{
+			const SOctreeBenchResult& res = results[i];
+			printf("Octree %-20s views: %u, old: %.2f ms, new: %.2f ms, visible: %u, mismatches: %u\n",
+				res.name, res.nViews, res.fOldMs, res.fNewMs, res.nVisibleObjs, res.nMismatches);
+		}
+
+		return bOk;
+	}
+	//----------------------------------------------------------------------------------------
+	bool _RunMathBenchmark()
+	{
+		std::vector<Common::SMathBenchResult> results;
+		const bool bOk = Common::RunMathBenchmark(results);
+
+		for (uint32 i = 0; i < results.size(); ++i)
+		{
+			const Common::SMathBenchResult& res = results[i];
+			printf("Math %-30s scalar: %.2f ms, simd: %.2f ms, max error: %g\n",
+				res.name, res.fScalarMs, res.fSimdMs, res.fMaxError);
+		}
+
+		return bOk;
+	}
+	//----------------------------------------------------------------------------------------
+	bool _RunAnimBenchmark()
+	{
+		const float fMaxRotError = 0.002f, fMaxTransError = 0.001f;
+		std::vector<SAnimBenchResult> results;
+
+		try
+		{
+			std::unique_ptr<SkeletonAnim> pSkeleton(MeshLoader::LoadSkeleton("sinbad/Sinbad.skeleton"));
+			pSkeleton->BenchmarkClips(results, 1000, fMaxRotError, fMaxTransError);
+		}
+		catch (std::exception& e)
+		{
+			printf("Anim %s\n", e.what());
+			return false;
+		}
+
+		bool bOk = !results.empty();
+
+		for (uint32 i = 0; i < results.size(); ++i)
+		{
+			const SAnimBenchResult& res = results[i];
+			printf("Anim %-20s bytes: %u -> %u, scan: %.2f ms, cursor: %.2f ms, compressed: %.2f ms, error: %g rad, %g\n",
+				res.name.c_str(), res.nRawBytes, res.nCompressedBytes, res.fScanMs, res.fCursorMs, res.fCompressedMs,
+				res.fMaxRotError, res.fMaxTransError);
+
+			// The errors are bounded at the keys, interpolating between them may add a little
+			if (res.fMaxRotError > 2 * fMaxRotError || res.fMaxTransError > 2 * fMaxTransError)
+				bOk = false;
+		}
+
+		return bOk;
+	}
+	//----------------------------------------------------------------------------------------
+	bool _RunTerrainRenderQueueTest()
+	{
+		STerrainQueueTestResult res;
+		const bool bOk = RunTerrainRenderQueueTest(res);
+
+		printf("TerrainRenderQueue terrains: %u, patches: %u, draws: %u, mismatches: %u\n",
+			res.nTerrains, res.nPatches, res.nDraws, res.nMismatches);
+
+		return bOk;
+	}
+}
+//----------------------------------------------------------------------------------------
+int RunBenchmarks()
+{
+	bool bOk = true;
+
+	if (!_RunOctreeBenchmark())
+		bOk = false;
+	if (!_RunMathBenchmark())
+		bOk = false;
+	if (!_RunAnimBenchmark())
+		bOk = false;
+	if (!_RunTerrainRenderQueueTest())
+		bOk = false;
+
+	printf(bOk ? "All passed\n" : "FAILED\n");
+
+	return bOk ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,19 @@
+/********************************************************************
+	created:	2016/11/21 16:40
+	filename	Benchmark.h
+	author:		maval
+
+	purpose:	Benchmarks and self tests of the engine, run by "Game -bench"
+				once the engine is initialized. Results are printed to stdout.
+*********************************************************************/
+#ifndef Benchmark_h__
+#define Benchmark_h__
+
+#include "Prerequiestity.h"
+
+#if USE_BENCHMARK
+// Returns the exit code of the process, nonzero if any of them failed
+int		RunBenchmarks();
+#endif
+
+#endif // Benchmark_h__
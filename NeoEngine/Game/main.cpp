@@ -2,18 +2,31 @@
 #include <vector>
 #include <Windows.h>
 #include <exception>
+#include <cstring>
 
 
 #include "Prerequiestity.h"
 #include "Application.h"
+#include "Benchmark.h"
 
 
-int main()
+int main(int argc, char* argv[])
 {
 	try
 	{
 		Application app;
 		app.Init();
+
+#if USE_BENCHMARK
+		// Run on the initialized engine instead of the main loop
+		if (argc > 1 && strcmp(argv[1], "-bench") == 0)
+		{
+			const int ret = RunBenchmarks();
+			app.ShutDown();
+			return ret;
+		}
+#endif
+
 		app.Run();
 		app.ShutDown();
 	}
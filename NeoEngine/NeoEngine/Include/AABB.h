@@ -28,11 +28,47 @@ namespace Common
 		void	GetPoints(VEC3* pPoints) const;
 		bool	IsFinite() const { return m_boundingRadius != -1; }
 		//任AABB,from ogre. NB: 任Ҫ
+		//Affine matrices go through TransformAffine(), the others transform all 8 corners.
 		void	Transform(const MAT44& matrix);
+		// Arvo's method: transform the center, the new half size is the old one by |matrix|.
+		// Only valid if matrix.IsAffine().
+		void	TransformAffine(const MAT44& matrix);
+		bool	IsNull() const { return m_minCorner.x > m_maxCorner.x; }
 
 		VEC3	m_minCorner, m_maxCorner;
 		float	m_boundingRadius;		//
-	};	
+	};
+
+	/////////////////////////////////////////////////////////////
+	//////// AABB array in SoA layout.
+	//////// Each component lives in its own 16-byte aligned stream, padded to a multiple
+	//////// of 4 so that SSE can process 4 boxes per instruction.
+	class AABBArray
+	{
+	public:
+		AABBArray();
+		~AABBArray();
+
+		void	Resize(uint32 nCount);
+		uint32	GetCount() const { return m_nCount; }
+		void	Set(uint32 i, const AxisAlignBBox& aabb);
+		void	Get(uint32 i, AxisAlignBBox& aabb) const;
+
+		float*	m_minX;
+		float*	m_minY;
+		float*	m_minZ;
+		float*	m_maxX;
+		float*	m_maxY;
+		float*	m_maxZ;
+
+	private:
+		AABBArray(const AABBArray&);
+		AABBArray& operator= (const AABBArray&);
+
+		float*	m_pData;
+		uint32	m_nCount;
+		uint32	m_nCapacity;
+	};
 }
 
 #endif // AABB_h__
\ No newline at end of file
@@ -149,15 +149,16 @@ namespace Neo
 	__forceinline DWORD SColor::GetAsInt() const
 	{
 #if USE_SIMD == 1
-		VEC4 c;
 		__m128 V1 =  _mm_set_ps(a, b, g, r);
 		__m128 V2 =  _mm_set_ps1(255.0f);
-		Common::m128_to_vec4(c, _mm_mul_ps( V1, V2 ));
-
-		BYTE tmp_a = Ftoi32_Fast(c.w);
-		BYTE tmp_r = Ftoi32_Fast(c.x);
-		BYTE tmp_g = Ftoi32_Fast(c.y);
-		BYTE tmp_b = Ftoi32_Fast(c.z);
+		// Truncate like the BYTE() casts below
+		__declspec(align(16)) int c[4];
+		_mm_store_si128((__m128i*)c, _mm_cvttps_epi32(_mm_mul_ps( V1, V2 )));
+
+		BYTE tmp_a = BYTE(c[3]);
+		BYTE tmp_r = BYTE(c[0]);
+		BYTE tmp_g = BYTE(c[1]);
+		BYTE tmp_b = BYTE(c[2]);
 #else
 		BYTE tmp_a = BYTE(a * 255);
 		BYTE tmp_r = BYTE(r * 255);
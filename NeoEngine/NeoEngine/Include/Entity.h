@@ -53,6 +53,11 @@ namespace Neo
 		void			SetCustomRenderData(void* pData) { m_pCustomRenderData = pData; }
 		void*			GetCustomRenderData() { return m_pCustomRenderData; }
 		void			UpdateAABB();
+		// Apply the relocation postponed while the octree deferred updates.
+		void			FlushOctreeUpdate();
+		// UpdateAABB() of ppEntities[0, nCount) that also writes the world bounds into bounds[0, nCount).
+		// Octree relocations are always deferred to FlushOctreeUpdate(), returns how many of them are pending.
+		static uint32	UpdateWorldAABBs(Entity** ppEntities, uint32 nCount, Common::AABBArray& bounds);
 
 		const VEC3&		GetPosition() { return m_position; }
 		const QUATERNION&	GetRotation() { return m_rotation; }
@@ -62,8 +67,8 @@ namespace Neo
 		const MAT44&	GetWorldMatrix();
 		const MAT44&	GetWorldITMatrix();
 
-		void			SetUpdateAABB(bool b)	{ m_bUpdateAABB = b; }
-		void			SetLocalAABB(const AABB& aabb) { m_localAABB = aabb; }
+		void			SetUpdateAABB(bool b)	{ m_bUpdateAABB = b; m_bBoundsDirty = true; }
+		void			SetLocalAABB(const AABB& aabb) { m_localAABB = aabb; m_bBoundsDirty = true; }
 		const AABB&		GetWorldAABB() const	{ return m_worldAABB; }
 		Mesh*			GetMesh() { return m_pMesh; }
 
@@ -74,9 +79,17 @@ namespace Neo
 		void			SetVisible(bool b) { m_bVisible = b; }
 		bool			GetVisible() const { return m_bVisible; }
 
+		// Location in the octree, maintained by Octree.
+		void			SetOctreeNode(Octree* pOctree, uint32 iNode, uint32 iSlot) { m_pOctree = pOctree; m_iOctreeNode = iNode; m_iOctreeSlot = iSlot; }
+		Octree*			GetOctree() const		{ return m_pOctree; }
+		uint32			GetOctreeNode() const	{ return m_iOctreeNode; }
+		uint32			GetOctreeSlot() const	{ return m_iOctreeSlot; }
+
 	protected:
 		void			_UpdateTransform();
 		void			_ComputeAABB();
+		// Returns true if the world AABB changed
+		bool			_UpdateWorldAABB();
 
 	protected:
 		Mesh*			m_pMesh;
@@ -92,11 +105,17 @@ namespace Neo
 		MAT44			m_matWorldIT;		//ת,ڷ߱任
 
 		bool			m_bUpdateAABB;
+		bool			m_bBoundsDirty;		// Transform changed since last UpdateAABB
 		AABB			m_localAABB;		//ذΧ
 		AABB			m_worldAABB;		//Χ
 		bool			m_bCastShadow;		// Is shadow caster?
 		bool			m_bReceiveShadow;	// Is shadow receiver?
 		bool			m_bVisible;
+
+		Octree*			m_pOctree;
+		uint32			m_iOctreeNode;
+		uint32			m_iOctreeSlot;
+		bool			m_bOctreePending;	// Bounds changed while the octree deferred updates
 	};
 }
 
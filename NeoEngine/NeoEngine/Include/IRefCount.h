@@ -16,6 +16,7 @@ public:
 	virtual ~IRefCount() { Release(); }
 
 	void	AddRef() const	{ ++m_refCnt; }
+	int		GetRefCount() const { return m_refCnt; }
 	void	Release() const
 	{
 		assert(m_refCnt >= 0);
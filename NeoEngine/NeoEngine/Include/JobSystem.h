@@ -0,0 +1,132 @@
+/********************************************************************
+	created:	2016/10/24 10:12
+	filename	JobSystem.h
+	author:		maval
+
+	purpose:	Job scheduler with a fixed worker pool.
+				Every thread owns a deque, it pushes and pops its own jobs at
+				the back while idle workers steal from the front of the others.
+				A thread waiting on a counter keeps executing jobs instead of
+				blocking, so a job may spawn more jobs and wait for them.
+				Long running work goes to background threads instead, which
+				the main thread never picks up while it waits on a frame job.
+				JobGraph runs a set of tasks with explicit dependencies.
+				In single thread mode every job runs inline on the calling
+				thread in submission order, which is deterministic for debugging.
+*********************************************************************/
+#ifndef JobSystem_h__
+#define JobSystem_h__
+
+#include "Prerequiestity.h"
+#include "Singleton.h"
+
+namespace Neo
+{
+	typedef std::function<void()>						JobFunc;
+	typedef std::function<void(uint32, uint32)>			RangeJobFunc;	// Processes [nBegin, nEnd)
+
+	// Counts the unfinished jobs of a batch, see JobSystem::Wait()
+	struct SJobCounter
+	{
+		SJobCounter() : nPending(0) {}
+
+		std::atomic<int>	nPending;
+	};
+	//------------------------------------------------------------------------------------
+	class JobSystem : public Common::CSingleton<JobSystem>
+	{
+	public:
+		JobSystem();
+		~JobSystem();
+
+		DECLEAR_SINGLETON(JobSystem)
+
+	public:
+		// nWorkers = 0 uses one worker for each hardware thread except the main one.
+		// Background threads only run RunBackground() jobs and aren't counted as workers.
+		void		Init(uint32 nWorkers = 0, uint32 nBackgroundThreads = 1);
+		void		Shutdown();
+		// Run every job inline on the calling thread. Only switch it between frames.
+		void		SetSingleThreaded(bool b) { m_bSingleThreaded = b; }
+		bool		IsSingleThreaded() const { return m_bSingleThreaded || m_workers.empty(); }
+		uint32		GetWorkerCount() const { return m_workers.size(); }
+
+		void		Run(const JobFunc& func, SJobCounter* pCounter);
+		// For work taking several frames, like reading files or preparing a terrain.
+		// It runs on a background thread, never inside the Wait() of the main thread,
+		// while the ParallelFor() it issues is still shared with the workers.
+		void		RunBackground(const JobFunc& func, SJobCounter* pCounter);
+		// Execute pending jobs until the counter drops to zero.
+		void		Wait(SJobCounter* pCounter);
+		// Split [0, nCount) into chunks of nGrain and process them in parallel, returns when all done.
+		void		ParallelFor(uint32 nCount, uint32 nGrain, const RangeJobFunc& func);
+
+	private:
+		struct SJob
+		{
+			JobFunc			func;
+			SJobCounter*	pCounter;
+		};
+
+		struct SWorkQueue
+		{
+			std::mutex			lock;
+			std::deque<SJob>	jobs;
+		};
+
+		void		_WorkerMain(uint32 iQueue);
+		void		_BackgroundMain(uint32 iQueue);
+		bool		_ExecuteOne(uint32 iQueue);
+		bool		_Pop(uint32 iQueue, SJob& job);
+		bool		_Steal(uint32 iQueue, SJob& job);
+
+		std::vector<std::thread>	m_workers;
+		std::vector<SWorkQueue*>	m_queues;		// m_queues[0] belongs to the main thread, then one for each worker and background thread
+		std::mutex					m_sleepLock;
+		std::condition_variable		m_wakeUp;
+		std::atomic<int>			m_nQueuedJobs;
+		std::atomic<bool>			m_bQuit;
+
+		std::vector<std::thread>	m_backgroundThreads;
+		uint32						m_iFirstBackgroundQueue;
+		std::mutex					m_backgroundLock;		// Guards m_backgroundJobs
+		std::condition_variable		m_backgroundWakeUp;
+		std::deque<SJob>			m_backgroundJobs;
+		bool						m_bQuitBackground;
+		bool						m_bSingleThreaded;
+	};
+	//------------------------------------------------------------------------------------
+	class JobGraph
+	{
+	public:
+		typedef uint32	TaskID;
+
+		JobGraph() {}
+
+	public:
+		TaskID		AddTask(const JobFunc& func);
+		// task will not start before dependsOn finished.
+		void		AddDependency(TaskID task, TaskID dependsOn);
+		// Run all tasks and return when every one of them finished.
+		void		Execute();
+		void		Clear() { m_tasks.clear(); }
+
+	private:
+		struct STask
+		{
+			JobFunc				func;
+			std::vector<TaskID>	successors;
+			int					nDeps;
+		};
+
+		void		_RunTask(TaskID id, SJobCounter* pCounter);
+
+		std::vector<STask>					m_tasks;
+		std::unique_ptr<std::atomic<int>[]>	m_pendingDeps;	// Unfinished dependencies of each task while executing
+
+		JobGraph(const JobGraph&);
+		JobGraph& operator= (const JobGraph&);
+	};
+}
+
+#endif // JobSystem_h__
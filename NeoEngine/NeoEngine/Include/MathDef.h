@@ -63,6 +63,16 @@ namespace Common
 			return *this;
 		}
 
+		// Null if they don't overlap
+		iRect Intersect(const iRect& rhs) const
+		{
+			iRect ret(std::max(left, rhs.left), std::max(top, rhs.top), std::min(right, rhs.right), std::min(bottom, rhs.bottom));
+			if (ret.left >= ret.right || ret.top >= ret.bottom)
+				ret.SetNull();
+
+			return ret;
+		}
+
 		int left, right, top, bottom;
 	};
 
@@ -374,6 +384,8 @@ namespace Common
 		float		Normalise();
 		void		FromRotationMatrix(const Matrix44& kRot);
 		Matrix44	ToRotationMatrix() const;
+		// Same as transforming v by the matrix of FromQuaternion()
+		Vector3		Rotate(const Vector3& v) const;
 
 		static Quaternion Slerp(float fT, const Quaternion& rkP, const Quaternion& rkQ, bool shortestPath = false);
 
@@ -411,6 +423,8 @@ namespace Common
 		Matrix44	Inverse() const;
 		//ת
 		Matrix44	Transpose() const;
+		// No projection, the last column is (0,0,0,1)
+		bool		IsAffine() const { return m03 == 0 && m13 == 0 && m23 == 0 && m33 == 1; }
 		//ƽƲ
 		inline void	ClearTranslation() { SetRow(3, Vector4(0,0,0,1)); }
 		//ƽƲ
@@ -442,6 +456,26 @@ namespace Common
 		static Matrix44 ZERO;
 	};
 
+	/////////////////////////////////////////////////////////////
+	//////// 16 bytes aligned storage, keeps a row/vector in one SIMD load
+	//////// and inside one cache line. Use them for arrays like bone palettes.
+	__declspec(align(16))
+	class Vector4A : public Vector4
+	{
+	public:
+		Vector4A() {}
+		Vector4A(const Vector4& v):Vector4(v) {}
+		Vector4A(float _x, float _y, float _z, float _w):Vector4(_x, _y, _z, _w) {}
+	};
+
+	__declspec(align(16))
+	class Matrix44A : public Matrix44
+	{
+	public:
+		Matrix44A() {}
+		Matrix44A(const Matrix44& m):Matrix44(m) {}
+	};
+
 	/////////////////////////////////////////////////////////////
 	//////// 3D plane
 	class Plane
@@ -490,6 +524,8 @@ namespace Common
 
 		std::pair<bool, float>	Intersects(const Vector3& p1, const Vector3& p2, const Vector3& p3) const;
 		std::pair<bool, float>	Intersects(const Plane& plane) const;
+		// Slab test, [tNear, tFar] is the part of the ray inside the box, tNear is at least 0
+		bool	Intersects(const AxisAlignBBox& aabb, float& tNear, float& tFar) const;
 	};
 
 
@@ -522,6 +558,48 @@ namespace Common
 	bool		IsPointInTriangle(const Vector3& pt, const Vector3& p1, const Vector3& p2, const Vector3& p3);
 	bool		IsPow2(int n);
 
+	//////// Batch versions, USE_SIMD picks the implementation like the single ones.
+	//////// pOut may be the same array as the input.
+	void		Transform_Vec3Array_By_Mat44(Vector4* pOut, const Vector3* pIn, uint32 nCount, const Matrix44& mat, bool bPosOrDir);
+	void		Transform_Vec4Array_By_Mat44(Vector4* pOut, const Vector4* pIn, uint32 nCount, const Matrix44& mat);
+	// pOut[i] = pLhs[i] * pRhs[i]
+	void		Multiply_Mat44Array_By_Mat44(Matrix44* pOut, const Matrix44* pLhs, const Matrix44* pRhs, uint32 nCount);
+	// pOut[i] = pLhs[i] * rhs
+	void		Multiply_Mat44Array_By_Mat44(Matrix44* pOut, const Matrix44* pLhs, const Matrix44& rhs, uint32 nCount);
+
+	//////// Both implementations are always compiled, so they can be compared against each other.
+	namespace Scalar
+	{
+		Vector4		Transform_Vec4_By_Mat44(const Vector4& pt, const Matrix44& mat);
+		Matrix44	Multiply_Mat44_By_Mat44(const Matrix44& mat1, const Matrix44& mat2);
+		Matrix44	Inverse(const Matrix44& mat);
+		Matrix44	Transpose(const Matrix44& mat);
+		Quaternion	Slerp(float fT, const Quaternion& rkP, const Quaternion& rkQ, bool shortestPath);
+	}
+
+	namespace SIMD
+	{
+		Vector4		Transform_Vec4_By_Mat44(const Vector4& pt, const Matrix44& mat);
+		Matrix44	Multiply_Mat44_By_Mat44(const Matrix44& mat1, const Matrix44& mat2);
+		Matrix44	Inverse(const Matrix44& mat);
+		Matrix44	Transpose(const Matrix44& mat);
+		Quaternion	Slerp(float fT, const Quaternion& rkP, const Quaternion& rkQ, bool shortestPath);
+	}
+
+#if USE_BENCHMARK
+	struct SMathBenchResult
+	{
+		const char*	name;
+		double		fScalarMs;
+		double		fSimdMs;
+		float		fMaxError;		// Largest difference between the two, relative to the magnitude of the result
+	};
+
+	// Run every function of Scalar and SIMD nCount times on the same random input.
+	// Returns false if a result of the two differs more than fEpsilon.
+	bool		RunMathBenchmark(std::vector<SMathBenchResult>& results, uint32 nCount = 100000, float fEpsilon = 1e-4f);
+#endif
+
 	// AABB vs AABB sweep test, returns true if intersection can occur if object is translated along given direction
 	bool		SweepIntersectionTest(const AxisAlignBBox &objectBB, const AxisAlignBBox &frustumBB, const Vector3 &vSweepDir);
 
@@ -57,6 +57,9 @@ namespace Common
 		__m128 vZeroMask = _mm_setzero_ps();
 		// Test for a divide by zero (Must be FP to detect -0.0)
 		vZeroMask = _mm_cmpneq_ps(vZeroMask,vResult);
+		// Keep the length, vResult and vLengthSq are reused below
+		float oLen;
+		_mm_store_ss(&oLen, vResult);
 		// Failsafe on zero (Or epsilon) length planes
 		// If the length is infinity, set the elements to zero
 		vLengthSq = _mm_cmpneq_ps(vLengthSq,g_XMInfinity.v);
@@ -69,9 +72,6 @@ namespace Common
 		__m128 vTemp2 = _mm_and_ps(vResult,vLengthSq);
 		m128_to_vec3(*this, _mm_or_ps(vTemp1,vTemp2));
 
-		float oLen;
-		XMStoreFloat(&oLen, _mm_sqrt_ps(vLengthSq));
-
 		return oLen;
 #else
 		float mod = sqrtf(x * x + y * y + z * z);
@@ -384,81 +384,38 @@ namespace Common
 		return Transform_Vec4_By_Mat44(Vector4(pt, bPosOrDir ? 1.0f : 0.0f), mat);
 	}
 
+	__forceinline Vector4	Transform_Vec4_By_Mat44(const Vector4& pt, const Matrix44& mat)
+	{
+#if USE_SIMD == 1
+		return SIMD::Transform_Vec4_By_Mat44(pt, mat);
+#else
+		return Scalar::Transform_Vec4_By_Mat44(pt, mat);
+#endif
+	}
+
 	__forceinline Matrix44	Multiply_Mat44_By_Mat44( const Matrix44& mat1, const Matrix44& mat2 )
 	{
-		Matrix44 ret;
 #if USE_SIMD == 1
-		Vector4 tmp;
-		__m128 m1r0 = _mm_set_ps(mat1.m_arr[0][3], mat1.m_arr[0][2], mat1.m_arr[0][1], mat1.m_arr[0][0]);
-		__m128 m1r1 = _mm_set_ps(mat1.m_arr[1][3], mat1.m_arr[1][2], mat1.m_arr[1][1], mat1.m_arr[1][0]);
-		__m128 m1r2 = _mm_set_ps(mat1.m_arr[2][3], mat1.m_arr[2][2], mat1.m_arr[2][1], mat1.m_arr[2][0]);
-		__m128 m1r3 = _mm_set_ps(mat1.m_arr[3][3], mat1.m_arr[3][2], mat1.m_arr[3][1], mat1.m_arr[3][0]);
-		__m128 m2r0 = _mm_set_ps(mat2.m_arr[0][3], mat2.m_arr[0][2], mat2.m_arr[0][1], mat2.m_arr[0][0]);
-		__m128 m2r1 = _mm_set_ps(mat2.m_arr[1][3], mat2.m_arr[1][2], mat2.m_arr[1][1], mat2.m_arr[1][0]);
-		__m128 m2r2 = _mm_set_ps(mat2.m_arr[2][3], mat2.m_arr[2][2], mat2.m_arr[2][1], mat2.m_arr[2][0]);
-		__m128 m2r3 = _mm_set_ps(mat2.m_arr[3][3], mat2.m_arr[3][2], mat2.m_arr[3][1], mat2.m_arr[3][0]);
-		// Use vW to hold the original row
-		__m128 vW = m1r0;
-		// Splat the component X,Y,Z then W
-		__m128 vX = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(0,0,0,0));
-		__m128 vY = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(1,1,1,1));
-		__m128 vZ = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(2,2,2,2));
-		vW = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(3,3,3,3));
-		// Perform the opertion on the first row
-		vX = _mm_mul_ps(vX,m2r0);
-		vY = _mm_mul_ps(vY,m2r1);
-		vZ = _mm_mul_ps(vZ,m2r2);
-		vW = _mm_mul_ps(vW,m2r3);
-		// Perform a binary add to reduce cumulative errors
-		vX = _mm_add_ps(vX,vZ);
-		vY = _mm_add_ps(vY,vW);
-		vX = _mm_add_ps(vX,vY);
-		m128_to_vec4(tmp, vX);
-		ret.SetRow(0, tmp);
-		// Repeat for the other 3 rows
-		vW = m1r1;
-		vX = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(0,0,0,0));
-		vY = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(1,1,1,1));
-		vZ = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(2,2,2,2));
-		vW = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(3,3,3,3));
-		vX = _mm_mul_ps(vX,m2r0);
-		vY = _mm_mul_ps(vY,m2r1);
-		vZ = _mm_mul_ps(vZ,m2r2);
-		vW = _mm_mul_ps(vW,m2r3);
-		vX = _mm_add_ps(vX,vZ);
-		vY = _mm_add_ps(vY,vW);
-		vX = _mm_add_ps(vX,vY);
-		m128_to_vec4(tmp, vX);
-		ret.SetRow(1, tmp);
-		vW = m1r2;
-		vX = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(0,0,0,0));
-		vY = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(1,1,1,1));
-		vZ = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(2,2,2,2));
-		vW = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(3,3,3,3));
-		vX = _mm_mul_ps(vX,m2r0);
-		vY = _mm_mul_ps(vY,m2r1);
-		vZ = _mm_mul_ps(vZ,m2r2);
-		vW = _mm_mul_ps(vW,m2r3);
-		vX = _mm_add_ps(vX,vZ);
-		vY = _mm_add_ps(vY,vW);
-		vX = _mm_add_ps(vX,vY);
-		m128_to_vec4(tmp, vX);
-		ret.SetRow(2, tmp);
-		vW = m1r3;
-		vX = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(0,0,0,0));
-		vY = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(1,1,1,1));
-		vZ = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(2,2,2,2));
-		vW = _mm_shuffle_ps(vW,vW,_MM_SHUFFLE(3,3,3,3));
-		vX = _mm_mul_ps(vX,m2r0);
-		vY = _mm_mul_ps(vY,m2r1);
-		vZ = _mm_mul_ps(vZ,m2r2);
-		vW = _mm_mul_ps(vW,m2r3);
-		vX = _mm_add_ps(vX,vZ);
-		vY = _mm_add_ps(vY,vW);
-		vX = _mm_add_ps(vX,vY);
-		m128_to_vec4(tmp, vX);
-		ret.SetRow(3, tmp);
+		return SIMD::Multiply_Mat44_By_Mat44(mat1, mat2);
 #else
+		return Scalar::Multiply_Mat44_By_Mat44(mat1, mat2);
+#endif
+	}
+
+	//////////// Scalar reference
+	__forceinline Vector4	Scalar::Transform_Vec4_By_Mat44(const Vector4& pt, const Matrix44& mat)
+	{
+		return Vector4(
+			mat.m_arr[0][0] * pt.x + mat.m_arr[1][0] * pt.y + mat.m_arr[2][0] * pt.z + mat.m_arr[3][0] * pt.w, 
+			mat.m_arr[0][1] * pt.x + mat.m_arr[1][1] * pt.y + mat.m_arr[2][1] * pt.z + mat.m_arr[3][1] * pt.w,
+			mat.m_arr[0][2] * pt.x + mat.m_arr[1][2] * pt.y + mat.m_arr[2][2] * pt.z + mat.m_arr[3][2] * pt.w,
+			mat.m_arr[0][3] * pt.x + mat.m_arr[1][3] * pt.y + mat.m_arr[2][3] * pt.z + mat.m_arr[3][3] * pt.w
+			);
+	}
+
+	__forceinline Matrix44	Scalar::Multiply_Mat44_By_Mat44( const Matrix44& mat1, const Matrix44& mat2 )
+	{
+		Matrix44 ret;
 		ret.m00 = mat1.m00 * mat2.m00 + mat1.m01 * mat2.m10 + mat1.m02 * mat2.m20 + mat1.m03 * mat2.m30;
 		ret.m01 = mat1.m00 * mat2.m01 + mat1.m01 * mat2.m11 + mat1.m02 * mat2.m21 + mat1.m03 * mat2.m31;
 		ret.m02 = mat1.m00 * mat2.m02 + mat1.m01 * mat2.m12 + mat1.m02 * mat2.m22 + mat1.m03 * mat2.m32;
@@ -478,10 +435,73 @@ namespace Common
 		ret.m31 = mat1.m30 * mat2.m01 + mat1.m31 * mat2.m11 + mat1.m32 * mat2.m21 + mat1.m33 * mat2.m31;
 		ret.m32 = mat1.m30 * mat2.m02 + mat1.m31 * mat2.m12 + mat1.m32 * mat2.m22 + mat1.m33 * mat2.m32;
 		ret.m33 = mat1.m30 * mat2.m03 + mat1.m31 * mat2.m13 + mat1.m32 * mat2.m23 + mat1.m33 * mat2.m33;
-#endif
 		return std::move(ret);
 	}
 
+	//////////// SIMD, rows are loaded unaligned so any Matrix44 works, Matrix44A only saves the cache line splits
+	namespace SIMD
+	{
+		// Row vector v times the matrix given by its rows
+		__forceinline __m128 TransformRow(__m128 v, __m128 r0, __m128 r1, __m128 r2, __m128 r3)
+		{
+			__m128 vX = _mm_mul_ps(_mm_shuffle_ps(v,v,_MM_SHUFFLE(0,0,0,0)), r0);
+			__m128 vY = _mm_mul_ps(_mm_shuffle_ps(v,v,_MM_SHUFFLE(1,1,1,1)), r1);
+			__m128 vZ = _mm_mul_ps(_mm_shuffle_ps(v,v,_MM_SHUFFLE(2,2,2,2)), r2);
+			__m128 vW = _mm_mul_ps(_mm_shuffle_ps(v,v,_MM_SHUFFLE(3,3,3,3)), r3);
+			// Perform a binary add to reduce cumulative errors
+			return _mm_add_ps(_mm_add_ps(vX,vZ), _mm_add_ps(vY,vW));
+		}
+
+		// The rhs rows are loaded first, so out may be lhs or rhs
+		__forceinline void MultiplyTo(Matrix44& out, const Matrix44& lhs, const Matrix44& rhs)
+		{
+			const __m128 r0 = _mm_loadu_ps(rhs.m_arr[0]);
+			const __m128 r1 = _mm_loadu_ps(rhs.m_arr[1]);
+			const __m128 r2 = _mm_loadu_ps(rhs.m_arr[2]);
+			const __m128 r3 = _mm_loadu_ps(rhs.m_arr[3]);
+			const __m128 l0 = _mm_loadu_ps(lhs.m_arr[0]);
+			const __m128 l1 = _mm_loadu_ps(lhs.m_arr[1]);
+			const __m128 l2 = _mm_loadu_ps(lhs.m_arr[2]);
+			const __m128 l3 = _mm_loadu_ps(lhs.m_arr[3]);
+
+			_mm_storeu_ps(out.m_arr[0], TransformRow(l0, r0, r1, r2, r3));
+			_mm_storeu_ps(out.m_arr[1], TransformRow(l1, r0, r1, r2, r3));
+			_mm_storeu_ps(out.m_arr[2], TransformRow(l2, r0, r1, r2, r3));
+			_mm_storeu_ps(out.m_arr[3], TransformRow(l3, r0, r1, r2, r3));
+		}
+
+		__forceinline Vector4	Transform_Vec4_By_Mat44(const Vector4& pt, const Matrix44& mat)
+		{
+			Vector4 ret;
+			m128_to_vec4(ret, TransformRow(_mm_loadu_ps(&pt.x), _mm_loadu_ps(mat.m_arr[0]),
+				_mm_loadu_ps(mat.m_arr[1]), _mm_loadu_ps(mat.m_arr[2]), _mm_loadu_ps(mat.m_arr[3])));
+			return ret;
+		}
+
+		__forceinline Matrix44	Multiply_Mat44_By_Mat44(const Matrix44& mat1, const Matrix44& mat2)
+		{
+			Matrix44 ret;
+			MultiplyTo(ret, mat1, mat2);
+			return ret;
+		}
+
+		__forceinline Matrix44	Transpose(const Matrix44& mat)
+		{
+			__m128 r0 = _mm_loadu_ps(mat.m_arr[0]);
+			__m128 r1 = _mm_loadu_ps(mat.m_arr[1]);
+			__m128 r2 = _mm_loadu_ps(mat.m_arr[2]);
+			__m128 r3 = _mm_loadu_ps(mat.m_arr[3]);
+			_MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+
+			Matrix44 ret;
+			_mm_storeu_ps(ret.m_arr[0], r0);
+			_mm_storeu_ps(ret.m_arr[1], r1);
+			_mm_storeu_ps(ret.m_arr[2], r2);
+			_mm_storeu_ps(ret.m_arr[3], r3);
+			return ret;
+		}
+	}
+
 	__forceinline Matrix44 operator * (const Matrix44& lhs, const Matrix44& rhs)
 	{
 		return Multiply_Mat44_By_Mat44(lhs, rhs);
@@ -48,7 +48,6 @@ namespace Neo
 		bool		InitAdjIndexData(const DWORD* pIdx, int nIdx);
 		bool		InitBoneWeights(const SVertexBoneWeight* pVerts, int nVert);
 		bool		InitTangentData(const STangentData* pVerts, int nVert);
-		void		InitTerrainVertData(VertexBuffer* posVB, VertexBuffer* deltaVB, IndexBuffer* pIB, uint32 nIndexCount);
 		bool		BuildTangents();
 
 		void			SetName(const STRING& name) { m_name = name; }
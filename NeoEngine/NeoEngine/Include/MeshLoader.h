@@ -4,25 +4,126 @@
 	author:		maval
 
 	purpose:	Collada mesh loader
+				Besides the xml .mesh, meshes can be stored in a binary .meshb.
+				It keeps every stream as a raw 16-byte aligned array, so loading
+				only maps the file and hands the stream pointers to SubMesh.
 *********************************************************************/
 #ifndef ColladaLoader_h__
 #define ColladaLoader_h__
 
 #include "Prerequiestity.h"
+#include "VertexData.h"
 
 namespace Neo
 {
+	//------------------------------------------------------------------------------------
+	// Binary mesh layout: SMeshFileHeader, nSubMesh * SSubMeshFileHeader, then the streams.
+	// Stream offsets are from the file start, 0 if the stream doesn't exist.
+	enum
+	{
+		MESH_BINARY_MAGIC		=	0x48534D4E,	// "NMSH" in the file
+		MESH_BINARY_VERSION		=	1,
+		MESH_BINARY_ALIGN		=	16,
+		MESH_BINARY_NAME_LEN	=	64,
+		MESH_BINARY_PATH_LEN	=	128,
+	};
+
+	struct SMeshFileHeader
+	{
+		uint32		magic;
+		uint32		version;
+		uint32		fileSize;
+		uint32		nSubMesh;
+		uint32		primType;
+		uint32		vertexStride;		// sizeof(SVertex) when written, rejects files from a different layout
+		char		skeletonLink[MESH_BINARY_PATH_LEN];
+	};
+
+	struct SSubMeshFileHeader
+	{
+		char		name[MESH_BINARY_NAME_LEN];
+		uint32		vertType;
+		uint32		nVert;
+		uint32		nIndex;
+		uint32		nAdjIndex;
+		uint32		vertOffset;
+		uint32		indexOffset;
+		uint32		adjIndexOffset;
+		uint32		boneWeightOffset;
+		uint32		tangentOffset;
+	};
+	//------------------------------------------------------------------------------------
 	class MeshLoader
 	{
 	public:
+		// CPU side copy of a mesh. Filling it touches no render resource, so it may be done on any thread.
+		struct SSubMeshData
+		{
+			SSubMeshData() : vertType(eVertexType_General) {}
+
+			STRING							name;
+			eVertexType						vertType;
+			std::vector<SVertex>			vecVertex;
+			std::vector<DWORD>				vecIndex;
+			std::vector<DWORD>				vecAdjIndex;
+			std::vector<SVertexBoneWeight>	vecBoneWeights;
+			std::vector<STangentData>		vecTangents;
+		};
+
+		struct SMeshData
+		{
+			SMeshData() : primType(ePrimitive_TriangleList) {}
+
+			uint32							GetByteSize() const;
+
+			std::vector<SSubMeshData>		subMeshes;
+			ePrimitive						primType;
+			STRING							skeletonLink;
+		};
+
+	public:
+		// Prefer the converted binary file next to an xml .mesh if there is one.
 		static Mesh*	LoadMesh(const STRING& filename, bool bMaterial = false, SkeletonAnim** pSkelAnim = nullptr);
+		// Split version of LoadMesh(), LoadMeshData() may run on a worker, CreateMesh() must run on the render thread.
+		static bool		LoadMeshData(const STRING& filename, SMeshData& data);
+		static Mesh*	CreateMesh(const STRING& filename, const SMeshData& data);
+		static SkeletonAnim*	LoadSkeleton(const STRING& skelFilename);
 		static bool		SaveMesh(Mesh* pMesh, const STRING& filename);
+		static bool		SaveMeshBinary(Mesh* pMesh, const STRING& filename, const STRING& skeletonLink = "");
+		// Offline convert an xml .mesh into the binary form, doesn't need the renderer.
+		static bool		ConvertMesh(const STRING& xmlFilename, const STRING& binFilename);
+		// "xxx.mesh" -> "xxx.meshb"
+		static STRING	GetBinaryFilename(const STRING& filename);
 
 	private:
-		static bool		_LoadVertex_General(TiXmlElement* vertNode, int nVert, SubMesh* pSubMesh, bool bNormalMap, DWORD* pIndexData, uint32 nIndex);
-		static bool		_LoadVertex_BoneWeights(TiXmlElement* pNode, SubMesh* pSubMesh);
-		static SkeletonAnim*		_LoadSkeleton(TiXmlElement* pSkelNode);
+		// Streams of a submesh, either owned by the xml parser or pointing into a mapped file
+		struct SSubMeshStreams
+		{
+			SSubMeshStreams()
+			: vertType(eVertexType_General), pVerts(nullptr), nVert(0), pIndex(nullptr), nIndex(0)
+			, pAdjIndex(nullptr), nAdjIndex(0), pBoneWeights(nullptr), pTangents(nullptr) {}
+
+			STRING						name;
+			eVertexType					vertType;
+			const SVertex*				pVerts;
+			uint32						nVert;
+			const DWORD*				pIndex;
+			uint32						nIndex;
+			const DWORD*				pAdjIndex;
+			uint32						nAdjIndex;
+			const SVertexBoneWeight*	pBoneWeights;
+			const STangentData*			pTangents;
+		};
+
+		static Mesh*	_LoadMeshBinary(const STRING& filename, SkeletonAnim** pSkelAnim);
+		static bool		_ParseXml(const STRING& filename, bool bMaterial, SMeshData& data);
+		static void		_GetStreams(const SSubMeshData& subMesh, SSubMeshStreams& streams);
+		static void		_GetBinaryStreams(const char* pData, const SSubMeshFileHeader& sub, SSubMeshStreams& streams);
+		static void		_CreateSubMesh(Mesh* pMesh, const SSubMeshStreams& streams);
+		static bool		_WriteBinary(const STRING& filename, const std::vector<SSubMeshStreams>& vecStreams, ePrimitive primType, const STRING& skeletonLink);
+		static bool		_LoadVertex_General(TiXmlElement* vertNode, int nVert, SSubMeshData& subMesh);
+		static bool		_LoadVertex_BoneWeights(TiXmlElement* pNode, SSubMeshData& subMesh);
 	};
 }
 
-#endif // ColladaLoader_h__
\ No newline at end of file
+#endif // ColladaLoader_h__
@@ -5,34 +5,51 @@
 
 	purpose:	.obj .mtl .
 				ܳ,objʽ̫,ĸо
-				TODO:̨س
+				The whole file is read into memory and tokenized in one pass,
+				no state is shared between loads so they may run on several threads.
 *********************************************************************/
 
 #ifndef ObjMeshLoader_h__
 #define ObjMeshLoader_h__
 
 #include "Prerequiestity.h"
+#include "MeshLoader.h"
 
 namespace Neo
 {
 	class ObjMeshLoader
 	{
 	public:
-		struct SVertCompare 
+		static Mesh*	LoadMesh(const STRING& filename, bool bFlipYZ, bool bNormalMap);
+		// CPU part of LoadMesh(), safe on any thread. Build the mesh with MeshLoader::CreateMesh().
+		static bool		LoadMeshData(const STRING& filename, bool bFlipYZ, MeshLoader::SMeshData& data);
+		static bool		LoadMtlFile(const STRING& filename);
+		// Parse the file nIteration times without creating any gpu resource, returns the throughput in MB/s.
+		static double	Benchmark(const STRING& filename, uint32 nIteration = 10);
+
+	private:
+		// Position/uv/normal indices of a face corner, -1 if absent
+		struct SVertKey
 		{
-			bool operator== (const SVertCompare& rhs) { return memcmp(this, &rhs, sizeof(SVertCompare)) == 0; }
+			bool operator== (const SVertKey& rhs) const { return idxPos == rhs.idxPos && idxUv == rhs.idxUv && idxNormal == rhs.idxNormal; }
 
 			int idxPos, idxUv, idxNormal;
 		};
 
-		static Mesh*	LoadMesh(const STRING& filename, bool bFlipYZ, bool bNormalMap);
-		static bool		LoadMtlFile(const STRING& filename);
+		struct SVertKeyHash
+		{
+			size_t operator() (const SVertKey& key) const
+			{
+				return (size_t)key.idxPos * 73856093u ^ (size_t)key.idxUv * 19349663u ^ (size_t)key.idxNormal * 83492791u;
+			}
+		};
 
-	private:
-		static void	_PreReadObject(std::ifstream& file, DWORD& nVert, DWORD& nUv, DWORD& nNormal, DWORD& nFace);
-		static bool	_DefineVertex(const SVertCompare& comp, DWORD& retIdx);
+		typedef std::unordered_map<SVertKey, DWORD, SVertKeyHash>	VertKeyMap;
 
-		static std::vector<SVertCompare>	m_vecComp;
+		static bool		_ReadFile(const STRING& filename, std::vector<char>& buffer);
+		static void		_ParseObj(const char* pBegin, const char* pEnd, bool bFlipYZ, MeshLoader::SMeshData& data);
+		static DWORD	_DefineVertex(const SVertKey& key, const std::vector<VEC3>& vecPos, const std::vector<VEC2>& vecUv,
+			const std::vector<VEC3>& vecNormal, VertKeyMap& mapVert, MeshLoader::SSubMeshData& subMesh);
 	};
 }
 
@@ -4,6 +4,14 @@
 	author:		maval
 
 	purpose:	A simple loose octree implementation.
+				Nodes live in one contiguous array, children of a node are
+				allocated as a block of 8 and selected by a child mask.
+				Objects are flattened in depth-first order into SoA bounds,
+				so every node (and every subtree) owns a contiguous range.
+				An object lives in the deepest node whose loose bound fully
+				contains it, and is relocated when its transform changes.
+				Several views (camera, shadow cascades) are culled in one
+				traversal, giving each object a bitmask of views it's in.
 *********************************************************************/
 #ifndef Octree_h__
 #define Octree_h__
@@ -14,21 +22,38 @@
 namespace Neo
 {
 	//------------------------------------------------------------------------------------
-	class OctreeNode
+	struct SOctreeNode
 	{
-	public:
-		OctreeNode();
-		~OctreeNode();
-
-		void			WalkOctree();
-		void			Insert(Entity* pObj, uint32 nDepth);
-		void			GetNodeIndex(const AABB& aabb, uint32& x, uint32& y, uint32& z);
-
-		OctreeNode*		m_pChildren[2][2][2];
-		EntityList		m_pObjs;
-		AABB			m_aabb;
-		AABB			m_aabbCullBound;
-		int				m_iDepth;
+		VEC3			vCenter;		// Center of the cell
+		VEC3			vLooseHalfSize;	// Half size of the loose bound, twice the cell
+		uint32			nParent;
+		uint32			nFirstChild;	// First node of the 8-children block, 0 if none
+		uint32			nObjStart;		// Objects owned by this node: [nObjStart, nObjEnd)
+		uint32			nObjEnd;
+		uint32			nSubtreeEnd;	// Objects of the whole subtree: [nObjStart, nSubtreeEnd)
+		uint8			childMask;		// Bit (x<<2 | y<<1 | z) set if that child is in use
+		uint8			depth;
+	};
+	//------------------------------------------------------------------------------------
+	// Views culled together in one traversal of the octree.
+	enum eCullView
+	{
+		eCullView_Camera,
+		eCullView_Cascade0,		// Followed by the other PSSM cascades
+		eCullView_Max = eCullView_Cascade0 + CSM_CASCADE_NUM
+	};
+	//------------------------------------------------------------------------------------
+	// A convex volume, the positive side of every plane is inside.
+	struct SCullVolume
+	{
+		enum { MAX_PLANES = 9 };	// A swept box has 3 faces and 6 silhouette edges at most
+
+		void			SetFrustum(const Camera& cam);
+		// The box extruded against vSweepDir, contains every obj that hits the box when moving along vSweepDir.
+		void			SetSweptBox(const AABB& box, const VEC3& vSweepDir);
+
+		PLANE			planes[MAX_PLANES];
+		uint32			nPlanes;
 	};
 	//------------------------------------------------------------------------------------
 	class Octree
@@ -39,16 +64,91 @@ namespace Neo
 
 	public:
 		void			Insert(Entity* pObj);
-		// Find any visible objs in the octree.
+		void			Remove(Entity* pObj);
+		// Relocate the obj after its world AABB changed.
+		void			Update(Entity* pObj);
+		// While deferred, relocations are only flagged on the obj and applied
+		// later by Entity::FlushOctreeUpdate(), so bounds can be updated in parallel.
+		void			SetDeferUpdates(bool b) { m_bDeferUpdates = b; }
+		bool			IsDeferringUpdates() const { return m_bDeferUpdates; }
+		// Cull all views in one traversal, bit i of GetViewMask() is set if the obj is in views[i].
+		// The result of views[0] is also written to Entity::SetVisible().
+		void			Cull(const SCullVolume* views, uint32 nViews);
+		// Find any visible objs of the camera in the octree.
 		void			Update();
 
-		OctreeNode*		m_pRootNode;
-		uint32			m_nTotalObjs;
-		uint32			m_nCulledObjs;
-		uint32			m_nCulledNodes[OCTREE_MAX_DEPTH];
-		uint32			m_nFrustumCullNum;
+		// Objs in traversal order, with the view masks of the last Cull()
+		uint32			GetObjCount() const { return m_objs.size(); }
+		Entity*			GetObj(uint32 i) const { return m_objs[i]; }
+		uint32			GetViewMask(uint32 i) const { return m_objViewMasks[i]; }
+
+		struct SViewStat
+		{
+			uint32		nVisibleObjs;
+			uint32		nCulledNodes;
+			uint32		nObjTests;		// Objs tested one by one, the others were decided by their node
+		};
+
+		uint32			GetTotalObjCount() const { return m_nTotalObjs; }
+		// Stats of views[iView] in the last Cull()
+		const SViewStat&	GetViewStat(uint32 iView) const { return m_viewStats[iView]; }
+
+	private:
+		// Frustum plane prepared for box tests
+		struct SCullPlane
+		{
+			PLANE		plane;
+			VEC3		vAbsNormal;
+		};
+
+		struct SCullView
+		{
+			SCullPlane	planes[SCullVolume::MAX_PLANES];
+			uint32		nPlanes;
+		};
+
+		uint32			_FindNode(const AABB& aabb);
+		void			_AttachToNode(uint32 iNode, Entity* pObj);
+		void			_DetachFromNode(uint32 iNode, uint32 iSlot);
+		void			_ReleaseIfEmpty(uint32 iNode);
+		VEC3			_GetChildCenter(uint32 iNode, uint32 iChild) const;
+		uint32			_AllocChildren(uint32 iNode);
+		void			_Flatten();
+		void			_FlattenNode(uint32 iNode);
+		// Refresh the world bounds of the flattened objects into m_objBounds, relocating the ones that moved.
+		void			_UpdateBounds();
+		void			_WalkOctree(const SCullView* views, uint32 nViews);
+		void			_CullObjects(uint32 nStart, uint32 nEnd, const SCullView& view, uint32 planeMask, uint32 iView);
+
+		std::vector<SOctreeNode>	m_nodes;		// m_nodes[0] is the root
+		std::vector<EntityList>		m_nodeObjs;		// Membership of each node, parallel to m_nodes
+		std::vector<uint32>			m_freeBlocks;	// Released 8-children blocks, reused before growing m_nodes
+		EntityList					m_objs;			// Flattened objects, parallel to m_objBounds
+		Common::AABBArray			m_objBounds;	// World bounds of flattened objects
+		std::vector<uint32>			m_objViewMasks;	// Views each flattened object is in
+		bool						m_bDirty;		// Membership changed, need to flatten again
+		bool						m_bDeferUpdates;
+		uint32						m_nTotalObjs;
+		SViewStat					m_viewStats[eCullView_Max];
 	};
+#if USE_BENCHMARK
+	//------------------------------------------------------------------------------------
+	struct SOctreeBenchResult
+	{
+		const char*	name;
+		uint32		nViews;
+		double		fOldMs;			// Recursive walk of the pointer based octree, once per view
+		double		fNewMs;			// Octree::Cull(), all views in one traversal
+		uint32		nVisibleObjs;	// Objs in any of the views
+		uint32		nMismatches;	// Objs the two disagree on
+	};
+
+	// Cull nObjs random boxes nIteration times with the old recursive walker and with Octree::Cull(),
+	// for the camera alone and for the camera with the shadow cascades. Needs no device.
+	// Returns false if the two walkers disagree on any obj.
+	bool		RunOctreeBenchmark(std::vector<SOctreeBenchResult>& results, uint32 nObjs = 20000, uint32 nIteration = 100);
+#endif
 
 }
 
-#endif // Octree_h__
\ No newline at end of file
+#endif // Octree_h__
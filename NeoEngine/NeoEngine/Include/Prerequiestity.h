@@ -12,10 +12,12 @@
 
 
 #define		USE_OPENGL				0			// Desktop OpenGL
-#define		USE_SIMD				0			// SIMD
+#define		USE_SIMD				1			// SIMD
 #define		USE_LISPPSM				0			// Light space perspective shadow mapping
 #define		USE_PSSM				1			// Parallel-Split Shadow Maps
 #define		USE_ESM					1			// Exponential Shadow Maps
+#define		USE_MULTITHREAD			1			// Run jobs on worker threads, 0 for deterministic single thread
+#define		USE_BENCHMARK			0			// Build the benchmarks and self tests run by "Game -bench"
 #define		BIG_ENDIAN				0			// MacOS is big endian
 
 
@@ -25,7 +27,9 @@ namespace Common
 	class Vector2;
 	class Vector3;
 	class Vector4;
+	class Vector4A;
 	class Matrix44;
+	class Matrix44A;
 	class Plane;
 	class AxisAlignBBox;
 	class iPoint;
@@ -52,6 +56,8 @@ namespace Neo
 	class	TerrainGlobalOptions;
 	class	TerrainGroup;
 	class	TerrainLodManager;
+	class	TerrainPaging;
+	class	TerrainRenderQueue;
 	class	TerrainLayerBlendMap;
 	class	Water;
 	class	Sky;
@@ -96,10 +102,14 @@ namespace Neo
 	class	SamplerState;
 	class	VertexBuffer;
 	class	IndexBuffer;
+	class	ShaderResourceBuffer;
 	class	GLRenderTarget;
 	class	GLVertexBuffer;
 	class	Octree;
 	class	Decal;
+	class	JobSystem;
+	class	JobGraph;
+	class	StreamSerialiser;
 }
 
 
@@ -113,6 +123,8 @@ typedef Common::Vector2			VEC2;
 typedef Common::Vector3			VEC3;
 typedef Common::Vector4			VEC4;
 typedef Common::Matrix44		MAT44;
+typedef Common::Vector4A		VEC4A;
+typedef Common::Matrix44A		MAT44A;
 typedef Common::AxisAlignBBox	AABB;
 typedef Common::Plane			PLANE;
 typedef Common::iPoint			IPOINT;
@@ -25,8 +25,12 @@ namespace Neo
 		virtual void*	Lock() = 0;
 		virtual void	Unlock() = 0;
 		virtual	void	UpdateBuf(void* pSrc) = 0;
+		/// Write nSize bytes at nOffset, the rest of the buffer is kept. Not for dynamic buffers
+		virtual	void	UpdateBufRange(const void* pSrc, uint32 nOffset, uint32 nSize) = 0;
 		virtual void*	GetInternel() = 0;
 		virtual uint32	GetStride() const = 0;
+		/// Size of the whole buffer in bytes
+		virtual uint32	GetSize() const = 0;
 	};
 	//------------------------------------------------------------------------------------
 	class ConstantBuffer
@@ -47,6 +51,41 @@ namespace Neo
 		Buffer*		m_pBuf;
 	};
 	//------------------------------------------------------------------------------------
+	// Structured buffer shaders read through a resource slot, e.g. StructuredBuffer<float4x4> in hlsl.
+	class ShaderResourceBuffer
+	{
+	public:
+		ShaderResourceBuffer(Buffer* pBuf, uint32 nElements) :m_pBuf(pBuf), m_nElements(nElements) {}
+		virtual ~ShaderResourceBuffer() { m_pBuf->Release(); }
+
+	public:
+		// A dynamic buffer is discarded by Lock(), write all of it before Unlock()
+		void*			Lock()
+		{
+			return m_pBuf->Lock();
+		}
+
+		void			Unlock()
+		{
+			m_pBuf->Unlock();
+		}
+
+		/// Write nElements elements starting at element iFirst, the others are kept
+		void			UpdateElements(const void* pSrc, uint32 iFirst, uint32 nElements)
+		{
+			m_pBuf->UpdateBufRange(pSrc, iFirst * m_pBuf->GetStride(), nElements * m_pBuf->GetStride());
+		}
+
+		uint32			GetElementCount() const { return m_nElements; }
+		uint32			GetStride() const { return m_pBuf->GetStride(); }
+
+		virtual	void	Apply(uint32 nSlot, bool bVS = false, bool bPS = false, bool bGS = false, bool bCS = false, bool bTessellate = false) = 0;
+
+	protected:
+		Buffer*		m_pBuf;
+		uint32		m_nElements;
+	};
+	//------------------------------------------------------------------------------------
 	class IndexBuffer
 	{
 	public:
@@ -100,6 +139,11 @@ namespace Neo
 			return m_pBuf->GetStride();
 		}
 
+		uint32			GetSize() const
+		{
+			return m_pBuf->GetSize();
+		}
+
 		Buffer*			m_pBuf;
 		eVertexType		m_vertType;
 
@@ -25,10 +25,13 @@ namespace Neo
 		virtual void*	Lock();
 		virtual void	Unlock();
 		virtual	void	UpdateBuf(void* pSrc);
+		virtual	void	UpdateBufRange(const void* pSrc, uint32 nOffset, uint32 nSize);
 		virtual void*	GetInternel();
 		virtual uint32	GetStride() const { return m_nStride; }
+		virtual uint32	GetSize() const { return m_size; }
 
 		ID3D11Buffer*	m_pBuf;
+		ID3D11ShaderResourceView*	m_pSRV;		// Structured buffers only
 		uint32			m_nStride;
 		uint32			m_usage;
 		uint32			m_size;
@@ -41,6 +44,16 @@ namespace Neo
 		D3D11ConstantBuffer(D3D11Buffer* pBuf);
 		~D3D11ConstantBuffer() {}
 
+	public:
+		virtual	void	Apply(uint32 nSlot, bool bVS = false, bool bPS = false, bool bGS = false, bool bCS = false, bool bTessellate = false);
+	};
+	//------------------------------------------------------------------------------------
+	class D3D11ShaderResourceBuffer : public ShaderResourceBuffer
+	{
+	public:
+		D3D11ShaderResourceBuffer(D3D11Buffer* pBuf, uint32 nElements);
+		~D3D11ShaderResourceBuffer() {}
+
 	public:
 		virtual	void	Apply(uint32 nSlot, bool bVS = false, bool bPS = false, bool bGS = false, bool bCS = false, bool bTessellate = false);
 	};
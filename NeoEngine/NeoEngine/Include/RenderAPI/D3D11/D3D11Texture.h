@@ -21,6 +21,8 @@ namespace Neo
 	public:
 		// Load from file
 		D3D11Texture(const STRING& filename, eTextureType type = eTextureType_2D, uint32 usage = 0, bool bSRGB = false);
+		// Load from a file already read into memory, filename only tells the format
+		D3D11Texture(const STRING& filename, const void* pData, uint32 nSize, eTextureType type, uint32 usage, bool bSRGB);
 		// Create as manual
 		D3D11Texture(uint32 width, uint32 height, const char* pTexData, ePixelFormat format, uint32 usage, bool bMipMap);
 		// Create from exist resource views
@@ -59,6 +61,7 @@ namespace Neo
 
 	private:
 		void				_CreateManual(const char* pTexData);
+		void				_Load(const STRING& filename, const void* pData, uint32 nSize, uint32 usage, bool bSRGB);
 
 	private:
 		ID3D11Texture2D*			m_pTexture2D;
@@ -175,6 +175,11 @@ public:
 		GLCHECK(glDrawElementsInstanced(Mode, Count, Type, Indices, InstanceCount));
 	}
 
+	static FORCEINLINE void DrawElementsInstancedBaseInstance(GLenum Mode, GLsizei Count, GLenum Type, const GLvoid* Indices, GLsizei InstanceCount, GLuint BaseInstance)
+	{
+		GLCHECK(glDrawElementsInstancedBaseInstance(Mode, Count, Type, Indices, InstanceCount, BaseInstance));
+	}
+
 	static FORCEINLINE void DrawRangeElements(GLenum Mode, GLuint Start, GLuint End, GLsizei Count, GLenum Type, const GLvoid* Indices)
 	{
 		GLCHECK(glDrawRangeElements(Mode, Start, End, Count, Type, Indices));
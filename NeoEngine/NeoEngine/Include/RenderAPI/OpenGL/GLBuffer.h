@@ -25,8 +25,10 @@ namespace Neo
 		virtual void*	Lock();
 		virtual void	Unlock();
 		virtual	void	UpdateBuf(void* pSrc);
+		virtual	void	UpdateBufRange(const void* pSrc, uint32 nOffset, uint32 nSize);
 		virtual void*	GetInternel() { return (void*)m_id; }
 		virtual uint32	GetStride() const { return m_nStride; }
+		virtual uint32	GetSize() const { return m_nSize; }
 
 		GLuint			m_id;
 		GLenum			m_target;
@@ -45,6 +47,18 @@ namespace Neo
 		virtual	void	Apply(uint32 nSlot, bool bVS = false, bool bPS = false, bool bGS = false, bool bCS = false, bool bTessellate = false) {}
 	};
 	//------------------------------------------------------------------------------------
+	// Shader storage buffer, nSlot is the binding of the buffer block in glsl.
+	class GLShaderResourceBuffer : public ShaderResourceBuffer
+	{
+	public:
+		GLShaderResourceBuffer(GLBuffer* pBuf, uint32 nElements) :ShaderResourceBuffer(pBuf, nElements) {}
+		~GLShaderResourceBuffer() {}
+
+	public:
+		// Bindings are shared by all stages in GL
+		virtual	void	Apply(uint32 nSlot, bool bVS = false, bool bPS = false, bool bGS = false, bool bCS = false, bool bTessellate = false);
+	};
+	//------------------------------------------------------------------------------------
 	class GLIndexBuffer : public IndexBuffer
 	{
 	public:
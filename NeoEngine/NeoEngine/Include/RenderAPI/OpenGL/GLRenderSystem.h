@@ -48,15 +48,17 @@ namespace Neo
 		virtual void			SetSamplerState(uint32 iStage, SamplerState* pSampler, bool bVS = false, bool bGS = false, bool bTessellation = false);
 		virtual Shader*			CreateShader(eShaderType type, eRenderPhase phase, const STRING& filename, uint32 flags, const STRING& strEntryFunc, eVertexType vertType, const std::vector<D3D_SHADER_MACRO>& vecMacros);
 		virtual Texture*		LoadTexture(const STRING& filename, eTextureType type = eTextureType_2D, uint32 usage = 0, bool bSRGB = false);
+		virtual Texture*		LoadTextureFromMemory(const STRING& filename, const void* pData, uint32 nSize, eTextureType type = eTextureType_2D, uint32 usage = 0, bool bSRGB = false);
 		virtual RenderTarget*	CreateRenderTarget(uint32 nWidth, uint32 nHeight, uint32 nDepth, ePixelFormat format, uint32 usage);
 		virtual Texture*		GetDepthBuffer();
 		virtual Texture*		CreateTextureArray(const StringVector& vecTexNames, bool bSRGB = false);
 		virtual Texture*		CreateTextureManual(uint32 nWidth, uint32 nHeight, const char* pTexData, ePixelFormat format, uint32 usage, bool bMipMap);
-		virtual void			DrawIndexed(ePrimitive type, IndexBuffer* indexBuf, uint32 nIndexCnt, uint32 nStartIndexLocation, uint32 nBaseIndexLocation, uint32 nInstanced = 0);
+		virtual void			DrawIndexed(ePrimitive type, IndexBuffer* indexBuf, uint32 nIndexCnt, uint32 nStartIndexLocation, uint32 nBaseIndexLocation, uint32 nInstanced = 0, uint32 nStartInstance = 0);
 		virtual void			Draw(uint32 nVertCnt, uint32 nStartVertLocation);
 		virtual void			SetVertexBuffer(VertexBuffer* vertBuf, uint32 iStream, uint32 nOffset);
 		virtual VertexBuffer*	CreateVertexBuffer(uint32 nSize, uint32 nStride, const void* pData, uint32 nUsage);
 		virtual IndexBuffer*	CreateIndexBuffer(uint32 nSize, const void* pData, uint32 nUsage);
+		virtual ShaderResourceBuffer*	CreateShaderResourceBuffer(uint32 nElements, uint32 nStride, uint32 nUsage);
 
 	private:
 		void					_LoadShaderXml(const STRING& strShader);
@@ -13,6 +13,11 @@
 #include "Texture.h"
 #include "RenderState.h"
 
+namespace DirectX
+{
+	struct DDS_HEADER;
+}
+
 namespace Neo
 {
 	//------------------------------------------------------------------------------------
@@ -21,6 +26,8 @@ namespace Neo
 	public:
 		// Load from file
 		GLTexture(const STRING& filename, eTextureType type, uint32 usage, bool bSRGB);
+		// Load from a file already read into memory
+		GLTexture(const STRING& filename, const void* pData, uint32 nSize, eTextureType type, uint32 usage, bool bSRGB);
 		// Create as manual
 		GLTexture(uint32 width, uint32 height, const void* pTexData, ePixelFormat format, uint32 usage, bool bMipMap);
 		// Create as texture array
@@ -41,6 +48,7 @@ namespace Neo
 
 	private:
 		void				_Init(uint32 width, uint32 height, const void* pTexData, ePixelFormat format, uint32 usage, uint32 nMips);
+		void				_InitFromDDS(const DirectX::DDS_HEADER* header, const void* bitData, eTextureType type, uint32 usage, bool bSRGB);
 
 		GLuint				m_id;
 		bool				m_bsRGB;
@@ -76,6 +76,7 @@ namespace Neo
 		eVertexType_SkinModel,
 		eVertexType_Terrain,
 		eVertexType_Instanced,
+		eVertexType_TerrainCompact,
 	};
 
 	// Use for render target to control which part to render
@@ -172,6 +173,7 @@ namespace Neo
 		eBufferUsage_Dynamic		=	1 << 1,
 		eBufferUsage_VertexBuf		=	1 << 2,
 		eBufferUsage_IndexBuf		=	1 << 3,
+		eBufferUsage_StructuredBuf	=	1 << 4,		// Array of structures read by shaders
 	};
 
 	enum ePrimitive
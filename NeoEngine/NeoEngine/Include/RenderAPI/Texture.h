@@ -42,6 +42,8 @@ namespace Neo
 		uint32				GetHeight() const { return m_height; }
 		uint32				GetUsage() const { return m_usage; }
 		ePixelFormat		GetFormat() const { return m_texFormat; }
+		// Estimated video memory of the texture, including the mip chain
+		uint32				GetResidentBytes() const;
 
 	protected:
 		eTextureType		m_texType;
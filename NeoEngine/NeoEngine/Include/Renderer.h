@@ -59,11 +59,13 @@ namespace Neo
 		VEC4	specularGloss;
 		VEC4	anisotropicParam;					// x=anisotropic  range. [0.316, 3.16]
 	};
-	// Skined matrixs constant buffer: (b2)
+	// Skined model constant buffer: (b2)
+	// The matrices of all models are in one structured buffer per frame: (t12)
 	__declspec(align(16))
 	struct cBufferSkin
 	{
-		MAT44	matSkin[100];
+		uint32	paletteOffset;						// First matrix of the drawn model
+		uint32	padding[3];
 	};
 
 	//------------------------------------------------------------------------------------
@@ -108,8 +110,14 @@ namespace Neo
 		// Update constant buffer to device
 		void						UpdateGlobalCBuffer(bool bTessellate = false, bool bCS = false, bool bGS = false);
 		void						UpdateMaterialCBuffer(bool bTessellate = false, bool bCS = false, bool bGS = false);
+		// Also binds the frame skin palette
 		void						UpdateSkinCBuffer();
 
+		// Map the frame skin palette for nMatrices, each model writes its own range then EndSkinPalettes().
+		// Main thread only, the mapped memory may be filled from jobs.
+		MAT44*						BeginSkinPalettes(uint32 nMatrices);
+		void						EndSkinPalettes();
+
 	private:
 		RenderSystem*				m_pRenderSys;
 		uint32						m_wndWidth, m_wndHeight;
@@ -122,6 +130,7 @@ namespace Neo
 		ConstantBuffer*				m_pGlobalCBuf;
 		ConstantBuffer*				m_pMaterialCB;
 		ConstantBuffer*				m_pSkinCB;
+		ShaderResourceBuffer*		m_pSkinPalette;
 
 		std::vector<SStateBlend>	m_blendStates;
 		std::vector<SStateDepth>	m_depthStates;
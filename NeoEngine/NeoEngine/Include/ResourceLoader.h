@@ -0,0 +1,113 @@
+/********************************************************************
+	created:	2016/11/02 14:30
+	filename	ResourceLoader.h
+	author:		maval
+
+	purpose:	Background loading of meshes and textures.
+				Loader threads read and parse files into CPU side staging data,
+				the main thread then creates the render resources of staged
+				requests in Update(), limited by a per-frame byte budget.
+				Loading is mostly waiting on the disk, so it owns its threads
+				instead of blocking the workers of JobSystem.
+*********************************************************************/
+#ifndef ResourceLoader_h__
+#define ResourceLoader_h__
+
+#include "Prerequiestity.h"
+#include "Singleton.h"
+#include "MeshLoader.h"
+#include "RenderDefine.h"
+
+namespace Neo
+{
+	enum eResourceType
+	{
+		eResourceType_Mesh,
+		eResourceType_Texture
+	};
+
+	enum eResourceState
+	{
+		eResourceState_Pending,		// Waiting for or being loaded by a loader thread
+		eResourceState_Staged,		// CPU data ready, waiting for the upload
+		eResourceState_Ready,
+		eResourceState_Failed
+	};
+	//------------------------------------------------------------------------------------
+	struct SResourceRequest
+	{
+		SResourceRequest(eResourceType _type, const STRING& _filename)
+		: type(_type), filename(_filename), texType(eTextureType_2D), texUsage(0), bSRGB(false)
+		, state(eResourceState_Pending), nStagedBytes(0), pMesh(nullptr), pSkeleton(nullptr), pTexture(nullptr) {}
+
+		eResourceType			type;
+		STRING					filename;
+		eTextureType			texType;
+		uint32					texUsage;
+		bool					bSRGB;
+		std::atomic<int>		state;			// eResourceState
+
+		// Staging data, released after the upload
+		MeshLoader::SMeshData	meshData;
+		std::vector<char>		fileData;		// Whole texture file
+		uint32					nStagedBytes;
+
+		// Results, valid once ready. The caller takes one by nulling it here, the loader
+		// releases those nobody took once the request has no other handle, or at Shutdown().
+		Mesh*					pMesh;
+		SkeletonAnim*			pSkeleton;		// Loaded along with the mesh if it links one
+		Texture*				pTexture;		// Shared through TextureManager, the caller owns one reference
+	};
+
+	typedef std::shared_ptr<SResourceRequest>	ResourceHandle;
+	//------------------------------------------------------------------------------------
+	class ResourceLoader : public Common::CSingleton<ResourceLoader>
+	{
+	public:
+		ResourceLoader();
+		~ResourceLoader();
+
+		DECLEAR_SINGLETON(ResourceLoader)
+
+	public:
+		// Without any loader thread requests are staged right away on the calling thread.
+		void			Init(uint32 nThreads = 1);
+		void			Shutdown();
+
+		// .obj goes through ObjMeshLoader, the others through MeshLoader.
+		ResourceHandle	LoadMeshAsync(const STRING& filename);
+		// Main thread only. A texture TextureManager holds already is ready right away,
+		// otherwise its entry is reserved and filled by the upload. The handle may be dropped,
+		// the texture then just stays in the TextureManager cache.
+		ResourceHandle	LoadTextureAsync(const STRING& filename, eTextureType type = eTextureType_2D, uint32 usage = 0, bool bSRGB = false);
+
+		// Main thread only. Upload staged requests in order until nBudgetBytes of staging data
+		// have been uploaded, at least one request goes each call so a big one can't starve.
+		void			Update(uint32 nBudgetBytes);
+		// Main thread only. Returns when the request is ready or failed, loads it on the
+		// calling thread if no loader thread picked it up yet. Returns false if it failed.
+		bool			Wait(const ResourceHandle& handle);
+		bool			IsReady(const ResourceHandle& handle) const { return handle->state == eResourceState_Ready; }
+		bool			IsFailed(const ResourceHandle& handle) const { return handle->state == eResourceState_Failed; }
+
+	private:
+		ResourceHandle	_Submit(const ResourceHandle& handle);
+		void			_LoaderMain();
+		void			_Stage(const ResourceHandle& handle);
+		void			_Upload(const ResourceHandle& handle);
+		// Fail a request which won't be loaded
+		void			_Cancel(SResourceRequest* pRequest);
+		// Release the results the caller didn't take
+		void			_ReleaseResults(SResourceRequest* pRequest);
+
+		std::vector<std::thread>	m_threads;
+		std::mutex					m_lock;			// Guards m_requests and m_staged
+		std::condition_variable		m_wakeUp;
+		std::deque<ResourceHandle>	m_requests;		// Not picked by a loader thread yet
+		std::deque<ResourceHandle>	m_staged;		// Waiting for the upload, in staging order
+		std::vector<ResourceHandle>	m_uploaded;		// Ready with results not taken yet, main thread only
+		bool						m_bQuit;
+	};
+}
+
+#endif // ResourceLoader_h__
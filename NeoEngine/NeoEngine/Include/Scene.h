@@ -11,6 +11,7 @@
 #include "Prerequiestity.h"
 #include "AABB.h"
 #include "RenderDefine.h"
+#include "SkinModel.h"
 
 namespace Neo
 {
@@ -24,6 +25,9 @@ namespace Neo
 		~Scene();
 
 	public:
+		// Kick off background loads of what the setup func needs, called before Enter().
+		void	SetPreloadFunc(const StrategyFunc& func) { m_preloadFunc = func; }
+		void	Preload();
 		void	Enter();
 		void	Update(float fDeltaTime);
 		void	RenderOpaque();
@@ -31,6 +35,12 @@ namespace Neo
 		void	RenderEntityList(const EntityList& ents);
 
 		void				AddEntity(Entity* pEntity);
+		// Skinned models must come here instead of AddEntity() to be animated
+		void				AddSkinModel(SkinModel* pModel);
+		// Main thread only, after Update()
+		void				UploadSkinPalettes();
+		// Animation work of the last Update()
+		const SAnimUpdateStats&	GetAnimStats() const { return m_animStats; }
 		void				AddInstancedEntity(const STRING& category, Entity* pEntity);
 		EntityList&			GetEntityList() { return m_lstEntity; }
 
@@ -41,8 +51,12 @@ namespace Neo
 	private:
 		StrategyFunc		m_setupFunc;
 		StrategyFunc		m_enterFunc;
+		StrategyFunc		m_preloadFunc;
 		bool				m_bSetup;
+		bool				m_bPreloaded;
 		EntityList			m_lstEntity;
+		std::vector<SkinModel*>	m_lstSkinModel;		// Also in m_lstEntity
+		SAnimUpdateStats	m_animStats;
 		AABB				m_sceneAABB;		// AABB of the whole scene
 		AABB				m_sceneShadowCasterAABB;	// AABB of all shadow casters
 		AABB				m_sceneShadowReceiverAABB;	// AABB of all shadow receivers
@@ -11,6 +11,7 @@
 #include "Prerequiestity.h"
 #include "Light.h"
 #include "RenderDefine.h"
+#include "ResourceLoader.h"
 
 namespace Neo
 {
@@ -34,6 +35,11 @@ namespace Neo
 		Octree*		GetOctree() { return m_pOctree; }
 
 		Mesh*		LoadMeshFromFile(const STRING& meshname, const STRING& filename);
+		// Start loading the mesh in background, CreateEntity() with the same name picks it up.
+		void		PreloadMesh(const STRING& meshname);
+		// Start loading the texture in background into the TextureManager cache, where LoadTexture() finds it.
+		void		PreloadTexture(const STRING& filename, eTextureType type = eTextureType_2D, uint32 usage = 0, bool bSRGB = false);
+		bool		IsMeshLoaded(const STRING& meshname) const;
 		void		EnableDebugRT(eDebugRT type);
 		void		SetShadowDepthBias(float fBias);
 		float		GetShadowDepthBias() const;
@@ -121,8 +127,10 @@ namespace Neo
 		MeshLoader*		m_pMeshLoader;
 		typedef std::unordered_map<STRING, Mesh*>			MeshContainer;
 		typedef std::unordered_map<Mesh*, SkeletonAnim*>	SkeletonContainer;
+		typedef std::unordered_map<STRING, ResourceHandle>	PendingMeshContainer;
 		MeshContainer	m_meshes;
 		SkeletonContainer m_skeletons;
+		PendingMeshContainer m_pendingMeshes;	// Requested by PreloadMesh(), not created yet
 		
 		eDebugRT		m_debugRT;
 		Mesh*			m_pDebugRTMesh;
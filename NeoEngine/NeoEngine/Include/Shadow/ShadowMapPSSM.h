@@ -21,6 +21,9 @@
 #include "Prerequiestity.h"
 #include "MathDef.h"
 #include "RenderDefine.h"
+#include "AABB.h"
+#include "Camera.h"
+#include "Octree.h"
 
 namespace Neo
 {
@@ -33,6 +36,12 @@ namespace Neo
 	public:
 		void				SetShadowMapSize(uint32 nSize);
 		void				Update(Camera& cam);
+		// Update() split up so the cascades can run as separate jobs.
+		// PrepareCascades() and FindCasters() must be done first, then cascades are independent of each other.
+		void				PrepareCascades(Camera& cam);
+		// Cull the camera and the caster volumes of all cascades in one octree traversal.
+		void				FindCasters(Camera& cam);
+		void				UpdateCascade(int iCascade);
 		void				Render();
 		Texture*			GetShadowTexture(int i);
 		const MAT44&		GetShadowTransform(int i) { return m_matShadowTransform[i]; }
@@ -44,17 +53,16 @@ namespace Neo
 		void				_AdjustCameraNearFar(Camera& cam);
 		void				_CalculateSplitPositions(Camera& cam, float* pDists);
 		AABB				_CalculateSplitFrustumAABB(Camera& cam, float fNear, float fFar, VEC3* oFrusumPoints = nullptr);
-		std::vector<Entity*>_FindCasters(Camera& cam, const AABB& frustumAABB, const VEC3& vSweepDir);
-
-		// A testing version which find shadow casters only based on split view frustum.
-		std::vector<Entity*>_FindCasters2(Camera& cam, float fNear, float fFar);
-
-		bool				_IsAabbInsideFrustum(Camera& cam, float fNear, float fFar, const AABB& aabb);
 		MAT44				_CalculateCropMatrix(Camera& cam, const EntityList& receivers, const EntityList& castersInSplit, const AABB& frustumAABB, const MAT44& matLightViewProj);
 		void				_VSMBlurPass(int iCascade);
 
 	private:
+		Camera				m_splitCam;			// Viewer camera with near/far adjusted to the scene
+		VEC3				m_vLightDir;
 		MAT44				m_matLightView;
+		MAT44				m_matLightViewProj;
+		AABB				m_splitFrustumAABB[CSM_CASCADE_NUM];
+		SCullVolume			m_casterVolumes[CSM_CASCADE_NUM];	// Split frustum AABB swept towards the light
 		MAT44				m_matLightProj[CSM_CASCADE_NUM];
 		MAT44				m_matShadowTransform[CSM_CASCADE_NUM];
 		RenderTarget*		m_shadowMapCascades[CSM_CASCADE_NUM];
@@ -4,6 +4,20 @@
 	author:		maval
 
 	purpose:	Skined model.
+				A skeleton is a flat array of bones sorted parent-before-child,
+				each bone only knows the index of its parent. Local poses are
+				kept in one stream per component, so combining them to model
+				space is a single loop over the array.
+				Animation works on local poses only: every part is a layer of
+				crossfading clips, blended over the layers below through an
+				optional bone mask, and the result goes to model space once.
+				All the buffers belong to the SkinModel and the skeleton is
+				only read, so models can be evaluated in parallel, see
+				SkinModel::UpdateAnimations(). The skin palettes of all models
+				then go to one buffer per frame, a draw only sets its offset.
+				Models far away are updated less often and with fewer bones,
+				the bones being sorted by depth, a bone LOD is just a prefix
+				of the array. Culled models don't evaluate at all.
 *********************************************************************/
 #ifndef SkinModel_h__
 #define SkinModel_h__
@@ -20,21 +34,20 @@ namespace Neo
 		eAnimPart_Count,
 	};
 	//------------------------------------------------------------------------------------
-	class Bone
+	// Local transform of every bone relative to its parent, in skeleton order.
+	struct SSkeletonPose
 	{
-	public:
-		Bone() { m_pParent = nullptr; m_bMatCombineValid = false; }
-		~Bone() {}
-
-		uint32		m_id;
-		STRING		m_name;
-		MAT44		m_matLocal;
-		MAT44		m_matCombine;		// accumulated transformations to root bone.
-		MAT44		m_matBindPose;		// local binding pose
-		MAT44		m_matInvBindPos;	// Inverse binding pose from root to local
-		bool		m_bMatCombineValid;
-		Bone*		m_pParent;
-		std::vector<Bone*> m_vecChilds;
+		void		Resize(uint32 nBones) { rotations.resize(nBones); translations.resize(nBones); }
+		uint32		GetBoneCount() const { return rotations.size(); }
+
+		// out = a towards b by t * pMask[i] for each of the first nBones, a null pMask blends every bone by t.
+		// out may be a or b, the bones past nBones are left as they are.
+		static void	Blend(const SSkeletonPose& a, const SSkeletonPose& b, float t, const float* pMask, SSkeletonPose& out, uint32 nBones);
+		// Weighted average of the first nBones of the poses, weights are normalized. out may be one of them.
+		static void	Blend(const SSkeletonPose* const* ppPoses, const float* pWeights, uint32 nPoses, SSkeletonPose& out, uint32 nBones);
+
+		std::vector<QUATERNION>		rotations;
+		std::vector<VEC3>			translations;
 	};
 	//------------------------------------------------------------------------------------
 	class AnimKeyFrame
@@ -45,16 +58,43 @@ namespace Neo
 		QUATERNION	rotate;
 	};
 	//------------------------------------------------------------------------------------
+	// Quantized keys of a compressed track.
+	// Rotations keep the three smallest components in 15 bits each plus the index of the
+	// largest one, 48 bits per key. Translations are 16 bits per component in the bound of
+	// the track, times are 16 bits of the clip length.
+	struct SCompressedKeys
+	{
+		SCompressedKeys() : fTimeScale(0) {}
+
+		uint32				GetKeyCount() const { return times.size(); }
+		float				GetTime(uint32 i) const { return times[i] * fTimeScale; }
+		void				GetKey(uint32 i, AnimKeyFrame& kf) const;
+
+		std::vector<uint16>	times;
+		std::vector<uint16>	rotations;		// 3 per key
+		std::vector<uint16>	translations;	// 3 per key, empty if constant, which is vTransMin then
+		VEC3				vTransMin;
+		VEC3				vTransExtent;
+		float				fTimeScale;		// Clip length / 65535
+	};
+	//------------------------------------------------------------------------------------
 	class AnimTrack
 	{
 	public:
 		AnimTrack() {}
 		~AnimTrack() {}
 
-		AnimKeyFrame		GetKf(float fTime);
+		// Reference sampler, searches the keys from the first one on every call.
+		AnimKeyFrame		GetKf(float fTime) const;
+		// Searches from cursor, the key of the last call, and updates it. Moving forward by
+		// about a frame each call makes it O(1), going backwards restarts from the first key.
+		void				Sample(float fTime, uint32& cursor, AnimKeyFrame& kf) const;
+		bool				IsCompressed() const { return m_vecKeyFrames.empty(); }
+		uint32				GetByteSize() const;
 
 		uint32		m_boneId;
-		std::vector<AnimKeyFrame>	m_vecKeyFrames;
+		std::vector<AnimKeyFrame>	m_vecKeyFrames;		// Empty in a compressed track
+		SCompressedKeys				m_compressed;
 	};
 	//------------------------------------------------------------------------------------
 	class AnimClip
@@ -66,39 +106,158 @@ namespace Neo
 			std::for_each(m_tracks.begin(), m_tracks.end(), std::default_delete<AnimTrack>());
 		}
 
+		// A compressed copy. Keys that interpolation of their neighbours reproduces within
+		// the given errors are dropped, the others are quantized. fMaxRotError is in radians.
+		AnimClip*					CreateCompressed(float fMaxRotError, float fMaxTransError) const;
+		uint32						GetByteSize() const;
+
 		STRING						m_name;
 		float						m_fLength;
 		std::vector<AnimTrack*>		m_tracks;
 	};
 	//------------------------------------------------------------------------------------
+#if USE_BENCHMARK
+	struct SAnimBenchResult
+	{
+		STRING		name;
+		uint32		nRawBytes;
+		uint32		nCompressedBytes;
+		double		fScanMs;			// AnimTrack::GetKf()
+		double		fCursorMs;			// Cursors on the raw keys
+		double		fCompressedMs;		// Cursors on the compressed keys
+		float		fMaxRotError;		// Radians, compressed against raw
+		float		fMaxTransError;
+	};
+#endif
+	//------------------------------------------------------------------------------------
 	class SkeletonAnim
 	{
 	public:
 		SkeletonAnim() {}
 		~SkeletonAnim()
 		{
-			std::for_each(m_vecBones.begin(), m_vecBones.end(), std::default_delete<Bone>());
 			std::for_each(m_vecAnims.begin(), m_vecAnims.end(), std::default_delete<AnimClip>());
 		}
 
-		MAT44	RecursUpdateBoneTransform(Bone* pBone);
+		// Loading: add bones in file order (index == bone id), link them, add the clips with
+		// track bone ids from the file, then BuildHierarchy() once.
+		uint32		AddBone(const STRING& name, const QUATERNION& rotation, const VEC3& translation);
+		void		SetParent(uint32 iBone, uint32 iParent);
+		// Sort the bones by depth, so parents come before their children, remap the tracks to the new order
+		// and compute the inverse bind pose. Also sets up default bone LODs.
+		void		BuildHierarchy();
+		// Level 0 has every bone, level i only the bones up to depths[i - 1]. Those deeper keep
+		// their bind pose relative to the closest evaluated ancestor.
+		void		SetBoneLodDepths(const std::vector<uint32>& depths);
+		uint32		GetBoneLodCount() const { return m_lodBoneCounts.size(); }
+		// Bones of a level, always the first ones of the array. Levels past the last give the last one.
+		uint32		GetLodBoneCount(uint32 iLod) const { return m_lodBoneCounts[Min<uint32>(iLod, m_lodBoneCounts.size() - 1)]; }
+		// Replace every clip by AnimClip::CreateCompressed()
+		void		CompressClips(float fMaxRotError, float fMaxTransError);
+#if USE_BENCHMARK
+		// Sample every raw clip for nFrames at 60 fps with each sampler, and compare a compressed copy against it
+		void		BenchmarkClips(std::vector<SAnimBenchResult>& results, uint32 nFrames = 1000,
+						float fMaxRotError = 0.002f, float fMaxTransError = 0.001f) const;
+#endif
+
+		uint32		GetBoneCount() const { return m_boneNames.size(); }
+		// -1 if not found
+		int			GetBoneIndex(const STRING& name) const;
+		// 1 for rootBone and its descendants, 0 for the others
+		void		BuildBoneMask(const STRING& rootBone, std::vector<float>& mask) const;
+		void		GetBindPose(SSkeletonPose& pose) const;
+		// pModel[i] = local[i] * pModel[parent[i]] for the first nBones, one pass in skeleton order
+		void		ComputeModelTransforms(const SSkeletonPose& pose, MAT44* pModel, uint32 nBones) const;
+		// pPalette[i] = inverse bind[i] * pModel[i] for the first nBones. A bone past them follows its
+		// ancestor in bind pose, which comes down to the same palette matrix as its parent.
+		void		ComputeSkinPalette(const MAT44* pModel, MAT44* pPalette, uint32 nBones) const;
+
+		// Bone arrays, all in skeleton order
+		std::vector<STRING>			m_boneNames;
+		std::vector<int>			m_boneParents;		// -1 for a root, otherwise always less than the bone's own index
+		std::vector<uint32>			m_boneIds;			// Id in the file, which is what the vertices use to index the skin palette
+		std::vector<uint32>			m_boneDepths;		// 0 for a root, never decreasing
+		std::vector<uint32>			m_lodBoneCounts;	// Bones evaluated by each LOD level
+		SSkeletonPose				m_bindPose;			// Local binding pose
+		std::vector<MAT44A>		m_invBindPose;		// Inverse binding pose from root to local
 
-		std::vector<Bone*>			m_vecBones;
 		std::vector<AnimClip*>		m_vecAnims;
 	};
 	//------------------------------------------------------------------------------------
 	class AnimState
 	{
 	public:
-		AnimState() :m_pAnim(nullptr),m_fAnimTime(0),m_bLoop(false) {}
+		AnimState() :m_pSkeleton(nullptr),m_pAnim(nullptr),m_fAnimTime(0),m_bLoop(false),m_fWeight(1),m_fTargetWeight(1),m_fFadeSpeed(0) {}
 		~AnimState() {}
 
-		void				Update(float dt);
+		void				Play(AnimClip* pAnim, bool bLoop);
+		// Move the weight linearly to fTarget in fTime seconds
+		void				FadeTo(float fTarget, float fTime);
+		// Advance the time and the fade. A clip that isn't looped is dropped at its end.
+		void				Advance(float dt);
+		// out = basePose with the animated bones among the first nBones replaced by the clip,
+		// keys are relative to the bind pose
+		void				Sample(const SSkeletonPose& basePose, SSkeletonPose& out, uint32 nBones);
 
 		SkeletonAnim*		m_pSkeleton;
 		AnimClip*			m_pAnim;
 		float				m_fAnimTime;
 		bool				m_bLoop;
+		float				m_fWeight;
+		float				m_fTargetWeight;
+		float				m_fFadeSpeed;	// Weight per second
+		std::vector<uint32>	m_cursors;		// Key cursor of each track of m_pAnim
+		SSkeletonPose		m_pose;			// Last sample
+	};
+	//------------------------------------------------------------------------------------
+	// Clips of one part. A new clip fades in while the ones before it fade out, their weights
+	// add up to one, whatever is missing keeps the pose of the layers below.
+	class AnimLayer
+	{
+	public:
+		AnimLayer() :m_fWeight(1) {}
+
+		void				Init(SkeletonAnim* pSkel);
+		// fFadeTime 0 replaces the playing clips at once
+		void				Play(AnimClip* pAnim, bool bLoop, float fFadeTime);
+		void				Advance(float dt);
+		// Blend the clips over the first nBones of pose, by the layer weight and the mask
+		void				Apply(SSkeletonPose& pose, uint32 nBones);
+
+		// Latest clip played
+		AnimState&			GetCurrent() { return m_states.back(); }
+		// Per bone weight in skeleton order, empty for every bone
+		void				SetMask(const std::vector<float>& mask) { m_mask = mask; }
+		void				SetWeight(float fWeight) { m_fWeight = fWeight; }
+		float				GetWeight() const { return m_fWeight; }
+
+	private:
+		SkeletonAnim*				m_pSkeleton;
+		std::vector<AnimState>		m_states;		// Oldest first, never empty
+		std::vector<float>			m_mask;
+		float						m_fWeight;
+		SSkeletonPose				m_pose;			// Blend of the clips before the mask
+		std::vector<const SSkeletonPose*>	m_blendPoses;
+		std::vector<float>			m_blendWeights;
+	};
+	//------------------------------------------------------------------------------------
+	// Animation LOD, picked by the size of a model on screen
+	struct SAnimLodLevel
+	{
+		float		fMinScreenSize;		// Projected bounding sphere diameter over the screen height
+		float		fUpdateInterval;	// Seconds between two evaluations, 0 for every frame
+		uint32		iBoneLod;			// See SkeletonAnim::GetLodBoneCount()
+	};
+	//------------------------------------------------------------------------------------
+	struct SAnimUpdateStats
+	{
+		SAnimUpdateStats() : nModels(0), nEvaluated(0), nCulled(0), nBonesEvaluated(0), nBonesTotal(0) {}
+
+		uint32		nModels;
+		uint32		nEvaluated;			// Models whose pose was evaluated
+		uint32		nCulled;			// Models not evaluated because they weren't seen
+		uint32		nBonesEvaluated;
+		uint32		nBonesTotal;		// Bones of all models, as a full update would evaluate
 	};
 	//------------------------------------------------------------------------------------
 	class SkinModel : public Entity
@@ -108,21 +267,59 @@ namespace Neo
 		~SkinModel();
 
 	public:
-		virtual void	Update(float dt);
 		virtual void	Render();
 		virtual void	DebugRender();
 
-		// Play 
-		void			PlayAnimation(eAnimPart part, const STRING& name, bool bLoop);
+		// Update the animation of every model in parallel jobs. With a camera the LOD of each model is picked
+		// from its size on screen: small ones are evaluated less often and with fewer bones, culled ones
+		// not at all unless they cast a shadow. Their time goes on, the next evaluation catches it up in one step.
+		static void		UpdateAnimations(SkinModel** ppModels, uint32 nModels, float dt, const Camera* pCamera = nullptr, SAnimUpdateStats* pStats = nullptr);
+		// Levels from the biggest screen size to the smallest, the last one also applies to off-screen shadow casters
+		static void		SetAnimLodLevels(const std::vector<SAnimLodLevel>& levels);
+		// Copy the palettes of every model to the frame skin palette, main thread only.
+		// A model can only be rendered after it was part of this in the frame.
+		static void		UploadPalettes(SkinModel** ppModels, uint32 nModels);
+
+		// Crossfade to the clip in fFadeTime seconds
+		void			PlayAnimation(eAnimPart part, const STRING& name, bool bLoop, float fFadeTime = 0.2f);
+		// Limit a part to rootBone and its descendants
+		void			SetPartMask(eAnimPart part, const STRING& rootBone);
+		void			SetPartWeight(eAnimPart part, float fWeight) { m_layers[part].SetWeight(fWeight); }
+		// Evaluate the pose and the skin palette at the current bone LOD. Only touches this model,
+		// safe to run in parallel for different models.
+		void			UpdateAnimation(float dt);
+		void			SetBoneLod(uint32 iLod) { m_iBoneLod = iLod; }
+		uint32			GetBoneLod() const { return m_iBoneLod; }
+		// Bones evaluated by the last update, 0 if it was skipped
+		uint32			GetEvaluatedBoneCount() const { return m_nEvaluatedBones; }
+		uint32			GetPaletteSize() const { return m_skinPalette.size(); }
 
 		void			ShowBones(bool bShow);
 		SkeletonAnim*	GetSkeleton() { return m_pSkeleton; }
-		AnimState&		GetAnimState(eAnimPart part) { return m_animState[part]; }
+		AnimState&		GetAnimState(eAnimPart part) { return m_layers[part].GetCurrent(); }
+		AnimLayer&		GetAnimLayer(eAnimPart part) { return m_layers[part]; }
+		// Model space transform of a bone in skeleton order, as of the last evaluation.
+		// Bones past the bone LOD aren't updated.
+		const MAT44&	GetBoneTransform(uint32 iBone) const { return m_boneTransforms[iBone]; }
 
 	private:
-		SkeletonAnim*		m_pSkeleton;
-		AnimState			m_animState[eAnimPart_Count];
-		SkeletonDebugger*	m_pSkelRender;
+		// Transpose the palette into pDst, indexed by the bone ids the vertices use
+		void			_WritePalette(MAT44* pDst) const;
+		// Pick the LOD level for this frame, false if it shouldn't be evaluated at all
+		bool			_SelectLod(const Camera* pCamera, uint32 iStagger);
+
+		SkeletonAnim*			m_pSkeleton;		// Shared by every model of the mesh, owned by SceneManager
+		AnimLayer				m_layers[eAnimPart_Count];	// Applied in order
+		SSkeletonPose			m_pose;
+		std::vector<MAT44A>	m_boneTransforms;	// Model space
+		std::vector<MAT44A>	m_skinPalette;		// Skeleton order, scattered to the bone ids when rendering
+		SkeletonDebugger*		m_pSkelRender;
+		uint32					m_nPaletteOffset;	// In the frame skin palette
+		uint32					m_iBoneLod;
+		uint32					m_nEvaluatedBones;
+		float					m_fUpdateInterval;
+		float					m_fPendingTime;		// Time since the last evaluation, all of it is advanced by the next one
+		float					m_fUpdateTimer;		// Counts towards the next evaluation, staggered when the LOD changes
 	};
 	//------------------------------------------------------------------------------------
 	class SkeletonDebugger
@@ -137,8 +334,7 @@ namespace Neo
 		void		Render();
 
 	private:
-		MAT44					m_matWorld;
-		SkeletonAnim*			m_pSkeleton;
+		SkinModel*				m_pModel;
 		Mesh*					m_pMesh;
 		std::vector<Entity*>	m_vecEntity;
 		Material*				m_pMtl;
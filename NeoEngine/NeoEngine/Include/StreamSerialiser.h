@@ -0,0 +1,107 @@
+/********************************************************************
+	created:	2016/11/02 14:20
+	filename	StreamSerialiser.h
+	author:		maval
+
+	purpose:	Chunked binary file reader / writer, from OGRE.
+				A chunk is an id, a version and the length of its body, so a
+				reader can skip any chunk it doesn't want with a single seek.
+				Large blocks can be stored compressed, see writeCompressed().
+*********************************************************************/
+#ifndef StreamSerialiser_h__
+#define StreamSerialiser_h__
+
+#include "Prerequiestity.h"
+
+namespace Neo
+{
+	class StreamSerialiser
+	{
+	public:
+		enum eMode
+		{
+			eMode_Read,
+			eMode_Write
+		};
+
+		/// Definition of a chunk of data in a file
+		struct Chunk
+		{
+			/// Identifier of the chunk (for example from makeIdentifier)
+			uint32 id;
+			/// Version of the chunk
+			uint16 version;
+			/// Length of the chunk data in bytes, excluding the header of this chunk
+			uint32 length;
+			/// Offset of the chunk header in the file
+			uint32 offset;
+
+			Chunk() : id(0), version(1), length(0), offset(0) {}
+		};
+
+		/// Size of the chunk header in the file
+		static const uint32 CHUNK_HEADER_SIZE;
+
+		/** Open a file for reading or writing.
+		@param nOffset Position to start reading at, so a chunk can be found again later
+		*/
+		StreamSerialiser(const STRING& filename, eMode mode, uint32 nOffset = 0);
+		~StreamSerialiser();
+
+		/// False if the file couldn't be opened or a read went past its end
+		bool	isValid() const { return !m_bError; }
+		uint32	tell();
+		void	seek(uint32 pos);
+
+		/** Begin writing a new chunk, it may contain nested chunks.
+		@note Every call must be matched by writeChunkEnd()
+		*/
+		void	writeChunkBegin(uint32 id, uint16 version = 1);
+		void	writeChunkEnd(uint32 id);
+
+		/** Read the header of the next chunk.
+		@return nullptr if the next chunk isn't id, or its version is newer than
+			maxVersion. The stream is left where it was in that case.
+		*/
+		const Chunk*	readChunkBegin(uint32 id, uint16 maxVersion);
+		/// Skip what's left of the current chunk
+		void	readChunkEnd(uint32 id);
+		/// The id of the next chunk without moving the stream, 0 at the end of the file
+		uint32	peekNextChunkID();
+		/// Whether the stream has reached the end of the current chunk
+		bool	isEndOfChunk(uint32 id);
+		uint32	getOffsetFromChunkStart();
+
+		template <typename T>
+		void	write(const T* pT, size_t count = 1) { writeData(pT, sizeof(T), count); }
+		void	write(const STRING* pStr);
+
+		template <typename T>
+		void	read(T* pT, size_t count = 1) { readData(pT, sizeof(T), count); }
+		void	read(STRING* pStr);
+
+		/** Write a compressed block of data.
+		@param nElemSize Size of one element of pData. The bytes are regrouped by
+			their position in the element before packing, which makes the
+			slowly changing bytes (exponents, colour channels) compress well.
+		*/
+		void	writeCompressed(const void* pData, uint32 nBytes, uint32 nElemSize);
+		/// Read a block written by writeCompressed, nBytes must match what was written
+		bool	readCompressed(void* pData, uint32 nBytes);
+
+	private:
+		void	writeData(const void* pData, size_t size, size_t count);
+		void	readData(void* pData, size_t size, size_t count);
+		/// Bytes left to read in the current chunk, or in the file outside of any chunk
+		uint32	getRemainingBytes();
+
+		std::fstream		m_file;
+		uint32				m_nFileSize;
+		std::vector<Chunk>	m_chunkStack;
+		Chunk				m_lastChunk;
+		bool				m_bRead;
+		bool				m_bError;
+	};
+}
+
+#endif // StreamSerialiser_h__
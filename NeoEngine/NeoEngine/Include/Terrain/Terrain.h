@@ -17,6 +17,7 @@
 #include "Terrain/TerrainLodManager.h"
 #include "Terrain/TerrainLayerBlendMap.h"
 #include "RenderDefine.h"
+#include "JobSystem.h"
 
 namespace Neo
 {
@@ -374,15 +375,21 @@ namespace Neo
 			GpuBufferAllocator() {}
 			virtual ~GpuBufferAllocator() {}
 
-			/** Allocate (or reuse) vertex buffers for a terrain LOD.
+			/** Allocate (or reuse) room for the vertex data of a terrain LOD.
+			@remarks
+				The shader reads the vertices from a buffer which may hold the vertex
+				data of other nodes too, each patch passes the first vertex of its own.
+				Vertex data in the same buffer drawn with the same shared index buffer
+				goes into one instanced draw.
 			@param numVertices The total number of vertices
-			@param destPos Pointer to a vertex buffer for positions, to be bound
-			@param destDelta Pointer to a vertex buffer for deltas, to be bound
+			@param destBuf Pointer to the buffer of STerrainVertex or STerrainCompactVertex
+				elements, as the terrain uses compact vertices or not
+			@param baseVertex The first of the numVertices vertices in *destBuf
 			*/
-			virtual void allocateVertexBuffers(Terrain* forTerrain, size_t numVertices, VertexBuffer** destPos, VertexBuffer** destDelta) = 0;
-			/** Free (or return to the pool) vertex buffers for terrain.
+			virtual void allocateVertexData(Terrain* forTerrain, size_t numVertices, ShaderResourceBuffer** destBuf, uint32& baseVertex) = 0;
+			/** Free (or return to the pool) vertex data for terrain.
 			*/
-			virtual void freeVertexBuffers(VertexBuffer* posbuf, VertexBuffer* deltabuf) = 0;
+			virtual void freeVertexData(ShaderResourceBuffer* buf, uint32 baseVertex, size_t numVertices) = 0;
 
 			/** Get a shared index buffer for a given number of settings.
 			@remarks
@@ -407,47 +414,164 @@ namespace Neo
 
 		};
 
+		/** Pools the vertex data of terrains which are unloaded for the next ones
+			to be loaded, and shares the index buffers.
+		@remarks
+			Vertex data of the same vertex size and count is cut from buffers of
+			VERTICES_PER_BUFFER vertices, so the nodes of a terrain at the same depth
+			end up in few buffers and draw together. Free ranges are kept in buckets
+			of vertex size and count, which is all a terrain of the same configuration
+			asks for again. The buffers are only released by freeAllBuffers().
+		*/
 		class DefaultGpuBufferAllocator : public GpuBufferAllocator
 		{
 		public:
+			struct Stats
+			{
+				/// Vertex data requests served from the pool
+				uint32 numHits;
+				/// Vertex data requests which had to create a buffer
+				uint32 numMisses;
+				/// Vertex buffers created by warmStart()
+				uint32 numPreallocated;
+				/// Vertex data handed out and not freed yet
+				uint32 numInUse;
+				/// Free vertex data held by the pool
+				uint32 numPooled;
+				/// Bytes of the free vertex data
+				size_t bytesPooled;
+				/// Bytes of the shared index buffers
+				size_t bytesShared;
+
+				Stats() : numHits(0), numMisses(0), numPreallocated(0), numInUse(0), numPooled(0), bytesPooled(0), bytesShared(0) {}
+			};
+
+			/// Vertices of the buffers vertex data is cut from, a larger vertex data gets a buffer of its own
+			static const size_t VERTICES_PER_BUFFER = 1 << 18;
+
 			DefaultGpuBufferAllocator();
 			~DefaultGpuBufferAllocator();
-			void allocateVertexBuffers(Terrain* forTerrain, size_t numVertices, VertexBuffer** destPos, VertexBuffer** destDelta);
-			void freeVertexBuffers(VertexBuffer* posbuf, VertexBuffer* deltabuf);
+			void allocateVertexData(Terrain* forTerrain, size_t numVertices, ShaderResourceBuffer** destBuf, uint32& baseVertex);
+			void freeVertexData(ShaderResourceBuffer* buf, uint32 baseVertex, size_t numVertices);
 			IndexBuffer* getSharedIndexBuffer(uint16 batchSize,
 				uint16 vdatasize, size_t vertexIncrement, uint16 xoffset, uint16 yoffset, uint16 numSkirtRowsCols,
 				uint16 skirtRowColSkip, uint32& nIndexCount);
+			/** Release the pooled vertex buffers and the shared index buffers.
+			@remarks Releases nothing while a terrain still holds vertex data from the pool,
+				unload the terrains first.
+			*/
 			void freeAllBuffers();
 
 			/** 'Warm start' the allocator based on needing x instances of
 			terrain with the given configuration.
+			@remarks Fills the pool with the vertex data of all LOD levels of these
+				terrains, so loading them afterwards doesn't create any buffer.
+			@param compact Whether these terrains use compact vertices,
+				@see Terrain::_getUseCompactVertices
 			*/
 			void warmStart(size_t numInstances, uint16 terrainSize, uint16 maxBatchSize,
-				uint16 minBatchSize);
+				uint16 minBatchSize, bool compact);
+
+			const Stats& getStats() const { return mStats; }
+			/// Reset the hit and miss counters
+			void resetStats();
 
 		protected:
-			typedef std::list<VertexBuffer*> VBufList;
-			VBufList mFreePosBufList;
-			VBufList mFreeDeltaBufList;
+			/// A range of vertex data in one of the buffers
+			struct VertexRange
+			{
+				ShaderResourceBuffer* buf;
+				uint32 baseVertex;
+			};
+			typedef std::vector<VertexRange> VRangeList;
+			/// Free ranges by bucketKey()
+			typedef std::map<uint64, VRangeList> VRangeBucketMap;
+			VRangeBucketMap mFreeRanges;
+			/// All buffers, free and in use ranges
+			std::vector<ShaderResourceBuffer*> mVertexBufs;
 			typedef std::map<uint32, IndexBuffer*> IBufMap;
 			IBufMap mSharedIBufMap;
+			Stats mStats;
 
 			uint32 hashIndexBuffer(uint16 batchSize,
 				uint16 vdatasize, size_t vertexIncrement, uint16 xoffset, uint16 yoffset, uint16 numSkirtRowsCols,
 				uint16 skirtRowColSkip);
-			VertexBuffer* getVertexBuffer(VBufList& list, size_t vertexSize, size_t numVertices);
+			static uint64 bucketKey(size_t vertexSize, size_t numVertices) { return ((uint64)vertexSize << 32) | numVertices; }
+			/// Create a buffer for the vertex data of a bucket and pool its ranges, the first excepted
+			VertexRange createVertexBuffer(size_t vertexSize, size_t numVertices);
 
 		};
 
 		void	UpdateLod();
+		// The two halves of UpdateLod(). Lod selection only reads the camera and the quad tree so it
+		// may run on a job thread, creating the material allocates render resources on the main thread.
+		void	CalculateLod()	{ calculateCurrentLod(); }
+		void	CreateLodEntities();
+		// Draws the draw list through a TerrainRenderQueue of its own, a TerrainGroup batches all its terrains in one
 		void	Render();
+		/// Upload the terrain constants and activate the material, once per terrain by TerrainRenderQueue
+		void	_setRenderState();
+		Material*	getMaterial() const { return mMaterial; }
+		/// Draw as wireframe, a material created later takes the setting too
+		void	enableWireframe(bool b);
+		bool	isWireframe() const { return mWireframe; }
+
+		/// A node drawn at a LOD, Render() only draws the nodes of the draw list
+		struct DrawRecord
+		{
+			TerrainQuadTreeNode*	node;
+			/// LOD level relative to the node
+			uint16					lod;
+			/// 0-1 transition to the next lower LOD
+			float					transition;
+		};
+		typedef std::vector<DrawRecord> DrawList;
+
+		/// Work done by the last LOD update
+		struct LodStats
+		{
+			/// Nodes whose LOD was evaluated
+			uint32	numNodesVisited;
+			/// Subtrees whose LOD could not have changed since the camera moved less than their slack
+			uint32	numSubtreesSkipped;
+			/// Nodes given another LOD or transition
+			uint32	numLodChanges;
+			/// Subtrees left out of the draw list by the frustum
+			uint32	numNodesCulled;
+			/// Size of the draw list
+			uint32	numDrawRecords;
+			/// Times the draw list was rebuilt, it is reused while the LOD and the view stay the same
+			uint32	numDrawListRebuilds;
+
+			LodStats() : numNodesVisited(0), numSubtreesSkipped(0), numLodChanges(0),
+				numNodesCulled(0), numDrawRecords(0), numDrawListRebuilds(0) {}
+
+			LodStats& operator+= (const LodStats& rhs)
+			{
+				numNodesVisited += rhs.numNodesVisited;
+				numSubtreesSkipped += rhs.numSubtreesSkipped;
+				numLodChanges += rhs.numLodChanges;
+				numNodesCulled += rhs.numNodesCulled;
+				numDrawRecords += rhs.numDrawRecords;
+				numDrawListRebuilds += rhs.numDrawListRebuilds;
+				return *this;
+			}
+		};
+
+		const LodStats& getLodStats() const { return mLodStats; }
+		const DrawList& getDrawList() const { return mDrawList; }
+		/** Evaluate the LOD of every node at the next update.
+		@remarks
+			Nodes otherwise keep their LOD until the camera moved far enough to change it,
+			anything else it depends on (heights, deltas, loaded LOD levels) has to call this.
+		*/
+		void _invalidateLod() { mLodInvalid = true; }
 
 		_declspec(align(16))
 		struct cBufferTerr
 		{
 			MAT44	posIndexToObjectSpace;
 			VEC4	uvMul_0;
-			VEC2	lodMorph;
 			float	baseUVScale;
 		};
 
@@ -514,42 +638,39 @@ namespace Neo
 		VEC3 convertDirection(Space inSpace, const VEC3& inDir, Space outSpace) const;
 
 		/** Save terrain data in native form to a standalone file
-		@param filename The name of the file to save to. If this is a filename with
-		no path elements, then it is saved in the first writeable location
-		available in the resource group you have chosen to use for this
-		terrain. If the filename includes path specifiers then it is saved
-		directly instead (but note that it may not be reloadable via the
-		resource system if the location is not on the path).
-		*/
-		//void save(const STRING& filename);
+		@param filename The name of the file to save to, relative to the working
+		directory unless it includes a full path.
+		@remarks
+		The file holds the heights and deltas of every LOD in its own chunk, from
+		the coarsest LOD to the finest, so prepare() can read just the coarse ones
+		and the rest can be streamed in later. Normals and lightmap are stored too.
+		*/
+		void save(const STRING& filename);
 		/** Save terrain data in native form to a serializing stream.
 		@remarks
 		If you want complete control over where the terrain data goes, use
 		this form.
 		*/
-		//void save(StreamSerialiser& stream);
+		void save(StreamSerialiser& stream);
 
 		/** Prepare the terrain from a standalone file.
 		@note
 		This is safe to do in a background thread as it creates no GPU resources.
 		It reads data from a native terrain data chunk. For more advanced uses,
 		such as loading from a shared file, use the StreamSerialiser form.
+		@par
+		Height data isn't read here, load() streams it from the file by LOD.
 		*/
-	//	bool prepare(const STRING& filename);
-		/** Prepare terrain data from saved data.
-		@remarks
-		This is safe to do in a background thread as it creates no GPU resources.
-		It reads data from a native terrain data chunk.
-		@return true if the preparation was successful
-		*/
-	//	bool prepare(DataStreamPtr& stream);
+		bool prepare(const STRING& filename);
 		/** Prepare terrain data from saved data.
 		@remarks
 		This is safe to do in a background thread as it creates no GPU resources.
 		It reads data from a native terrain data chunk.
+		@param filename Name of the file the stream reads from, LOD data is read
+		from it again when a finer LOD is loaded.
 		@return true if the preparation was successful
 		*/
-	//	bool prepare(StreamSerialiser& stream);
+		bool prepare(StreamSerialiser& stream, const STRING& filename);
 
 		/** Prepare the terrain from some import data rather than loading from
 		native data.
@@ -563,20 +684,15 @@ namespace Neo
 		This method must be called from the primary render thread. To load data
 		in a background thread, use the prepare() method.
 		*/
-	//	void load(const STRING& filename);
-
-		/** Prepare and load the terrain in one simple call from a stream.
-		@note
-		This method must be called from the primary render thread. To load data
-		in a background thread, use the prepare() method.
-		*/
-	//	void load(StreamSerialiser& stream);
+		void load(const STRING& filename);
 
 		/** Load the terrain based on the data already populated via prepare methods.
 		@remarks
 		This method must be called in the main render thread.
 		@param lodLevel Load the specified LOD level
-		@param synchronous Load type
+		@param synchronous Load type. When the terrain is prepared from a file and
+		nothing is loaded yet, the coarsest LOD is loaded right away and the
+		finer ones are streamed in by a job, they're picked up by CreateLodEntities().
 		*/
 		void load(int lodLevel = 0, bool synchronous = true);
 
@@ -687,6 +803,11 @@ namespace Neo
 		*/
 		void getPointFromSelfOrNeighbour(long x, long y, VEC3* outpos) const;
 
+		/** Get the height at a point, cascading into neighbours if out of bounds.
+		@note The height is relative to this tile, like getPointFromSelfOrNeighbour
+		*/
+		float getHeightFromSelfOrNeighbour(long x, long y) const;
+
 		/** Get a VEC3 of the world-space point on the terrain, supplying the
 		height data manually (can be more optimal).
 		@note This point is relative to Terrain::getPosition
@@ -1080,10 +1201,12 @@ namespace Neo
 		in its recorded position, and the place it will end up in the LOD
 		in which it is removed.
 		@param rect Rectangle describing the area in which heights have altered
+		@param deltaData Receives the deltas, laid out like mDeltaData. The background
+		update writes to a copy the main thread takes over when it finalises.
 		@return A Rectangle describing the area which was updated (may be wider
 		than the input rectangle)
 		*/
-		Rect calculateHeightDeltas(const Rect& rect);
+		Rect calculateHeightDeltas(const Rect& rect, float* deltaData);
 
 		/** Finalise the height deltas.
 		Calculated height deltas are kept in a separate calculation field to make
@@ -1142,9 +1265,10 @@ namespace Neo
 		0 indicates no limit
 		@return A pair which contains whether the ray hit the terrain and, if so, where.
 		@remarks This can be called from any thread as long as no parallel write to
-		the heightmap data occurs.
+		the heightmap data occurs. The quad tree node height bounds are used to skip
+		empty space, only the quads of the leaves the ray passes are tested.
 		*/
-	//	std::pair<bool, VEC3> rayIntersects(const Ray& ray, bool cascadeToNeighbours = false, float distanceLimit = 0); //const;
+		std::pair<bool, VEC3> rayIntersects(const RAY& ray, bool cascadeToNeighbours = false, float distanceLimit = 0) const;
 
 																	   /// Get the AABB (local coords) of the entire terrain
 		const AABB& getAABB() const;
@@ -1281,6 +1405,11 @@ namespace Neo
 		/// Get whether LOD morphing is needed
 		bool _getMorphRequired() const { return mLodMorphRequired; }
 
+		/// Whether the vertex data is a single stream of STerrainCompactVertex. @see TerrainGlobalOptions::setUseCompactVertices
+		bool _getUseCompactVertices() const { return mUseCompactVertices; }
+		/// Whether the CPU vertex data is kept after upload. @see TerrainGlobalOptions::setEditable
+		bool isEditable() const { return mEditable; }
+
 		/** Request internal implementation options for the terrain material to use,
 		in this case a terrain-wide normal map.
 		The TerrainMaterialGenerator should call this method to specify the
@@ -1416,7 +1545,7 @@ namespace Neo
 		@param distanceLimit Limit beyond which we want to ignore neighbours (0 for infinite)
 		@return The first neighbour along this ray, or null
 		*/
-	//	Terrain* raySelectNeighbour(const Ray& ray, float distanceLimit = 0);
+		Terrain* raySelectNeighbour(const RAY& ray, float distanceLimit = 0) const;
 
 		/** Dump textures to files.
 		@remarks
@@ -1424,7 +1553,12 @@ namespace Neo
 		*/
 //		void _dumpTextures(const STRING& prefix, const STRING& suffix);
 
-		/** Query whether a derived data update is in progress or not. */
+		/** Query whether a derived data update is in progress or not.
+		@remarks
+			True from the moment an update is issued until its results have been
+			finalised in the main thread, which happens in update() or once per frame
+			in CreateLodEntities().
+		*/
 		bool isDerivedDataUpdateInProgress() const { return mDerivedDataUpdateInProgress; }
 
 
@@ -1434,13 +1568,13 @@ namespace Neo
 		static void convertTerrainToWorldAxes(Alignment align, const VEC3& terrainVec, VEC3* worldVec);
 
 		/// Utility method to write a layer declaration to a stream
-	//	static void writeLayerDeclaration(const TerrainLayerDeclaration& decl, StreamSerialiser& ser);
+		static void writeLayerDeclaration(const TerrainLayerDeclaration& decl, StreamSerialiser& ser);
 		/// Utility method to read a layer declaration from a stream
-	//	static bool readLayerDeclaration(StreamSerialiser& ser, TerrainLayerDeclaration& targetdecl);
+		static bool readLayerDeclaration(StreamSerialiser& ser, TerrainLayerDeclaration& targetdecl);
 		/// Utility method to write a layer instance list to a stream
-	//	static void writeLayerInstanceList(const Terrain::LayerInstanceList& lst, StreamSerialiser& ser);
+		static void writeLayerInstanceList(const Terrain::LayerInstanceList& lst, StreamSerialiser& ser);
 		/// Utility method to read a layer instance list from a stream
-	//	static bool readLayerInstanceList(StreamSerialiser& ser, size_t numSamplers, Terrain::LayerInstanceList& targetlst);
+		static bool readLayerInstanceList(StreamSerialiser& ser, size_t numSamplers, Terrain::LayerInstanceList& targetlst);
 
 	protected:
 		/** Gets the data size at a given LOD level.
@@ -1461,6 +1595,18 @@ namespace Neo
 		void freeGPUResources();
 		void determineLodLevels();
 		void distributeVertexData();
+
+		/// Vertex data shared by the quad tree nodes from treeDepthStart to treeDepthEnd (exclusive)
+		struct VertexDataLayout
+		{
+			uint16 treeDepthStart;
+			uint16 treeDepthEnd;
+			uint16 resolution;
+			uint32 size;
+		};
+		typedef std::vector<VertexDataLayout> VertexDataLayoutList;
+		/// How distributeVertexData() splits the vertex data of a terrain of this configuration
+		static void getVertexDataLayout(uint16 size, uint16 maxBatchSize, uint16 minBatchSize, VertexDataLayoutList& layout);
 		void updateBaseScale();
 		void createGPUBlendTextures();
 		void createLayerBlendMaps();
@@ -1482,8 +1628,14 @@ namespace Neo
 		*/
 		void getPointAlign(long x, long y, float height, Alignment align, VEC3* outpos) const;
 		void calculateCurrentLod();
-		/// Test a single quad of the terrain for ray intersection.
-	//	std::pair<bool, VEC3> checkQuadIntersection(int x, int y, const Ray& ray); //const;
+		/// The material all nodes are drawn with, textures as loaded
+		void createMaterial();
+		/** Convert a world ray to vertex grid space: x, y in vertices and z the height.
+		@note The transform is affine, a distance along the grid ray is the same along the world ray
+		*/
+		void getGridRay(const RAY& ray, RAY* outRay) const;
+		/// Nearest intersection of a grid space ray within [0, tMax]
+		bool rayIntersectsGrid(const RAY& gridRay, float tMax, float* outT) const;
 
 																					  /// Delete blend maps for all layers >= lowIndex
 		void deleteBlendMaps(uint8 lowIndex);
@@ -1502,6 +1654,13 @@ namespace Neo
 		void deriveUVMultipliers();
 
 		void updateDerivedDataImpl(const Rect& rect, const Rect& lightmapExtraRect, bool synchronous, uint8 typeMask);
+		/// Background part of a derived data update, fills mDerivedDataResponse from mDerivedDataRequest.
+		/// It only reads the terrain, the main thread applies the results in handleDerivedDataResponse()
+		void handleDerivedDataRequest();
+		/// Main thread part, finalise the response of a finished background update and issue the next one
+		void handleDerivedDataResponse();
+		/// Finalise the background update if it has finished, returns immediately otherwise
+		void processDerivedDataResponse();
 
 		void getEdgeRect(NeighbourIndex index, long range, Rect* outRect) const;
 		// get the equivalent of the passed in edge rectangle in neighbour
@@ -1551,6 +1710,8 @@ namespace Neo
 		bool mDerivedDataUpdateInProgress;
 		/// If another update is requested while one is already running
 		uint8 mDerivedUpdatePendingMask;
+		/// Tracks the background derived data job
+		SJobCounter mDerivedDataJobs;
 
 		bool mGenerateMaterialInProgress;
 		/// Don't release Height/DeltaData when preparing
@@ -1577,6 +1738,8 @@ namespace Neo
 			uint8 remainingTypeMask;
 			/// The area of deltas that was updated
 			Rect deltaUpdateRect;
+			/// Copy of mDeltaData the deltas are calculated into, deltaUpdateRect of it is copied back in main thread
+			std::vector<float> deltaData;
 			/// The area of normals that was updated
 			Rect normalUpdateRect;
 			/// The area of lightmap that was updated
@@ -1589,6 +1752,9 @@ namespace Neo
 				return o;
 			}
 		};
+		/// The update in flight, only touched by the job while mDerivedDataJobs is pending
+		DerivedDataRequest mDerivedDataRequest;
+		DerivedDataResponse mDerivedDataResponse;
 
 		enum GenerateMaterialStage {
 			GEN_MATERIAL,
@@ -1644,6 +1810,8 @@ namespace Neo
 		bool mCompositeMapDirtyRectLightmapUpdate;
 
 		bool mLodMorphRequired;
+		bool mUseCompactVertices;
+		bool mEditable;
 		bool mNormalMapRequired;
 		bool mLightMapRequired;
 		bool mLightMapShadowsOnly;
@@ -1663,11 +1831,26 @@ namespace Neo
 		GpuBufferAllocator* mCustomGpuBufferAllocator;
 		DefaultGpuBufferAllocator mDefaultGpuBufferAllocator;
 
-		size_t getPositionBufVertexSize() const;
-		size_t getDeltaBufVertexSize() const;
+		/// Size of a vertex in the vertex data buffers, STerrainCompactVertex or STerrainVertex
+		static size_t getVertexSize(bool compact);
 
 		TerrainLodManager* mLodManager;
 
+		/// The next LOD update evaluates every node
+		bool mLodInvalid;
+		/// cFactor and highest LOD loaded the node LODs were calculated for
+		float mLodCFactor;
+		int mLodHighestLoaded;
+		/// View the draw list was culled with
+		MAT44 mDrawListView;
+		MAT44 mDrawListProj;
+		DrawList mDrawList;
+		LodStats mLodStats;
+		/// Shared by all nodes, created once loaded
+		Material* mMaterial;
+		bool mWireframe;
+		TerrainRenderQueue* mRenderQueue;
+
 	public:
 		/** Increase Terrain's LOD level by 1
 		@param synchronous Run synchronously
@@ -1681,6 +1864,14 @@ namespace Neo
 		int getHighestLodPrepared() const { return (mLodManager) ? mLodManager->getHighestLodPrepared() : -1; };
 		int getHighestLodLoaded() const { return (mLodManager) ? mLodManager->getHighestLodLoaded() : -1; };
 		int getTargetLodLevel() const { return (mLodManager) ? mLodManager->getTargetLodLevel() : -1; };
+		/// The manager streaming the LOD levels of this terrain, null until prepared
+		TerrainLodManager* getLodManager() const { return mLodManager; }
+
+		/** Estimate of the memory this terrain holds in bytes: height and delta data,
+			normal, light and blend maps and the vertex data of the loaded LOD levels,
+			including those still being streamed in.
+		*/
+		size_t getMemoryUsage() const;
 	};
 
 
@@ -1714,6 +1905,9 @@ namespace Neo
 		SColor mCompositeMapDiffuse;
 		float mCompositeMapDistance;
 		bool mUseVertexCompressionWhenAvailable;
+		bool mUseLightMap;
+		bool mUseCompactVertices;
+		bool mEditable;
 
 	public:
 		TerrainGlobalOptions();
@@ -1734,6 +1928,12 @@ namespace Neo
 		const VEC3& getLightMapDirection() const { return mLightMapDir; }
 		/** Set the shadow map light direction to use (world space). */
 		void setLightMapDirection(const VEC3& v) { mLightMapDir = v; }
+		/// Whether terrains bake a shadow lightmap when loaded
+		bool getUseLightMap() const { return mUseLightMap; }
+		/** Whether terrains bake a shadow lightmap when loaded (default false).
+		@see TerrainGroup::dirtyLightmaps
+		*/
+		void setUseLightMap(bool b) { mUseLightMap = b; }
 		/// Get the composite map ambient light to use 
 		const SColor& getCompositeMapAmbient() const { return mCompositeMapAmbient; }
 		/// Set the composite map ambient light to use 
@@ -1869,6 +2069,27 @@ namespace Neo
 		However you can disable this in an emergency if required.
 		*/
 		void setUseVertexCompressionWhenAvailable(bool enable) { mUseVertexCompressionWhenAvailable = enable; }
+
+		/// Whether new terrains store their vertices as STerrainCompactVertex
+		bool getUseCompactVertices() const { return mUseCompactVertices; }
+		/** Store the vertices of new terrains in a single 8 byte stream instead of a
+		position and a delta stream of 8 bytes each (default false).
+		@remarks
+			Heights are quantized to 16 bits over the height range of the vertex data,
+			the LOD delta to 12 bits over the same range. Editable terrains ignore this,
+			an edit could leave the quantized range.
+		*/
+		void setUseCompactVertices(bool b) { mUseCompactVertices = b; }
+		/// Whether compact vertices are used by new terrains, taking editing into account
+		bool _getUseCompactVertices() const { return mUseCompactVertices && !mEditable; }
+
+		/// Whether new terrains keep their CPU vertex data for editing
+		bool getEditable() const { return mEditable; }
+		/** Keep the CPU copy of the vertex data of new terrains after it is uploaded,
+		so that Terrain::updateGeometry can patch it (default false). Without it the
+		copy is freed once the terrain is loaded.
+		*/
+		void setEditable(bool b) { mEditable = b; }
 	};
 }
 
@@ -40,11 +40,12 @@ namespace Neo
 	@par
 		Note that this is not a 'paging' class as such. It's simply a way to make it easier to 
 		perform common tasks with multiple terrain instances, which you choose when 
-		to define, load and remove. Automatic paging is handled separately by the Paging
-		component. 
+		to define, load and remove. Automatic paging around the camera is handled
+		separately by TerrainPaging (@see setPaging). 
 	*/
 	class TerrainGroup
 	{
+		friend class TerrainPaging;
 	public:
 		/** Constructor.
 		@param sm The SceneManager which will parent the terrain instances. 
@@ -62,7 +63,21 @@ namespace Neo
 		virtual ~TerrainGroup();
 
 		void	UpdateLod();
+		// See Terrain::CalculateLod() and Terrain::CreateLodEntities()
+		void	CalculateLod();
+		void	CreateLodEntities();
+		/// Draws all loaded terrains through one TerrainRenderQueue
 		void	Render();
+		/// Draw the terrains as wireframe, the ones loaded later as well
+		void	enableWireframe(bool b);
+		bool	isWireframe() const { return mWireframe; }
+		/// LOD work of the last update summed over the loaded terrains. @see Terrain::getLodStats
+		Terrain::LodStats	getLodStats() const;
+		/** Per frame update in the main thread, before CalculateLod().
+		@remarks Loads the terrains prepared in the background since the last call,
+			then runs the paging if there is one.
+		*/
+		void	UpdatePaging(const Camera& cam);
 
 		/** Retrieve a shared structure which will provide the base settings for
 			all terrains created via this group.
@@ -223,8 +238,11 @@ namespace Neo
 		@param x, y The coordinates of the terrain slot relative to the centre slot (signed).
 		@param synchronous Whether we should force this to happen entirely in the
 			primary thread (default false, operations are threaded if possible)
+		@param lodLevel The LOD level to load, see Terrain::load. Clamped to the coarsest level.
+		@remarks When not synchronous the terrain is prepared by a job and only
+			loaded by the UpdatePaging() that follows its completion.
 		*/
-		virtual void loadTerrain(long x, long y, bool synchronous = false);
+		virtual void loadTerrain(long x, long y, bool synchronous = false, int lodLevel = 0);
 		
 		/** Unload a specific terrain slot.
 		@remarks
@@ -297,8 +315,13 @@ namespace Neo
 			TerrainSlotDefinition def;
 			/// Actual terrain instance
 			Terrain* instance;
+			/// Background preparation of instance
+			SJobCounter prepareJobs;
+			bool prepareSucceeded;
+			/// LOD level to load once prepared
+			int loadLodLevel;
 
-			TerrainSlot(long _x, long _y) : x(_x), y(_y), instance(0) {}
+			TerrainSlot(long _x, long _y) : x(_x), y(_y), instance(0), prepareSucceeded(false), loadLodLevel(0) {}
 			virtual ~TerrainSlot();
 			void freeInstance();
 		};
@@ -341,6 +364,12 @@ namespace Neo
 		@see Terrain::updateDerivedData
 		*/
 		void updateDerivedData(bool synchronous = false, uint8 typeMask = 0xFF);
+
+		/** Re-bake the lightmap of all terrains which have one, e.g. after the light
+			direction has changed. The work is done in the background.
+		@see TerrainGlobalOptions::setLightMapDirection
+		*/
+		void dirtyLightmaps();
 		
 		/** Result from a terrain ray intersection with the terrain group. 
 		*/
@@ -353,6 +382,8 @@ namespace Neo
 			/// Position at which the intersection occurred
 			VEC3 position;
 
+			RayResult()
+				: hit(false), terrain(0), position(VEC3::ZERO) {}
 			RayResult(bool _hit, Terrain* _terrain, const VEC3& _pos)
 				: hit(_hit), terrain(_terrain), position(_pos) {}
 		};
@@ -385,6 +416,12 @@ namespace Neo
 		 the terrain data occurs.
 		 */
 		RayResult rayIntersects(const RAY& ray, float distanceLimit = 0) const; 
+
+		/** Batched version of rayIntersects, pResults[i] is the result of pRays[i].
+		@remarks The rays are spread over the job system threads, use this for the
+			many queries of a frame (line of sight, projectiles) rather than one call per ray.
+		*/
+		void rayIntersects(const RAY* pRays, uint32 nRays, RayResult* pResults, float distanceLimit = 0) const;
 		
 		typedef std::vector<Terrain*> TerrainList; 
 		/** Test intersection of a box with the terrain. 
@@ -472,9 +509,18 @@ namespace Neo
 		static const uint16 CHUNK_VERSION;
 
 		/// Loads terrain's next LOD level.
-		//void increaseLodLevel(long x, long y, bool synchronous = false);
-		///// Removes terrain's highest LOD level.
-		//void decreaseLodLevel(long x, long y);
+		void increaseLodLevel(long x, long y, bool synchronous = false);
+		/// Removes terrain's highest LOD level.
+		void decreaseLodLevel(long x, long y);
+
+		/** Set the paging which loads and unloads the terrain slots around the camera.
+		@remarks The group takes ownership of the paging, null stops paging.
+		*/
+		void setPaging(TerrainPaging* paging);
+		TerrainPaging* getPaging() const { return mPaging; }
+
+		/// The vertex and index buffer pool shared by all terrains of the group
+		Terrain::DefaultGpuBufferAllocator& getGpuBufferAllocator() { return mBufferAllocator; }
 
 		//void setAutoUpdateLod(TerrainAutoUpdateLod* updater);
 		///// Automatically checks if terrain's LOD level needs to be updated.
@@ -492,6 +538,11 @@ namespace Neo
 		STRING mFilenamePrefix;
 		STRING mFilenameExtension;
 		//TerrainAutoUpdateLod *mAutoUpdateLod;
+		TerrainPaging* mPaging;
+		TerrainRenderQueue* mRenderQueue;
+		bool mWireframe;
+		/// Slots whose terrain is prepared by a job, loaded by processLoadResponses()
+		std::vector<TerrainSlot*> mLoadingSlots;
 		Terrain::DefaultGpuBufferAllocator mBufferAllocator;
 		
 		/// Get the position of a terrain instance
@@ -500,8 +551,18 @@ namespace Neo
 		TerrainSlot* getTerrainSlot(long x, long y, bool createIfMissing);
 		TerrainSlot* getTerrainSlot(long x, long y) const;
 		void connectNeighbour(TerrainSlot* slot, long offsetx, long offsety);
-
-		void loadTerrainImpl(TerrainSlot* slot, bool synchronous);
+		/// Slot range covered by loaded terrains, false if there is none
+		bool getLoadedSlotRange(long* minX, long* minY, long* maxX, long* maxY) const;
+		/// rayIntersects walking the slots of the given range
+		RayResult rayIntersectsSlots(const RAY& ray, float distanceLimit, long minX, long minY, long maxX, long maxY) const;
+
+		void loadTerrainImpl(TerrainSlot* slot, bool synchronous, int lodLevel = 0);
+		/// Background part of a load, prepare the terrain of the slot from its definition
+		void handleLoadRequest(TerrainSlot* slot);
+		/// Main thread part, load the prepared terrain and hook it up with its neighbours
+		void handleLoadResponse(TerrainSlot* slot, bool synchronous);
+		/// Load the terrains whose preparation has finished
+		void processLoadResponses();
 
 		/// Structure for holding the load request
 		struct LoadRequest
@@ -8,6 +8,7 @@
 #ifndef TerrainLodManager_h__
 #define TerrainLodManager_h__
 
+#include "JobSystem.h"
 
 namespace Neo
 {
@@ -22,6 +23,10 @@ namespace Neo
 	/** Terrain LOD data manager
 	@par
 		This class is used for managing terrain LOD data's loading, unloading.
+	@par
+		A terrain prepared from a file only holds its coarsest LOD at first, finer
+		LODs are read from their own chunks by a background job. The main thread
+		copies them into the terrain and hands them to the GPU in processLoadResponse().
 	*/
 
 	class TerrainLodManager
@@ -59,7 +64,8 @@ namespace Neo
 		};
 	public:
         TerrainLodManager(Terrain* t);
-        TerrainLodManager(Terrain* t, const STRING& filename);
+        /// Stream the LOD data of the terrain chunk found at nOffset in filename
+        TerrainLodManager(Terrain* t, const STRING& filename, uint32 nOffset = 0);
         virtual ~TerrainLodManager();
 
 		static const uint16 WORKQUEUE_LOAD_LOD_DATA_REQUEST;
@@ -69,8 +75,12 @@ namespace Neo
 		//virtual void handleResponse(const WorkQueue::Response* res, const WorkQueue* srcQ);
 
 		void updateToLodLevel(int lodLevel, bool synchronous = false);
+		/// Finish a LOD load if its job is done, returns immediately otherwise. Main thread only.
+		void processLoadResponse();
 		/// Save each LOD level separately compressed so seek is possible
-	//	static void saveLodData(StreamSerialiser& stream, Terrain* terrain);
+		static void saveLodData(StreamSerialiser& stream, Terrain* terrain);
+		/// Skip the LOD chunks written by saveLodData
+		static void skipLodData(StreamSerialiser& stream, uint16 numLodLevels);
 
 		/** Copy geometry data from buffer to mHeightData/mDeltaData
 		  @param lodLevel A LOD level to work with
@@ -82,11 +92,14 @@ namespace Neo
 		/** Read separated geometry data from file into allocated memory
 		  @param lowerLodBound Lower bound of LOD levels to load
           @param higherLodBound Upper bound of LOD levels to load
-		  @remarks Geometry data are uncompressed using inflate() and stored into
-			    allocated buffer
+		  @param lods Receives the uncompressed geometry data of each level read, see fillBufferAtLod()
+		  @remarks Doesn't touch the terrain, so it's safe in a background thread
+		  @return false if the file couldn't be read
 		  */
-		void readLodData(uint16 lowerLodBound, uint16 higherLodBound);
+		bool readLodData(uint16 lowerLodBound, uint16 higherLodBound, LodsData& lods);
 		void waitForDerivedProcesses();
+		/// Whether LOD data is streamed from a file
+		bool hasLodFile() const { return !mFilename.empty(); }
 
 		int getHighestLodPrepared(){ return mHighestLodPrepared; }
 		int getHighestLodLoaded(){ return mHighestLodLoaded; }
@@ -101,6 +114,10 @@ namespace Neo
 	private:
 		void init();
 		void buildLodInfoTable();
+		/// Background part of a LOD load, reads mLoadRequest's LODs into mLoadedLods
+		void handleRequest();
+		/// Main thread part, fill the terrain and create the vertex data of the loaded LODs, then issue the next load
+		void handleResponse();
 
 		/** Separate geometry data by LOD level
 		@param data A geometry data to separate i.e. mHeightData/mDeltaData
@@ -122,9 +139,14 @@ namespace Neo
 		static void separateData(float* data, uint16 size, uint16 numLodLevels, LodsData& lods );
 	private:
 		Terrain* mTerrain;
-	//	DataStreamPtr mDataStream;
-		size_t mStreamOffset;
+		STRING mFilename;
+		uint32 mStreamOffset;	/// Offset of the terrain chunk in mFilename
 		uint16 mWorkQueueChannel;
+		/// The load in flight, only touched by the job while mLoadJobs is pending
+		LoadLodRequest mLoadRequest;
+		LodsData mLoadedLods;
+		bool mLoadSucceeded;
+		SJobCounter mLoadJobs;
 
 		LodInfo* mLodInfoTable;
 		int mTargetLodLevel;    /// Which LOD level is demanded
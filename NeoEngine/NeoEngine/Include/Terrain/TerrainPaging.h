@@ -0,0 +1,116 @@
+/********************************************************************
+	created:	2016/11/04 10:30
+	filename	TerrainPaging.h
+	author:		maval
+
+	purpose:	Loads and unloads the slots of a TerrainGroup around the camera.
+*********************************************************************/
+#ifndef TerrainPaging_h__
+#define TerrainPaging_h__
+
+#include "Terrain/TerrainGroup.h"
+
+namespace Neo
+{
+	/** \addtogroup Optional Components
+	*  @{
+	*/
+	/** \addtogroup Terrain
+	*  Some details on the terrain paging
+	*  @{
+	*/
+
+	/** Camera driven paging of the slots of a TerrainGroup.
+	@remarks
+		Slots within the load radius of the camera slot are prepared in the background
+		and loaded, nearest first, and the slots in front of the camera before those
+		behind it. A terrain is only unloaded once its slot is further than the hold
+		radius, so moving back and forth over a slot border doesn't reload anything.
+	@par
+		While a memory budget is set no load is started that would exceed it, unless
+		terrains further away than the one to load can be unloaded to make room.
+	@par
+		Each paged terrain streams its LOD levels through its TerrainLodManager: the
+		slots nearer than the LOD distance hold all levels and every LOD distance
+		further one level less.
+	@note
+		Only slots defined from a file are paged. A terrain defined from import data
+		would be lost once unloaded (@see TerrainGroup::unloadTerrain).
+	*/
+	class TerrainPaging
+	{
+	public:
+		TerrainPaging(TerrainGroup* group);
+		~TerrainPaging();
+
+		/// Page the slots around the camera, main thread only. @see TerrainGroup::UpdatePaging
+		void update(const Camera& cam);
+
+		/** Set the radii around the camera slot, in slots.
+		@param loadRadius Slots within this distance are loaded
+		@param holdRadius Loaded slots are kept up to this distance, at least loadRadius
+		*/
+		void setPageRadius(float loadRadius, float holdRadius);
+		float getLoadRadius() const { return mLoadRadius; }
+		float getHoldRadius() const { return mHoldRadius; }
+
+		/// Memory the terrains of the group may use in bytes, 0 for no limit. @see Terrain::getMemoryUsage
+		void setMemoryBudget(size_t bytes);
+		size_t getMemoryBudget() const { return mMemoryBudget; }
+		/// Memory used by the terrains of the group at the last update, including the loads in flight
+		size_t getMemoryUsage() const { return mMemoryUsage; }
+
+		/// How many terrains may be prepared in the background at the same time
+		void setMaxConcurrentLoads(uint32 n);
+		uint32 getMaxConcurrentLoads() const { return mMaxConcurrentLoads; }
+
+		/** Distance in slots over which a terrain drops one LOD level.
+		@remarks 0 keeps every paged terrain at full detail.
+		*/
+		void setLodDistance(float slots);
+		float getLodDistance() const { return mLodDistance; }
+
+	private:
+		struct SPageSlot
+		{
+			TerrainGroup::TerrainSlot* slot;
+			/// Distance to the camera slot
+			float distance;
+			/// Distance to the camera weighted by the view direction, lower loads first
+			float priority;
+
+			bool operator< (const SPageSlot& rhs) const { return priority < rhs.priority; }
+		};
+
+		/// LOD level a terrain at this distance should have, not clamped to the levels of the terrain
+		int		calculateLodLevel(float distance) const;
+		/// Memory a terrain which isn't loaded yet is assumed to need
+		size_t	estimateTerrainMemory() const;
+		/// Fill the buffer pool of the group for the slots within the hold radius
+		void	warmStart();
+
+		TerrainGroup*	mGroup;
+		float			mLoadRadius;
+		float			mHoldRadius;
+		float			mLodDistance;
+		size_t			mMemoryBudget;
+		size_t			mMemoryUsage;
+		/// Largest Terrain::getMemoryUsage seen so far
+		size_t			mTerrainMemory;
+		uint32			mMaxConcurrentLoads;
+
+		long			mCameraSlotX;
+		long			mCameraSlotY;
+		/// Work is left that a later update has to finish even if the camera slot stays the same
+		bool			mPending;
+		/// The buffer pool of the group holds the vertex data of all slots within the hold radius
+		bool			mWarmStarted;
+		/// Vertex format the pool was warmed with
+		bool			mWarmCompact;
+
+		std::vector<SPageSlot>	mLoadCandidates;
+		std::vector<SPageSlot>	mLoadedSlots;
+	};
+}
+
+#endif // TerrainPaging_h__
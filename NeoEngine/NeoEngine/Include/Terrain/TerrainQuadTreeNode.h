@@ -3,6 +3,7 @@
 
 #include "MathDef.h"
 #include "AABB.h"
+#include "Terrain/Terrain.h"
 
 namespace Neo
 {
@@ -22,13 +23,12 @@ namespace Neo
 			uint16 xoff, uint16 yoff, uint16 size, uint16 lod, uint16 depth, uint16 quadrant);
 		virtual ~TerrainQuadTreeNode();
 
-		void CreateEntity();
-		void Render();
-
 		/// Get the horizontal offset into the main terrain data of this node
 		uint16 getXOffset() const { return mOffsetX; }
 		/// Get the vertical offset into the main terrain data of this node
 		uint16 getYOffset() const { return mOffsetY; }
+		/// Get the number of vertices along one side of this node at the highest LOD
+		uint16 getSize() const { return mSize; }
 		/// Is this a leaf node (no children)
 		bool isLeaf() const;
 		/// Get the base LOD level this node starts at (the highest LOD it handles)
@@ -45,7 +45,7 @@ namespace Neo
 		/// Prepare node and children (perform CPU tasks, may be background thread)
 		void prepare();
 		/// Prepare node from a stream
-	//	void prepare(StreamSerialiser& stream);
+		void prepare(StreamSerialiser& stream);
 		/// Load node and children (perform GPU tasks, will be render thread)
 		void load();
 		/// Load node and children in a depth range (perform GPU tasks, will be render thread)
@@ -58,7 +58,7 @@ namespace Neo
 		/// Unprepare node and children (perform CPU tasks, may be background thread)
 		void unprepare();
 		/// Save node to a stream
-	//	void save(StreamSerialiser& stream);
+		void save(StreamSerialiser& stream);
 
 		struct LodLevel
 		{
@@ -69,7 +69,8 @@ namespace Neo
 			uint32 nIndexCount;
 			/// Maximum delta height between this and the next lower lod
 			float maxHeightDelta;
-			/// Temp calc area for max height delta
+			/// Temp calc area for max height delta, written by the derived data job
+			/// and promoted to maxHeightDelta in finaliseDeltaValues()
 			float calcMaxHeightDelta;
 			/// The most recently calculated transition distance
 			float lastTransitionDist;
@@ -97,7 +98,25 @@ namespace Neo
 		/** Notify the node (and children) of a height delta value. */
 		void notifyDelta(uint16 x, uint16 y, uint16 lod, float delta);
 
+		/** Collect this node and its children which handle a given lod and overlap a rect.
+		@remarks
+			Each node owns its own LodLevel, so the collected nodes can be passed
+			to notifyDeltas() from different threads.
+		*/
+		void getNodesForLod(uint16 lod, const Rect& rect, std::vector<TerrainQuadTreeNode*>& outNodes);
+
+		/** Notify this node only of a field of height deltas for one lod.
+		@remarks
+			Has the same effect as calling notifyDelta() for each point of the field,
+			without walking down the tree once per point.
+		@param rect The area covered by the field, [left, right) x [top, bottom) in vertices
+		@param deltas One value per vertex of rect, row by row
+		*/
+		void notifyDeltas(uint16 lod, const Rect& rect, const float* deltas);
+
 		/** Notify the node (and children) that deltas have finished being calculated.
+		@remarks
+			Like the deltas, the child with the max delta only goes live in finaliseDeltaValues().
 		*/
 		void postDeltaCalculation(const Rect& rect);
 
@@ -166,11 +185,22 @@ namespace Neo
 		float getMaxHeight() const;
 
 		/** Calculate appropriate LOD for this node and children
-		@param cam The camera to be used (this should already be the LOD camera)
+		@remarks
+			Each node remembers how far the camera may move before its LOD, or that of
+			any of its children, could change. Subtrees the camera stayed within that
+			distance of keep the LOD of the last call without being visited.
 		@param cFactor The cFactor which incorporates the viewport size, max pixel error and lod bias
+		@param camPos The camera position relative to the terrain position
+		@param force Evaluate every node, the cached results are out of date
+		@param stats Counts the work done
 		@return true if this node or any of its children were selected for rendering
 		*/
-		bool calculateCurrentLod(float cFactor);
+		bool calculateCurrentLod(float cFactor, const VEC3& camPos, bool force, Terrain::LodStats& stats);
+
+		/** Add the nodes rendered at the current LOD which are in the view frustum to a draw list.
+		@param terrainPos The terrain position, the bounds are relative to it
+		*/
+		void buildDrawList(Camera& cam, const VEC3& terrainPos, Terrain::DrawList& drawList, Terrain::LodStats& stats);
 
 		/// Get the current LOD index (only valid after calculateCurrentLod)
 		int getCurrentLod() const { return mCurrentLod; }
@@ -185,13 +215,21 @@ namespace Neo
 		/// Manually set the current LOD transition state, intended for internal use only
 		void setLodTransition(float t);
 
-		Entity* getEntity() { return mEntity; }
-		void enableWireframe(bool b);
+		/** The buffers and index count to draw this node at a LOD. @see TerrainRenderQueue
+		@param ppVertexBuf The buffer the shader reads the vertices from, baseVertex the first of this node's vertex data
+		@param heightRange Lowest height and height range the compact vertices are quantized to
+		@return false if the vertex or index data isn't loaded
+		*/
+		bool getRenderData(uint16 lod, ShaderResourceBuffer** ppVertexBuf, uint32& baseVertex,
+			IndexBuffer** ppIndexBuf, uint32& nIndexCount, VEC2& heightRange) const;
+
+		/// Shader resource slot of the vertex data buffer, read by the vertex shader
+		static unsigned short VERTEX_DATA_SLOT;
+		/// Buffer binding used for holding the per patch instance data. @see STerrainPatchInstance
+		static unsigned short PATCH_BUFFER;
 
-		/// Buffer binding used for holding positions
-		static unsigned short POSITION_BUFFER;
-		/// Buffer binding used for holding delta values
-		static unsigned short DELTA_BUFFER;
+		/// Number of vertices of a vertex data set of size vertices per side shared by treeLevels levels, skirts included
+		static size_t _getNumVertices(uint16 size, uint16 treeLevels);
 
 	protected:
 		Terrain* mTerrain;
@@ -199,8 +237,6 @@ namespace Neo
 		TerrainQuadTreeNode* mChildren[4];
 		LodLevelList mLodLevels;
 
-		Entity*	mEntity;
-
 		uint16 mOffsetX, mOffsetY;
 		uint16 mBoundaryX, mBoundaryY;
 		/// The number of vertices at the original terrain resolution this node encompasses
@@ -215,7 +251,13 @@ namespace Neo
 		float mLodTransition; /// 0-1 transition to lower LOD
 		/// The child with the largest height delta 
 		TerrainQuadTreeNode* mChildWithMaxHeightDelta;
+		/// Temp calc area for mChildWithMaxHeightDelta, see calcMaxHeightDelta
+		TerrainQuadTreeNode* mCalcChildWithMaxHeightDelta;
 		bool mSelfOrChildRendered;
+		/// Camera position of the last LOD evaluation, relative to the terrain position
+		VEC3 mLodCameraPos;
+		/// Distance the camera may move from mLodCameraPos before the LOD of this subtree could change, -1 = unknown
+		float mLodSlack;
 
 		struct VertexDataRecord
 		{
@@ -223,8 +265,9 @@ namespace Neo
 			void*		cpuVertexDeltaData;
 			uint32		cpuVertexCount;
 
-			VertexBuffer*	gpuPosVertexBuf;
-			VertexBuffer*	gpuDeltaVertexBuf;
+			/// Shared with other vertex data, ours starts at gpuBaseVertex
+			ShaderResourceBuffer*	gpuVertexBuf;
+			uint32		gpuBaseVertex;
 
 			/// Resolution of the data compared to the base terrain data (NOT number of vertices!)
 			uint16 resolution;
@@ -238,12 +281,15 @@ namespace Neo
 			uint16 skirtRowColSkip;
 			/// Is the GPU vertex data out of date?
 			bool gpuVertexDataDirty;
+			/// Lowest height and height range the compact GPU vertices are quantized to
+			float minHeight;
+			float heightRange;
 
 			VertexDataRecord(uint16 res, uint16 sz, uint16 lvls) 
 				: cpuVertexPosData(0), cpuVertexDeltaData(0), resolution(res), size(sz),
-				cpuVertexCount(0), gpuPosVertexBuf(0), gpuDeltaVertexBuf(0),
+				cpuVertexCount(0), gpuVertexBuf(0), gpuBaseVertex(0),
 				treeLevels(lvls), numSkirtRowsCols(0),
-                skirtRowColSkip(0), gpuVertexDataDirty(false) {}
+                skirtRowColSkip(0), gpuVertexDataDirty(false), minHeight(0), heightRange(1) {}
 		};
 		
 		TerrainQuadTreeNode* mNodeWithVertexData;
@@ -263,6 +309,8 @@ namespace Neo
 		void createGpuVertexData();
 		void destroyGpuVertexData();
 		void updateGpuVertexData();
+		/// Copy the CPU vertex data to the GPU buffers, quantizing it for compact vertices
+		void uploadVertexData();
 		void createGpuIndexData();
 		void destroyGpuIndexData();
 
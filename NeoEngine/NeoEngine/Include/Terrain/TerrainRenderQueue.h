@@ -0,0 +1,127 @@
+/********************************************************************
+	created:	2016/11/07 14:20
+	filename	TerrainRenderQueue.h
+	author:		maval
+
+	purpose:	Batches the visible patches of one or more terrains into instanced draws.
+*********************************************************************/
+#ifndef TerrainRenderQueue_h__
+#define TerrainRenderQueue_h__
+
+#include "Terrain/Terrain.h"
+#include "VertexData.h"
+
+namespace Neo
+{
+	/** \addtogroup Optional Components
+	*  @{
+	*/
+	/** \addtogroup Terrain
+	*  Some details on the terrain rendering
+	*  @{
+	*/
+
+	/** Draws the draw lists of a set of terrains with as few state changes as possible.
+	@remarks
+		The vertex shader reads the vertices from the vertex data buffers of the
+		GpuBufferAllocator, which hold the vertex data of many nodes, at the base
+		vertex of each patch. The patches are sorted by terrain, vertex data buffer
+		and index buffer, and their parameters (LOD morph, height range of compact
+		vertices, terrain position, base vertex) packed into one instance buffer,
+		uploaded once per render. Each run of patches sharing vertex data buffer and
+		index buffer is a single instanced draw: the index buffers are shared by all
+		nodes at the same position in their vertex data and LOD, so the nodes of a
+		terrain draw with a few instanced draws per LOD. The terrain constants and
+		the material are applied once per terrain.
+	@par
+		The instance buffer is bound and all draws issued through the RenderSystem
+		given to render(), RunTerrainRenderQueueTest() uses a recording one.
+	*/
+	class TerrainRenderQueue
+	{
+	public:
+		TerrainRenderQueue();
+		~TerrainRenderQueue();
+
+		/// Forget the patches of the last render
+		void	clear();
+		/// Queue the draw list of a terrain. @see Terrain::getDrawList
+		void	addTerrain(Terrain* terrain);
+		/// Sort the patches, upload their parameters and draw them
+		void	render(RenderSystem* pRenderSys);
+
+		struct Batch
+		{
+			Terrain*		terrain;
+			ShaderResourceBuffer*	vertexBuf;
+			IndexBuffer*	indexBuf;
+			uint32			numIndices;
+			/// First patch in the instance buffer
+			uint32			firstInstance;
+			uint32			numInstances;
+		};
+		typedef std::vector<Batch> BatchList;
+
+		/// The draws of the last render, in order
+		const BatchList&	getBatches() const { return mBatches; }
+		/// Patches queued
+		uint32				getNumPatches() const { return (uint32)mPatches.size(); }
+
+	private:
+		struct Patch
+		{
+			Terrain*		terrain;
+			ShaderResourceBuffer*	vertexBuf;
+			IndexBuffer*	indexBuf;
+			uint32			numIndices;
+			STerrainPatchInstance	params;
+
+			bool operator< (const Patch& rhs) const
+			{
+				if (terrain != rhs.terrain)
+					return terrain < rhs.terrain;
+				if (vertexBuf != rhs.vertexBuf)
+					return vertexBuf < rhs.vertexBuf;
+				return indexBuf < rhs.indexBuf;
+			}
+
+			bool isSameBatch(const Patch& rhs) const
+			{
+				return terrain == rhs.terrain && vertexBuf == rhs.vertexBuf && indexBuf == rhs.indexBuf;
+			}
+		};
+
+		std::vector<Patch>					mPatches;
+		BatchList							mBatches;
+		/// CPU copy of the instance buffer, as large as the buffer
+		std::vector<STerrainPatchInstance>	mPatchParams;
+		VertexBuffer*						mPatchBuf;
+	};
+
+#if USE_BENCHMARK
+	struct STerrainQueueTestResult
+	{
+		uint32	nTerrains;
+		/// Patches of the draw lists
+		uint32	nPatches;
+		/// DrawIndexed calls recorded
+		uint32	nDraws;
+		/// Patches which weren't drawn exactly once with their vertex data and index buffer
+		uint32	nMismatches;
+	};
+
+	/** Loads a group of nTerrainsPerSide x nTerrainsPerSide bumpy terrains, selects their
+		finest LOD seen from above and renders them through a RenderSystem which only
+		records the draws.
+	@remarks
+		The camera and the max pixel error of the scene are changed during the test and
+		restored afterwards. The terrain materials are created by the renderer, so the
+		engine has to be initialized.
+	@return true if every patch was drawn once and the patches took at most a quarter
+		as many draws
+	*/
+	bool	RunTerrainRenderQueueTest(STerrainQueueTestResult& result, uint16 terrainSize = 513, long nTerrainsPerSide = 2);
+#endif
+}
+
+#endif // TerrainRenderQueue_h__
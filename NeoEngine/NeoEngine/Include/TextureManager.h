@@ -0,0 +1,91 @@
+/********************************************************************
+	created:	2016/11/04 11:20
+	filename	TextureManager.h
+	author:		maval
+
+	purpose:	Texture cache in front of RenderSystem::LoadTexture().
+				Textures are shared by (path, type, usage, sRGB), the manager
+				holds one reference of each, so a texture whose ref count is 1
+				isn't used by any material any more. Those unused ones are kept
+				for reuse until they exceed a byte budget, then released in
+				least recently used order.
+*********************************************************************/
+#ifndef TextureManager_h__
+#define TextureManager_h__
+
+#include "Prerequiestity.h"
+#include "Singleton.h"
+#include "RenderDefine.h"
+
+namespace Neo
+{
+	class TextureManager : public Common::CSingleton<TextureManager>
+	{
+	public:
+		TextureManager();
+		~TextureManager();
+
+		DECLEAR_SINGLETON(TextureManager)
+
+	public:
+		// The texture belongs to the manager, AddRef() it to keep it beyond the next Update(). Null if it failed to load.
+		Texture*		LoadTexture(const STRING& filename, eTextureType type = eTextureType_2D, uint32 usage = 0, bool bSRGB = false);
+		// Async loads go through these two. Returns the texture if it's loaded already, otherwise
+		// reserves its entry for FillTexture() and returns null. LoadTexture() may fill it meanwhile.
+		Texture*		ReserveTexture(const STRING& filename, eTextureType type, uint32 usage, bool bSRGB);
+		// Create the texture of a reserved entry from the file in memory, unless it got one already.
+		// A null pData drops the reservation. Returns the texture of the entry, owned by the manager.
+		Texture*		FillTexture(const STRING& filename, eTextureType type, uint32 usage, bool bSRGB, const void* pData, uint32 nSize);
+		// Release unused textures over the budget, call once a frame.
+		void			Update();
+		// Bytes of unused textures kept around for reuse
+		void			SetUnusedBudget(uint32 nBytes) { m_nUnusedBudget = nBytes; }
+		uint32			GetUnusedBudget() const { return m_nUnusedBudget; }
+		uint32			GetResidentBytes() const { return m_nResidentBytes; }
+		uint32			GetTextureCount() const { return m_textures.size(); }
+		void			Clear();
+
+	private:
+		struct STextureKey
+		{
+			bool operator== (const STextureKey& rhs) const
+			{
+				return type == rhs.type && usage == rhs.usage && bSRGB == rhs.bSRGB && filename == rhs.filename;
+			}
+
+			STRING			filename;
+			eTextureType	type;
+			uint32			usage;
+			bool			bSRGB;
+		};
+
+		struct STextureKeyHash
+		{
+			size_t operator() (const STextureKey& key) const
+			{
+				return std::hash<STRING>()(key.filename) ^ ((size_t)key.type << 1) ^ ((size_t)key.usage << 5) ^ (size_t)key.bSRGB;
+			}
+		};
+
+		struct STextureEntry
+		{
+			Texture*		pTexture;		// Null while only reserved
+			uint32			nBytes;
+			uint32			nLastUsed;		// m_nTick when it was last requested or referenced
+			uint32			nReserved;		// Async loads not filled yet
+		};
+
+		typedef std::unordered_map<STextureKey, STextureEntry, STextureKeyHash>	TextureContainer;
+
+		TextureContainer::iterator	_GetEntry(const STRING& filename, eTextureType type, uint32 usage, bool bSRGB);
+		// Does nothing if the load failed and pTexture is null
+		void			_SetTexture(STextureEntry& entry, Texture* pTexture);
+
+		TextureContainer	m_textures;
+		uint32				m_nResidentBytes;
+		uint32				m_nUnusedBudget;
+		uint32				m_nTick;
+	};
+}
+
+#endif // TextureManager_h__
@@ -10,6 +10,7 @@
 #define Common_h__
 
 #include <random>
+#include <chrono>
 
 inline std::string	GetResPath(const std::string& filename)
 {
@@ -44,6 +45,16 @@ inline float RandomRange(float fMin, float fMax, int range)
 	return fMin + (fMax - fMin) * RandomFloat(range);
 }
 
+// Wall time of running func once, in milliseconds
+template<class Func>
+inline double TimeMs(Func func)
+{
+	const auto start = std::chrono::high_resolution_clock::now();
+	func();
+	const std::chrono::duration<double, std::milli> elapsed = std::chrono::high_resolution_clock::now() - start;
+	return elapsed.count();
+}
+
 // swap variables of any type
 template<typename Type>
 inline void Swap(Type &A, Type &B)
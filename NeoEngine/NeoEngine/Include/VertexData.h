@@ -47,19 +47,44 @@ namespace Neo
 		SColor	color;
 	};
 
-	/////////	Stream 0 as terrain vb0
+	/////////	Terrain CPU vertex data, positions
 	struct STerrainPosVertex 
 	{
 		short	pos[2];
 		float	height;
 	};
 
-	/////////	Stream 1 as terrain vb1
+	/////////	Terrain CPU vertex data, deltas
 	struct STerrainDeltaVertex 
 	{
 		VEC2	delta;
 	};
 
+	/////////	Terrain vertex read by the shader from the vertex data buffer
+	struct STerrainVertex
+	{
+		short	pos[2];
+		float	height;
+		VEC2	delta;
+	};
+
+	/////////	Compact terrain vertex read by the shader from the vertex data buffer
+	struct STerrainCompactVertex
+	{
+		short	pos[2];
+		uint16	height;		// unorm over the height range of the vertex data
+		uint16	delta;		// low 12 bits: snorm delta over the same range, high 4 bits: LOD threshold + 1
+	};
+
+	/////////	Stream 0 as terrain per patch instance data, the only stream of the terrain
+	struct STerrainPatchInstance
+	{
+		VEC2	lodMorph;		// transition to the next lower LOD, global LOD the vertices drop out at
+		VEC2	heightRange;	// lowest height and height range of compact vertices
+		VEC3	offset;			// terrain position
+		uint32	baseVertex;		// first vertex of the vertex data of the patch in the vertex data buffer
+	};
+
 	/////////	Stream 1 as instanced data
 	struct SInstancedData 
 	{
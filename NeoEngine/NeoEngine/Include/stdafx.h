@@ -30,6 +30,10 @@
 #include <functional>
 #include <memory>
 #include <limits>
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
 // OIS
 #include <OIS.h>
@@ -39,6 +39,12 @@ namespace Common
 
 	void AxisAlignBBox::Transform( const MAT44& matrix )
 	{
+		if (matrix.IsAffine())
+		{
+			TransformAffine(matrix);
+			return;
+		}
+
 		VEC3 oldMin, oldMax, currentCorner;
 
 		// Getting the old values so that we can use the existing merge method.
@@ -89,6 +95,74 @@ namespace Common
 		Merge( Common::Transform_Vec3_By_Mat44(currentCorner, matrix, true).GetVec3() ); 
 	}
 	//------------------------------------------------------------------------------------
+	void AxisAlignBBox::TransformAffine(const MAT44& matrix)
+	{
+		_AST(matrix.IsAffine());
+
+		// A null box stays null
+		if (IsNull())
+		{
+			return;
+		}
+
+#if USE_SIMD == 1
+		const __m128 vHalf = _mm_set_ps1(0.5f);
+		const __m128 vMin = _mm_set_ps(0, m_minCorner.z, m_minCorner.y, m_minCorner.x);
+		const __m128 vMax = _mm_set_ps(0, m_maxCorner.z, m_maxCorner.y, m_maxCorner.x);
+		const __m128 vCenter = _mm_mul_ps(_mm_add_ps(vMin, vMax), vHalf);
+		const __m128 vExtent = _mm_mul_ps(_mm_sub_ps(vMax, vMin), vHalf);
+
+		// Clear the sign bit for |matrix|
+		const __m128 vAbsMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+		const __m128 r0 = _mm_loadu_ps(matrix.m_arr[0]);
+		const __m128 r1 = _mm_loadu_ps(matrix.m_arr[1]);
+		const __m128 r2 = _mm_loadu_ps(matrix.m_arr[2]);
+		const __m128 r3 = _mm_loadu_ps(matrix.m_arr[3]);
+
+		__m128 vNewCenter = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(vCenter, vCenter, _MM_SHUFFLE(0,0,0,0)), r0),
+					   _mm_mul_ps(_mm_shuffle_ps(vCenter, vCenter, _MM_SHUFFLE(1,1,1,1)), r1)),
+			_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(vCenter, vCenter, _MM_SHUFFLE(2,2,2,2)), r2), r3));
+		__m128 vNewExtent = _mm_add_ps(
+			_mm_add_ps(_mm_mul_ps(_mm_shuffle_ps(vExtent, vExtent, _MM_SHUFFLE(0,0,0,0)), _mm_and_ps(r0, vAbsMask)),
+					   _mm_mul_ps(_mm_shuffle_ps(vExtent, vExtent, _MM_SHUFFLE(1,1,1,1)), _mm_and_ps(r1, vAbsMask))),
+			_mm_mul_ps(_mm_shuffle_ps(vExtent, vExtent, _MM_SHUFFLE(2,2,2,2)), _mm_and_ps(r2, vAbsMask)));
+
+		VEC4 newMin, newMax, radius;
+		Common::m128_to_vec4(newMin, _mm_sub_ps(vNewCenter, vNewExtent));
+		Common::m128_to_vec4(newMax, _mm_add_ps(vNewCenter, vNewExtent));
+
+		// Lane 3 is 0 in vNewExtent, so the dot of the 4 lanes is the squared length
+		__m128 vLenSq = _mm_mul_ps(vNewExtent, vNewExtent);
+		vLenSq = _mm_add_ps(vLenSq, _mm_shuffle_ps(vLenSq, vLenSq, 0x4E));
+		vLenSq = _mm_add_ps(vLenSq, _mm_shuffle_ps(vLenSq, vLenSq, 0xB1));
+		_mm_store_ss(&m_boundingRadius, _mm_sqrt_ss(vLenSq));
+
+		m_minCorner.Set(newMin.x, newMin.y, newMin.z);
+		m_maxCorner.Set(newMax.x, newMax.y, newMax.z);
+#else
+		const VEC3 vCenter = GetCenter(), vExtent = GetSize() * 0.5f;
+		const float center[3] = { vCenter.x, vCenter.y, vCenter.z };
+		const float extent[3] = { vExtent.x, vExtent.y, vExtent.z };
+		VEC3 newCenter(matrix.m30, matrix.m31, matrix.m32), newExtent(0, 0, 0);
+
+		for (int i = 0; i < 3; ++i)
+		{
+			newCenter.x += center[i] * matrix.m_arr[i][0];
+			newCenter.y += center[i] * matrix.m_arr[i][1];
+			newCenter.z += center[i] * matrix.m_arr[i][2];
+
+			newExtent.x += extent[i] * fabsf(matrix.m_arr[i][0]);
+			newExtent.y += extent[i] * fabsf(matrix.m_arr[i][1]);
+			newExtent.z += extent[i] * fabsf(matrix.m_arr[i][2]);
+		}
+
+		m_minCorner = newCenter - newExtent;
+		m_maxCorner = newCenter + newExtent;
+		m_boundingRadius = newExtent.GetLength();
+#endif
+	}
+	//------------------------------------------------------------------------------------
 	void AxisAlignBBox::SetNull()
 	{
 		m_minCorner.Set(10000,10000,10000);
@@ -122,5 +196,82 @@ namespace Common
 		pPoints[6].Set(m_maxCorner.x, m_maxCorner.y, m_minCorner.z);
 		pPoints[7].Set(m_maxCorner.x, m_maxCorner.y, m_maxCorner.z);
 	}
+	//------------------------------------------------------------------------------------
+	AABBArray::AABBArray()
+		: m_minX(nullptr), m_minY(nullptr), m_minZ(nullptr)
+		, m_maxX(nullptr), m_maxY(nullptr), m_maxZ(nullptr)
+		, m_pData(nullptr)
+		, m_nCount(0)
+		, m_nCapacity(0)
+	{
+
+	}
+	//------------------------------------------------------------------------------------
+	AABBArray::~AABBArray()
+	{
+		if (m_pData)
+		{
+			_aligned_free(m_pData);
+			m_pData = nullptr;
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void AABBArray::Resize(uint32 nCount)
+	{
+		m_nCount = nCount;
+
+		// Always keep one extra group of 4, so unaligned 4-wide loads never run off the end.
+		const uint32 nCapacity = ((nCount + 3) & ~3) + 4;
+
+		if (nCapacity <= m_nCapacity)
+		{
+			return;
+		}
+
+		float* pData = (float*)_aligned_malloc(nCapacity * 6 * sizeof(float), 16);
+
+		// Padding lanes are null boxes (min > max), they fail any culling test.
+		for (uint32 i = 0; i < nCapacity; ++i)
+		{
+			pData[nCapacity * 0 + i] = pData[nCapacity * 1 + i] = pData[nCapacity * 2 + i] = 10000;
+			pData[nCapacity * 3 + i] = pData[nCapacity * 4 + i] = pData[nCapacity * 5 + i] = -10000;
+		}
+
+		if (m_pData)
+		{
+			for (uint32 iStream = 0; iStream < 6; ++iStream)
+			{
+				memcpy(pData + nCapacity * iStream, m_pData + m_nCapacity * iStream, m_nCapacity * sizeof(float));
+			}
+			_aligned_free(m_pData);
+		}
+
+		m_pData = pData;
+		m_nCapacity = nCapacity;
+
+		m_minX = m_pData;
+		m_minY = m_pData + nCapacity;
+		m_minZ = m_pData + nCapacity * 2;
+		m_maxX = m_pData + nCapacity * 3;
+		m_maxY = m_pData + nCapacity * 4;
+		m_maxZ = m_pData + nCapacity * 5;
+	}
+	//------------------------------------------------------------------------------------
+	void AABBArray::Set(uint32 i, const AxisAlignBBox& aabb)
+	{
+		m_minX[i] = aabb.m_minCorner.x;
+		m_minY[i] = aabb.m_minCorner.y;
+		m_minZ[i] = aabb.m_minCorner.z;
+		m_maxX[i] = aabb.m_maxCorner.x;
+		m_maxY[i] = aabb.m_maxCorner.y;
+		m_maxZ[i] = aabb.m_maxCorner.z;
+	}
+	//------------------------------------------------------------------------------------
+	void AABBArray::Get(uint32 i, AxisAlignBBox& aabb) const
+	{
+		aabb.SetNull();
+		aabb.Merge(VEC3(m_minX[i], m_minY[i], m_minZ[i]));
+		aabb.Merge(VEC3(m_maxX[i], m_maxY[i], m_maxZ[i]));
+	}
 
 }
\ No newline at end of file
@@ -3,6 +3,7 @@
 #include "Renderer.h"
 #include "Mesh.h"
 #include "Material.h"
+#include "Octree.h"
 
 namespace Neo
 {
@@ -16,8 +17,13 @@ namespace Neo
 		, m_bCastShadow(false)
 		, m_bReceiveShadow(true)
 		, m_bUpdateAABB(bUpdateAABB)
+		, m_bBoundsDirty(true)
 		, m_pCustomRenderData(nullptr)
 		, m_pMaterial(nullptr)
+		, m_pOctree(nullptr)
+		, m_iOctreeNode(0)
+		, m_iOctreeSlot(0)
+		, m_bOctreePending(false)
 	{
 		SetVisible(true);
 
@@ -29,6 +35,11 @@ namespace Neo
 	//------------------------------------------------------------------------------------
 	Entity::~Entity()
 	{
+		if (m_pOctree)
+		{
+			m_pOctree->Remove(this);
+		}
+
 		SAFE_RELEASE(m_pMaterial);
 		SAFE_DELETE(m_pCustomRenderData);
 	}
@@ -37,24 +48,28 @@ namespace Neo
 	{
 		m_position = pos;
 		m_bMatrixInvalid = true;
+		m_bBoundsDirty = true;
 	}
 	//------------------------------------------------------------------------------------
 	void Entity::SetRotation( const QUATERNION& quat )
 	{
 		m_rotation = quat;
 		m_bMatrixInvalid = true;
+		m_bBoundsDirty = true;
 	}
 	//------------------------------------------------------------------------------------
 	void Entity::SetScale( float scale )
 	{
 		m_scale.Set(scale, scale, scale);
 		m_bMatrixInvalid = true;
+		m_bBoundsDirty = true;
 	}
 	//------------------------------------------------------------------------------------
 	void Entity::SetScale(float x, float y, float z)
 	{
 		m_scale.Set(x, y, z);
 		m_bMatrixInvalid = true;
+		m_bBoundsDirty = true;
 	}
 	//------------------------------------------------------------------------------------
 	void Entity::SetWorldMatrix(const MAT44& mat)
@@ -64,6 +79,7 @@ namespace Neo
 		m_matWorldIT = m_matWorldIT.Transpose();
 
 		m_bMatrixInvalid = false;
+		m_bBoundsDirty = true;
 	}
 	//------------------------------------------------------------------------------------
 	const MAT44& Entity::GetWorldMatrix()
@@ -178,15 +194,75 @@ namespace Neo
 		return m_pMaterial;
 	}
 	//------------------------------------------------------------------------------------
-	void Entity::UpdateAABB()
+	bool Entity::_UpdateWorldAABB()
 	{
 		_UpdateTransform();
 
 		//Χ
-		if (m_bUpdateAABB)
+		if (m_bUpdateAABB && m_bBoundsDirty)
 		{
 			m_worldAABB = m_localAABB;
 			m_worldAABB.Transform(m_matWorld);
+			m_bBoundsDirty = false;
+
+			return true;
+		}
+
+		return false;
+	}
+	//------------------------------------------------------------------------------------
+	void Entity::UpdateAABB()
+	{
+		// Let the octree relocate us if we left our node.
+		if (_UpdateWorldAABB() && m_pOctree)
+		{
+			if (m_pOctree->IsDeferringUpdates())
+			{
+				m_bOctreePending = true;
+			}
+			else
+			{
+				m_pOctree->Update(this);
+			}
+		}
+	}
+	//------------------------------------------------------------------------------------
+	uint32 Entity::UpdateWorldAABBs(Entity** ppEntities, uint32 nCount, Common::AABBArray& bounds)
+	{
+		_AST(bounds.GetCount() >= nCount);
+
+		uint32 nPending = 0;
+
+		for (uint32 i = 0; i < nCount; ++i)
+		{
+			Entity* pEntity = ppEntities[i];
+
+			if (pEntity->_UpdateWorldAABB() && pEntity->m_pOctree)
+			{
+				pEntity->m_bOctreePending = true;
+			}
+
+			if (pEntity->m_bOctreePending)
+			{
+				++nPending;
+			}
+
+			bounds.Set(i, pEntity->m_worldAABB);
+		}
+
+		return nPending;
+	}
+	//------------------------------------------------------------------------------------
+	void Entity::FlushOctreeUpdate()
+	{
+		if (m_bOctreePending)
+		{
+			m_bOctreePending = false;
+
+			if (m_pOctree)
+			{
+				m_pOctree->Update(this);
+			}
 		}
 	}
 
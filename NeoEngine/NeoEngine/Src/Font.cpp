@@ -6,6 +6,7 @@
 #include "Mesh.h"
 #include "Entity.h"
 #include "MaterialManager.h"
+#include "TextureManager.h"
 
 
 namespace Neo
@@ -150,7 +151,7 @@ namespace Neo
 	{
 		m_pMaterial = MaterialManager::GetSingleton().NewMaterial("Mtl_Font");
 		m_pMaterial->AddRef();
-		m_pMaterial->SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("Font.dds")));
+		m_pMaterial->SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("Font.dds")));
 		m_pMaterial->InitShader(("Font"), eShader_UI);
 	}
 }
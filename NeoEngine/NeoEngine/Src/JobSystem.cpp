@@ -0,0 +1,372 @@
+#include "stdafx.h"
+#include "JobSystem.h"
+
+namespace Neo
+{
+	// Index of the work queue owned by the current thread, 0 for the main thread.
+	static __declspec(thread) uint32 t_iWorkQueue = 0;
+
+	//------------------------------------------------------------------------------------
+	JobSystem::JobSystem()
+		: m_nQueuedJobs(0)
+		, m_bQuit(false)
+		, m_iFirstBackgroundQueue(1)
+		, m_bQuitBackground(false)
+		, m_bSingleThreaded(false)
+	{
+		m_queues.push_back(new SWorkQueue);
+	}
+	//------------------------------------------------------------------------------------
+	JobSystem::~JobSystem()
+	{
+		Shutdown();
+
+		for (uint32 i = 0; i < m_queues.size(); ++i)
+		{
+			SAFE_DELETE(m_queues[i]);
+		}
+		m_queues.clear();
+	}
+	//------------------------------------------------------------------------------------
+	void JobSystem::Init(uint32 nWorkers, uint32 nBackgroundThreads)
+	{
+		_AST(m_workers.empty());
+
+#if USE_MULTITHREAD
+		if (nWorkers == 0)
+		{
+			const uint32 nHardware = std::thread::hardware_concurrency();
+			nWorkers = nHardware > 1 ? nHardware - 1 : 0;
+		}
+#else
+		nWorkers = 0;
+#endif
+
+		// Without workers everything runs inline anyway
+		if (nWorkers == 0)
+		{
+			nBackgroundThreads = 0;
+		}
+
+		m_bQuit = false;
+		m_bQuitBackground = false;
+		m_iFirstBackgroundQueue = nWorkers + 1;
+
+		for (uint32 i = 0; i < nWorkers + nBackgroundThreads; ++i)
+		{
+			m_queues.push_back(new SWorkQueue);
+		}
+
+		for (uint32 i = 0; i < nWorkers; ++i)
+		{
+			m_workers.push_back(std::thread(&JobSystem::_WorkerMain, this, i + 1));
+		}
+
+		for (uint32 i = 0; i < nBackgroundThreads; ++i)
+		{
+			m_backgroundThreads.push_back(std::thread(&JobSystem::_BackgroundMain, this, m_iFirstBackgroundQueue + i));
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void JobSystem::Shutdown()
+	{
+		if (m_workers.empty())
+		{
+			return;
+		}
+
+		// Background threads finish the jobs queued so far, somebody may wait on them.
+		// They go first since their ParallelFor() needs the workers.
+		{
+			std::lock_guard<std::mutex> guard(m_backgroundLock);
+			m_bQuitBackground = true;
+		}
+		m_backgroundWakeUp.notify_all();
+
+		for (uint32 i = 0; i < m_backgroundThreads.size(); ++i)
+		{
+			m_backgroundThreads[i].join();
+		}
+		m_backgroundThreads.clear();
+
+		{
+			std::lock_guard<std::mutex> guard(m_sleepLock);
+			m_bQuit = true;
+		}
+		m_wakeUp.notify_all();
+
+		for (uint32 i = 0; i < m_workers.size(); ++i)
+		{
+			m_workers[i].join();
+		}
+		m_workers.clear();
+
+		for (uint32 i = 1; i < m_queues.size(); ++i)
+		{
+			_AST(m_queues[i]->jobs.empty());
+			SAFE_DELETE(m_queues[i]);
+		}
+		m_queues.resize(1);
+		m_iFirstBackgroundQueue = 1;
+	}
+	//------------------------------------------------------------------------------------
+	void JobSystem::Run(const JobFunc& func, SJobCounter* pCounter)
+	{
+		if (IsSingleThreaded())
+		{
+			func();
+			return;
+		}
+
+		++pCounter->nPending;
+
+		SJob job;
+		job.func = func;
+		job.pCounter = pCounter;
+
+		SWorkQueue* pQueue = m_queues[t_iWorkQueue];
+		{
+			std::lock_guard<std::mutex> guard(pQueue->lock);
+			pQueue->jobs.push_back(job);
+		}
+
+		// Taking the lock makes sure a worker going to sleep can't miss this job
+		{
+			std::lock_guard<std::mutex> guard(m_sleepLock);
+			++m_nQueuedJobs;
+		}
+		m_wakeUp.notify_one();
+	}
+	//------------------------------------------------------------------------------------
+	void JobSystem::RunBackground(const JobFunc& func, SJobCounter* pCounter)
+	{
+		if (IsSingleThreaded() || m_backgroundThreads.empty())
+		{
+			func();
+			return;
+		}
+
+		++pCounter->nPending;
+
+		SJob job;
+		job.func = func;
+		job.pCounter = pCounter;
+
+		// Not counted in m_nQueuedJobs, the workers can't take it
+		{
+			std::lock_guard<std::mutex> guard(m_backgroundLock);
+			m_backgroundJobs.push_back(job);
+		}
+		m_backgroundWakeUp.notify_one();
+	}
+	//------------------------------------------------------------------------------------
+	void JobSystem::Wait(SJobCounter* pCounter)
+	{
+		while (pCounter->nPending > 0)
+		{
+			if (!_ExecuteOne(t_iWorkQueue))
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void JobSystem::ParallelFor(uint32 nCount, uint32 nGrain, const RangeJobFunc& func)
+	{
+		_AST(nGrain > 0);
+
+		if (IsSingleThreaded() || nCount <= nGrain)
+		{
+			for (uint32 nBegin = 0; nBegin < nCount; nBegin += nGrain)
+			{
+				func(nBegin, Min(nBegin + nGrain, nCount));
+			}
+			return;
+		}
+
+		SJobCounter counter;
+
+		for (uint32 nBegin = 0; nBegin < nCount; nBegin += nGrain)
+		{
+			const uint32 nEnd = Min(nBegin + nGrain, nCount);
+			Run([&func, nBegin, nEnd]() { func(nBegin, nEnd); }, &counter);
+		}
+
+		Wait(&counter);
+	}
+	//------------------------------------------------------------------------------------
+	void JobSystem::_WorkerMain(uint32 iQueue)
+	{
+		t_iWorkQueue = iQueue;
+
+		for (;;)
+		{
+			if (_ExecuteOne(iQueue))
+			{
+				continue;
+			}
+
+			std::unique_lock<std::mutex> lock(m_sleepLock);
+			m_wakeUp.wait(lock, [this]() { return m_nQueuedJobs > 0 || m_bQuit; });
+
+			if (m_bQuit)
+			{
+				return;
+			}
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void JobSystem::_BackgroundMain(uint32 iQueue)
+	{
+		// Jobs issued by a background job go to its own queue, where the workers steal them
+		t_iWorkQueue = iQueue;
+
+		for (;;)
+		{
+			SJob job;
+			{
+				std::unique_lock<std::mutex> lock(m_backgroundLock);
+				m_backgroundWakeUp.wait(lock, [this]() { return !m_backgroundJobs.empty() || m_bQuitBackground; });
+
+				if (m_backgroundJobs.empty())
+				{
+					return;
+				}
+
+				job = m_backgroundJobs.front();
+				m_backgroundJobs.pop_front();
+			}
+
+			job.func();
+			--job.pCounter->nPending;
+		}
+	}
+	//------------------------------------------------------------------------------------
+	bool JobSystem::_ExecuteOne(uint32 iQueue)
+	{
+		SJob job;
+
+		if (!_Pop(iQueue, job) && !_Steal(iQueue, job))
+		{
+			return false;
+		}
+
+		--m_nQueuedJobs;
+
+		job.func();
+		--job.pCounter->nPending;
+
+		return true;
+	}
+	//------------------------------------------------------------------------------------
+	bool JobSystem::_Pop(uint32 iQueue, SJob& job)
+	{
+		SWorkQueue* pQueue = m_queues[iQueue];
+		std::lock_guard<std::mutex> guard(pQueue->lock);
+
+		if (pQueue->jobs.empty())
+		{
+			return false;
+		}
+
+		// Newest first, its data is most likely still in cache
+		job = pQueue->jobs.back();
+		pQueue->jobs.pop_back();
+
+		return true;
+	}
+	//------------------------------------------------------------------------------------
+	bool JobSystem::_Steal(uint32 iQueue, SJob& job)
+	{
+		const uint32 nQueue = m_queues.size();
+
+		for (uint32 i = 1; i < nQueue; ++i)
+		{
+			const uint32 iVictim = (iQueue + i) % nQueue;
+
+			// The main thread leaves background work alone, it would stall the frame
+			if (iQueue == 0 && iVictim >= m_iFirstBackgroundQueue)
+			{
+				continue;
+			}
+
+			SWorkQueue* pVictim = m_queues[iVictim];
+			std::lock_guard<std::mutex> guard(pVictim->lock);
+
+			if (!pVictim->jobs.empty())
+			{
+				// Oldest first, usually the biggest piece of work left
+				job = pVictim->jobs.front();
+				pVictim->jobs.pop_front();
+
+				return true;
+			}
+		}
+
+		return false;
+	}
+	//------------------------------------------------------------------------------------
+	JobGraph::TaskID JobGraph::AddTask(const JobFunc& func)
+	{
+		STask task;
+		task.func = func;
+		task.nDeps = 0;
+		m_tasks.push_back(task);
+
+		return m_tasks.size() - 1;
+	}
+	//------------------------------------------------------------------------------------
+	void JobGraph::AddDependency(TaskID task, TaskID dependsOn)
+	{
+		_AST(task < m_tasks.size() && dependsOn < m_tasks.size() && task != dependsOn);
+
+		m_tasks[dependsOn].successors.push_back(task);
+		++m_tasks[task].nDeps;
+	}
+	//------------------------------------------------------------------------------------
+	void JobGraph::Execute()
+	{
+		const uint32 nTask = m_tasks.size();
+
+		m_pendingDeps.reset(new std::atomic<int>[nTask]);
+		for (uint32 i = 0; i < nTask; ++i)
+		{
+			m_pendingDeps[i] = m_tasks[i].nDeps;
+		}
+
+		JobSystem& jobSys = JobSystem::GetSingleton();
+		SJobCounter counter;
+
+		// Kick off the roots, the rest is started by their last finished dependency
+		for (uint32 i = 0; i < nTask; ++i)
+		{
+			if (m_tasks[i].nDeps == 0)
+			{
+				jobSys.Run([this, i, &counter]() { _RunTask(i, &counter); }, &counter);
+			}
+		}
+
+		jobSys.Wait(&counter);
+
+		m_pendingDeps.reset();
+	}
+	//------------------------------------------------------------------------------------
+	void JobGraph::_RunTask(TaskID id, SJobCounter* pCounter)
+	{
+		const STask& task = m_tasks[id];
+		task.func();
+
+		// Successors are queued before this job retires, so the counter can't hit zero early
+		JobSystem& jobSys = JobSystem::GetSingleton();
+
+		for (uint32 i = 0; i < task.successors.size(); ++i)
+		{
+			const TaskID succ = task.successors[i];
+
+			if (--m_pendingDeps[succ] == 0)
+			{
+				jobSys.Run([this, succ, pCounter]() { _RunTask(succ, pCounter); }, pCounter);
+			}
+		}
+	}
+}
@@ -313,6 +313,12 @@ namespace Neo
 			retMacros.push_back(macro);
 		}
 
+		if (m_vertType == eVertexType_TerrainCompact)
+		{
+			D3D_SHADER_MACRO macro = { "COMPACT_VERTEX", "" };
+			retMacros.push_back(macro);
+		}
+
 		if (m_vertType == eVertexType_NormalMap && m_shaderType != eShader_Fur)
 		{
 			D3D_SHADER_MACRO macro = { "NORMAL_MAP", "" };
@@ -1,5 +1,6 @@
 #include "stdafx.h"
 #include "MaterialManager.h"
+#include "TextureManager.h"
 #include "Material.h"
 #include "Texture.h"
 #include "Renderer.h"
@@ -10,7 +11,7 @@ namespace Neo
 	MaterialManager::MaterialManager()
 	{
 		Material* pMaterial = NewMaterial("Mtl_DefaultWhite");
-		pMaterial->SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("White1x1.dds")));
+		pMaterial->SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("White1x1.dds")));
 		pMaterial->InitShader(("Opaque"), eShader_Opaque);
 	}
 	//------------------------------------------------------------------------------------
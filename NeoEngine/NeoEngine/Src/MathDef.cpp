@@ -34,16 +34,6 @@ namespace Common
 		result = Transform_Vec4_By_Mat44(pt, mat);
 	}
 
-	Common::Vector4 Transform_Vec4_By_Mat44( const Vector4& pt, const Matrix44& mat )
-	{
-		return Vector4(
-			mat.m_arr[0][0] * pt.x + mat.m_arr[1][0] * pt.y + mat.m_arr[2][0] * pt.z + mat.m_arr[3][0] * pt.w, 
-			mat.m_arr[0][1] * pt.x + mat.m_arr[1][1] * pt.y + mat.m_arr[2][1] * pt.z + mat.m_arr[3][1] * pt.w,
-			mat.m_arr[0][2] * pt.x + mat.m_arr[1][2] * pt.y + mat.m_arr[2][2] * pt.z + mat.m_arr[3][2] * pt.w,
-			mat.m_arr[0][3] * pt.x + mat.m_arr[1][3] * pt.y + mat.m_arr[2][3] * pt.z + mat.m_arr[3][3] * pt.w
-			);
-	}
-
 	//////////////////////////////////////////////////////////////////////////////////////////////
 	void Matrix44::MakeIdentity()
 	{
@@ -60,10 +50,11 @@ namespace Common
 
 	Matrix44 Matrix44::Transpose() const
 	{
-		return Matrix44(	m00, m10, m20, m30,
-							m01, m11, m21, m31,
-							m02, m12, m22, m32,
-							m03, m13, m23, m33);
+#if USE_SIMD == 1
+		return SIMD::Transpose(*this);
+#else
+		return Scalar::Transpose(*this);
+#endif
 	}
 
 	void Matrix44::FromAxisAngle( const Vector3& axis, float angle )
@@ -134,12 +125,29 @@ namespace Common
 	}
 
 	Matrix44 Matrix44::Inverse() const
+	{
+#if USE_SIMD == 1
+		return SIMD::Inverse(*this);
+#else
+		return Scalar::Inverse(*this);
+#endif
+	}
+
+	Matrix44 Scalar::Transpose(const Matrix44& mat)
+	{
+		return Matrix44(	mat.m00, mat.m10, mat.m20, mat.m30,
+							mat.m01, mat.m11, mat.m21, mat.m31,
+							mat.m02, mat.m12, mat.m22, mat.m32,
+							mat.m03, mat.m13, mat.m23, mat.m33);
+	}
+
+	Matrix44 Scalar::Inverse(const Matrix44& mat)
 	{
 		//from ogre
-		float m00 = m_arr[0][0], m01 = m_arr[0][1], m02 = m_arr[0][2], m03 = m_arr[0][3];
-		float m10 = m_arr[1][0], m11 = m_arr[1][1], m12 = m_arr[1][2], m13 = m_arr[1][3];
-		float m20 = m_arr[2][0], m21 = m_arr[2][1], m22 = m_arr[2][2], m23 = m_arr[2][3];
-		float m30 = m_arr[3][0], m31 = m_arr[3][1], m32 = m_arr[3][2], m33 = m_arr[3][3];
+		float m00 = mat.m_arr[0][0], m01 = mat.m_arr[0][1], m02 = mat.m_arr[0][2], m03 = mat.m_arr[0][3];
+		float m10 = mat.m_arr[1][0], m11 = mat.m_arr[1][1], m12 = mat.m_arr[1][2], m13 = mat.m_arr[1][3];
+		float m20 = mat.m_arr[2][0], m21 = mat.m_arr[2][1], m22 = mat.m_arr[2][2], m23 = mat.m_arr[2][3];
+		float m30 = mat.m_arr[3][0], m31 = mat.m_arr[3][1], m32 = mat.m_arr[3][2], m33 = mat.m_arr[3][3];
 
 		float v0 = m20 * m31 - m21 * m30;
 		float v1 = m20 * m32 - m22 * m30;
@@ -196,6 +204,91 @@ namespace Common
 			d30, d31, d32, d33);
 	}
 
+	Matrix44 SIMD::Inverse(const Matrix44& mat)
+	{
+		// Cramer's rule, from Intel "Streaming SIMD Extensions - Inverse of 4x4 Matrix"
+		const float* src = mat.m_arr[0];
+		__m128 minor0, minor1, minor2, minor3;
+		__m128 row0, row1, row2, row3;
+		__m128 det, tmp1;
+
+		// Transposed, with rows 1 and 3 rotated by 2
+		tmp1 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(src)), (const __m64*)(src + 4));
+		row1 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(src + 8)), (const __m64*)(src + 12));
+		row0 = _mm_shuffle_ps(tmp1, row1, 0x88);
+		row1 = _mm_shuffle_ps(row1, tmp1, 0xDD);
+		tmp1 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(src + 2)), (const __m64*)(src + 6));
+		row3 = _mm_loadh_pi(_mm_loadl_pi(_mm_setzero_ps(), (const __m64*)(src + 10)), (const __m64*)(src + 14));
+		row2 = _mm_shuffle_ps(tmp1, row3, 0x88);
+		row3 = _mm_shuffle_ps(row3, tmp1, 0xDD);
+
+		tmp1 = _mm_mul_ps(row2, row3);
+		tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+		minor0 = _mm_mul_ps(row1, tmp1);
+		minor1 = _mm_mul_ps(row0, tmp1);
+		tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+		minor0 = _mm_sub_ps(_mm_mul_ps(row1, tmp1), minor0);
+		minor1 = _mm_sub_ps(_mm_mul_ps(row0, tmp1), minor1);
+		minor1 = _mm_shuffle_ps(minor1, minor1, 0x4E);
+
+		tmp1 = _mm_mul_ps(row1, row2);
+		tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+		minor0 = _mm_add_ps(_mm_mul_ps(row3, tmp1), minor0);
+		minor3 = _mm_mul_ps(row0, tmp1);
+		tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+		minor0 = _mm_sub_ps(minor0, _mm_mul_ps(row3, tmp1));
+		minor3 = _mm_sub_ps(_mm_mul_ps(row0, tmp1), minor3);
+		minor3 = _mm_shuffle_ps(minor3, minor3, 0x4E);
+
+		tmp1 = _mm_mul_ps(_mm_shuffle_ps(row1, row1, 0x4E), row3);
+		tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+		row2 = _mm_shuffle_ps(row2, row2, 0x4E);
+		minor0 = _mm_add_ps(_mm_mul_ps(row2, tmp1), minor0);
+		minor2 = _mm_mul_ps(row0, tmp1);
+		tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+		minor0 = _mm_sub_ps(minor0, _mm_mul_ps(row2, tmp1));
+		minor2 = _mm_sub_ps(_mm_mul_ps(row0, tmp1), minor2);
+		minor2 = _mm_shuffle_ps(minor2, minor2, 0x4E);
+
+		tmp1 = _mm_mul_ps(row0, row1);
+		tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+		minor2 = _mm_add_ps(_mm_mul_ps(row3, tmp1), minor2);
+		minor3 = _mm_sub_ps(_mm_mul_ps(row2, tmp1), minor3);
+		tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+		minor2 = _mm_sub_ps(_mm_mul_ps(row3, tmp1), minor2);
+		minor3 = _mm_sub_ps(minor3, _mm_mul_ps(row2, tmp1));
+
+		tmp1 = _mm_mul_ps(row0, row3);
+		tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+		minor1 = _mm_sub_ps(minor1, _mm_mul_ps(row2, tmp1));
+		minor2 = _mm_add_ps(_mm_mul_ps(row1, tmp1), minor2);
+		tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+		minor1 = _mm_add_ps(_mm_mul_ps(row2, tmp1), minor1);
+		minor2 = _mm_sub_ps(minor2, _mm_mul_ps(row1, tmp1));
+
+		tmp1 = _mm_mul_ps(row0, row2);
+		tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0xB1);
+		minor1 = _mm_add_ps(_mm_mul_ps(row3, tmp1), minor1);
+		minor3 = _mm_sub_ps(minor3, _mm_mul_ps(row1, tmp1));
+		tmp1 = _mm_shuffle_ps(tmp1, tmp1, 0x4E);
+		minor1 = _mm_sub_ps(minor1, _mm_mul_ps(row3, tmp1));
+		minor3 = _mm_add_ps(_mm_mul_ps(row1, tmp1), minor3);
+
+		// A true division instead of rcp, to stay close to the scalar path
+		det = _mm_mul_ps(row0, minor0);
+		det = _mm_add_ps(_mm_shuffle_ps(det, det, 0x4E), det);
+		det = _mm_add_ss(_mm_shuffle_ps(det, det, 0xB1), det);
+		det = _mm_div_ss(_mm_set_ss(1.0f), det);
+		det = _mm_shuffle_ps(det, det, 0x00);
+
+		Matrix44 ret;
+		_mm_storeu_ps(ret.m_arr[0], _mm_mul_ps(det, minor0));
+		_mm_storeu_ps(ret.m_arr[1], _mm_mul_ps(det, minor1));
+		_mm_storeu_ps(ret.m_arr[2], _mm_mul_ps(det, minor2));
+		_mm_storeu_ps(ret.m_arr[3], _mm_mul_ps(det, minor3));
+		return ret;
+	}
+
 	void Quaternion::FromAxisAngle( const Vector3& axis, float angle )
 	{
 		float fHalfRadin = Angle_To_Radian(angle * 0.5f);
@@ -219,6 +312,15 @@ namespace Common
 	}
 
 	Quaternion Quaternion::Slerp(float fT, const Quaternion& rkP, const Quaternion& rkQ, bool shortestPath)
+	{
+#if USE_SIMD == 1
+		return SIMD::Slerp(fT, rkP, rkQ, shortestPath);
+#else
+		return Scalar::Slerp(fT, rkP, rkQ, shortestPath);
+#endif
+	}
+
+	Quaternion Scalar::Slerp(float fT, const Quaternion& rkP, const Quaternion& rkQ, bool shortestPath)
 	{
 		float fCos = rkP.Dot(rkQ);
 		Quaternion rkT;
@@ -259,6 +361,61 @@ namespace Common
 		}
 	}
 
+	Quaternion SIMD::Slerp(float fT, const Quaternion& rkP, const Quaternion& rkQ, bool shortestPath)
+	{
+		// w,x,y,z are contiguous, the lanes are in that order
+		const __m128 vP = _mm_loadu_ps(&rkP.w);
+		__m128 vQ = _mm_loadu_ps(&rkQ.w);
+
+		__m128 vDot = _mm_mul_ps(vP, vQ);
+		vDot = _mm_add_ps(vDot, _mm_shuffle_ps(vDot, vDot, 0x4E));
+		vDot = _mm_add_ps(vDot, _mm_shuffle_ps(vDot, vDot, 0xB1));
+
+		float fCos;
+		_mm_store_ss(&fCos, vDot);
+
+		// Do we need to invert rotation?
+		if (fCos < 0.0f && shortestPath)
+		{
+			fCos = -fCos;
+			vQ = _mm_sub_ps(_mm_setzero_ps(), vQ);
+		}
+
+		float fCoeff0, fCoeff1;
+		const bool bLinear = fabsf(fCos) >= 1 - 1e-03;
+
+		if (!bLinear)
+		{
+			// Standard case (slerp)
+			float fSin = sqrtf(1 - fCos * fCos);
+			float fAngle = atan2(fSin, fCos);
+			float fInvSin = 1.0f / fSin;
+			fCoeff0 = sinf((1.0f - fT) * fAngle) * fInvSin;
+			fCoeff1 = sinf(fT * fAngle) * fInvSin;
+		}
+		else
+		{
+			// Close or opposite, see Scalar::Slerp()
+			fCoeff0 = 1.0f - fT;
+			fCoeff1 = fT;
+		}
+
+		__m128 vResult = _mm_add_ps(_mm_mul_ps(_mm_set_ps1(fCoeff0), vP), _mm_mul_ps(_mm_set_ps1(fCoeff1), vQ));
+
+		if (bLinear)
+		{
+			// taking the complement requires renormalisation
+			__m128 vLenSq = _mm_mul_ps(vResult, vResult);
+			vLenSq = _mm_add_ps(vLenSq, _mm_shuffle_ps(vLenSq, vLenSq, 0x4E));
+			vLenSq = _mm_add_ps(vLenSq, _mm_shuffle_ps(vLenSq, vLenSq, 0xB1));
+			vResult = _mm_div_ps(vResult, _mm_sqrt_ps(vLenSq));
+		}
+
+		Quaternion ret;
+		_mm_storeu_ps(&ret.w, vResult);
+		return ret;
+	}
+
 	void Quaternion::FromRotationMatrix(const Matrix44& kRot)
 	{
 		// Algorithm in Ken Shoemake's article in 1987 SIGGRAPH course notes
@@ -329,6 +486,15 @@ namespace Common
 		return kRot;
 	}
 
+	Vector3 Quaternion::Rotate(const Vector3& v) const
+	{
+		// v + 2w(u x v) + 2u x (u x v), u is the vector part
+		const Vector3 u(x, y, z);
+		const Vector3 t = CrossProduct_Vec3_By_Vec3(u, v) * 2.0f;
+
+		return v + t * w + CrossProduct_Vec3_By_Vec3(u, t);
+	}
+
 	void Plane::Redefine(const Vector3& _n, const Vector3& _p)
 	{
 		n = _n;
@@ -381,6 +547,44 @@ namespace Common
 		return DotProduct_Vec3_By_Vec3(v, n) + d;
 	}
 
+	bool Ray::Intersects(const AxisAlignBBox& aabb, float& tNear, float& tFar) const
+	{
+		const float* pOrigin = &m_origin.x;
+		const float* pDir = &m_dir.x;
+		const float* pMin = &aabb.m_minCorner.x;
+		const float* pMax = &aabb.m_maxCorner.x;
+
+		tNear = 0;
+		tFar = FLT_MAX;
+
+		for (int i = 0; i < 3; ++i)
+		{
+			if (pDir[i] == 0)
+			{
+				// Parallel to the slab
+				if (pOrigin[i] < pMin[i] || pOrigin[i] > pMax[i])
+					return false;
+
+				continue;
+			}
+
+			const float fInvDir = 1.0f / pDir[i];
+			float t0 = (pMin[i] - pOrigin[i]) * fInvDir;
+			float t1 = (pMax[i] - pOrigin[i]) * fInvDir;
+
+			if (t0 > t1)
+				std::swap(t0, t1);
+
+			tNear = Max(tNear, t0);
+			tFar = Min(tFar, t1);
+
+			if (tNear > tFar)
+				return false;
+		}
+
+		return true;
+	}
+
 
 	bool Vector3::DirectionEqual(const Vector3& dir, float fToleraceRadian) const
 	{
@@ -516,6 +720,229 @@ namespace Common
 		// all tests passed - intersection occurs
 		return true;
 	}
-}
+	//------------------------------------------------------------------------------------
+	void Transform_Vec3Array_By_Mat44(Vector4* pOut, const Vector3* pIn, uint32 nCount, const Matrix44& mat, bool bPosOrDir)
+	{
+		const float w = bPosOrDir ? 1.0f : 0.0f;
+#if USE_SIMD == 1
+		const __m128 r0 = _mm_loadu_ps(mat.m_arr[0]);
+		const __m128 r1 = _mm_loadu_ps(mat.m_arr[1]);
+		const __m128 r2 = _mm_loadu_ps(mat.m_arr[2]);
+		const __m128 r3 = _mm_loadu_ps(mat.m_arr[3]);
+
+		for (uint32 i = 0; i < nCount; ++i)
+		{
+			const __m128 v = _mm_set_ps(w, pIn[i].z, pIn[i].y, pIn[i].x);
+			_mm_storeu_ps(&pOut[i].x, SIMD::TransformRow(v, r0, r1, r2, r3));
+		}
+#else
+		for (uint32 i = 0; i < nCount; ++i)
+		{
+			pOut[i] = Scalar::Transform_Vec4_By_Mat44(Vector4(pIn[i], w), mat);
+		}
+#endif
+	}
+	//------------------------------------------------------------------------------------
+	void Transform_Vec4Array_By_Mat44(Vector4* pOut, const Vector4* pIn, uint32 nCount, const Matrix44& mat)
+	{
+#if USE_SIMD == 1
+		const __m128 r0 = _mm_loadu_ps(mat.m_arr[0]);
+		const __m128 r1 = _mm_loadu_ps(mat.m_arr[1]);
+		const __m128 r2 = _mm_loadu_ps(mat.m_arr[2]);
+		const __m128 r3 = _mm_loadu_ps(mat.m_arr[3]);
+
+		for (uint32 i = 0; i < nCount; ++i)
+		{
+			_mm_storeu_ps(&pOut[i].x, SIMD::TransformRow(_mm_loadu_ps(&pIn[i].x), r0, r1, r2, r3));
+		}
+#else
+		for (uint32 i = 0; i < nCount; ++i)
+		{
+			pOut[i] = Scalar::Transform_Vec4_By_Mat44(pIn[i], mat);
+		}
+#endif
+	}
+	//------------------------------------------------------------------------------------
+	void Multiply_Mat44Array_By_Mat44(Matrix44* pOut, const Matrix44* pLhs, const Matrix44* pRhs, uint32 nCount)
+	{
+		for (uint32 i = 0; i < nCount; ++i)
+		{
+#if USE_SIMD == 1
+			SIMD::MultiplyTo(pOut[i], pLhs[i], pRhs[i]);
+#else
+			pOut[i] = Scalar::Multiply_Mat44_By_Mat44(pLhs[i], pRhs[i]);
+#endif
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void Multiply_Mat44Array_By_Mat44(Matrix44* pOut, const Matrix44* pLhs, const Matrix44& rhs, uint32 nCount)
+	{
+#if USE_SIMD == 1
+		// rhs may live in pOut, so its rows are read once before anything is written
+		const __m128 r0 = _mm_loadu_ps(rhs.m_arr[0]);
+		const __m128 r1 = _mm_loadu_ps(rhs.m_arr[1]);
+		const __m128 r2 = _mm_loadu_ps(rhs.m_arr[2]);
+		const __m128 r3 = _mm_loadu_ps(rhs.m_arr[3]);
+
+		for (uint32 i = 0; i < nCount; ++i)
+		{
+			const __m128 l0 = _mm_loadu_ps(pLhs[i].m_arr[0]);
+			const __m128 l1 = _mm_loadu_ps(pLhs[i].m_arr[1]);
+			const __m128 l2 = _mm_loadu_ps(pLhs[i].m_arr[2]);
+			const __m128 l3 = _mm_loadu_ps(pLhs[i].m_arr[3]);
+
+			_mm_storeu_ps(pOut[i].m_arr[0], SIMD::TransformRow(l0, r0, r1, r2, r3));
+			_mm_storeu_ps(pOut[i].m_arr[1], SIMD::TransformRow(l1, r0, r1, r2, r3));
+			_mm_storeu_ps(pOut[i].m_arr[2], SIMD::TransformRow(l2, r0, r1, r2, r3));
+			_mm_storeu_ps(pOut[i].m_arr[3], SIMD::TransformRow(l3, r0, r1, r2, r3));
+		}
+#else
+		const Matrix44 matRhs = rhs;
+
+		for (uint32 i = 0; i < nCount; ++i)
+		{
+			pOut[i] = Scalar::Multiply_Mat44_By_Mat44(pLhs[i], matRhs);
+		}
+#endif
+	}
+#if USE_BENCHMARK
+	//------------------------------------------------------------------------------------
+	namespace
+	{
+		// Difference of n floats, relative to the magnitude when it's above 1
+		float _RelativeError(const float* a, const float* b, uint32 n)
+		{
+			float fErr = 0;
+			for (uint32 i = 0; i < n; ++i)
+			{
+				const float fScale = Max(1.0f, Max(fabsf(a[i]), fabsf(b[i])));
+				fErr = Max(fErr, fabsf(a[i] - b[i]) / fScale);
+			}
+			return fErr;
+		}
+	}
 
+	bool RunMathBenchmark(std::vector<SMathBenchResult>& results, uint32 nCount, float fEpsilon)
+	{
+		results.clear();
 
+		// Random TRS matrices, the usual world and bone transforms
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+
+		std::vector<Matrix44A> vecMat(nCount), vecMat2(nCount);
+		std::vector<Vector4A> vecPt(nCount);
+		std::vector<Vector3> vecPt3(nCount);
+		std::vector<Quaternion> vecQuat(nCount), vecQuat2(nCount);
+		std::vector<float> vecT(nCount);
+
+		for (uint32 i = 0; i < nCount; ++i)
+		{
+			for (int j = 0; j < 2; ++j)
+			{
+				VEC3 axis(dist(rng), dist(rng), dist(rng));
+				if (axis.GetLength() < 1e-2f)
+					axis = VEC3::UNIT_Y;
+				axis.Normalize();
+
+				Quaternion q(axis, dist(rng) * PI);
+				(j == 0 ? vecQuat[i] : vecQuat2[i]) = q;
+
+				Matrix44& mat = (j == 0 ? vecMat[i] : vecMat2[i]);
+				mat.FromQuaternion(q);
+
+				Matrix44 matScale;
+				matScale.SetScale(VEC3(1.5f + dist(rng), 1.5f + dist(rng), 1.5f + dist(rng)));
+				mat = Scalar::Multiply_Mat44_By_Mat44(matScale, mat);
+				mat.SetTranslation(VEC3(dist(rng), dist(rng), dist(rng)) * 100.0f);
+			}
+
+			vecPt3[i].Set(dist(rng) * 100.0f, dist(rng) * 100.0f, dist(rng) * 100.0f);
+			vecPt[i] = Vector4(vecPt3[i], 1.0f);
+			vecT[i] = (dist(rng) + 1.0f) * 0.5f;
+		}
+
+		std::vector<Matrix44A> vecMatScalar(nCount), vecMatSimd(nCount);
+		std::vector<Vector4A> vecPtScalar(nCount), vecPtSimd(nCount);
+		std::vector<Quaternion> vecQuatScalar(nCount), vecQuatSimd(nCount);
+
+		auto matError = [&]() -> float
+		{
+			float fErr = 0;
+			for (uint32 i = 0; i < nCount; ++i)
+				fErr = Max(fErr, _RelativeError(vecMatScalar[i].m_arr[0], vecMatSimd[i].m_arr[0], 16));
+			return fErr;
+		};
+
+		auto ptError = [&]() -> float
+		{
+			float fErr = 0;
+			for (uint32 i = 0; i < nCount; ++i)
+				fErr = Max(fErr, _RelativeError(&vecPtScalar[i].x, &vecPtSimd[i].x, 4));
+			return fErr;
+		};
+
+		auto quatError = [&]() -> float
+		{
+			float fErr = 0;
+			for (uint32 i = 0; i < nCount; ++i)
+				fErr = Max(fErr, _RelativeError(&vecQuatScalar[i].w, &vecQuatSimd[i].w, 4));
+			return fErr;
+		};
+
+		SMathBenchResult res;
+
+		res.name = "Multiply_Mat44_By_Mat44";
+		res.fScalarMs = TimeMs([&]() { for (uint32 i = 0; i < nCount; ++i) vecMatScalar[i] = Scalar::Multiply_Mat44_By_Mat44(vecMat[i], vecMat2[i]); });
+		res.fSimdMs = TimeMs([&]() { for (uint32 i = 0; i < nCount; ++i) vecMatSimd[i] = SIMD::Multiply_Mat44_By_Mat44(vecMat[i], vecMat2[i]); });
+		res.fMaxError = matError();
+		results.push_back(res);
+
+		res.name = "Transform_Vec4_By_Mat44";
+		res.fScalarMs = TimeMs([&]() { for (uint32 i = 0; i < nCount; ++i) vecPtScalar[i] = Scalar::Transform_Vec4_By_Mat44(vecPt[i], vecMat[i]); });
+		res.fSimdMs = TimeMs([&]() { for (uint32 i = 0; i < nCount; ++i) vecPtSimd[i] = SIMD::Transform_Vec4_By_Mat44(vecPt[i], vecMat[i]); });
+		res.fMaxError = ptError();
+		results.push_back(res);
+
+		res.name = "Inverse";
+		res.fScalarMs = TimeMs([&]() { for (uint32 i = 0; i < nCount; ++i) vecMatScalar[i] = Scalar::Inverse(vecMat[i]); });
+		res.fSimdMs = TimeMs([&]() { for (uint32 i = 0; i < nCount; ++i) vecMatSimd[i] = SIMD::Inverse(vecMat[i]); });
+		res.fMaxError = matError();
+		results.push_back(res);
+
+		res.name = "Transpose";
+		res.fScalarMs = TimeMs([&]() { for (uint32 i = 0; i < nCount; ++i) vecMatScalar[i] = Scalar::Transpose(vecMat[i]); });
+		res.fSimdMs = TimeMs([&]() { for (uint32 i = 0; i < nCount; ++i) vecMatSimd[i] = SIMD::Transpose(vecMat[i]); });
+		res.fMaxError = matError();
+		results.push_back(res);
+
+		res.name = "Slerp";
+		res.fScalarMs = TimeMs([&]() { for (uint32 i = 0; i < nCount; ++i) vecQuatScalar[i] = Scalar::Slerp(vecT[i], vecQuat[i], vecQuat2[i], true); });
+		res.fSimdMs = TimeMs([&]() { for (uint32 i = 0; i < nCount; ++i) vecQuatSimd[i] = SIMD::Slerp(vecT[i], vecQuat[i], vecQuat2[i], true); });
+		res.fMaxError = quatError();
+		results.push_back(res);
+
+		// The batch ones go through USE_SIMD, so compare them with per element scalar calls
+		res.name = "Transform_Vec3Array_By_Mat44";
+		res.fScalarMs = TimeMs([&]() { for (uint32 i = 0; i < nCount; ++i) vecPtScalar[i] = Scalar::Transform_Vec4_By_Mat44(Vector4(vecPt3[i], 1.0f), vecMat[0]); });
+		res.fSimdMs = TimeMs([&]() { Transform_Vec3Array_By_Mat44(&vecPtSimd[0], &vecPt3[0], nCount, vecMat[0], true); });
+		res.fMaxError = ptError();
+		results.push_back(res);
+
+		res.name = "Multiply_Mat44Array_By_Mat44";
+		res.fScalarMs = TimeMs([&]() { for (uint32 i = 0; i < nCount; ++i) vecMatScalar[i] = Scalar::Multiply_Mat44_By_Mat44(vecMat[i], vecMat2[0]); });
+		res.fSimdMs = TimeMs([&]() { Multiply_Mat44Array_By_Mat44(&vecMatSimd[0], &vecMat[0], vecMat2[0], nCount); });
+		res.fMaxError = matError();
+		results.push_back(res);
+
+		bool bOk = true;
+		for (uint32 i = 0; i < results.size(); ++i)
+		{
+			if (results[i].fMaxError > fEpsilon)
+				bOk = false;
+		}
+
+		return bOk;
+	}
+#endif
+}
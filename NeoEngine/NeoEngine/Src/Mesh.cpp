@@ -267,19 +267,6 @@ namespace Neo
 		return true;
 	}
 	//------------------------------------------------------------------------------------
-	void SubMesh::InitTerrainVertData(VertexBuffer* posVB, VertexBuffer* deltaVB, IndexBuffer* pIB, uint32 nIndexCount)
-	{
-		_AST(!m_pVertexStream0 && !m_pVertexStream1);
-
-		m_pVertexStream0 = posVB;
-		m_pVertexStream1 = deltaVB;
-		m_pIndexBuf = pIB;
-		m_nIndexCnt = nIndexCount;
-		m_vertData.SetVertType(eVertexType_Terrain);
-
-		m_pVertexStream0->m_vertType = eVertexType_Terrain;
-	}
-	//------------------------------------------------------------------------------------
 	bool SubMesh::InitIndexData(const DWORD* pIdx, int nIdx, bool bStatic)
 	{
 		SAFE_DELETE(m_pIndexBuf);
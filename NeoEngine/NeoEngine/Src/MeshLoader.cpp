@@ -9,31 +9,230 @@ using namespace std;
 
 namespace Neo
 {
+	struct view_unmapper { void operator()(const void* p) { if (p) ::UnmapViewOfFile(p); } };
+
+	typedef std::unique_ptr<const void, view_unmapper> ScopedMapView;
+
+	// Read-only view of a whole file
+	struct SMappedFile
+	{
+		SMappedFile() : nSize(0) {}
+
+		ScopedHandle	hFile;
+		ScopedHandle	hMapping;
+		ScopedMapView	pView;
+		uint32			nSize;
+	};
+
+	static uint32 _AlignOffset(uint32 nOffset)
+	{
+		return (nOffset + MESH_BINARY_ALIGN - 1) & ~(MESH_BINARY_ALIGN - 1);
+	}
+
+	// Map a binary mesh and validate its layout, returns nullptr if it can't be used
+	static const SMeshFileHeader* _MapMeshBinary(const STRING& filename, SMappedFile& file)
+	{
+		file.hFile.reset(safe_handle(::CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr)));
+
+		LARGE_INTEGER fileSize;
+		if (!file.hFile || !::GetFileSizeEx(file.hFile.get(), &fileSize) || fileSize.HighPart != 0 || fileSize.LowPart < sizeof(SMeshFileHeader))
+		{
+			return nullptr;
+		}
+
+		file.nSize = fileSize.LowPart;
+		file.hMapping.reset(::CreateFileMappingA(file.hFile.get(), nullptr, PAGE_READONLY, 0, 0, nullptr));
+		if (!file.hMapping)
+		{
+			return nullptr;
+		}
+
+		file.pView.reset(::MapViewOfFile(file.hMapping.get(), FILE_MAP_READ, 0, 0, 0));
+		if (!file.pView)
+		{
+			return nullptr;
+		}
+
+		const uint32 nFileSize = file.nSize;
+		const SMeshFileHeader* pHeader = static_cast<const SMeshFileHeader*>(file.pView.get());
+
+		if (pHeader->magic != MESH_BINARY_MAGIC || pHeader->version != MESH_BINARY_VERSION ||
+			pHeader->fileSize != nFileSize || pHeader->vertexStride != sizeof(SVertex) ||
+			sizeof(SMeshFileHeader) + pHeader->nSubMesh * sizeof(SSubMeshFileHeader) > nFileSize)
+		{
+			return nullptr;
+		}
+
+		// Every stream must lie inside the file
+		auto IsValidStream = [&](uint32 nOffset, uint32 nBytes) -> bool
+		{
+			return nOffset % MESH_BINARY_ALIGN == 0 && nOffset <= nFileSize && nBytes <= nFileSize - nOffset;
+		};
+
+		const SSubMeshFileHeader* pSubHeaders = reinterpret_cast<const SSubMeshFileHeader*>(pHeader + 1);
+
+		for (uint32 i = 0; i < pHeader->nSubMesh; ++i)
+		{
+			const SSubMeshFileHeader& sub = pSubHeaders[i];
+
+			if (sub.name[MESH_BINARY_NAME_LEN - 1] != 0 || sub.vertOffset == 0 || sub.indexOffset == 0 ||
+				!IsValidStream(sub.vertOffset, sub.nVert * sizeof(SVertex)) ||
+				!IsValidStream(sub.indexOffset, sub.nIndex * sizeof(DWORD)) ||
+				(sub.adjIndexOffset && !IsValidStream(sub.adjIndexOffset, sub.nAdjIndex * sizeof(DWORD))) ||
+				(sub.boneWeightOffset && !IsValidStream(sub.boneWeightOffset, sub.nVert * sizeof(SVertexBoneWeight))) ||
+				(sub.tangentOffset && !IsValidStream(sub.tangentOffset, sub.nVert * sizeof(STangentData))))
+			{
+				return nullptr;
+			}
+		}
+
+		return pHeader;
+	}
+	//------------------------------------------------------------------------------------
+	uint32 MeshLoader::SMeshData::GetByteSize() const
+	{
+		uint32 nBytes = 0;
+
+		for (uint32 i = 0; i < subMeshes.size(); ++i)
+		{
+			const SSubMeshData& sub = subMeshes[i];
+
+			nBytes += sub.vecVertex.size() * sizeof(SVertex);
+			nBytes += (sub.vecIndex.size() + sub.vecAdjIndex.size()) * sizeof(DWORD);
+			nBytes += sub.vecBoneWeights.size() * sizeof(SVertexBoneWeight);
+			nBytes += sub.vecTangents.size() * sizeof(STangentData);
+		}
+
+		return nBytes;
+	}
+	//------------------------------------------------------------------------------------
 	Mesh* MeshLoader::LoadMesh(const STRING& filename, bool bMaterial, SkeletonAnim** pSkelAnim)
 	{
-		TiXmlDocument doc;
-		if(!doc.LoadFile(filename.c_str()))
+		const STRING binFilename = GetBinaryFilename(filename);
+
+		if (binFilename == filename || ::GetFileAttributesA(binFilename.c_str()) != INVALID_FILE_ATTRIBUTES)
+		{
+			return _LoadMeshBinary(binFilename, pSkelAnim);
+		}
+
+		SMeshData data;
+		if (!_ParseXml(filename, bMaterial, data))
 		{
 			throw std::logic_error("Failed to load mesh file!");
 			return nullptr;
 		}
 
-		bool bSaveMesh = false;
+		Mesh* pMesh = CreateMesh(filename, data);
+
+		if (!data.skeletonLink.empty() && pSkelAnim)
+		{
+			*pSkelAnim = LoadSkeleton(data.skeletonLink);
+		}
+
+		return pMesh;
+	}
+	//------------------------------------------------------------------------------------
+	bool MeshLoader::LoadMeshData(const STRING& filename, SMeshData& data)
+	{
+		const STRING binFilename = GetBinaryFilename(filename);
+
+		if (binFilename != filename && ::GetFileAttributesA(binFilename.c_str()) == INVALID_FILE_ATTRIBUTES)
+		{
+			return _ParseXml(filename, false, data);
+		}
+
+		SMappedFile file;
+		const SMeshFileHeader* pHeader = _MapMeshBinary(binFilename, file);
+		if (!pHeader)
+		{
+			return false;
+		}
+
+		const char* pData = static_cast<const char*>(file.pView.get());
+		const SSubMeshFileHeader* pSubHeaders = reinterpret_cast<const SSubMeshFileHeader*>(pHeader + 1);
+
+		data.primType = (ePrimitive)pHeader->primType;
+		data.skeletonLink.assign(pHeader->skeletonLink, strnlen(pHeader->skeletonLink, MESH_BINARY_PATH_LEN));
+		data.subMeshes.resize(pHeader->nSubMesh);
+
+		// The view goes away with this function, so copy the streams out
+		for (uint32 i = 0; i < pHeader->nSubMesh; ++i)
+		{
+			SSubMeshStreams streams;
+			_GetBinaryStreams(pData, pSubHeaders[i], streams);
+
+			SSubMeshData& sub = data.subMeshes[i];
+			sub.name = streams.name;
+			sub.vertType = streams.vertType;
+			sub.vecVertex.assign(streams.pVerts, streams.pVerts + streams.nVert);
+			sub.vecIndex.assign(streams.pIndex, streams.pIndex + streams.nIndex);
+
+			if (streams.pAdjIndex)
+				sub.vecAdjIndex.assign(streams.pAdjIndex, streams.pAdjIndex + streams.nAdjIndex);
+
+			if (streams.pBoneWeights)
+				sub.vecBoneWeights.assign(streams.pBoneWeights, streams.pBoneWeights + streams.nVert);
+
+			if (streams.pTangents)
+				sub.vecTangents.assign(streams.pTangents, streams.pTangents + streams.nVert);
+		}
+
+		return true;
+	}
+	//------------------------------------------------------------------------------------
+	Mesh* MeshLoader::CreateMesh(const STRING& filename, const SMeshData& data)
+	{
 		Mesh* pMesh = new Mesh(filename.c_str());
+		pMesh->SetPrimitiveType(data.primType);
+
+		for (uint32 i = 0; i < data.subMeshes.size(); ++i)
+		{
+			SSubMeshStreams streams;
+			_GetStreams(data.subMeshes[i], streams);
+
+			_CreateSubMesh(pMesh, streams);
+		}
+
+		return pMesh;
+	}
+	//------------------------------------------------------------------------------------
+	STRING MeshLoader::GetBinaryFilename(const STRING& filename)
+	{
+		const size_t nLen = filename.length();
+
+		if (nLen >= 6 && filename.compare(nLen - 6, 6, ".meshb") == 0)
+		{
+			return filename;
+		}
+
+		if (nLen >= 5 && filename.compare(nLen - 5, 5, ".mesh") == 0)
+		{
+			return filename + "b";
+		}
+
+		return filename + ".meshb";
+	}
+	//------------------------------------------------------------------------------------
+	bool MeshLoader::_ParseXml(const STRING& filename, bool bMaterial, SMeshData& data)
+	{
+		TiXmlDocument doc;
+		if(!doc.LoadFile(filename.c_str()))
+		{
+			return false;
+		}
 
 		// For each submesh
 		TiXmlElement* submeshNode = doc.FirstChildElement("mesh")->FirstChildElement("submeshes")->FirstChildElement("submesh");
 
 		while (submeshNode)
 		{
-			vector<DWORD> vecIndex;
-
-			SubMesh* pSubMesh = new SubMesh;
-			pMesh->AddSubMesh(pSubMesh);
+			data.subMeshes.push_back(SSubMeshData());
+			SSubMeshData& subMesh = data.subMeshes.back();
 
 			const char* szName = submeshNode->Attribute("name");
-			if(szName) 
-				pSubMesh->SetName(szName);
+			if(szName)
+				subMesh.name = szName;
 
 			if (bMaterial)
 			{
@@ -51,7 +250,7 @@ namespace Neo
 				int nFace = 0;
 				facesNode->Attribute("count", &nFace);
 
-				vecIndex.resize(nFace*3);
+				subMesh.vecIndex.resize(nFace*3);
 
 				int idx = 0;
 				TiXmlElement* faceNode = facesNode->FirstChildElement("face");
@@ -62,9 +261,9 @@ namespace Neo
 					faceNode->Attribute("v2", &v2);
 					faceNode->Attribute("v3", &v3);
 
-					vecIndex[idx++] = v1;
-					vecIndex[idx++] = v2;
-					vecIndex[idx++] = v3;
+					subMesh.vecIndex[idx++] = v1;
+					subMesh.vecIndex[idx++] = v2;
+					subMesh.vecIndex[idx++] = v3;
 
 					faceNode = faceNode->NextSiblingElement("face");
 				}
@@ -78,12 +277,12 @@ namespace Neo
 
 				TiXmlElement* vertNode = geometryNode->FirstChildElement("vertexbuffer")->FirstChildElement("vertex");
 
-				bSaveMesh = _LoadVertex_General(vertNode, nVert, pSubMesh, false, &vecIndex[0], vecIndex.size());
+				_LoadVertex_General(vertNode, nVert, subMesh);
 
 				TiXmlElement* pBoneWeightsNode = submeshNode->FirstChildElement("boneassignments");
 				if (pBoneWeightsNode)
 				{
-					_LoadVertex_BoneWeights(pBoneWeightsNode, pSubMesh);
+					_LoadVertex_BoneWeights(pBoneWeightsNode, subMesh);
 				}
 
 			}
@@ -94,24 +293,20 @@ namespace Neo
 		TiXmlElement* pSkelNode = doc.FirstChildElement("mesh")->FirstChildElement("skeletonlink");
 		if (pSkelNode)
 		{
-			if (pSkelAnim)
-			{
-				*pSkelAnim = _LoadSkeleton(pSkelNode);
-			}
-		}
+			const char* szSkelName = pSkelNode->Attribute("name");
+			_AST(szSkelName);
 
-		if (bSaveMesh)
-		{
-			SaveMesh(pMesh, filename);
+			data.skeletonLink = szSkelName;
 		}
-		
-		return pMesh;
+
+		return true;
 	}
 	//------------------------------------------------------------------------------------
-	bool MeshLoader::_LoadVertex_General(TiXmlElement* vertNode, int nVert, SubMesh* pSubMesh, bool bNormalMap, DWORD* pIndexData, uint32 nIndex)
+	bool MeshLoader::_LoadVertex_General(TiXmlElement* vertNode, int nVert, SSubMeshData& subMesh)
 	{
 		int idx = 0;
-		std::vector<SVertex> vecVertex(nVert);
+		std::vector<SVertex>& vecVertex = subMesh.vecVertex;
+		vecVertex.resize(nVert);
 
 		TiXmlElement* pNode = vertNode;
 		while (pNode)
@@ -175,10 +370,247 @@ namespace Neo
 			}
 		}
 
-		pSubMesh->InitVertData(eVertexType_General, &vecVertex[0], nVert, true);
-		pSubMesh->InitIndexData(pIndexData, nIndex, true);
+		return true;
+	}
+	//------------------------------------------------------------------------------------
+	void MeshLoader::_GetStreams(const SSubMeshData& subMesh, SSubMeshStreams& streams)
+	{
+		streams.name = subMesh.name;
+		streams.vertType = subMesh.vertType;
+		streams.pVerts = subMesh.vecVertex.empty() ? nullptr : &subMesh.vecVertex[0];
+		streams.nVert = subMesh.vecVertex.size();
+		streams.pIndex = subMesh.vecIndex.empty() ? nullptr : &subMesh.vecIndex[0];
+		streams.nIndex = subMesh.vecIndex.size();
+		streams.pAdjIndex = subMesh.vecAdjIndex.empty() ? nullptr : &subMesh.vecAdjIndex[0];
+		streams.nAdjIndex = subMesh.vecAdjIndex.size();
+		streams.pBoneWeights = subMesh.vecBoneWeights.empty() ? nullptr : &subMesh.vecBoneWeights[0];
+		streams.pTangents = subMesh.vecTangents.empty() ? nullptr : &subMesh.vecTangents[0];
+	}
+	//------------------------------------------------------------------------------------
+	void MeshLoader::_GetBinaryStreams(const char* pData, const SSubMeshFileHeader& sub, SSubMeshStreams& streams)
+	{
+		streams.name = sub.name;
+		streams.vertType = (eVertexType)sub.vertType;
+		streams.pVerts = reinterpret_cast<const SVertex*>(pData + sub.vertOffset);
+		streams.nVert = sub.nVert;
+		streams.pIndex = reinterpret_cast<const DWORD*>(pData + sub.indexOffset);
+		streams.nIndex = sub.nIndex;
+
+		if (sub.adjIndexOffset)
+		{
+			streams.pAdjIndex = reinterpret_cast<const DWORD*>(pData + sub.adjIndexOffset);
+			streams.nAdjIndex = sub.nAdjIndex;
+		}
 
-		return false;
+		if (sub.boneWeightOffset)
+			streams.pBoneWeights = reinterpret_cast<const SVertexBoneWeight*>(pData + sub.boneWeightOffset);
+
+		if (sub.tangentOffset)
+			streams.pTangents = reinterpret_cast<const STangentData*>(pData + sub.tangentOffset);
+	}
+	//------------------------------------------------------------------------------------
+	void MeshLoader::_CreateSubMesh(Mesh* pMesh, const SSubMeshStreams& streams)
+	{
+		SubMesh* pSubMesh = new SubMesh;
+		pMesh->AddSubMesh(pSubMesh);
+
+		if (!streams.name.empty())
+			pSubMesh->SetName(streams.name);
+
+		pSubMesh->InitVertData(streams.vertType, streams.pVerts, streams.nVert, true);
+		pSubMesh->InitIndexData(streams.pIndex, streams.nIndex, true);
+
+		if (streams.pAdjIndex)
+		{
+			pSubMesh->InitAdjIndexData(streams.pAdjIndex, streams.nAdjIndex);
+		}
+
+		if (streams.pBoneWeights)
+		{
+			pSubMesh->InitBoneWeights(streams.pBoneWeights, streams.nVert);
+		}
+
+		if (streams.pTangents)
+		{
+			pSubMesh->InitTangentData(streams.pTangents, streams.nVert);
+		}
+	}
+	//------------------------------------------------------------------------------------
+	Mesh* MeshLoader::_LoadMeshBinary(const STRING& filename, SkeletonAnim** pSkelAnim)
+	{
+		SMappedFile file;
+		const SMeshFileHeader* pHeader = _MapMeshBinary(filename, file);
+
+		if (!pHeader)
+		{
+			throw std::logic_error("Failed to load binary mesh file!");
+			return nullptr;
+		}
+
+		const char* pData = static_cast<const char*>(file.pView.get());
+		const SSubMeshFileHeader* pSubHeaders = reinterpret_cast<const SSubMeshFileHeader*>(pHeader + 1);
+
+		Mesh* pMesh = new Mesh(filename.c_str());
+		pMesh->SetPrimitiveType((ePrimitive)pHeader->primType);
+
+		// Streams are handed to SubMesh straight from the mapped view, it copies what it keeps
+		for (uint32 i = 0; i < pHeader->nSubMesh; ++i)
+		{
+			SSubMeshStreams streams;
+			_GetBinaryStreams(pData, pSubHeaders[i], streams);
+
+			_CreateSubMesh(pMesh, streams);
+		}
+
+		if (pHeader->skeletonLink[0] && pSkelAnim)
+		{
+			const STRING skeletonLink(pHeader->skeletonLink, strnlen(pHeader->skeletonLink, MESH_BINARY_PATH_LEN));
+			*pSkelAnim = LoadSkeleton(skeletonLink);
+		}
+
+		return pMesh;
+	}
+	//------------------------------------------------------------------------------------
+	bool MeshLoader::_WriteBinary(const STRING& filename, const std::vector<SSubMeshStreams>& vecStreams, ePrimitive primType, const STRING& skeletonLink)
+	{
+		if (skeletonLink.length() >= MESH_BINARY_PATH_LEN)
+		{
+			return false;
+		}
+
+		const uint32 nSubMesh = vecStreams.size();
+		std::vector<SSubMeshFileHeader> vecSubHeaders(nSubMesh);
+
+		// Lay out the streams after the headers
+		uint32 nOffset = sizeof(SMeshFileHeader) + nSubMesh * sizeof(SSubMeshFileHeader);
+
+		auto AllocStream = [&](uint32 nBytes) -> uint32
+		{
+			nOffset = _AlignOffset(nOffset);
+			const uint32 nStart = nOffset;
+			nOffset += nBytes;
+			return nStart;
+		};
+
+		for (uint32 i = 0; i < nSubMesh; ++i)
+		{
+			const SSubMeshStreams& streams = vecStreams[i];
+			SSubMeshFileHeader& sub = vecSubHeaders[i];
+
+			if (streams.name.length() >= MESH_BINARY_NAME_LEN || !streams.pVerts || !streams.pIndex)
+			{
+				return false;
+			}
+
+			ZeroMemory(&sub, sizeof(sub));
+			strcpy_s(sub.name, streams.name.c_str());
+			sub.vertType = streams.vertType;
+			sub.nVert = streams.nVert;
+			sub.nIndex = streams.nIndex;
+			sub.nAdjIndex = streams.pAdjIndex ? streams.nAdjIndex : 0;
+
+			sub.vertOffset = AllocStream(streams.nVert * sizeof(SVertex));
+			sub.indexOffset = AllocStream(streams.nIndex * sizeof(DWORD));
+			if (streams.pAdjIndex)
+				sub.adjIndexOffset = AllocStream(streams.nAdjIndex * sizeof(DWORD));
+			if (streams.pBoneWeights)
+				sub.boneWeightOffset = AllocStream(streams.nVert * sizeof(SVertexBoneWeight));
+			if (streams.pTangents)
+				sub.tangentOffset = AllocStream(streams.nVert * sizeof(STangentData));
+		}
+
+		std::vector<char> vecBuffer(_AlignOffset(nOffset), 0);
+		char* pData = &vecBuffer[0];
+
+		SMeshFileHeader* pHeader = reinterpret_cast<SMeshFileHeader*>(pData);
+		pHeader->magic = MESH_BINARY_MAGIC;
+		pHeader->version = MESH_BINARY_VERSION;
+		pHeader->fileSize = vecBuffer.size();
+		pHeader->nSubMesh = nSubMesh;
+		pHeader->primType = primType;
+		pHeader->vertexStride = sizeof(SVertex);
+		strcpy_s(pHeader->skeletonLink, skeletonLink.c_str());
+
+		if (nSubMesh)
+		{
+			memcpy(pHeader + 1, &vecSubHeaders[0], nSubMesh * sizeof(SSubMeshFileHeader));
+		}
+
+		for (uint32 i = 0; i < nSubMesh; ++i)
+		{
+			const SSubMeshStreams& streams = vecStreams[i];
+			const SSubMeshFileHeader& sub = vecSubHeaders[i];
+
+			memcpy(pData + sub.vertOffset, streams.pVerts, streams.nVert * sizeof(SVertex));
+			memcpy(pData + sub.indexOffset, streams.pIndex, streams.nIndex * sizeof(DWORD));
+			if (sub.adjIndexOffset)
+				memcpy(pData + sub.adjIndexOffset, streams.pAdjIndex, streams.nAdjIndex * sizeof(DWORD));
+			if (sub.boneWeightOffset)
+				memcpy(pData + sub.boneWeightOffset, streams.pBoneWeights, streams.nVert * sizeof(SVertexBoneWeight));
+			if (sub.tangentOffset)
+				memcpy(pData + sub.tangentOffset, streams.pTangents, streams.nVert * sizeof(STangentData));
+		}
+
+		std::ofstream file(filename.c_str(), std::ios::binary | std::ios::trunc);
+		if (!file)
+		{
+			return false;
+		}
+
+		file.write(pData, vecBuffer.size());
+
+		return file.good();
+	}
+	//------------------------------------------------------------------------------------
+	bool MeshLoader::SaveMeshBinary(Mesh* pMesh, const STRING& filename, const STRING& skeletonLink)
+	{
+		std::vector<SSubMeshStreams> vecStreams(pMesh->GetSubMeshCount());
+
+		for (uint32 iSubMesh = 0; iSubMesh < pMesh->GetSubMeshCount(); ++iSubMesh)
+		{
+			SubMesh* pSubMesh = pMesh->GetSubMesh(iSubMesh);
+			const VertexData& vertData = pSubMesh->GetVertData();
+			SSubMeshStreams& streams = vecStreams[iSubMesh];
+
+			// Terrain and other gpu-only submeshes have nothing to save
+			_AST(vertData.GetVertex() && pSubMesh->GetIndexData());
+
+			streams.name = pSubMesh->GetName();
+			streams.vertType = vertData.GetVertType();
+			streams.pVerts = vertData.GetVertex();
+			streams.nVert = vertData.GetVertCount();
+			streams.pIndex = pSubMesh->GetIndexData();
+			streams.nIndex = pSubMesh->GetIndexCount();
+			streams.pBoneWeights = vertData.GetBoneWeights();
+			streams.pTangents = vertData.GetTangent();
+
+			if (pSubMesh->GetAdjIndexCount())
+			{
+				streams.pAdjIndex = pSubMesh->GetAdjIndexData();
+				streams.nAdjIndex = pSubMesh->GetAdjIndexCount();
+			}
+		}
+
+		return _WriteBinary(filename, vecStreams, pMesh->GetPrimitiveType(), skeletonLink);
+	}
+	//------------------------------------------------------------------------------------
+	bool MeshLoader::ConvertMesh(const STRING& xmlFilename, const STRING& binFilename)
+	{
+		SMeshData data;
+
+		if (!_ParseXml(xmlFilename, false, data))
+		{
+			return false;
+		}
+
+		std::vector<SSubMeshStreams> vecStreams(data.subMeshes.size());
+
+		for (uint32 i = 0; i < data.subMeshes.size(); ++i)
+		{
+			_GetStreams(data.subMeshes[i], vecStreams[i]);
+		}
+
+		return _WriteBinary(binFilename, vecStreams, data.primType, data.skeletonLink);
 	}
 	//------------------------------------------------------------------------------------
 	bool MeshLoader::SaveMesh(Mesh* pMesh, const STRING& filename)
@@ -262,11 +694,8 @@ namespace Neo
 		return bOk;
 	}
 	//------------------------------------------------------------------------------------
-	SkeletonAnim* MeshLoader::_LoadSkeleton(TiXmlElement* pSkelNode)
+	SkeletonAnim* MeshLoader::LoadSkeleton(const STRING& skelFilename)
 	{
-		const char* skelFilename = pSkelNode->Attribute("name");
-		_AST(skelFilename);
-
 		TiXmlDocument doc;
 		if (!doc.LoadFile(GetResPath(skelFilename).c_str()))
 		{
@@ -281,16 +710,12 @@ namespace Neo
 		TiXmlElement* pBoneNode = doc.FirstChildElement("skeleton")->FirstChildElement("bones")->FirstChildElement("bone");
 		while (pBoneNode)
 		{
-			Bone* pBone = new Bone;
 			int id;
 			double fRadian, posx, posy, posz, axisx, axisy, axisz;
 
-			pBone->m_name = pBoneNode->Attribute("name");
+			const STRING name = pBoneNode->Attribute("name");
 			pBoneNode->Attribute("id", &id);
 
-			mapNameToId[pBone->m_name] = id;
-			pBone->m_id = id;
-
 			{
 				TiXmlElement* posNode = pBoneNode->FirstChildElement("position");
 				posNode->Attribute("x", &posx);
@@ -307,11 +732,10 @@ namespace Neo
 				axisNode->Attribute("z", &axisz);
 			}
 
-			pBone->m_matBindPose.FromAxisAngle(VEC3(axisx, axisy, axisz), Common::Radian_To_Angle(fRadian));
-			pBone->m_matBindPose.SetTranslation(VEC3(posx, posy, posz));
-			pBone->m_matLocal = pBone->m_matBindPose;
+			// Bone ids index the skin palette, they are expected to follow the file order
+			_AST(id == (int)pSkeleton->GetBoneCount());
+			mapNameToId[name] = pSkeleton->AddBone(name, QUATERNION(VEC3(axisx, axisy, axisz), Common::Radian_To_Angle(fRadian)), VEC3(posx, posy, posz));
 
-			pSkeleton->m_vecBones.push_back(pBone);
 			pBoneNode = pBoneNode->NextSiblingElement("bone");
 		}
 
@@ -327,13 +751,7 @@ namespace Neo
 			_AST(iterChild != mapNameToId.end() && iterParent != mapNameToId.end());
 
 			// Child points to parent.
-			Bone* pChildBone = pSkeleton->m_vecBones[iterChild->second];
-			Bone* pParentBone = pSkeleton->m_vecBones[iterParent->second];
-
-			_AST(pChildBone->m_pParent == nullptr && "This bone already has a parent!");
-
-			pChildBone->m_pParent = pParentBone;
-			pParentBone->m_vecChilds.push_back(pChildBone);
+			pSkeleton->SetParent(iterChild->second, iterParent->second);
 
 			pRelationNode = pRelationNode->NextSiblingElement("boneparent");
 		}
@@ -398,14 +816,17 @@ namespace Neo
 			pAnimNode = pAnimNode->NextSiblingElement("animation");
 		}
 
+		pSkeleton->BuildHierarchy();
+
 		return pSkeleton;
 	}
 	//------------------------------------------------------------------------------------
-	bool MeshLoader::_LoadVertex_BoneWeights(TiXmlElement* pNode, SubMesh* pSubMesh)
+	bool MeshLoader::_LoadVertex_BoneWeights(TiXmlElement* pNode, SSubMeshData& subMesh)
 	{
 		TiXmlElement* pVertBoneWeightNode = pNode->FirstChildElement("vertexboneassignment");
 		uint32 idx = 0;
-		std::vector<SVertexBoneWeight> vecBoneWeights(pSubMesh->GetVertData().GetVertCount());
+		std::vector<SVertexBoneWeight>& vecBoneWeights = subMesh.vecBoneWeights;
+		vecBoneWeights.resize(subMesh.vecVertex.size());
 
 		while (pVertBoneWeightNode)
 		{
@@ -432,8 +853,6 @@ namespace Neo
 			++idx;
 		}
 
-		pSubMesh->InitBoneWeights(&vecBoneWeights[0], vecBoneWeights.size());
-
 		return true;
 	}
 
@@ -3,261 +3,403 @@
 #include "Mesh.h"
 #include "Material.h"
 #include "MaterialManager.h"
+#include "TextureManager.h"
 #include "Texture.h"
 #include "Entity.h"
 #include "Scene.h"
 #include "Renderer.h"
+#include <chrono>
 
 using namespace std;
 
 namespace Neo
 {
-	std::vector<ObjMeshLoader::SVertCompare> ObjMeshLoader::m_vecComp;
-
-
-	Mesh* ObjMeshLoader::LoadMesh(const STRING& filename, bool bFlipYZ, bool bNormalMap)
+	// Splits a text buffer into whitespace separated tokens, never crossing a line unless asked to.
+	struct SObjTokenizer
 	{
-		std::ifstream file(filename.c_str());
-		if(file.fail())
-			return nullptr;
+		SObjTokenizer(const char* pBegin, const char* pEnd) : p(pBegin), end(pEnd) {}
 
-		Mesh* pMesh = new Mesh;
+		bool	IsEnd() const { return p >= end; }
 
-		//.objʽÿfȻǴǰۼӵ.
-		//ܳ,ЩȥۼӲ,̫鷳
-		DWORD nTotalPosCount, nTotalUvCount, nTotalNormalCount;
-		nTotalPosCount = nTotalUvCount = nTotalNormalCount = 0;
+		void	SkipSpace()
+		{
+			while (p < end && (*p == ' ' || *p == '\t' || *p == '\r'))
+				++p;
+		}
 
-		//each object
-		for (;;)
+		void	NextLine()
 		{
-			if(file.eof())
-				break;
+			while (p < end && *p != '\n')
+				++p;
 
-			//ȡ,ⷴ洢ռ
-			DWORD nPos, nUv, nNormal, nFace;
-			nPos = nUv = nNormal = nFace = 0;
-			_PreReadObject(file, nPos, nUv, nNormal, nFace);
+			if (p < end)
+				++p;
+		}
 
-			vector<VEC3> vecPos(nPos);
-			vector<VEC2> vecUv(nUv);
-			vector<VEC3> vecNormal(nNormal);
+		bool	Expect(char c)
+		{
+			if (p < end && *p == c)
+			{
+				++p;
+				return true;
+			}
+			return false;
+		}
 
-			vector<SVertex> vecVertex;
-			vector<DWORD> vecIndex;
-			vecIndex.reserve(nFace * 3);
-			vecVertex.reserve(nFace * 3);
+		// Returns false at the end of line
+		bool	ReadToken(const char*& pToken, uint32& nLen)
+		{
+			SkipSpace();
+			pToken = p;
 
-			SubMesh* pSubMesh = new SubMesh;
-			pMesh->AddSubMesh(pSubMesh);
+			while (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n')
+				++p;
 
-			m_vecComp.clear();
-			m_vecComp.reserve(nFace*3);
+			nLen = p - pToken;
+			return nLen > 0;
+		}
 
-			//ʽȡ
-			DWORD curVert, curUv, curNormal, curFace;
-			curVert = curUv = curNormal = curFace = 0;
-			STRING command;
-			bool bFlush = false;
+		bool	ReadInt(int& n)
+		{
+			SkipSpace();
 
-			//each command
-			for(;;)
-			{
-				if(file.eof())
-					break;
+			bool bNeg = false;
+			if (Expect('-'))
+				bNeg = true;
+			else
+				Expect('+');
 
-				file >> command;
+			if (p >= end || *p < '0' || *p > '9')
+				return false;
 
-				if (strcmp(command.c_str(), "v") == 0)
-				{
-					if(bFlush)
-					{
-						//һ
-						file.seekg(-1, ios_base::cur);
-						break;
-					}
+			int val = 0;
+			while (p < end && *p >= '0' && *p <= '9')
+				val = val * 10 + (*p++ - '0');
 
-					VEC3& pos = vecPos[curVert++];
-					file >> pos.x >> pos.y >> pos.z;
-
-					if (bFlipYZ)
-					{
-						Swap(pos.y, pos.z);
-						pos.z = -pos.z;
-					}
-				}
-				else if (strcmp(command.c_str(), "vt") == 0)
-				{
-					VEC2& uv = vecUv[curUv++];
-					file >> uv.x >> uv.y;
+			n = bNeg ? -val : val;
+			return true;
+		}
 
-					uv.y = 1 - uv.y;
-				}
-				else if (strcmp(command.c_str(), "vn") == 0)
-				{
-					VEC3& normal = vecNormal[curNormal++];
-					file >> normal.x >> normal.y >> normal.z;
+		bool	ReadFloat(float& f)
+		{
+			SkipSpace();
 
-					if (bFlipYZ)
-					{
-						Swap(normal.y, normal.z);
-						normal.z = -normal.z;
-					}
-				}
-				else if (strcmp(command.c_str(), "f") == 0)
-				{
-					DWORD idxPos[3] = {0};
-					DWORD idxUv[3] = {0};
-					DWORD idxNormal[3] = {0};
+			bool bNeg = false;
+			if (Expect('-'))
+				bNeg = true;
+			else
+				Expect('+');
 
-					for (int i=0; i<3; ++i)
-					{
-						file >> idxPos[i];
-						file.ignore(10, '/');
-						file >> idxUv[i];
-						file.ignore(10, '/');
-						file >> idxNormal[i];
-
-						//.objǴ1ʼ
-						idxPos[i] -= 1; idxUv[i] -= 1; idxNormal[i] -= 1;
-						//ǰ˵,ȥۼӵĲ
-						idxPos[i] -= nTotalPosCount;
-						idxUv[i] -= nTotalUvCount;
-						idxNormal[i] -= nTotalNormalCount;
-
-						SVertex vertex;
-						vertex.pos = vecPos[idxPos[i]];
-
-						if (idxUv[i] != 0xffffffff)
-						{
-							vertex.uv = vecUv[idxUv[i]];
-						}
-						vertex.normal = vecNormal[idxNormal[i]];
+			double val = 0;
+			bool bDigit = false;
 
-						SVertCompare comp = { idxPos[i], idxUv[i], idxNormal[i] };
+			while (p < end && *p >= '0' && *p <= '9')
+			{
+				val = val * 10 + (*p++ - '0');
+				bDigit = true;
+			}
 
-						DWORD idxVert;
-						if (_DefineVertex(comp, idxVert))
-						{
-							vecVertex.push_back(vertex);
-							idxVert = vecVertex.size() - 1;
-						}
-						
-						vecIndex.push_back(idxVert);
-					}
-				}
-				else if (strcmp(command.c_str(), "g") == 0)
+			if (Expect('.'))
+			{
+				double scale = 0.1;
+				while (p < end && *p >= '0' && *p <= '9')
 				{
-					bFlush = true;
+					val += (*p++ - '0') * scale;
+					scale *= 0.1;
+					bDigit = true;
 				}
+			}
 
-				//һ
-				file.ignore(1000, '\n');
+			if (!bDigit)
+				return false;
+
+			if (p < end && (*p == 'e' || *p == 'E'))
+			{
+				++p;
+				int exponent = 0;
+				if (ReadInt(exponent))
+					val *= pow(10.0, exponent);
 			}
 
-			pSubMesh->InitVertData(eVertexType_General, &vecVertex[0], vecVertex.size(), true);
-			pSubMesh->InitIndexData(&vecIndex[0], vecIndex.size(), true);
+			f = (float)(bNeg ? -val : val);
+			return true;
+		}
+
+		const char*		p;
+		const char*		end;
+	};
+
+	static bool _IsToken(const char* pToken, uint32 nLen, const char* szCmd)
+	{
+		return strlen(szCmd) == nLen && strncmp(pToken, szCmd, nLen) == 0;
+	}
+
+	// .objǴ1ʼ, ʾԵǰĩβ
+	static int _ResolveIndex(int idx, uint32 nCount)
+	{
+		if (idx > 0)
+			idx -= 1;
+		else if (idx < 0)
+			idx += nCount;
+		else
+			return -1;
+
+		return (idx >= 0 && (uint32)idx < nCount) ? idx : -1;
+	}
+	//------------------------------------------------------------------------------------
+	Mesh* ObjMeshLoader::LoadMesh(const STRING& filename, bool bFlipYZ, bool bNormalMap)
+	{
+		MeshLoader::SMeshData data;
+		if (!LoadMeshData(filename, bFlipYZ, data))
+			return nullptr;
+
+		return MeshLoader::CreateMesh(filename, data);
+	}
+	//------------------------------------------------------------------------------------
+	bool ObjMeshLoader::LoadMeshData(const STRING& filename, bool bFlipYZ, MeshLoader::SMeshData& data)
+	{
+		std::vector<char> buffer;
+		if (!_ReadFile(filename, buffer))
+			return false;
+
+		_ParseObj(buffer.data(), buffer.data() + buffer.size(), bFlipYZ, data);
+
+		return true;
+	}
+	//------------------------------------------------------------------------------------
+	double ObjMeshLoader::Benchmark(const STRING& filename, uint32 nIteration)
+	{
+		std::vector<char> buffer;
+		if (!_ReadFile(filename, buffer) || nIteration == 0)
+			return 0;
 
-			nTotalPosCount += nPos;
-			nTotalUvCount += nUv;
-			nTotalNormalCount += nNormal;
+		const auto start = std::chrono::high_resolution_clock::now();
+
+		for (uint32 i = 0; i < nIteration; ++i)
+		{
+			MeshLoader::SMeshData data;
+			_ParseObj(buffer.data(), buffer.data() + buffer.size(), false, data);
 		}
-				
-		return pMesh;
+
+		const std::chrono::duration<double> elapsed = std::chrono::high_resolution_clock::now() - start;
+		const double fMegaBytes = (double)buffer.size() * nIteration / (1024 * 1024);
+
+		return elapsed.count() > 0 ? fMegaBytes / elapsed.count() : 0;
 	}
+	//------------------------------------------------------------------------------------
+	bool ObjMeshLoader::_ReadFile(const STRING& filename, std::vector<char>& buffer)
+	{
+		ScopedHandle hFile(safe_handle(::CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+			OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr)));
+
+		LARGE_INTEGER fileSize;
+		if (!hFile || !::GetFileSizeEx(hFile.get(), &fileSize) || fileSize.HighPart != 0)
+			return false;
+
+		buffer.resize(fileSize.LowPart);
+		if (buffer.empty())
+			return true;
 
-	void ObjMeshLoader::_PreReadObject( std::ifstream& file, DWORD& nPos, DWORD& nUv, DWORD& nNormal, DWORD& nFace )
+		DWORD nRead = 0;
+		return ::ReadFile(hFile.get(), buffer.data(), fileSize.LowPart, &nRead, nullptr) && nRead == fileSize.LowPart;
+	}
+	//------------------------------------------------------------------------------------
+	void ObjMeshLoader::_ParseObj(const char* pBegin, const char* pEnd, bool bFlipYZ, MeshLoader::SMeshData& data)
 	{
-		//¼µǰλ,صʱ˵λ
-		streamoff pos = file.tellg();
+		//.objʽÿfǴǰۼӵ, Ըɷļڹ
+		std::vector<VEC3> vecPos;
+		std::vector<VEC2> vecUv;
+		std::vector<VEC3> vecNormal;
+
+		// Rough guess of ~40 bytes per line to avoid most reallocations
+		const uint32 nGuess = (pEnd - pBegin) / 40;
+		vecPos.reserve(nGuess);
+
+		VertKeyMap mapVert;
+		std::vector<SVertKey> vecPolygon;
+		std::vector<DWORD> vecCorner;
 
+		data.subMeshes.push_back(MeshLoader::SSubMeshData());
 		bool bFlush = false;
-		STRING command;
-		while (1)
+
+		SObjTokenizer tok(pBegin, pEnd);
+		const char* pCmd;
+		uint32 nCmdLen;
+
+		//each command
+		while (!tok.IsEnd())
 		{
-			if(file.eof())
+			if (!tok.ReadToken(pCmd, nCmdLen))
 			{
-				//NB: ĩβҪ״̬ٻ
-				file.clear();
-				file.seekg(pos, ios_base::beg);
-				return;
+				tok.NextLine();
+				continue;
 			}
 
-			file >> command;
-
-			if (strcmp(command.c_str(), "v") == 0)
+			if (_IsToken(pCmd, nCmdLen, "v"))
 			{
-				if(bFlush)
+				if (bFlush)
 				{
-					file.seekg(pos, ios_base::beg);
-					return;
+					//һ
+					if (!data.subMeshes.back().vecIndex.empty())
+					{
+						data.subMeshes.push_back(MeshLoader::SSubMeshData());
+						mapVert.clear();
+					}
+					bFlush = false;
 				}
-				++nPos;
+
+				VEC3 pos(0, 0, 0);
+				tok.ReadFloat(pos.x);
+				tok.ReadFloat(pos.y);
+				tok.ReadFloat(pos.z);
+
+				if (bFlipYZ)
+				{
+					Swap(pos.y, pos.z);
+					pos.z = -pos.z;
+				}
+
+				vecPos.push_back(pos);
 			}
-			else if (strcmp(command.c_str(), "vt") == 0)
+			else if (_IsToken(pCmd, nCmdLen, "vt"))
 			{
-				++nUv;
+				VEC2 uv(0, 0);
+				tok.ReadFloat(uv.x);
+				tok.ReadFloat(uv.y);
+
+				uv.y = 1 - uv.y;
+				vecUv.push_back(uv);
 			}
-			else if (strcmp(command.c_str(), "vn") == 0)
+			else if (_IsToken(pCmd, nCmdLen, "vn"))
 			{
-				++nNormal;
+				VEC3 normal(0, 0, 0);
+				tok.ReadFloat(normal.x);
+				tok.ReadFloat(normal.y);
+				tok.ReadFloat(normal.z);
+
+				if (bFlipYZ)
+				{
+					Swap(normal.y, normal.z);
+					normal.z = -normal.z;
+				}
+
+				vecNormal.push_back(normal);
 			}
-			else if (strcmp(command.c_str(), "f") == 0)
+			else if (_IsToken(pCmd, nCmdLen, "f"))
 			{
-				++nFace;
+				// Corners are pos, pos/uv, pos//normal or pos/uv/normal
+				vecPolygon.clear();
+				bool bValid = true;
+				int idxPos;
+
+				while (tok.ReadInt(idxPos))
+				{
+					int idxUv = 0, idxNormal = 0;
+
+					if (tok.Expect('/'))
+					{
+						if (tok.Expect('/'))
+						{
+							tok.ReadInt(idxNormal);
+						}
+						else
+						{
+							tok.ReadInt(idxUv);
+							if (tok.Expect('/'))
+								tok.ReadInt(idxNormal);
+						}
+					}
+
+					SVertKey key;
+					key.idxPos = _ResolveIndex(idxPos, vecPos.size());
+					key.idxUv = _ResolveIndex(idxUv, vecUv.size());
+					key.idxNormal = _ResolveIndex(idxNormal, vecNormal.size());
+
+					bValid &= key.idxPos >= 0;
+					vecPolygon.push_back(key);
+				}
+
+				if (bValid && vecPolygon.size() >= 3)
+				{
+					MeshLoader::SSubMeshData& subMesh = data.subMeshes.back();
+
+					vecCorner.clear();
+					for (uint32 i = 0; i < vecPolygon.size(); ++i)
+					{
+						vecCorner.push_back(_DefineVertex(vecPolygon[i], vecPos, vecUv, vecNormal, mapVert, subMesh));
+					}
+
+					// Triangulate polygons as a fan
+					for (uint32 i = 2; i < vecCorner.size(); ++i)
+					{
+						subMesh.vecIndex.push_back(vecCorner[0]);
+						subMesh.vecIndex.push_back(vecCorner[i - 1]);
+						subMesh.vecIndex.push_back(vecCorner[i]);
+					}
+				}
 			}
-			else if (strcmp(command.c_str(), "g") == 0)
+			else if (_IsToken(pCmd, nCmdLen, "g"))
 			{
 				bFlush = true;
 			}
 
 			//һ
-			file.ignore(1000, '\n');
+			tok.NextLine();
 		}
-	}
 
-	bool ObjMeshLoader::_DefineVertex(const SVertCompare& comp, DWORD& retIdx)
-	{
-		//.objĶ岻ֱӸ,Ǹɷֶ.Թm_vertsҪ鷳Щ.
-		//1. ڵǰбв,Ƿͬ
-		auto iter = std::find(m_vecComp.begin(), m_vecComp.end(), comp);
-
-		if(iter != m_vecComp.end())
+		if (data.subMeshes.back().vecIndex.empty())
 		{
-			//2. ,ظ
-			retIdx = std::distance(m_vecComp.begin(), iter);
-			return false;
+			data.subMeshes.pop_back();
 		}
-		else
+	}
+	//------------------------------------------------------------------------------------
+	DWORD ObjMeshLoader::_DefineVertex(const SVertKey& key, const std::vector<VEC3>& vecPos, const std::vector<VEC2>& vecUv,
+		const std::vector<VEC3>& vecNormal, VertKeyMap& mapVert, MeshLoader::SSubMeshData& subMesh)
+	{
+		//.objĶ岻ֱӸ,Ǹɷֶ.
+		//ͬϵĶظ,¶㵽ĩβ
+		auto result = mapVert.insert(std::make_pair(key, (DWORD)subMesh.vecVertex.size()));
+
+		if (result.second)
 		{
-			//3. û,¶㵽ĩβ
-			m_vecComp.push_back(comp);
-			return true;
+			SVertex vertex;
+			vertex.pos = vecPos[key.idxPos];
+
+			if (key.idxUv >= 0)
+				vertex.uv = vecUv[key.idxUv];
+
+			if (key.idxNormal >= 0)
+				vertex.normal = vecNormal[key.idxNormal];
+
+			subMesh.vecVertex.push_back(vertex);
 		}
-	}
 
+		return result.first->second;
+	}
+	//------------------------------------------------------------------------------------
 	bool ObjMeshLoader::LoadMtlFile(const STRING& filename)
 	{
-		const STRING filepath = GetResPath(filename);
-		ifstream file(filepath);
-		if (file.fail())
+		std::vector<char> buffer;
+		if (!_ReadFile(GetResPath(filename), buffer))
 			return false;
 
-		STRING command;
 		Material* pNewMaterial = nullptr;
-		STRING matName;
+		SObjTokenizer tok(buffer.data(), buffer.data() + buffer.size());
+		const char* pCmd, *pArg;
+		uint32 nCmdLen, nArgLen;
 
 		//each command
-		for (;;)
+		while (!tok.IsEnd())
 		{
-			if (file.eof())
-				break;
-
-			file >> command;
+			if (!tok.ReadToken(pCmd, nCmdLen))
+			{
+				tok.NextLine();
+				continue;
+			}
 
-			if (strcmp(command.c_str(), "newmtl") == 0)
+			if (_IsToken(pCmd, nCmdLen, "newmtl") && tok.ReadToken(pArg, nArgLen))
 			{
-				file >> matName;
+				const STRING matName(pArg, nArgLen);
 
 				if (pNewMaterial)
 				{
@@ -270,44 +412,36 @@ namespace Neo
 				subMtl.specular.Set(0.2f, 0.2f, 0.2f);
 				subMtl.glossiness = 0.5f;
 			}
-			else if (strcmp(command.c_str(), "map_Kd") == 0)
+			else if (pNewMaterial)
 			{
-				STRING texName;
-				file >> texName;
-				pNewMaterial->SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath(texName)));
+				// Texture slot of map_Kd, bump and spec
+				int iSlot = -1;
 
-				SSamplerDesc& samDesc = pNewMaterial->GetSamplerStateDesc(0);
-				pNewMaterial->SetSamplerStateDesc(0, samDesc);
-			}
-			else if (strcmp(command.c_str(), "bump") == 0)
-			{
-				STRING texName;
-				file >> texName;
-				pNewMaterial->SetTexture(1, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath(texName)));
+				if (_IsToken(pCmd, nCmdLen, "map_Kd"))
+					iSlot = 0;
+				else if (_IsToken(pCmd, nCmdLen, "bump"))
+					iSlot = 1;
+				else if (_IsToken(pCmd, nCmdLen, "spec"))
+					iSlot = 2;
 
-				SSamplerDesc& samDesc = pNewMaterial->GetSamplerStateDesc(1);
-				pNewMaterial->SetSamplerStateDesc(1, samDesc);
-			}
-			else if (strcmp(command.c_str(), "spec") == 0)
-			{
-				STRING texName;
-				file >> texName;
-				pNewMaterial->SetTexture(2, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath(texName)));
+				if (iSlot >= 0 && tok.ReadToken(pArg, nArgLen))
+				{
+					const STRING texName(pArg, nArgLen);
+					pNewMaterial->SetTexture(iSlot, TextureManager::GetSingleton().LoadTexture(GetResPath(texName)));
 
-				SSamplerDesc& samDesc = pNewMaterial->GetSamplerStateDesc(2);
-				pNewMaterial->SetSamplerStateDesc(2, samDesc);
-			}
-			else if (strcmp(command.c_str(), "Ks") == 0)
-			{
-				SubMaterial& subMtl = pNewMaterial->GetSubMaterial(0);
-				//file >> subMtl.specular.x >> subMtl.specular.y >> subMtl.specular.z;
+					SSamplerDesc& samDesc = pNewMaterial->GetSamplerStateDesc(iSlot);
+					pNewMaterial->SetSamplerStateDesc(iSlot, samDesc);
+				}
 			}
 
 			//һ
-			file.ignore(1000, '\n');
+			tok.NextLine();
 		}
 
-		pNewMaterial->InitShader("Opaque", eShader_Opaque);
+		if (pNewMaterial)
+		{
+			pNewMaterial->InitShader("Opaque", eShader_Opaque);
+		}
 
 		return true;
 	}
@@ -4,231 +4,866 @@
 #include "Camera.h"
 #include "SceneManager.h"
 #include "Scene.h"
+#include <random>
 
 namespace Neo
 {
 	//------------------------------------------------------------------------------------
-	OctreeNode::OctreeNode()
-		: m_iDepth(-1)
+	Octree::Octree(const AABB& sceneAABB)
+		: m_bDirty(true)
+		, m_bDeferUpdates(false)
+		, m_nTotalObjs(0)
 	{
-		ZeroMemory(m_pChildren, 8 * sizeof(OctreeNode*));
+		SOctreeNode root;
+		root.vCenter = sceneAABB.GetCenter();
+		root.vLooseHalfSize = sceneAABB.GetSize();
+		root.nParent = 0;
+		root.nFirstChild = 0;
+		root.nObjStart = root.nObjEnd = root.nSubtreeEnd = 0;
+		root.childMask = 0;
+		root.depth = 0;
+
+		m_nodes.push_back(root);
+		m_nodeObjs.push_back(EntityList());
+
+		ZeroMemory(m_viewStats, sizeof(m_viewStats));
 	}
 	//------------------------------------------------------------------------------------
-	OctreeNode::~OctreeNode()
+	Octree::~Octree()
 	{
-		for (int i = 0; i < 2; ++i)
+		for (uint32 i = 0; i < m_nodeObjs.size(); ++i)
 		{
-			for (int j = 0; j < 2; ++j)
+			for (uint32 j = 0; j < m_nodeObjs[i].size(); ++j)
 			{
-				for (int k = 0; k < 2; ++k)
-				{
-					SAFE_DELETE(m_pChildren[i][j][k]);
-				}
+				m_nodeObjs[i][j]->SetOctreeNode(nullptr, 0, 0);
 			}
 		}
 	}
 	//------------------------------------------------------------------------------------
-	void OctreeNode::WalkOctree()
+	void Octree::Insert(Entity* pObj)
 	{
-		int result = 1;
+		_AST(pObj->GetOctree() == nullptr);
 
-		for (int i = 0; i < 6; ++i)
+		pObj->UpdateAABB();
+
+		_AttachToNode(_FindNode(pObj->GetWorldAABB()), pObj);
+
+		++m_nTotalObjs;
+	}
+	//------------------------------------------------------------------------------------
+	void Octree::Remove(Entity* pObj)
+	{
+		_AST(pObj->GetOctree() == this);
+
+		_DetachFromNode(pObj->GetOctreeNode(), pObj->GetOctreeSlot());
+		pObj->SetOctreeNode(nullptr, 0, 0);
+
+		--m_nTotalObjs;
+	}
+	//------------------------------------------------------------------------------------
+	void Octree::Update(Entity* pObj)
+	{
+		_AST(pObj->GetOctree() == this);
+
+		const uint32 iOldNode = pObj->GetOctreeNode();
+		const uint32 iOldSlot = pObj->GetOctreeSlot();
+		const uint32 iNewNode = _FindNode(pObj->GetWorldAABB());
+
+		// Still in the right node, new bounds are picked up by the next gather.
+		if (iNewNode == iOldNode)
+		{
+			return;
+		}
+
+		// Attach first, so releasing the old branch can't free the new node when it's an ancestor.
+		_AttachToNode(iNewNode, pObj);
+		_DetachFromNode(iOldNode, iOldSlot);
+	}
+	//------------------------------------------------------------------------------------
+	uint32 Octree::_FindNode(const AABB& aabb)
+	{
+		const VEC3 vCenter = aabb.GetCenter();
+		const VEC3 vHalfSize = aabb.GetSize() / 2;
+		uint32 iNode = 0;
+
+		while (m_nodes[iNode].depth < OCTREE_MAX_DEPTH)
 		{
-			PLANE::Side side = g_env.pSceneMgr->GetCamera()->GetFrustumPlane(i).GetSide(m_aabbCullBound);
+			const VEC3& vNodeCenter = m_nodes[iNode].vCenter;
+			const uint32 iChild = (vCenter.x > vNodeCenter.x ? 4 : 0) | (vCenter.y > vNodeCenter.y ? 2 : 0) | (vCenter.z > vNodeCenter.z ? 1 : 0);
 
-			if (side == PLANE::NEGATIVE_SIDE)
+			// Stop at the deepest node whose loose bound still fully contains the obj.
+			const VEC3 vChildCenter = _GetChildCenter(iNode, iChild);
+			const VEC3 vChildLooseHalfSize = m_nodes[iNode].vLooseHalfSize / 2;
+
+			if (fabsf(vCenter.x - vChildCenter.x) + vHalfSize.x > vChildLooseHalfSize.x ||
+				fabsf(vCenter.y - vChildCenter.y) + vHalfSize.y > vChildLooseHalfSize.y ||
+				fabsf(vCenter.z - vChildCenter.z) + vHalfSize.z > vChildLooseHalfSize.z)
 			{
-				// Camera is not in this node.
-				result = 0;
 				break;
-			} 
-			else if(side == PLANE::BOTH_SIDE)
+			}
+
+			if (m_nodes[iNode].nFirstChild == 0)
+			{
+				_AllocChildren(iNode);
+			}
+
+			m_nodes[iNode].childMask |= 1 << iChild;
+			iNode = m_nodes[iNode].nFirstChild + iChild;
+		}
+
+		return iNode;
+	}
+	//------------------------------------------------------------------------------------
+	void Octree::_AttachToNode(uint32 iNode, Entity* pObj)
+	{
+		EntityList& objs = m_nodeObjs[iNode];
+
+		pObj->SetOctreeNode(this, iNode, objs.size());
+		objs.push_back(pObj);
+
+		m_bDirty = true;
+	}
+	//------------------------------------------------------------------------------------
+	void Octree::_DetachFromNode(uint32 iNode, uint32 iSlot)
+	{
+		EntityList& objs = m_nodeObjs[iNode];
+
+		// Swap with the last one, keep slots of the others valid.
+		if (iSlot + 1 != objs.size())
+		{
+			Entity* pLast = objs.back();
+			objs[iSlot] = pLast;
+			pLast->SetOctreeNode(this, iNode, iSlot);
+		}
+		objs.pop_back();
+
+		_ReleaseIfEmpty(iNode);
+
+		m_bDirty = true;
+	}
+	//------------------------------------------------------------------------------------
+	void Octree::_ReleaseIfEmpty(uint32 iNode)
+	{
+		// Walk up and give back the child blocks of branches that became empty.
+		while (iNode != 0 && m_nodeObjs[iNode].empty() && m_nodes[iNode].childMask == 0)
+		{
+			SOctreeNode& parent = m_nodes[m_nodes[iNode].nParent];
+			parent.childMask &= ~(1 << (iNode - parent.nFirstChild));
+
+			if (parent.childMask == 0)
+			{
+				m_freeBlocks.push_back(parent.nFirstChild);
+				parent.nFirstChild = 0;
+			}
+
+			iNode = m_nodes[iNode].nParent;
+		}
+	}
+	//------------------------------------------------------------------------------------
+	VEC3 Octree::_GetChildCenter(uint32 iNode, uint32 iChild) const
+	{
+		// Cell half size of the child is half of the parent's cell half size,
+		// which is a quarter of the parent's loose half size.
+		const SOctreeNode& node = m_nodes[iNode];
+		const VEC3 vOffset = node.vLooseHalfSize / 4;
+
+		return VEC3(node.vCenter.x + ((iChild & 4) ? vOffset.x : -vOffset.x),
+			node.vCenter.y + ((iChild & 2) ? vOffset.y : -vOffset.y),
+			node.vCenter.z + ((iChild & 1) ? vOffset.z : -vOffset.z));
+	}
+	//------------------------------------------------------------------------------------
+	uint32 Octree::_AllocChildren(uint32 iNode)
+	{
+		uint32 iFirst;
+
+		// Reuse a released block if possible, it's empty already.
+		if (!m_freeBlocks.empty())
+		{
+			iFirst = m_freeBlocks.back();
+			m_freeBlocks.pop_back();
+		}
+		else
+		{
+			iFirst = m_nodes.size();
+			m_nodes.resize(iFirst + 8);
+			m_nodeObjs.resize(iFirst + 8);
+		}
+
+		for (uint32 i = 0; i < 8; ++i)
+		{
+			SOctreeNode& child = m_nodes[iFirst + i];
+			child.vCenter = _GetChildCenter(iNode, i);
+			child.vLooseHalfSize = m_nodes[iNode].vLooseHalfSize / 2;
+			child.nParent = iNode;
+			child.nFirstChild = 0;
+			child.nObjStart = child.nObjEnd = child.nSubtreeEnd = 0;
+			child.childMask = 0;
+			child.depth = m_nodes[iNode].depth + 1;
+		}
+
+		m_nodes[iNode].nFirstChild = iFirst;
+
+		return iFirst;
+	}
+	//------------------------------------------------------------------------------------
+	void Octree::_Flatten()
+	{
+		m_objs.clear();
+		m_objs.reserve(m_nTotalObjs);
+
+		_FlattenNode(0);
+
+		m_objBounds.Resize(m_objs.size());
+		m_bDirty = false;
+	}
+	//------------------------------------------------------------------------------------
+	void Octree::_FlattenNode(uint32 iNode)
+	{
+		SOctreeNode& node = m_nodes[iNode];
+		const EntityList& objs = m_nodeObjs[iNode];
+
+		node.nObjStart = m_objs.size();
+		m_objs.insert(m_objs.end(), objs.begin(), objs.end());
+		node.nObjEnd = m_objs.size();
+
+		for (uint32 i = 0; i < 8; ++i)
+		{
+			if (node.childMask & (1 << i))
 			{
-				// Camera is in this node partially.
-				result = 2;
+				_FlattenNode(node.nFirstChild + i);
 			}
 		}
 
-		if (result != 0)
+		node.nSubtreeEnd = m_objs.size();
+	}
+	//------------------------------------------------------------------------------------
+	void Octree::_UpdateBounds()
+	{
+		if (m_objs.empty())
+		{
+			return;
+		}
+
+		// Usually Scene::Update() already refreshed every obj, and this is a plain gather
+		if (Entity::UpdateWorldAABBs(&m_objs[0], m_objs.size(), m_objBounds) == 0)
 		{
-			// Frustum culling
-			for (uint32 i = 0; i < m_pObjs.size(); ++i)
+			return;
+		}
+
+		for (uint32 i = 0; i < m_objs.size(); ++i)
+		{
+			m_objs[i]->FlushOctreeUpdate();
+		}
+
+		// Some left their node, the flattened order changed
+		if (m_bDirty)
+		{
+			_Flatten();
+			Entity::UpdateWorldAABBs(&m_objs[0], m_objs.size(), m_objBounds);
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void Octree::Cull(const SCullVolume* views, uint32 nViews)
+	{
+		_AST(nViews > 0 && nViews <= eCullView_Max);
+
+		if (m_bDirty)
+		{
+			_Flatten();
+		}
+
+		_UpdateBounds();
+
+		m_objViewMasks.assign(m_objs.size(), 0);
+		ZeroMemory(m_viewStats, sizeof(m_viewStats));
+
+		SCullView cullViews[eCullView_Max];
+
+		for (uint32 v = 0; v < nViews; ++v)
+		{
+			cullViews[v].nPlanes = views[v].nPlanes;
+
+			for (uint32 i = 0; i < views[v].nPlanes; ++i)
+			{
+				const PLANE& plane = views[v].planes[i];
+				cullViews[v].planes[i].plane = plane;
+				cullViews[v].planes[i].vAbsNormal.Set(fabsf(plane.n.x), fabsf(plane.n.y), fabsf(plane.n.z));
+			}
+		}
+
+		_WalkOctree(cullViews, nViews);
+
+		for (uint32 i = 0; i < m_objs.size(); ++i)
+		{
+			m_objs[i]->SetVisible((m_objViewMasks[i] & 1) != 0);
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void Octree::Update()
+	{
+		SCullVolume view;
+		view.SetFrustum(*g_env.pSceneMgr->GetCamera());
+
+		Cull(&view, 1);
+	}
+	//------------------------------------------------------------------------------------
+	void Octree::_WalkOctree(const SCullView* views, uint32 nViews)
+	{
+		struct SWalkItem
+		{
+			uint32	iNode;
+			uint32	viewMask;						// Views the parent still intersects
+			uint16	planeMasks[eCullView_Max];		// Planes of each view the parent still intersects
+		};
+
+		SWalkItem stack[8 * (OCTREE_MAX_DEPTH + 1)];
+		int nTop = 0;
+
+		stack[nTop].iNode = 0;
+		stack[nTop].viewMask = (1 << nViews) - 1;
+		for (uint32 v = 0; v < nViews; ++v)
+		{
+			stack[nTop].planeMasks[v] = (uint16)((1 << views[v].nPlanes) - 1);
+		}
+		++nTop;
+
+		while (nTop > 0)
+		{
+			SWalkItem item = stack[--nTop];
+			const SOctreeNode& node = m_nodes[item.iNode];
+			uint32 insideMask = 0;
+
+			for (uint32 v = 0; v < nViews; ++v)
+			{
+				if (!(item.viewMask & (1 << v)))
+				{
+					continue;
+				}
+
+				const SCullView& view = views[v];
+				uint32 planeMask = item.planeMasks[v];
+				bool bCulled = false;
+
+				for (uint32 i = 0; i < view.nPlanes; ++i)
+				{
+					// The parent is fully inside this plane, so is this node.
+					if (!(planeMask & (1 << i)))
+					{
+						continue;
+					}
+
+					const float fDist = Common::DotProduct_Vec3_By_Vec3(view.planes[i].plane.n, node.vCenter) + view.planes[i].plane.d;
+					const float fRadius = Common::DotProduct_Vec3_By_Vec3(view.planes[i].vAbsNormal, node.vLooseHalfSize);
+
+					if (fDist < -fRadius)
+					{
+						// View is not in this node.
+						bCulled = true;
+						break;
+					}
+					else if (fDist > fRadius)
+					{
+						planeMask &= ~(1 << i);
+					}
+				}
+
+				if (bCulled)
+				{
+					item.viewMask &= ~(1 << v);
+					++m_viewStats[v].nCulledNodes;
+				}
+				else if (planeMask == 0)
+				{
+					// Node is fully inside the view, so is every obj it contains.
+					item.viewMask &= ~(1 << v);
+					insideMask |= 1 << v;
+					m_viewStats[v].nVisibleObjs += node.nSubtreeEnd - node.nObjStart;
+				}
+				else
+				{
+					item.planeMasks[v] = (uint16)planeMask;
+				}
+			}
+
+			if (insideMask)
 			{
-				if (!g_env.pSceneMgr->GetCamera()->FrustumCullingAABB(m_pObjs[i]->GetWorldAABB()))
+				for (uint32 i = node.nObjStart; i < node.nSubtreeEnd; ++i)
 				{
-					m_pObjs[i]->SetVisible(true);
-					--g_env.pSceneMgr->GetOctree()->m_nCulledObjs;
+					m_objViewMasks[i] |= insideMask;
 				}
-				++g_env.pSceneMgr->GetOctree()->m_nFrustumCullNum;
 			}
 
-			// Walk through 8 child nodes
-			if (m_pChildren[0][0][0])
+			if (item.viewMask == 0)
 			{
-				m_pChildren[0][0][0]->WalkOctree();
+				continue;
 			}
 
-			if (m_pChildren[0][0][1])
+			// Node is partially in some views, only planes it straddles need to be tested.
+			for (uint32 v = 0; v < nViews; ++v)
 			{
-				m_pChildren[0][0][1]->WalkOctree();
+				if (item.viewMask & (1 << v))
+				{
+					_CullObjects(node.nObjStart, node.nObjEnd, views[v], item.planeMasks[v], v);
+				}
 			}
 
-			if (m_pChildren[0][1][0])
+			for (uint32 i = 0; i < 8; ++i)
 			{
-				m_pChildren[0][1][0]->WalkOctree();
+				if (node.childMask & (1 << i))
+				{
+					stack[nTop] = item;
+					stack[nTop].iNode = node.nFirstChild + i;
+					++nTop;
+				}
 			}
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void Octree::_CullObjects(uint32 nStart, uint32 nEnd, const SCullView& view, uint32 planeMask, uint32 iView)
+	{
+		if (nStart == nEnd)
+		{
+			return;
+		}
 
-			if (m_pChildren[0][1][1])
+		SViewStat& stat = m_viewStats[iView];
+		const uint32 viewBit = 1 << iView;
+
+		stat.nObjTests += nEnd - nStart;
+
+		// A box is outside a plane iff its corner furthest along the normal is behind it,
+		// so each plane only needs one of the min/max streams per axis.
+		const float* px[SCullVolume::MAX_PLANES];
+		const float* py[SCullVolume::MAX_PLANES];
+		const float* pz[SCullVolume::MAX_PLANES];
+		const PLANE* pPlanes[SCullVolume::MAX_PLANES];
+		uint32 nPlanes = 0;
+
+		for (uint32 i = 0; i < view.nPlanes; ++i)
+		{
+			if (planeMask & (1 << i))
 			{
-				m_pChildren[0][1][1]->WalkOctree();
+				const PLANE& plane = view.planes[i].plane;
+				px[nPlanes] = plane.n.x >= 0 ? m_objBounds.m_maxX : m_objBounds.m_minX;
+				py[nPlanes] = plane.n.y >= 0 ? m_objBounds.m_maxY : m_objBounds.m_minY;
+				pz[nPlanes] = plane.n.z >= 0 ? m_objBounds.m_maxZ : m_objBounds.m_minZ;
+				pPlanes[nPlanes] = &plane;
+				++nPlanes;
 			}
+		}
+
+#if USE_SIMD == 1
+		__m128 vNx[SCullVolume::MAX_PLANES], vNy[SCullVolume::MAX_PLANES], vNz[SCullVolume::MAX_PLANES], vD[SCullVolume::MAX_PLANES];
+		const __m128 vZero = _mm_setzero_ps();
+
+		for (uint32 j = 0; j < nPlanes; ++j)
+		{
+			vNx[j] = _mm_set1_ps(pPlanes[j]->n.x);
+			vNy[j] = _mm_set1_ps(pPlanes[j]->n.y);
+			vNz[j] = _mm_set1_ps(pPlanes[j]->n.z);
+			vD[j] = _mm_set1_ps(pPlanes[j]->d);
+		}
 
-			if (m_pChildren[1][0][0])
+		// 4 boxes per iteration, lanes past nEnd read the padding and are ignored.
+		for (uint32 i = nStart; i < nEnd; i += 4)
+		{
+			__m128 vOut = vZero;
+
+			for (uint32 j = 0; j < nPlanes; ++j)
 			{
-				m_pChildren[1][0][0]->WalkOctree();
+				__m128 vDist = _mm_add_ps(_mm_mul_ps(vNx[j], _mm_loadu_ps(px[j] + i)), vD[j]);
+				vDist = _mm_add_ps(vDist, _mm_mul_ps(vNy[j], _mm_loadu_ps(py[j] + i)));
+				vDist = _mm_add_ps(vDist, _mm_mul_ps(vNz[j], _mm_loadu_ps(pz[j] + i)));
+				vOut = _mm_or_ps(vOut, _mm_cmplt_ps(vDist, vZero));
 			}
 
-			if (m_pChildren[1][0][1])
+			const int outMask = _mm_movemask_ps(vOut);
+			const uint32 nLanes = Min(nEnd - i, (uint32)4);
+
+			for (uint32 k = 0; k < nLanes; ++k)
 			{
-				m_pChildren[1][0][1]->WalkOctree();
+				if (!(outMask & (1 << k)))
+				{
+					m_objViewMasks[i + k] |= viewBit;
+					++stat.nVisibleObjs;
+				}
 			}
+		}
+#else
+		for (uint32 i = nStart; i < nEnd; ++i)
+		{
+			bool bOut = false;
 
-			if (m_pChildren[1][1][0])
+			for (uint32 j = 0; j < nPlanes && !bOut; ++j)
 			{
-				m_pChildren[1][1][0]->WalkOctree();
+				const float fDist = pPlanes[j]->n.x * px[j][i] + pPlanes[j]->n.y * py[j][i] + pPlanes[j]->n.z * pz[j][i] + pPlanes[j]->d;
+				bOut = fDist < 0;
 			}
 
-			if (m_pChildren[1][1][1])
+			if (!bOut)
 			{
-				m_pChildren[1][1][1]->WalkOctree();
+				m_objViewMasks[i] |= viewBit;
+				++stat.nVisibleObjs;
 			}
 		}
-		else
+#endif
+	}
+	//------------------------------------------------------------------------------------
+	void SCullVolume::SetFrustum(const Camera& cam)
+	{
+		for (int i = 0; i < 6; ++i)
 		{
-			++g_env.pSceneMgr->GetOctree()->m_nCulledNodes[m_iDepth];
+			planes[i] = cam.GetFrustumPlane(i);
 		}
+
+		nPlanes = 6;
 	}
 	//------------------------------------------------------------------------------------
-	void OctreeNode::Insert(Entity* pObj, uint32 nDepth)
+	void SCullVolume::SetSweptBox(const AABB& box, const VEC3& vSweepDir)
 	{
-		if (nDepth < OCTREE_MAX_DEPTH)
-		{
-			uint32 x, y, z;
-			GetNodeIndex(pObj->GetWorldAABB(), x, y, z);
+		// Faces looking along the extrusion are open, the others are kept. Every edge between
+		// an open and a kept face adds a plane through the edge, parallel to the extrusion.
+		static const VEC3* AXIS[3] = { &VEC3::UNIT_X, &VEC3::UNIT_Y, &VEC3::UNIT_Z };
 
-			if (m_pChildren[x][y][z] == nullptr)
-			{
-				m_pChildren[x][y][z] = new OctreeNode;
-				m_pChildren[x][y][z]->m_iDepth = m_iDepth + 1;
+		const VEC3 vExtrude = -vSweepDir;
+		const VEC3 vCenter = box.GetCenter();
+		const VEC3 vHalfSize = box.GetSize() / 2;
+		const float extrude[3] = { vExtrude.x, vExtrude.y, vExtrude.z };
+		const float center[3] = { vCenter.x, vCenter.y, vCenter.z };
+		const float halfSize[3] = { vHalfSize.x, vHalfSize.y, vHalfSize.z };
 
-				// Calc AABB of the child node.
-				VEC3 vMin, vMax;
+		nPlanes = 0;
 
-				if (x == 0)
+		for (int a = 0; a < 3; ++a)
+		{
+			for (int s = -1; s <= 1; s += 2)
+			{
+				// Outward normal of this face is s * AXIS[a]
+				if (s * extrude[a] > 0)
 				{
-					vMin.x = m_aabb.m_minCorner.x;
-					vMax.x = (m_aabb.m_minCorner.x + m_aabb.m_maxCorner.x) / 2;
-				} 
-				else
+					continue;
+				}
+
+				planes[nPlanes++].Set(*AXIS[a] * (float)-s, s * center[a] + halfSize[a]);
+			}
+		}
+
+		for (int a = 0; a < 3; ++a)
+		{
+			for (int b = a + 1; b < 3; ++b)
+			{
+				const VEC3& vEdgeDir = *AXIS[3 - a - b];
+
+				for (int sa = -1; sa <= 1; sa += 2)
 				{
-					vMin.x = (m_aabb.m_minCorner.x + m_aabb.m_maxCorner.x) / 2;
-					vMax.x = m_aabb.m_maxCorner.x;
+					for (int sb = -1; sb <= 1; sb += 2)
+					{
+						const float fFacingA = sa * extrude[a];
+						const float fFacingB = sb * extrude[b];
+
+						// Silhouette only if one face is open and the other strictly faces away
+						if (!((fFacingA > 0 && fFacingB < 0) || (fFacingA < 0 && fFacingB > 0)))
+						{
+							continue;
+						}
+
+						const VEC3 vEdgePt = vCenter + *AXIS[a] * (sa * halfSize[a]) + *AXIS[b] * (sb * halfSize[b]);
+
+						VEC3 vNormal = Common::CrossProduct_Vec3_By_Vec3(vEdgeDir, vExtrude);
+						vNormal.Normalize();
+
+						if (Common::DotProduct_Vec3_By_Vec3(vNormal, vCenter - vEdgePt) < 0)
+						{
+							vNormal.Neg();
+						}
+
+						planes[nPlanes++].Redefine(vNormal, vEdgePt);
+					}
 				}
+			}
+		}
 
-				if (y == 0)
+		_AST(nPlanes <= MAX_PLANES);
+	}
+#if USE_BENCHMARK
+	//------------------------------------------------------------------------------------
+	namespace
+	{
+		// The octree before it was linearized: one allocation per node, objs kept in the
+		// leaves, and every node and obj tested against every plane of the view.
+		// Objs were tested by Camera::FrustumCullingAABB(), the plane test stands in for it
+		// so both walkers can be compared on the same views.
+		struct SLegacyOctreeNode
+		{
+			SLegacyOctreeNode()
+			{
+				ZeroMemory(pChildren, sizeof(pChildren));
+			}
+
+			~SLegacyOctreeNode()
+			{
+				for (int i = 0; i < 8; ++i)
 				{
-					vMin.y = m_aabb.m_minCorner.y;
-					vMax.y = (m_aabb.m_minCorner.y + m_aabb.m_maxCorner.y) / 2;
+					SAFE_DELETE(pChildren[i]);
 				}
-				else
+			}
+
+			void Insert(uint32 iObj, const AABB& objAABB, uint32 nDepth)
+			{
+				if (nDepth == OCTREE_MAX_DEPTH)
 				{
-					vMin.y = (m_aabb.m_minCorner.y + m_aabb.m_maxCorner.y) / 2;
-					vMax.y = m_aabb.m_maxCorner.y;
+					objs.push_back(iObj);
+					return;
 				}
 
-				if (z == 0)
+				const VEC3 vNodeCenter = aabb.GetCenter();
+				const VEC3 v = objAABB.GetCenter();
+				const uint32 iChild = (v.x > vNodeCenter.x ? 4 : 0) | (v.y > vNodeCenter.y ? 2 : 0) | (v.z > vNodeCenter.z ? 1 : 0);
+
+				if (pChildren[iChild] == nullptr)
 				{
-					vMin.z = m_aabb.m_minCorner.z;
-					vMax.z = (m_aabb.m_minCorner.z + m_aabb.m_maxCorner.z) / 2;
+					const VEC3 vMin((iChild & 4) ? vNodeCenter.x : aabb.m_minCorner.x,
+						(iChild & 2) ? vNodeCenter.y : aabb.m_minCorner.y,
+						(iChild & 1) ? vNodeCenter.z : aabb.m_minCorner.z);
+					const VEC3 vMax((iChild & 4) ? aabb.m_maxCorner.x : vNodeCenter.x,
+						(iChild & 2) ? aabb.m_maxCorner.y : vNodeCenter.y,
+						(iChild & 1) ? aabb.m_maxCorner.z : vNodeCenter.z);
+
+					pChildren[iChild] = new SLegacyOctreeNode;
+					pChildren[iChild]->SetBound(vMin, vMax);
 				}
-				else
+
+				pChildren[iChild]->Insert(iObj, objAABB, nDepth + 1);
+			}
+
+			void SetBound(const VEC3& vMin, const VEC3& vMax)
+			{
+				aabb.SetNull();
+				aabb.Merge(vMin);
+				aabb.Merge(vMax);
+
+				const VEC3 vHalfSize = aabb.GetSize() / 2;
+				aabbCullBound.SetNull();
+				aabbCullBound.Merge(vMin - vHalfSize);
+				aabbCullBound.Merge(vMax + vHalfSize);
+			}
+
+			void Walk(const SCullVolume& view, const std::vector<AABB>& objAABBs, std::vector<uint8>& visible) const
+			{
+				for (uint32 i = 0; i < view.nPlanes; ++i)
 				{
-					vMin.z = (m_aabb.m_minCorner.z + m_aabb.m_maxCorner.z) / 2;
-					vMax.z = m_aabb.m_maxCorner.z;
+					if (view.planes[i].GetSide(aabbCullBound) == PLANE::NEGATIVE_SIDE)
+					{
+						return;
+					}
 				}
 
-				m_pChildren[x][y][z]->m_aabb.SetNull();
-				m_pChildren[x][y][z]->m_aabb.Merge(vMin);
-				m_pChildren[x][y][z]->m_aabb.Merge(vMax);
+				for (uint32 i = 0; i < objs.size(); ++i)
+				{
+					bool bOut = false;
+
+					for (uint32 j = 0; j < view.nPlanes && !bOut; ++j)
+					{
+						bOut = view.planes[j].GetSide(objAABBs[objs[i]]) == PLANE::NEGATIVE_SIDE;
+					}
 
-				const VEC3 vHalfSize = m_pChildren[x][y][z]->m_aabb.GetSize() / 2;
-				m_pChildren[x][y][z]->m_aabbCullBound.SetNull();
-				m_pChildren[x][y][z]->m_aabbCullBound.Merge(vMin - vHalfSize);
-				m_pChildren[x][y][z]->m_aabbCullBound.Merge(vMax + vHalfSize);
+					if (!bOut)
+					{
+						visible[objs[i]] = 1;
+					}
+				}
+
+				for (int i = 0; i < 8; ++i)
+				{
+					if (pChildren[i])
+					{
+						pChildren[i]->Walk(view, objAABBs, visible);
+					}
+				}
 			}
 
-			m_pChildren[x][y][z]->Insert(pObj, ++nDepth);
+			SLegacyOctreeNode*		pChildren[8];
+			std::vector<uint32>		objs;
+			AABB					aabb;
+			AABB					aabbCullBound;
+		};
 
-			int asdf = 0;
-		} 
-		else
+		// Planes of a perspective frustum, the same ones Camera::GetFrustumPlane() would give
+		void _SetPerspective(SCullVolume& view, const VEC3& vPos, const VEC3& vDir, float fFovY, float fAspect, float fNear, float fFar)
 		{
-			m_pObjs.push_back(pObj);
+			VEC3 zAxis(vDir);
+			zAxis.Normalize();
+			VEC3 xAxis = Common::CrossProduct_Vec3_By_Vec3(VEC3::UNIT_Y, zAxis);
+			xAxis.Normalize();
+			const VEC3 yAxis = Common::CrossProduct_Vec3_By_Vec3(zAxis, xAxis);
+
+			const float fHalfY = fFovY / 2;
+			const float fHalfX = atanf(tanf(fHalfY) * fAspect);
+
+			view.planes[0].Redefine(xAxis * cosf(fHalfX) + zAxis * sinf(fHalfX), vPos);
+			view.planes[1].Redefine(xAxis * -cosf(fHalfX) + zAxis * sinf(fHalfX), vPos);
+			view.planes[2].Redefine(yAxis * -cosf(fHalfY) + zAxis * sinf(fHalfY), vPos);
+			view.planes[3].Redefine(yAxis * cosf(fHalfY) + zAxis * sinf(fHalfY), vPos);
+			view.planes[4].Redefine(zAxis, vPos + zAxis * fNear);
+			view.planes[5].Redefine(-zAxis, vPos + zAxis * fFar);
+			view.nPlanes = 6;
 		}
 	}
-	//------------------------------------------------------------------------------------
-	void OctreeNode::GetNodeIndex(const AABB& aabb, uint32& x, uint32& y, uint32& z)
-	{
-		const VEC3& vNodeCenter = m_aabb.GetCenter();
-		const VEC3& v = aabb.GetCenter();
 
-		x = v.x > vNodeCenter.x ? 1 : 0;
-		y = v.y > vNodeCenter.y ? 1 : 0;
-		z = v.z > vNodeCenter.z ? 1 : 0;
-	}
-	//------------------------------------------------------------------------------------
-	Octree::Octree(const AABB& sceneAABB)
-		: m_nTotalObjs(0)
-		, m_nCulledObjs(0)
+	bool RunOctreeBenchmark(std::vector<SOctreeBenchResult>& results, uint32 nObjs, uint32 nIteration)
 	{
-		m_pRootNode = new OctreeNode;
-		m_pRootNode->m_iDepth = 0;
-		m_pRootNode->m_aabb = sceneAABB;
-	}
-	//------------------------------------------------------------------------------------
-	Octree::~Octree()
-	{
-		SAFE_DELETE(m_pRootNode);
-	}
-	//------------------------------------------------------------------------------------
-	void Octree::Insert(Entity* pObj)
-	{
-		pObj->UpdateAABB();
+		results.clear();
 
-		// Insert object to leaf node.
-		m_pRootNode->Insert(pObj, 0);
+		// A 2km world, objs scattered near the ground
+		const float fWorldSize = 2000.0f;
+		const VEC3 vWorldMin(-fWorldSize / 2, -fWorldSize / 2, -fWorldSize / 2);
+		const VEC3 vWorldMax(fWorldSize / 2, fWorldSize / 2, fWorldSize / 2);
 
-		++m_nTotalObjs;
-	}
-	//------------------------------------------------------------------------------------
-	void Octree::Update()
-	{
-		// Invisible all objs, let the octree find visible objs.
-		EntityList& lstEntity = g_env.pSceneMgr->GetCurScene()->GetEntityList();
+		AABB sceneAABB;
+		sceneAABB.SetNull();
+		sceneAABB.Merge(vWorldMin);
+		sceneAABB.Merge(vWorldMax);
+
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> dist(0.0f, 1.0f);
 
-		for (uint32 i = 0; i < lstEntity.size(); ++i)
+		Octree octree(sceneAABB);
+		SLegacyOctreeNode legacyRoot;
+		legacyRoot.SetBound(vWorldMin, vWorldMax);
+
+		std::vector<Entity*> vecEntities(nObjs);
+		std::vector<AABB> vecObjAABBs(nObjs);
+		std::unordered_map<Entity*, uint32> entityIndices;
+
+		for (uint32 i = 0; i < nObjs; ++i)
 		{
-			lstEntity[i]->SetVisible(false);
+			// Small enough to stay in the loose bound of a leaf of the old octree
+			const VEC3 vHalfSize(0.5f + dist(rng) * 4.5f, 0.5f + dist(rng) * 4.5f, 0.5f + dist(rng) * 4.5f);
+
+			AABB localAABB;
+			localAABB.SetNull();
+			localAABB.Merge(-vHalfSize);
+			localAABB.Merge(vHalfSize);
+
+			Entity* pEntity = new Entity(nullptr, false);
+			pEntity->SetUpdateAABB(true);
+			pEntity->SetLocalAABB(localAABB);
+			pEntity->SetPosition(VEC3((dist(rng) - 0.5f) * fWorldSize * 0.95f, dist(rng) * 100.0f, (dist(rng) - 0.5f) * fWorldSize * 0.95f));
+
+			octree.Insert(pEntity);
+
+			vecEntities[i] = pEntity;
+			vecObjAABBs[i] = pEntity->GetWorldAABB();
+			entityIndices[pEntity] = i;
+			legacyRoot.Insert(i, vecObjAABBs[i], 0);
+		}
+
+		// Camera at the edge of the world looking across it, and a shadow cascade per split
+		SCullVolume views[eCullView_Max];
+
+		const VEC3 vCamPos(0, 50.0f, -fWorldSize * 0.45f);
+		const VEC3 vCamDir(0.2f, -0.1f, 1.0f);
+		const float fFovY = PI / 3, fAspect = 16.0f / 9.0f;
+		_SetPerspective(views[eCullView_Camera], vCamPos, vCamDir, fFovY, fAspect, 1.0f, 1500.0f);
+
+		VEC3 vLightDir(0.3f, -1.0f, 0.2f);
+		vLightDir.Normalize();
+
+		const float splits[CSM_CASCADE_NUM + 1] = { 1.0f, 100.0f, 400.0f, 1500.0f };
+		for (uint32 c = 0; c < CSM_CASCADE_NUM; ++c)
+		{
+			// Bound the slice by the near and far planes of a frustum cut at the split distances
+			SCullVolume slice;
+			_SetPerspective(slice, vCamPos, vCamDir, fFovY, fAspect, splits[c], splits[c + 1]);
+
+			VEC3 zAxis(vCamDir);
+			zAxis.Normalize();
+			VEC3 xAxis = Common::CrossProduct_Vec3_By_Vec3(VEC3::UNIT_Y, zAxis);
+			xAxis.Normalize();
+			const VEC3 yAxis = Common::CrossProduct_Vec3_By_Vec3(zAxis, xAxis);
+
+			AABB sliceAABB;
+			sliceAABB.SetNull();
+			for (int s = 0; s < 2; ++s)
+			{
+				const float fDist = splits[c + s];
+				const float fHalfH = fDist * tanf(fFovY / 2), fHalfW = fHalfH * fAspect;
+				const VEC3 vCenter = vCamPos + zAxis * fDist;
+
+				sliceAABB.Merge(vCenter + xAxis * fHalfW + yAxis * fHalfH);
+				sliceAABB.Merge(vCenter + xAxis * fHalfW - yAxis * fHalfH);
+				sliceAABB.Merge(vCenter - xAxis * fHalfW + yAxis * fHalfH);
+				sliceAABB.Merge(vCenter - xAxis * fHalfW - yAxis * fHalfH);
+			}
+
+			views[eCullView_Cascade0 + c].SetSweptBox(sliceAABB, vLightDir);
+		}
+
+		std::vector<uint8> legacyVisible[eCullView_Max];
+
+		auto walkLegacy = [&](uint32 nViews)
+		{
+			for (uint32 v = 0; v < nViews; ++v)
+			{
+				legacyVisible[v].assign(nObjs, 0);
+				legacyRoot.Walk(views[v], vecObjAABBs, legacyVisible[v]);
+			}
+		};
+
+		const uint32 viewCounts[2] = { 1, eCullView_Max };
+		const char* names[2] = { "Camera", "Camera + cascades" };
+
+		bool bOk = true;
+
+		for (uint32 t = 0; t < 2; ++t)
+		{
+			const uint32 nViews = viewCounts[t];
+
+			// First calls flatten and gather, keep them out of the timing
+			walkLegacy(nViews);
+			octree.Cull(views, nViews);
+
+			SOctreeBenchResult res;
+			res.name = names[t];
+			res.nViews = nViews;
+			res.fOldMs = TimeMs([&]() { for (uint32 i = 0; i < nIteration; ++i) walkLegacy(nViews); });
+			res.fNewMs = TimeMs([&]() { for (uint32 i = 0; i < nIteration; ++i) octree.Cull(views, nViews); });
+			res.nVisibleObjs = 0;
+			res.nMismatches = 0;
+
+			for (uint32 i = 0; i < octree.GetObjCount(); ++i)
+			{
+				const uint32 iObj = entityIndices[octree.GetObj(i)];
+
+				if (octree.GetViewMask(i))
+				{
+					++res.nVisibleObjs;
+				}
+
+				for (uint32 v = 0; v < nViews; ++v)
+				{
+					const bool bNew = (octree.GetViewMask(i) & (1 << v)) != 0;
+					if (bNew != (legacyVisible[v][iObj] != 0))
+					{
+						++res.nMismatches;
+						break;
+					}
+				}
+			}
+
+			if (res.nMismatches)
+				bOk = false;
+
+			results.push_back(res);
 		}
 
-		for (uint32 i = 0; i < OCTREE_MAX_DEPTH; ++i)
+		for (uint32 i = 0; i < nObjs; ++i)
 		{
-			m_nCulledNodes[i] = 0;
+			delete vecEntities[i];
 		}
 
-		m_nCulledObjs = m_nTotalObjs;
-		m_nFrustumCullNum = 0;
-		m_pRootNode->WalkOctree();
+		return bOk;
 	}
+#endif
 
-}
\ No newline at end of file
+}
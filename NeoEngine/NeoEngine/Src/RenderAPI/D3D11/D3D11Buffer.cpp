@@ -42,8 +42,46 @@ namespace Neo
 		}
 	}
 	//------------------------------------------------------------------------------------
+	D3D11ShaderResourceBuffer::D3D11ShaderResourceBuffer(D3D11Buffer* pBuf, uint32 nElements)
+		:ShaderResourceBuffer(pBuf, nElements)
+	{
+
+	}
+	//------------------------------------------------------------------------------------
+	void D3D11ShaderResourceBuffer::Apply(uint32 nSlot, bool bVS, bool bPS, bool bGS, bool bCS, bool bTessellate)
+	{
+		ID3D11ShaderResourceView* pSRV = static_cast<D3D11Buffer*>(m_pBuf)->m_pSRV;
+
+		if (bVS)
+		{
+			g_pRenderSys->GetDeviceContext()->VSSetShaderResources(nSlot, 1, &pSRV);
+		}
+
+		if (bPS)
+		{
+			g_pRenderSys->GetDeviceContext()->PSSetShaderResources(nSlot, 1, &pSRV);
+		}
+
+		if (bGS)
+		{
+			g_pRenderSys->GetDeviceContext()->GSSetShaderResources(nSlot, 1, &pSRV);
+		}
+
+		if (bCS)
+		{
+			g_pRenderSys->GetDeviceContext()->CSSetShaderResources(nSlot, 1, &pSRV);
+		}
+
+		if (bTessellate)
+		{
+			g_pRenderSys->GetDeviceContext()->HSSetShaderResources(nSlot, 1, &pSRV);
+			g_pRenderSys->GetDeviceContext()->DSSetShaderResources(nSlot, 1, &pSRV);
+		}
+	}
+	//------------------------------------------------------------------------------------
 	D3D11Buffer::D3D11Buffer(uint32 nSize, uint32 nStride, uint32 nUsage, const void* pData)
-		: m_nStride(nStride)
+		: m_pSRV(nullptr)
+		, m_nStride(nStride)
 		, m_usage(nUsage)
 		, m_size(nSize)
 		, m_pShadowBuf(nullptr)
@@ -74,6 +112,12 @@ namespace Neo
 		{
 			bd.BindFlags = D3D11_BIND_INDEX_BUFFER;
 		}
+		else if (nUsage & eBufferUsage_StructuredBuf)
+		{
+			bd.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+			bd.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+			bd.StructureByteStride = nStride;
+		}
 
 		if (nUsage & eBufferUsage_Dynamic)
 		{
@@ -91,11 +135,17 @@ namespace Neo
 
 		HRESULT hr = S_OK;
 		V(g_pRenderSys->GetDevice()->CreateBuffer(&bd, pData ? &InitData : nullptr, &m_pBuf));
+
+		if (nUsage & eBufferUsage_StructuredBuf)
+		{
+			V(g_pRenderSys->GetDevice()->CreateShaderResourceView(m_pBuf, nullptr, &m_pSRV));
+		}
 	}
 	//------------------------------------------------------------------------------------
 	D3D11Buffer::~D3D11Buffer()
 	{
 		SAFE_DELETE_ARRAY(m_pShadowBuf);
+		SAFE_RELEASE(m_pSRV);
 		SAFE_RELEASE(m_pBuf);
 	}
 	//------------------------------------------------------------------------------------
@@ -141,6 +191,14 @@ namespace Neo
 		g_pRenderSys->GetDeviceContext()->UpdateSubresource(m_pBuf, 0, NULL, pSrc, 0, 0);
 	}
 	//------------------------------------------------------------------------------------
+	void D3D11Buffer::UpdateBufRange(const void* pSrc, uint32 nOffset, uint32 nSize)
+	{
+		_AST(!(m_usage & (eBufferUsage_Dynamic | eBufferUsage_ConstantBuf)) && nOffset + nSize <= m_size);
+
+		D3D11_BOX box = { nOffset, 0, 0, nOffset + nSize, 1, 1 };
+		g_pRenderSys->GetDeviceContext()->UpdateSubresource(m_pBuf, 0, &box, pSrc, 0, 0);
+	}
+	//------------------------------------------------------------------------------------
 	void* D3D11Buffer::GetInternel()
 	{
 		return m_pBuf;
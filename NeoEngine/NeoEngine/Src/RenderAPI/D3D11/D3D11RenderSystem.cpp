@@ -549,6 +549,11 @@ namespace Neo
 		return new D3D11Texture(filename, type, usage, bSRGB);
 	}
 	//------------------------------------------------------------------------------------
+	Texture* D3D11RenderSystem::LoadTextureFromMemory(const STRING& filename, const void* pData, uint32 nSize, eTextureType type, uint32 usage, bool bSRGB)
+	{
+		return new D3D11Texture(filename, pData, nSize, type, usage, bSRGB);
+	}
+	//------------------------------------------------------------------------------------
 	Texture* D3D11RenderSystem::GetDepthBuffer()
 	{
 		return m_pTexDepthStencil;
@@ -564,14 +569,14 @@ namespace Neo
 		return new D3D11Texture(nWidth, nHeight, pTexData, format, usage, bMipMap);
 	}
 	//------------------------------------------------------------------------------------
-	void D3D11RenderSystem::DrawIndexed(ePrimitive type, IndexBuffer* indexBuf, uint32 nIndexCnt, uint32 nStartIndexLocation, uint32 nBaseIndexLocation, uint32 nInstanced)
+	void D3D11RenderSystem::DrawIndexed(ePrimitive type, IndexBuffer* indexBuf, uint32 nIndexCnt, uint32 nStartIndexLocation, uint32 nBaseIndexLocation, uint32 nInstanced, uint32 nStartInstance)
 	{
 		m_pDeviceContext->IASetPrimitiveTopology(GetD3D11PrimType(type));
 		m_pDeviceContext->IASetIndexBuffer((ID3D11Buffer*)indexBuf->GetInternel(), DXGI_FORMAT_R32_UINT, 0);
 
 		if (nInstanced)
 		{
-			m_pDeviceContext->DrawIndexedInstanced(nIndexCnt, nInstanced, nStartIndexLocation, nBaseIndexLocation, 0);
+			m_pDeviceContext->DrawIndexedInstanced(nIndexCnt, nInstanced, nStartIndexLocation, nBaseIndexLocation, nStartInstance);
 		} 
 		else
 		{
@@ -598,6 +603,12 @@ namespace Neo
 		return new D3D11IndexBuffer(pBuf);
 	}
 	//------------------------------------------------------------------------------------
+	ShaderResourceBuffer* D3D11RenderSystem::CreateShaderResourceBuffer(uint32 nElements, uint32 nStride, uint32 nUsage)
+	{
+		D3D11Buffer* pBuf = new D3D11Buffer(nElements * nStride, nStride, nUsage | eBufferUsage_StructuredBuf);
+		return new D3D11ShaderResourceBuffer(pBuf, nElements);
+	}
+	//------------------------------------------------------------------------------------
 	void D3D11RenderSystem::Draw(uint32 nVertCnt, uint32 nStartVertLocation)
 	{
 		m_pDeviceContext->Draw(nVertCnt, nStartVertLocation);
@@ -122,15 +122,16 @@ namespace Neo
 		}
 		break;
 
+		// The vertices are read from the vertex data buffer, only the patch stream is bound
 		case eVertexType_Terrain:
+		case eVertexType_TerrainCompact:
 		{
 			D3D11_INPUT_ELEMENT_DESC layout[] =
 			{
 				// Stream 0
-				{ "POSITION", 0, DXGI_FORMAT_R16G16_SINT, 0, 0, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-				{ "TEXCOORD", 0, DXGI_FORMAT_R32_FLOAT, 0, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
-				// Stream 1
-				{ "TEXCOORD", 1, DXGI_FORMAT_R32G32_FLOAT, 1, D3D11_APPEND_ALIGNED_ELEMENT, D3D11_INPUT_PER_VERTEX_DATA, 0 },
+				{ "TEXCOORD", 0, DXGI_FORMAT_R32G32B32A32_FLOAT, 0, 0, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+				{ "TEXCOORD", 1, DXGI_FORMAT_R32G32B32_FLOAT, 0, 16, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
+				{ "TEXCOORD", 2, DXGI_FORMAT_R32_UINT, 0, 28, D3D11_INPUT_PER_INSTANCE_DATA, 1 },
 			};
 
 			SAFE_RELEASE(m_pInputLayout);
@@ -15,6 +15,23 @@ namespace Neo
 		, m_pSRV(nullptr)
 		, m_pDSV(nullptr)
 		, m_pTexStaging(nullptr)
+	{
+		_Load(filename, nullptr, 0, usage, bSRGB);
+	}
+	//--------------------------------------------------------------------------
+	D3D11Texture::D3D11Texture(const STRING& filename, const void* pData, uint32 nSize, eTextureType type, uint32 usage, bool bSRGB)
+		: Texture(type, 0, 0, 0, ePF_Unknown, usage, true)
+		, m_pTexture2D(nullptr)
+		, m_pTexture3D(nullptr)
+		, m_pRTV(nullptr)
+		, m_pSRV(nullptr)
+		, m_pDSV(nullptr)
+		, m_pTexStaging(nullptr)
+	{
+		_Load(filename, pData, nSize, usage, bSRGB);
+	}
+	//--------------------------------------------------------------------------
+	void D3D11Texture::_Load(const STRING& filename, const void* pData, uint32 nSize, uint32 usage, bool bSRGB)
 	{
 		////////////////////////////////////////////////////////////////
 		////////////// Load texture
@@ -55,22 +72,36 @@ namespace Neo
 		default: _AST(0);
 		}
 
+		// pData is the whole file already read into memory, the file is only opened without it
 		if (filename.find(".dds") != STRING::npos)
 		{
-			if (usage & eTextureUsage_ReadWrite)
+			const bool bStaging = (usage & eTextureUsage_ReadWrite) != 0;
+			const D3D11_USAGE d3dUsage = bStaging ? D3D11_USAGE_STAGING : D3D11_USAGE_DEFAULT;
+			const uint32 bindFlags = bStaging ? 0 : D3D11_BIND_SHADER_RESOURCE;
+			const uint32 cpuFlags = bStaging ? D3D11_CPU_ACCESS_READ : 0;
+			ID3D11ShaderResourceView** ppSRV = bStaging ? nullptr : &m_pSRV;
+
+			if (pData)
 			{
-				V(DirectX::CreateDDSTextureFromFileEx(g_pRenderSys->GetDevice(), EngineToUnicode(filename).c_str(),
-					4096, D3D11_USAGE_STAGING, 0, D3D11_CPU_ACCESS_READ, 0, bSRGB, pTex, nullptr));
-			} 
+				V(DirectX::CreateDDSTextureFromMemoryEx(g_pRenderSys->GetDevice(), (const uint8_t*)pData, nSize,
+					4096, d3dUsage, bindFlags, cpuFlags, 0, bSRGB, pTex, ppSRV));
+			}
 			else
 			{
 				V(DirectX::CreateDDSTextureFromFileEx(g_pRenderSys->GetDevice(), EngineToUnicode(filename).c_str(),
-					4096, D3D11_USAGE_DEFAULT, D3D11_BIND_SHADER_RESOURCE, 0, 0, bSRGB, pTex, &m_pSRV));
+					4096, d3dUsage, bindFlags, cpuFlags, 0, bSRGB, pTex, ppSRV));
 			}
 		} 
 		else
 		{
-			V(D3DX11CreateTextureFromFileA(g_pRenderSys->GetDevice(), filename.c_str(), &loadInfo, nullptr, pTex, nullptr));
+			if (pData)
+			{
+				V(D3DX11CreateTextureFromMemory(g_pRenderSys->GetDevice(), pData, nSize, &loadInfo, nullptr, pTex, nullptr));
+			}
+			else
+			{
+				V(D3DX11CreateTextureFromFileA(g_pRenderSys->GetDevice(), filename.c_str(), &loadInfo, nullptr, pTex, nullptr));
+			}
 
 			if (!(usage & eTextureUsage_ReadWrite))
 			{
@@ -579,6 +610,22 @@ namespace Neo
 
 			g_pRenderSys->GetDeviceContext()->UpdateSubresource(m_pTexture2D, 0, nullptr, pData->GetDataPointer(), pData->GetPitch(), 0);
 		} 
+		else if (!rcSrc)
+		{
+			// Update rcDest with the whole pixel box
+			_AST(pData->GetBytesPerPixel() == D3D11Texture::GetBytesPerPixelFromFormat(GetFormat()) &&
+				pData->GetWidth() == rcDest->GetWidth() && pData->GetHeight() == rcDest->GetHeight());
+
+			D3D11_BOX box;
+			box.left = rcDest->left;
+			box.right = rcDest->right;
+			box.top = rcDest->top;
+			box.bottom = rcDest->bottom;
+			box.front = 0;
+			box.back = 1;
+
+			g_pRenderSys->GetDeviceContext()->UpdateSubresource(m_pTexture2D, 0, &box, pData->GetDataPointer(), pData->GetPitch(), 0);
+		}
 		else
 		{
 			_AST(0);
@@ -53,6 +53,14 @@ namespace Neo
 
 		OpenGLAPI::UnmapBuffer(m_target);
 	}
+	//------------------------------------------------------------------------------------
+	void GLBuffer::UpdateBufRange(const void* pSrc, uint32 nOffset, uint32 nSize)
+	{
+		_AST(nOffset + nSize <= m_nSize);
+
+		OpenGLAPI::BindBuffer(m_target, m_id);
+		OpenGLAPI::BufferSubData(m_target, nOffset, nSize, pSrc);
+	}
 
 	//------------------------------------------------------------------------------------
 	GLVertexBuffer::GLVertexBuffer(GLBuffer* pBuf, uint32 nSize, uint32 nUsage, const void* pData)
@@ -96,22 +104,25 @@ namespace Neo
 			}
 			break;
 
+		// The vertices are read from the vertex data buffer, only the patch stream is bound
 		case eVertexType_Terrain:
+		case eVertexType_TerrainCompact:
 		{
-			_AST(vecVBOs.size() == 2);
+			_AST(vecVBOs.size() == 1);
 			OpenGLAPI::BindBuffer(GL_ARRAY_BUFFER, (GLuint)vecVBOs[0]->GetInternel());
 
-			// pos index
+			// lod morph, height range
 			OpenGLAPI::EnableVertexAttribArray(0);
-			OpenGLAPI::VertexAttribPointer(0, 2, GL_SHORT, GL_FALSE, 8, (GLvoid*)0);
-			// height
+			OpenGLAPI::VertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(STerrainPatchInstance), (GLvoid*)0);
+			OpenGLAPI::VertexAttribDivisor(0, 1);
+			// terrain position
 			OpenGLAPI::EnableVertexAttribArray(1);
-			OpenGLAPI::VertexAttribPointer(1, 1, GL_FLOAT, GL_FALSE, 8, (GLvoid*)4);
-
-			// delta
-			OpenGLAPI::BindBuffer(GL_ARRAY_BUFFER, (GLuint)vecVBOs[1]->GetInternel());
+			OpenGLAPI::VertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(STerrainPatchInstance), (GLvoid*)16);
+			OpenGLAPI::VertexAttribDivisor(1, 1);
+			// base vertex
 			OpenGLAPI::EnableVertexAttribArray(2);
-			OpenGLAPI::VertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8, (GLvoid*)0);
+			OpenGLAPI::VertexAttribIPointer(2, 1, GL_UNSIGNED_INT, sizeof(STerrainPatchInstance), (GLvoid*)28);
+			OpenGLAPI::VertexAttribDivisor(2, 1);
 		}
 		break;
 
@@ -133,6 +144,11 @@ namespace Neo
 		OpenGLAPI::BindVertexArray(m_vao);
 	}
 	//------------------------------------------------------------------------------------
+	void GLShaderResourceBuffer::Apply(uint32 nSlot, bool bVS, bool bPS, bool bGS, bool bCS, bool bTessellate)
+	{
+		OpenGLAPI::BindBufferBase(GL_SHADER_STORAGE_BUFFER, nSlot, static_cast<GLBuffer*>(m_pBuf)->m_id);
+	}
+	//------------------------------------------------------------------------------------
 	GLIndexBuffer::GLIndexBuffer(GLBuffer* pBuf, uint32 nSize, uint32 nUsage, const void* pData)
 		: IndexBuffer(pBuf)
 	{
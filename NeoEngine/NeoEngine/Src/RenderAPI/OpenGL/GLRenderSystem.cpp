@@ -235,6 +235,11 @@ namespace Neo
 		return new GLTexture(filename, type, usage, bSRGB);
 	}
 	//------------------------------------------------------------------------------------
+	Texture* GLRenderSystem::LoadTextureFromMemory(const STRING& filename, const void* pData, uint32 nSize, eTextureType type /*= eTextureType_2D*/, uint32 usage /*= 0*/, bool bSRGB /*= false*/)
+	{
+		return new GLTexture(filename, pData, nSize, type, usage, bSRGB);
+	}
+	//------------------------------------------------------------------------------------
 	void GLRenderSystem::ApplyBlendState(SStateBlend* pState)
 	{
 		OpenGLAPI::EnableIf(GL_BLEND, pState->Desc.RenderTarget[0].BlendEnable);
@@ -315,13 +320,20 @@ namespace Neo
 		return new GLIndexBuffer(pBuf, nSize, nUsage, pData);
 	}
 	//------------------------------------------------------------------------------------
+	ShaderResourceBuffer* GLRenderSystem::CreateShaderResourceBuffer(uint32 nElements, uint32 nStride, uint32 nUsage)
+	{
+		GLBuffer* pBuf = new GLBuffer(GL_SHADER_STORAGE_BUFFER, nStride, nElements * nStride, nUsage);
+
+		return new GLShaderResourceBuffer(pBuf, nElements);
+	}
+	//------------------------------------------------------------------------------------
 	void GLRenderSystem::SetVertexBuffer(VertexBuffer* vertBuf, uint32 iStream, uint32 nOffset)
 	{
 		GLVertexBuffer* pVB = (GLVertexBuffer*)vertBuf;
 		m_vecCurVBOs.push_back(pVB);
 	}
 	//------------------------------------------------------------------------------------
-	void GLRenderSystem::DrawIndexed(ePrimitive type, IndexBuffer* indexBuf, uint32 nIndexCnt, uint32 nStartIndexLocation, uint32 nBaseIndexLocation, uint32 nInstanced)
+	void GLRenderSystem::DrawIndexed(ePrimitive type, IndexBuffer* indexBuf, uint32 nIndexCnt, uint32 nStartIndexLocation, uint32 nBaseIndexLocation, uint32 nInstanced, uint32 nStartInstance)
 	{
 		GLBoundShaderState* pShaderState = _FindOrCreateBoundShaderState();
 
@@ -337,7 +349,14 @@ namespace Neo
 		default: _AST(0);
 		}
 
-		OpenGLAPI::DrawElements(glPrimType, nIndexCnt, GL_UNSIGNED_INT, nullptr);
+		if (nInstanced)
+		{
+			OpenGLAPI::DrawElementsInstancedBaseInstance(glPrimType, nIndexCnt, GL_UNSIGNED_INT, nullptr, nInstanced, nStartInstance);
+		}
+		else
+		{
+			OpenGLAPI::DrawElements(glPrimType, nIndexCnt, GL_UNSIGNED_INT, nullptr);
+		}
 
 		m_vecCurVBOs.clear();
 		m_curBoundShaderState.Reset();
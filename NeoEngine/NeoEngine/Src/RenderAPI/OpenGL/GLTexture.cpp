@@ -85,6 +85,25 @@ namespace Neo
 
 		V(DirectX::LoadTextureDataFromFile(EngineToUnicode(filename).c_str(), ddsData, &header, &bitData, &bitSize));
 
+		_InitFromDDS(header, bitData, type, usage, bSRGB);
+	}
+	//------------------------------------------------------------------------------------
+	GLTexture::GLTexture(const STRING& filename, const void* pData, uint32 nSize, eTextureType type, uint32 usage, bool bSRGB)
+		: m_pLockData(nullptr)
+		, m_filename(filename)
+	{
+		HRESULT hr = S_OK;
+		const DirectX::DDS_HEADER* header = nullptr;
+		const uint8_t* bitData = nullptr;
+		size_t bitSize = 0;
+
+		V(DirectX::LoadTextureDataFromMemory((const uint8_t*)pData, nSize, &header, &bitData, &bitSize));
+
+		_InitFromDDS(header, bitData, type, usage, bSRGB);
+	}
+	//------------------------------------------------------------------------------------
+	void GLTexture::_InitFromDDS(const DirectX::DDS_HEADER* header, const void* bitData, eTextureType type, uint32 usage, bool bSRGB)
+	{
 		m_width = header->width;
 		m_height = header->height;
 		m_depth = header->depth;
@@ -349,6 +368,25 @@ namespace Neo
 				pData->GetDataPointer()
 				);
 		}
+		else if (!rcSrc)
+		{
+			// Update rcDest with the whole pixel box
+			_AST(pData->GetWidth() == rcDest->GetWidth() && pData->GetHeight() == rcDest->GetHeight());
+
+			OpenGLAPI::BindTexture(GL_TEXTURE_2D, m_id);
+
+			const GLPixelFormat& nativeFormat = GetNativePixelFormat(m_texFormat);
+
+			OpenGLAPI::TexSubImage2D(
+				GL_TEXTURE_2D,
+				0,
+				rcDest->left, rcDest->top,
+				rcDest->GetWidth(), rcDest->GetHeight(),
+				nativeFormat.Format,
+				nativeFormat.Type,
+				pData->GetDataPointer()
+				);
+		}
 		else
 		{
 			_AST(0);
@@ -9,6 +9,7 @@ namespace Neo
 		, m_texType(type)
 		, m_width(nWidth)
 		, m_height(nHeight)
+		, m_depth(nDepth)
 		, m_bMipMap(bMips)
 		, m_texFormat(format)
 	{
@@ -29,6 +30,8 @@ namespace Neo
 		case ePF_L8:		bytesPerPixel = 1; break;
 		case ePF_R16F:		bytesPerPixel = 2; break;
 		case ePF_G32R32F:	bytesPerPixel = 8; break;
+		case ePF_G16R16F:	bytesPerPixel = 4; break;
+		case ePF_A32R32G32B32F: bytesPerPixel = 16; break;
 		case ePF_Depth32:	bytesPerPixel = 4; break;
 
 		case ePF_DXT1:
@@ -82,5 +85,22 @@ namespace Neo
 
 		return nSize;
 	}
+	//------------------------------------------------------------------------------------
+	uint32 Texture::GetResidentBytes() const
+	{
+		uint32 nMips = 1;
+		if (m_bMipMap)
+		{
+			for (uint32 nSize = Max(m_width, m_height); nSize > 1; nSize >>= 1)
+			{
+				++nMips;
+			}
+		}
 
+		const uint32 nSlices = m_texType == eTextureType_CubeMap ? 6 : Max(m_depth, 1u);
+		// Formats we don't know the size of count as 32bit
+		const ePixelFormat format = m_texFormat < ePF_Num ? m_texFormat : ePF_A8R8G8B8;
+
+		return CalcTexDataSize(m_width, m_height, nMips, format) * nSlices;
+	}
 }
\ No newline at end of file
@@ -23,6 +23,11 @@
 
 namespace Neo
 {
+	// Must match gSkinPalette in the shaders
+	static const uint32 SKIN_PALETTE_SLOT = 12;
+	// 16 characters of 64 bones before the palette grows
+	static const uint32 MIN_SKIN_PALETTE_SIZE = 1024;
+
 	//----------------------------------------------------------------------------------------
 	Renderer::Renderer()
 	: m_wndWidth(0)
@@ -31,6 +36,7 @@ namespace Neo
 	, m_pGlobalCBuf(nullptr)
 	, m_pMaterialCB(nullptr)
 	, m_pSkinCB(nullptr)
+	, m_pSkinPalette(nullptr)
 	, m_bClipPlaneEnabled(false)
 	, m_iCurBlendState(0xffffffff)
 	, m_iCurRasterState(0xffffffff)
@@ -124,6 +130,7 @@ namespace Neo
 		SAFE_DELETE(m_pGlobalCBuf);
 		SAFE_DELETE(m_pMaterialCB);
 		SAFE_DELETE(m_pSkinCB);
+		SAFE_DELETE(m_pSkinPalette);
 	}
 	//------------------------------------------------------------------------------------
 	void Renderer::SetActiveTexture(int stage, Texture* pTexture)
@@ -243,7 +250,34 @@ namespace Neo
 	{
 		m_pSkinCB->UpdateBuf(&m_cBufferSkin);
 
-		m_pSkinCB->Apply(3, true, false, false, false, false);
+		m_pSkinCB->Apply(2, true, false, false, false, false);
+
+		if (m_pSkinPalette)
+		{
+			m_pSkinPalette->Apply(SKIN_PALETTE_SLOT, true);
+		}
+	}
+	//------------------------------------------------------------------------------------
+	MAT44* Renderer::BeginSkinPalettes(uint32 nMatrices)
+	{
+		if (!m_pSkinPalette || m_pSkinPalette->GetElementCount() < nMatrices)
+		{
+			uint32 nSize = m_pSkinPalette ? m_pSkinPalette->GetElementCount() : MIN_SKIN_PALETTE_SIZE;
+			while (nSize < nMatrices)
+			{
+				nSize *= 2;
+			}
+
+			SAFE_DELETE(m_pSkinPalette);
+			m_pSkinPalette = m_pRenderSys->CreateShaderResourceBuffer(nSize, sizeof(MAT44), eBufferUsage_Dynamic);
+		}
+
+		return (MAT44*)m_pSkinPalette->Lock();
+	}
+	//------------------------------------------------------------------------------------
+	void Renderer::EndSkinPalettes()
+	{
+		m_pSkinPalette->Unlock();
 	}
 	//-------------------------------------------------------------------------------
 	void Renderer::DrawText( const STRING& text, const IPOINT& pos, const SColor& color )
@@ -265,8 +299,7 @@ namespace Neo
 			lstEntity[i]->GetMaterial()->SetFillMode(b ? eFill_Wireframe : eFill_Solid);
 		}
 
-		TerrainQuadTreeNode* pTerrainNode = g_env.pSceneMgr->GetTerrain()->getTerrain(0, 0)->getQuadTree();
-		pTerrainNode->enableWireframe(b);
+		g_env.pSceneMgr->GetTerrain()->enableWireframe(b);
 	}
 	//------------------------------------------------------------------------------------
 	void Renderer::UnbindTexture(Texture* tex)
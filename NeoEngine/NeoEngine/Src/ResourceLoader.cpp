@@ -0,0 +1,363 @@
+#include "stdafx.h"
+#include "ResourceLoader.h"
+#include "ObjMeshLoader.h"
+#include "SkinModel.h"
+#include "TextureManager.h"
+#include "Texture.h"
+
+namespace Neo
+{
+	//------------------------------------------------------------------------------------
+	ResourceLoader::ResourceLoader()
+		: m_bQuit(false)
+	{
+
+	}
+	//------------------------------------------------------------------------------------
+	ResourceLoader::~ResourceLoader()
+	{
+		Shutdown();
+	}
+	//------------------------------------------------------------------------------------
+	void ResourceLoader::Init(uint32 nThreads)
+	{
+		_AST(m_threads.empty());
+
+#if !USE_MULTITHREAD
+		nThreads = 0;
+#endif
+
+		m_bQuit = false;
+
+		for (uint32 i = 0; i < nThreads; ++i)
+		{
+			m_threads.push_back(std::thread(&ResourceLoader::_LoaderMain, this));
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void ResourceLoader::Shutdown()
+	{
+		if (!m_threads.empty())
+		{
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+				m_bQuit = true;
+			}
+			m_wakeUp.notify_all();
+
+			for (uint32 i = 0; i < m_threads.size(); ++i)
+			{
+				m_threads[i].join();
+			}
+			m_threads.clear();
+		}
+
+		// Nobody is going to pick them up any more
+		std::lock_guard<std::mutex> guard(m_lock);
+
+		for (auto iter = m_requests.begin(); iter != m_requests.end(); ++iter)
+		{
+			_Cancel(iter->get());
+		}
+		m_requests.clear();
+
+		for (auto iter = m_staged.begin(); iter != m_staged.end(); ++iter)
+		{
+			_Cancel(iter->get());
+		}
+		m_staged.clear();
+
+		// Preloaded but never claimed
+		for (auto iter = m_uploaded.begin(); iter != m_uploaded.end(); ++iter)
+		{
+			_ReleaseResults(iter->get());
+		}
+		m_uploaded.clear();
+	}
+	//------------------------------------------------------------------------------------
+	void ResourceLoader::_Cancel(SResourceRequest* pRequest)
+	{
+		if (pRequest->type == eResourceType_Texture)
+		{
+			TextureManager::GetSingleton().FillTexture(pRequest->filename, pRequest->texType, pRequest->texUsage, pRequest->bSRGB, nullptr, 0);
+		}
+
+		SAFE_DELETE(pRequest->pSkeleton);
+		pRequest->state = eResourceState_Failed;
+	}
+	//------------------------------------------------------------------------------------
+	void ResourceLoader::_ReleaseResults(SResourceRequest* pRequest)
+	{
+		SAFE_DELETE(pRequest->pMesh);
+		SAFE_DELETE(pRequest->pSkeleton);
+		SAFE_RELEASE(pRequest->pTexture);
+	}
+	//------------------------------------------------------------------------------------
+	ResourceHandle ResourceLoader::LoadMeshAsync(const STRING& filename)
+	{
+		return _Submit(std::make_shared<SResourceRequest>(eResourceType_Mesh, filename));
+	}
+	//------------------------------------------------------------------------------------
+	ResourceHandle ResourceLoader::LoadTextureAsync(const STRING& filename, eTextureType type, uint32 usage, bool bSRGB)
+	{
+		ResourceHandle handle = std::make_shared<SResourceRequest>(eResourceType_Texture, filename);
+		handle->texType = type;
+		handle->texUsage = usage;
+		handle->bSRGB = bSRGB;
+
+		// Shared with the sync loads, only the first request of a texture reads the file
+		Texture* pTexture = TextureManager::GetSingleton().ReserveTexture(filename, type, usage, bSRGB);
+
+		if (pTexture)
+		{
+			pTexture->AddRef();
+			handle->pTexture = pTexture;
+			handle->state = eResourceState_Ready;
+			m_uploaded.push_back(handle);
+
+			return handle;
+		}
+
+		return _Submit(handle);
+	}
+	//------------------------------------------------------------------------------------
+	ResourceHandle ResourceLoader::_Submit(const ResourceHandle& handle)
+	{
+		if (m_threads.empty())
+		{
+			_Stage(handle);
+			return handle;
+		}
+
+		{
+			std::lock_guard<std::mutex> guard(m_lock);
+			m_requests.push_back(handle);
+		}
+		m_wakeUp.notify_one();
+
+		return handle;
+	}
+	//------------------------------------------------------------------------------------
+	void ResourceLoader::Update(uint32 nBudgetBytes)
+	{
+		// Drop the requests whose results were taken, or which nobody can take any more
+		for (uint32 i = 0; i < m_uploaded.size(); )
+		{
+			SResourceRequest* pRequest = m_uploaded[i].get();
+
+			if (m_uploaded[i].use_count() == 1)
+			{
+				_ReleaseResults(pRequest);
+			}
+
+			if (!pRequest->pMesh && !pRequest->pSkeleton && !pRequest->pTexture)
+			{
+				m_uploaded[i] = m_uploaded.back();
+				m_uploaded.pop_back();
+			}
+			else
+			{
+				++i;
+			}
+		}
+
+		uint32 nUploaded = 0;
+
+		for (;;)
+		{
+			ResourceHandle handle;
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+
+				if (m_staged.empty())
+				{
+					return;
+				}
+
+				// Always let the first one through, otherwise a request bigger than the budget never goes
+				if (nUploaded > 0 && nUploaded + m_staged.front()->nStagedBytes > nBudgetBytes)
+				{
+					return;
+				}
+
+				handle = m_staged.front();
+				m_staged.pop_front();
+			}
+
+			nUploaded += handle->nStagedBytes;
+			_Upload(handle);
+		}
+	}
+	//------------------------------------------------------------------------------------
+	bool ResourceLoader::Wait(const ResourceHandle& handle)
+	{
+		for (;;)
+		{
+			const int state = handle->state;
+
+			if (state == eResourceState_Ready)
+			{
+				return true;
+			}
+			else if (state == eResourceState_Failed)
+			{
+				return false;
+			}
+
+			bool bStageHere = false, bUploadHere = false;
+			{
+				std::lock_guard<std::mutex> guard(m_lock);
+
+				if (state == eResourceState_Pending)
+				{
+					// Don't wait behind the whole queue if no loader thread has started on it
+					auto iter = std::find(m_requests.begin(), m_requests.end(), handle);
+					if (iter != m_requests.end())
+					{
+						m_requests.erase(iter);
+						bStageHere = true;
+					}
+				}
+				else
+				{
+					auto iter = std::find(m_staged.begin(), m_staged.end(), handle);
+					if (iter != m_staged.end())
+					{
+						m_staged.erase(iter);
+						bUploadHere = true;
+					}
+				}
+			}
+
+			if (bStageHere)
+			{
+				_Stage(handle);
+			}
+			else if (bUploadHere)
+			{
+				_Upload(handle);
+			}
+			else
+			{
+				std::this_thread::yield();
+			}
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void ResourceLoader::_LoaderMain()
+	{
+		for (;;)
+		{
+			ResourceHandle handle;
+			{
+				std::unique_lock<std::mutex> lock(m_lock);
+				m_wakeUp.wait(lock, [this]() { return !m_requests.empty() || m_bQuit; });
+
+				if (m_bQuit)
+				{
+					return;
+				}
+
+				handle = m_requests.front();
+				m_requests.pop_front();
+			}
+
+			_Stage(handle);
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void ResourceLoader::_Stage(const ResourceHandle& handle)
+	{
+		SResourceRequest* pRequest = handle.get();
+		bool bOk = false;
+
+		try
+		{
+			if (pRequest->type == eResourceType_Mesh)
+			{
+				if (pRequest->filename.find(".obj") != STRING::npos)
+				{
+					bOk = ObjMeshLoader::LoadMeshData(pRequest->filename, false, pRequest->meshData);
+				}
+				else
+				{
+					bOk = MeshLoader::LoadMeshData(pRequest->filename, pRequest->meshData);
+
+					if (bOk && !pRequest->meshData.skeletonLink.empty())
+					{
+						pRequest->pSkeleton = MeshLoader::LoadSkeleton(pRequest->meshData.skeletonLink);
+					}
+				}
+
+				pRequest->nStagedBytes = pRequest->meshData.GetByteSize();
+			}
+			else
+			{
+				std::ifstream file(pRequest->filename.c_str(), std::ios::binary | std::ios::ate);
+
+				if (file.good())
+				{
+					pRequest->fileData.resize((size_t)file.tellg());
+					file.seekg(0);
+					file.read(pRequest->fileData.data(), pRequest->fileData.size());
+
+					bOk = file.good() && !pRequest->fileData.empty();
+				}
+
+				pRequest->nStagedBytes = pRequest->fileData.size();
+			}
+		}
+		catch (std::exception&)
+		{
+			bOk = false;
+		}
+
+		if (!bOk && pRequest->type == eResourceType_Mesh)
+		{
+			pRequest->state = eResourceState_Failed;
+			return;
+		}
+
+		// A texture goes to _Upload() even if it failed, its TextureManager entry is dropped on the main thread
+		if (!bOk)
+		{
+			std::vector<char>().swap(pRequest->fileData);
+			pRequest->nStagedBytes = 0;
+		}
+
+		// The state goes after the queue, so Wait() always finds a staged request in m_staged
+		std::lock_guard<std::mutex> guard(m_lock);
+		m_staged.push_back(handle);
+		pRequest->state = eResourceState_Staged;
+	}
+	//------------------------------------------------------------------------------------
+	void ResourceLoader::_Upload(const ResourceHandle& handle)
+	{
+		SResourceRequest* pRequest = handle.get();
+
+		if (pRequest->type == eResourceType_Mesh)
+		{
+			pRequest->pMesh = MeshLoader::CreateMesh(pRequest->filename, pRequest->meshData);
+			MeshLoader::SMeshData().subMeshes.swap(pRequest->meshData.subMeshes);
+		}
+		else
+		{
+			// Empty file data drops the reservation, the texture may still have been loaded meanwhile
+			Texture* pTexture = TextureManager::GetSingleton().FillTexture(pRequest->filename, pRequest->texType, pRequest->texUsage, pRequest->bSRGB,
+				pRequest->fileData.empty() ? nullptr : pRequest->fileData.data(), pRequest->fileData.size());
+			std::vector<char>().swap(pRequest->fileData);
+
+			if (!pTexture)
+			{
+				pRequest->state = eResourceState_Failed;
+				return;
+			}
+
+			pTexture->AddRef();
+			pRequest->pTexture = pTexture;
+		}
+
+		m_uploaded.push_back(handle);
+		pRequest->state = eResourceState_Ready;
+	}
+}
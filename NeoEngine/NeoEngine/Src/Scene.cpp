@@ -8,12 +8,19 @@
 #include "Terrain/Terrain.h"
 #include "Entity.h"
 #include "Material.h"
+#include "Octree.h"
+#include "JobSystem.h"
+#include "SkinModel.h"
 
 namespace Neo
 {
+	// Number of entities updated by one job
+	static const uint32 ENTITY_UPDATE_GRAIN = 32;
+
 	//------------------------------------------------------------------------------------
 	Scene::Scene( StrategyFunc& setupFunc, StrategyFunc& enterFunc )
 		:m_bSetup(false)
+		,m_bPreloaded(false)
 		,m_setupFunc(setupFunc)
 		,m_enterFunc(enterFunc)
 	{
@@ -23,6 +30,7 @@ namespace Neo
 	Scene::~Scene()
 	{
 		m_lstEntity.clear();
+		m_lstSkinModel.clear();
 	}
 	//------------------------------------------------------------------------------------
 	void Scene::AddEntity( Entity* pEntity )
@@ -30,6 +38,12 @@ namespace Neo
 		m_lstEntity.push_back(pEntity);
 	}
 	//------------------------------------------------------------------------------------
+	void Scene::AddSkinModel(SkinModel* pModel)
+	{
+		m_lstEntity.push_back(pModel);
+		m_lstSkinModel.push_back(pModel);
+	}
+	//------------------------------------------------------------------------------------
 	void Scene::AddInstancedEntity(const STRING& category, Entity* pEntity)
 	{
 		m_mapInstanced[category].lstEntity.push_back(pEntity);
@@ -51,12 +65,28 @@ namespace Neo
 		}
 	}
 	//------------------------------------------------------------------------------------
+	void Scene::Preload()
+	{
+		if (m_bSetup || m_bPreloaded)
+		{
+			return;
+		}
+
+		if (m_preloadFunc)
+		{
+			m_preloadFunc(this);
+		}
+		m_bPreloaded = true;
+	}
+	//------------------------------------------------------------------------------------
 	void Scene::Enter()
 	{
 		g_env.pSceneMgr->ClearScene();
 
 		if(!m_bSetup)
 		{
+			// Whatever the setup func waits on first, the rest keeps loading meanwhile
+			Preload();
 			m_setupFunc(this);
 			m_bSetup = true;
 		}
@@ -85,9 +115,39 @@ namespace Neo
 	//------------------------------------------------------------------------------------
 	void Scene::Update(float fDeltaTime)
 	{
+		// Entities only touch their own transform and bounds, relocating them in
+		// the octree is postponed and done serially in list order afterwards.
+		Octree* pOctree = g_env.pSceneMgr->GetOctree();
+		pOctree->SetDeferUpdates(true);
+
+		// Much more work per model than per entity, so they get their own finer grained jobs.
+		// Visibility is the culling result of the last frame.
+		if (!m_lstSkinModel.empty())
+		{
+			SkinModel::UpdateAnimations(&m_lstSkinModel[0], m_lstSkinModel.size(), fDeltaTime, g_env.pSceneMgr->GetCamera(), &m_animStats);
+		}
+
+		JobSystem::GetSingleton().ParallelFor(m_lstEntity.size(), ENTITY_UPDATE_GRAIN, [this, fDeltaTime](uint32 nBegin, uint32 nEnd)
+		{
+			for (uint32 i = nBegin; i < nEnd; ++i)
+			{
+				m_lstEntity[i]->Update(fDeltaTime);
+			}
+		});
+
+		pOctree->SetDeferUpdates(false);
+
 		for (size_t i=0; i<m_lstEntity.size(); ++i)
 		{
-			m_lstEntity[i]->Update(fDeltaTime);
+			m_lstEntity[i]->FlushOctreeUpdate();
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void Scene::UploadSkinPalettes()
+	{
+		if (!m_lstSkinModel.empty())
+		{
+			SkinModel::UploadPalettes(&m_lstSkinModel[0], m_lstSkinModel.size());
 		}
 	}
 	//----------------------------------------------------------------------------------------
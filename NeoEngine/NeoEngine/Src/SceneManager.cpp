@@ -17,6 +17,7 @@
 #include "StructuredBuffer.h"
 #include "AmbientCube.h"
 #include "MaterialManager.h"
+#include "TextureManager.h"
 #include "SkinModel.h"
 #include "ThirdPersonCharacter.h"
 #include "ShadowMapPSSM.h"
@@ -25,12 +26,18 @@
 #include "Octree.h"
 #include "Terrain/TerrainGroup.h"
 #include "Decal.h"
+#include "JobSystem.h"
+#include "ResourceLoader.h"
 
 
 namespace Neo
 {
 	bool g_bTiled = false;
 
+	// Staging data handed to the GPU per frame by ResourceLoader
+	static const uint32 RESOURCE_UPLOAD_BUDGET = 4 * 1024 * 1024;
+	static const uint32 RESOURCE_LOADER_THREADS = 2;
+
 	//------------------------------------------------------------------------------------
 	SceneManager::SceneManager()
 	: m_pRenderSystem(g_env.pRenderer->GetRenderSys())
@@ -64,11 +71,15 @@ namespace Neo
 		const uint32 nScreenWidth = g_env.pRenderer->GetWndWidth();
 		const uint32 nScreenHeight = g_env.pRenderer->GetWndHeight();
 
+		JobSystem::GetSingleton().Init();
+		ResourceLoader::GetSingleton().Init(RESOURCE_LOADER_THREADS);
+
 		AABB aabb;
 		aabb.Merge(VEC3(-10000.0f, -10000.0f, -10000.0f));
 		aabb.Merge(VEC3(10000.0f, 10000.0f, 10000.0f));
 
-		m_pTexEnvBRDF = m_pRenderSystem->LoadTexture(GetResPath("EnvironmentBRDF.dds"));
+		m_pTexEnvBRDF = TextureManager::GetSingleton().LoadTexture(GetResPath("EnvironmentBRDF.dds"));
+		m_pTexEnvBRDF->AddRef();
 
 		m_pRT_Normal = g_env.pRenderer->CreateRenderTarget(nScreenWidth, nScreenHeight, 1, ePF_A8R8G8B8, 0);
 		m_pRT_Albedo = g_env.pRenderer->CreateRenderTarget(nScreenWidth, nScreenHeight, 1, ePF_A8R8G8B8, 0);
@@ -170,11 +181,21 @@ namespace Neo
 	//-------------------------------------------------------------------------------
 	SceneManager::~SceneManager()
 	{
+		JobSystem::GetSingleton().Shutdown();
+		ResourceLoader::GetSingleton().Shutdown();
+
 		ClearScene();
 
 		std::for_each(m_scenes.begin(), m_scenes.end(), std::default_delete<Scene>());
 		m_scenes.clear();
 
+		// Shared by the skin models, all gone with the scenes
+		for (auto iter = m_skeletons.begin(); iter != m_skeletons.end(); ++iter)
+		{
+			SAFE_DELETE(iter->second);
+		}
+		m_skeletons.clear();
+
 		SAFE_DELETE(m_pTerrain);
 		SAFE_DELETE(m_pTerrainOptions);
 		SAFE_DELETE(m_pOctree);
@@ -196,6 +217,9 @@ namespace Neo
 		SAFE_RELEASE(m_pMtlCompose);
 		SAFE_RELEASE(m_pMtlLinearizeDepth);
 		SAFE_RELEASE(m_pMtlFinalScene);
+
+		// The cache is a static singleton, release its textures while the device is still there
+		TextureManager::GetSingleton().Clear();
 	}
 	//-------------------------------------------------------------------------------
 	void SceneManager::CreateSky()
@@ -219,7 +243,7 @@ namespace Neo
 		pSkinModel->SetCastShadow(true);
 		pSkinModel->SetScale(0.4f);
 
-		pScene->AddEntity(pSkinModel);
+		pScene->AddSkinModel(pSkinModel);
 
 		Material* pMaterial = Neo::MaterialManager::GetSingleton().NewMaterial("Mtl_sinbad", eVertexType_SkinModel, pSkinModel->GetMesh()->GetSubMeshCount());
 
@@ -239,7 +263,7 @@ namespace Neo
 
 		for (uint32 i = 0; i < pSkinModel->GetMesh()->GetSubMeshCount(); ++i)
 		{
-			Texture* pTexDiff = m_pRenderSystem->LoadTexture(GetResPath(strTexNames[i]), eTextureType_2D, 0, true);
+			Texture* pTexDiff = TextureManager::GetSingleton().LoadTexture(GetResPath(strTexNames[i]), eTextureType_2D, 0, true);
 
 			pMaterial->GetSubMaterial(i).SetTexture(0, pTexDiff);
 			pMaterial->GetSubMaterial(i).glossiness = vSpecGloss[i].w;
@@ -259,33 +283,87 @@ namespace Neo
 	//-------------------------------------------------------------------------------
 	void SceneManager::Update(float fDeltaTime)
 	{
+		ResourceLoader::GetSingleton().Update(RESOURCE_UPLOAD_BUDGET);
+		TextureManager::GetSingleton().Update();
+
 		if (!m_pCurScene)
 		{
 			return;
 		}
 
+		// The hero drives the camera, so it goes first and all jobs see the final camera of this frame
+		if (m_pHero)
+		{
+			m_pHero->Update(fDeltaTime);
+		}
+
+		// Frustum planes are built lazily, do it before they are read from several jobs
+		m_camera->GetFrustumPlane(0);
+
+		// Terrains are paged in and out around the final camera, before their LOD is calculated
 		if (m_pTerrain)
 		{
-			m_pTerrain->UpdateLod();
+			m_pTerrain->UpdatePaging(*m_camera);
 		}
 
-		m_pOctree->Update();
+		ShadowMapPSSM* pPSSM = nullptr;
+#if !USE_LISPPSM && USE_PSSM
+		if (m_pShadowMap)
+		{
+			pPSSM = m_pShadowMap->GetPSSM();
+			pPSSM->PrepareCascades(*m_camera);
+		}
+#endif
 
-		if (m_pHero)
+		// Entities update their bounds first, then one octree traversal culls the camera
+		// and finds the casters of all cascades. Cascades are independent of each other.
+		JobGraph graph;
+
+		const JobGraph::TaskID taskEntities = graph.AddTask([this, fDeltaTime]() { m_pCurScene->Update(fDeltaTime); });
+
+		const JobGraph::TaskID taskCull = graph.AddTask([this, pPSSM]()
 		{
-			m_pHero->Update(fDeltaTime);
+			if (pPSSM)
+				pPSSM->FindCasters(*m_camera);
+			else
+				m_pOctree->Update();
+		});
+		graph.AddDependency(taskCull, taskEntities);
+
+		if (pPSSM)
+		{
+			for (int i = 0; i < CSM_CASCADE_NUM; ++i)
+			{
+				const JobGraph::TaskID taskCascade = graph.AddTask([pPSSM, i]() { pPSSM->UpdateCascade(i); });
+				graph.AddDependency(taskCascade, taskCull);
+			}
+		}
+		else if (m_pShadowMap)
+		{
+			const JobGraph::TaskID taskShadow = graph.AddTask([this]() { m_pShadowMap->Update(); });
+			graph.AddDependency(taskShadow, taskEntities);
 		}
 
-		if(m_pShadowMap)
-			m_pShadowMap->Update();
+		if (m_pTerrain)
+		{
+			graph.AddTask([this]() { m_pTerrain->CalculateLod(); });
+		}
+
+		graph.Execute();
+
+		// Below may create render resources, stay on the main thread
+		m_pCurScene->UploadSkinPalettes();
+
+		if (m_pTerrain)
+		{
+			m_pTerrain->CreateLodEntities();
+		}
 
 		if (m_pWater)
 			m_pWater->Update();
 
 		if (m_pSky)
 			m_pSky->Update();
-
-		m_pCurScene->Update(fDeltaTime);
 	}
 	//------------------------------------------------------------------------------------
 	void SceneManager::Render(Material* pMaterial)
@@ -665,10 +743,19 @@ namespace Neo
 			sprintf_s(szBuf, sizeof(szBuf), "CasterIn Cascade0: %d, Cascade1: %d, Cascade2: %d", nShadowCasters0, nShadowCasters1, nShadowCasters2);
 			g_env.pRenderer->DrawText(szBuf, IPOINT(10, 55), Neo::SColor::YELLOW);
 
-			sprintf_s(szBuf, sizeof(szBuf), "Total Objects: %d, Culled Objects: %d, Frustum Cull Performs: %d", 
-				m_pOctree->m_nTotalObjs, m_pOctree->m_nCulledObjs, m_pOctree->m_nFrustumCullNum);
+			const Octree::SViewStat& camStat = m_pOctree->GetViewStat(eCullView_Camera);
+			sprintf_s(szBuf, sizeof(szBuf), "Total Objects: %d, Visible Objects: %d, Culled Nodes: %d, Object Tests: %d", 
+				m_pOctree->GetTotalObjCount(), camStat.nVisibleObjs, camStat.nCulledNodes, camStat.nObjTests);
 			g_env.pRenderer->DrawText(szBuf, IPOINT(10, 70), Neo::SColor::YELLOW);
 
+			const Octree::SViewStat& cascadeStat0 = m_pOctree->GetViewStat(eCullView_Cascade0);
+			const Octree::SViewStat& cascadeStat1 = m_pOctree->GetViewStat(eCullView_Cascade0 + 1);
+			const Octree::SViewStat& cascadeStat2 = m_pOctree->GetViewStat(eCullView_Cascade0 + 2);
+			sprintf_s(szBuf, sizeof(szBuf), "Cascade Culled Nodes: %d, %d, %d, Object Tests: %d, %d, %d", 
+				cascadeStat0.nCulledNodes, cascadeStat1.nCulledNodes, cascadeStat2.nCulledNodes,
+				cascadeStat0.nObjTests, cascadeStat1.nObjTests, cascadeStat2.nObjTests);
+			g_env.pRenderer->DrawText(szBuf, IPOINT(10, 85), Neo::SColor::YELLOW);
+
 			if (m_pHero)
 			{
 				g_env.pRenderer->DrawText(m_strHeroStateChange, IPOINT(10, 100), Neo::SColor::YELLOW);
@@ -787,6 +874,9 @@ namespace Neo
 		{
 			m_pOctree->Insert(lstEntity[i]);
 		}
+
+		// Load the next scene in background while this one is shown
+		m_scenes[(curScene + 1) % m_scenes.size()]->Preload();
 	}
 	//------------------------------------------------------------------------------------
 	void SceneManager::SetupSunLight( const VEC3& dir, const SColor& color )
@@ -794,6 +884,15 @@ namespace Neo
 		m_sunLight.lightDir = dir;
 		m_sunLight.lightDir.Normalize();
 		m_sunLight.lightColor = color;
+
+		// Terrain lightmaps are baked along the sun direction
+		if (m_pTerrainOptions && !m_pTerrainOptions->getLightMapDirection().IsEquivalent(m_sunLight.lightDir))
+		{
+			m_pTerrainOptions->setLightMapDirection(m_sunLight.lightDir);
+
+			if (m_pTerrain)
+				m_pTerrain->dirtyLightmaps();
+		}
 	}
 	//------------------------------------------------------------------------------------
 	Mesh* SceneManager::CreateFrustumMesh( const VEC3& minBottom, const VEC3& maxBottom, const VEC3& minTop, const VEC3& maxTop )
@@ -995,26 +1094,64 @@ namespace Neo
 	//------------------------------------------------------------------------------------
 	Mesh* SceneManager::LoadMeshFromFile(const STRING& meshname, const STRING& filename)
 	{
-		Mesh* mesh = nullptr;
-		SkeletonAnim* skel = nullptr;
+		ResourceHandle handle;
+		auto iter = m_pendingMeshes.find(meshname);
 
-		if (filename.find(".obj") != STRING::npos)
+		if (iter != m_pendingMeshes.end())
 		{
-			mesh = ObjMeshLoader::LoadMesh(filename, false, false);
+			handle = iter->second;
+			m_pendingMeshes.erase(iter);
 		}
 		else
 		{
-			mesh = MeshLoader::LoadMesh(filename, false, &skel);
+			handle = ResourceLoader::GetSingleton().LoadMeshAsync(filename);
+		}
 
-			if (skel)
-			{
-				m_skeletons.insert(std::make_pair(mesh, skel));
-			}
+		if (!ResourceLoader::GetSingleton().Wait(handle))
+		{
+			throw std::logic_error("Failed to load mesh: " + filename);
+		}
+
+		// Take the results, the loader releases what's left
+		Mesh* pMesh = handle->pMesh;
+		handle->pMesh = nullptr;
+
+		if (handle->pSkeleton)
+		{
+			m_skeletons.insert(std::make_pair(pMesh, handle->pSkeleton));
+			handle->pSkeleton = nullptr;
 		}
 
-		m_meshes.insert(std::make_pair(meshname, mesh));
+		m_meshes.insert(std::make_pair(meshname, pMesh));
+
+		return pMesh;
+	}
+	//------------------------------------------------------------------------------------
+	void SceneManager::PreloadMesh(const STRING& meshname)
+	{
+		if (m_meshes.find(meshname) != m_meshes.end() || m_pendingMeshes.find(meshname) != m_pendingMeshes.end())
+		{
+			return;
+		}
+
+		m_pendingMeshes.insert(std::make_pair(meshname, ResourceLoader::GetSingleton().LoadMeshAsync(meshname)));
+	}
+	//------------------------------------------------------------------------------------
+	void SceneManager::PreloadTexture(const STRING& filename, eTextureType type, uint32 usage, bool bSRGB)
+	{
+		// Nothing to claim, the uploaded texture waits in the cache
+		ResourceLoader::GetSingleton().LoadTextureAsync(filename, type, usage, bSRGB);
+	}
+	//------------------------------------------------------------------------------------
+	bool SceneManager::IsMeshLoaded(const STRING& meshname) const
+	{
+		if (m_meshes.find(meshname) != m_meshes.end())
+		{
+			return true;
+		}
 
-		return mesh;
+		auto iter = m_pendingMeshes.find(meshname);
+		return iter != m_pendingMeshes.end() && ResourceLoader::GetSingleton().IsReady(iter->second);
 	}
 
 }
\ No newline at end of file
@@ -14,6 +14,7 @@
 #include "MaterialManager.h"
 #include "Renderer.h"
 #include "Texture.h"
+#include "Octree.h"
 
 namespace Neo
 {
@@ -51,14 +52,25 @@ namespace Neo
 	}
 	//------------------------------------------------------------------------------------
 	void ShadowMapPSSM::Update(Camera& cam)
+	{
+		PrepareCascades(cam);
+		FindCasters(cam);
+
+		for (int i = 0; i < CSM_CASCADE_NUM; ++i)
+		{
+			UpdateCascade(i);
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void ShadowMapPSSM::PrepareCascades(Camera& cam)
 	{
 		// Constructing a new camera because we will modify near/far plane
-		Camera tmpCam = cam;
+		m_splitCam = cam;
 
-		_AdjustCameraNearFar(tmpCam);
+		_AdjustCameraNearFar(m_splitCam);
 
 		float fSplitPoints[CSM_CASCADE_NUM + 1] = { 0 };
-		_CalculateSplitPositions(tmpCam, fSplitPoints);
+		_CalculateSplitPositions(m_splitCam, fSplitPoints);
 
 		cBufferGlobal& cb = g_env.pRenderer->GetGlobalCB();
 		cb.shadowSplitDists[0] = fSplitPoints[0];
@@ -67,8 +79,8 @@ namespace Neo
 		cb.shadowSplitDists[3] = fSplitPoints[3];
 
 		// Calc light view matrix
-		VEC3 vLightDir = g_env.pSceneMgr->GetSunLight().lightDir;
-		VEC3 vInvLightDir = vLightDir;
+		m_vLightDir = g_env.pSceneMgr->GetSunLight().lightDir;
+		VEC3 vInvLightDir = m_vLightDir;
 		vInvLightDir.Neg();
 
 		const AABB sceneAABB = g_env.pSceneMgr->GetCurScene()->GetSceneAABB();
@@ -79,48 +91,89 @@ namespace Neo
 		m_matLightView = lightView;
 
 		// Calc a tight light frustum
-		AABB tmpAABB = _CalculateSplitFrustumAABB(tmpCam, tmpCam.GetNearClip(), tmpCam.GetFarClip());
+		AABB tmpAABB = _CalculateSplitFrustumAABB(m_splitCam, m_splitCam.GetNearClip(), m_splitCam.GetFarClip());
 		tmpAABB.Transform(lightView);
 
 		const VEC3 vAabbSize = tmpAABB.GetSize();
 		
 		MAT44 lightProj = Common::BuildOthroMatrix(vAabbSize.x, vAabbSize.y, 0, vAabbSize.z);
+		m_matLightViewProj = lightView * lightProj;
+
+		for (int i = 0; i < CSM_CASCADE_NUM; ++i)
+		{
+			m_splitFrustumAABB[i] = _CalculateSplitFrustumAABB(m_splitCam, fSplitPoints[i], fSplitPoints[i + 1]);
+			m_casterVolumes[i].SetSweptBox(m_splitFrustumAABB[i], m_vLightDir);
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void ShadowMapPSSM::FindCasters(Camera& cam)
+	{
+		SCullVolume views[eCullView_Max];
+		views[eCullView_Camera].SetFrustum(cam);
 
 		for (int i = 0; i < CSM_CASCADE_NUM; ++i)
 		{
-			VEC3 vFrustumPoints[8];
-			AABB frusumAABB = _CalculateSplitFrustumAABB(tmpCam, fSplitPoints[i], fSplitPoints[i + 1], vFrustumPoints);
+			views[eCullView_Cascade0 + i] = m_casterVolumes[i];
+			m_shadowCasters[i].clear();
+		}
 
-			// find casters
-			std::vector<Entity*> castersInSplit = _FindCasters(tmpCam, frusumAABB, vLightDir);
-			//std::vector<Entity*> castersInSplit = _FindCasters2(tmpCam, fSplitPoints[i], fSplitPoints[i + 1]);
-			
-			m_shadowCasters[i] = castersInSplit;
+		Octree* pOctree = g_env.pSceneMgr->GetOctree();
+		pOctree->Cull(views, eCullView_Max);
 
-			// calculate crop matrix
-			MAT44 matCrop = _CalculateCropMatrix(tmpCam, g_env.pSceneMgr->GetCurScene()->GetEntityList(), castersInSplit, frusumAABB, lightView * lightProj);
+		// One pass for all cascades
+		for (uint32 i = 0; i < pOctree->GetObjCount(); ++i)
+		{
+			const uint32 casterMask = pOctree->GetViewMask(i) >> eCullView_Cascade0;
+			Entity *pObject = pOctree->GetObj(i);
 
-			// combine
-			if (castersInSplit.empty())
-			{
-				m_matLightProj[i] = MAT44::ZERO;
-		//		m_matLightProj[i].m33 = 1.0f;
-			} 
-			else
+			if (casterMask == 0)
+				continue;
+
+			if (!pObject->GetCastShadow()
+#if USE_ESM
+				// ESM requires rendering shadow receivers..
+				&& !pObject->GetReceiveShadow()
+#endif
+				) 
+				continue;
+
+			for (int iCascade = 0; iCascade < CSM_CASCADE_NUM; ++iCascade)
 			{
-				m_matLightProj[i] = lightView * lightProj * matCrop;
+				if (casterMask & (1 << iCascade))
+				{
+					m_shadowCasters[iCascade].push_back(pObject);
+				}
 			}
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void ShadowMapPSSM::UpdateCascade(int i)
+	{
+		const AABB& frusumAABB = m_splitFrustumAABB[i];
 
-			// calculate texture matrix
-			float fTexOffset = 0.5f + (0.5f / g_env.pSceneMgr->GetShadowMapSize());
-
-			MAT44 matTexBias(0.5f, 0.0f, 0.0f, 0.0f,
-				0.0f, -0.5f, 0.0f, 0.0f,
-				0.0f, 0.0f, 1.0f, 0.0f,
-				fTexOffset, fTexOffset, 0.0f, 1.0f);
+		// calculate crop matrix
+		MAT44 matCrop = _CalculateCropMatrix(m_splitCam, g_env.pSceneMgr->GetCurScene()->GetEntityList(), m_shadowCasters[i], frusumAABB, m_matLightViewProj);
 
-			m_matShadowTransform[i] = m_matLightProj[i] * matTexBias;
+		// combine
+		if (m_shadowCasters[i].empty())
+		{
+			m_matLightProj[i] = MAT44::ZERO;
+	//		m_matLightProj[i].m33 = 1.0f;
+		} 
+		else
+		{
+			m_matLightProj[i] = m_matLightViewProj * matCrop;
 		}
+
+		// calculate texture matrix
+		float fTexOffset = 0.5f + (0.5f / g_env.pSceneMgr->GetShadowMapSize());
+
+		MAT44 matTexBias(0.5f, 0.0f, 0.0f, 0.0f,
+			0.0f, -0.5f, 0.0f, 0.0f,
+			0.0f, 0.0f, 1.0f, 0.0f,
+			fTexOffset, fTexOffset, 0.0f, 1.0f);
+
+		m_matShadowTransform[i] = m_matLightProj[i] * matTexBias;
 	}
 	//------------------------------------------------------------------------------------
 	void ShadowMapPSSM::Render()
@@ -287,34 +340,6 @@ namespace Neo
 		return aabb;
 	}
 	//------------------------------------------------------------------------------------
-	std::vector<Entity*> ShadowMapPSSM::_FindCasters(Camera& cam, const AABB& frustumAABB, const VEC3& vSweepDir)
-	{
-		std::vector<Entity*> casters;
-		auto& lstEntity = g_env.pSceneMgr->GetCurScene()->GetEntityList();
-		casters.reserve(lstEntity.size());
-
-		for (uint32 i = 0; i < lstEntity.size(); i++)
-		{
-			Entity *pObject = lstEntity[i];
-
-			if (!pObject->GetCastShadow()
-#if USE_ESM
-				// ESM requires rendering shadow receivers..
-				&& !pObject->GetReceiveShadow()
-#endif
-				) 
-				continue;
-
-			// do intersection test
-			if (!SweepIntersectionTest(pObject->GetWorldAABB(), frustumAABB, vSweepDir))
-				continue;
-
-			casters.push_back(pObject);
-		}
-
-		return casters;
-	}
-	//------------------------------------------------------------------------------------
 	// helper function for computing AABB in clip space
 	static AABB CreateClipSpaceAABB(const AABB &bb, const MAT44 &mViewProj)
 	{
@@ -416,55 +441,6 @@ namespace Neo
 		return BuildCropMatrix(cropBB.m_minCorner, cropBB.m_maxCorner);
 	}
 	//------------------------------------------------------------------------------------
-	std::vector<Entity*> ShadowMapPSSM::_FindCasters2(Camera& cam, float fNear, float fFar)
-	{
-		std::vector<Entity*> casters;
-		auto& lstEntity = g_env.pSceneMgr->GetCurScene()->GetEntityList();
-		casters.reserve(lstEntity.size());
-
-		for (uint32 i = 0; i < lstEntity.size(); i++)
-		{
-			Entity *pObject = lstEntity[i];
-			if (!pObject->GetCastShadow())
-				continue;
-
-			// do intersection test
-			if (!_IsAabbInsideFrustum(cam, fNear, fFar, pObject->GetWorldAABB()))
-				continue;
-
-			casters.push_back(pObject);
-		}
-		return casters;
-	}
-	//------------------------------------------------------------------------------------
-	bool ShadowMapPSSM::_IsAabbInsideFrustum(Camera& cam, float fNear, float fFar, const AABB& aabb)
-	{
-		//תռвü
-		VEC4 pos(aabb.GetCenter(), 1.0f);
-		Common::Transform_Vec4_By_Mat44(pos, pos, cam.GetViewMatrix());
-
-		float half_h = tanf(cam.GetFov() * 0.5f) * fNear;
-		float half_w = half_h * cam.GetAspectRatio();
-
-		//ǰ
-		if (pos.z + aabb.m_boundingRadius <= fNear || pos.z - aabb.m_boundingRadius >= fFar)
-			return false;
-
-		//
-		float planeX = half_w * pos.z / fNear;
-		if (pos.x - planeX >= aabb.m_boundingRadius ||
-			pos.x + aabb.m_boundingRadius <= -planeX)
-			return false;
-
-		//
-		float planeY = half_h * pos.z / fNear;
-		if (pos.y - planeY >= aabb.m_boundingRadius ||
-			pos.y + aabb.m_boundingRadius <= -planeY)
-			return false;
-
-		return true;
-	}
-	//------------------------------------------------------------------------------------
 	void ShadowMapPSSM::_VSMBlurPass(int iCascade)
 	{
 		static bool bInit = false;
@@ -5,50 +5,733 @@
 #include "Material.h"
 #include "MaterialManager.h"
 #include "Renderer.h"
+#include "JobSystem.h"
+#include "Camera.h"
 
 namespace Neo
 {
+	// Models evaluated by one job, a model costs about as much as a few hundred plain entities
+	static const uint32 ANIMATION_UPDATE_GRAIN = 4;
+
+	// Default animation LODs: full rate close by, down to 7.5 Hz with the shallowest bones only
+	static std::vector<SAnimLodLevel> s_animLodLevels =
+	{
+		{ 0.25f,	0.0f,			0 },
+		{ 0.1f,		1.0f / 30,		1 },
+		{ 0.03f,	1.0f / 15,		2 },
+		{ 0.0f,		1.0f / 7.5f,	2 },
+	};
+
+	namespace
+	{
+		const float SQRT2 = 1.41421356f;
+
+		// Index a of the keys around fTime, time(a) <= fTime < time(a + 1), clamped to the first and last pair.
+		template<class GetTime>
+		uint32 _SeekKey(GetTime getTime, uint32 nKeys, float fTime, uint32 cursor)
+		{
+			// Back to the start when the time went backwards, e.g. a loop
+			if (cursor + 1 >= nKeys || getTime(cursor) > fTime)
+			{
+				cursor = 0;
+			}
+
+			while (cursor + 2 < nKeys && getTime(cursor + 1) <= fTime)
+			{
+				++cursor;
+			}
+
+			return cursor;
+		}
+
+		void _Interpolate(const AnimKeyFrame& a, const AnimKeyFrame& b, float fTime, AnimKeyFrame& kf)
+		{
+			const float fSpan = b.m_fTime - a.m_fTime;
+			const float t = fSpan > 0 ? Clamp((fTime - a.m_fTime) / fSpan, 0.0f, 1.0f) : 0.0f;
+
+			kf.m_fTime = fTime;
+			kf.translate = a.translate + t * (b.translate - a.translate);
+			kf.rotate = QUATERNION::Slerp(t, a.rotate, b.rotate, true);
+		}
+
+		// Angle between two rotations
+		float _RotationError(const QUATERNION& a, const QUATERNION& b)
+		{
+			return 2.0f * acosf(Min(1.0f, fabsf(a.Dot(b))));
+		}
+
+		// Smallest three: the largest component is made positive and rebuilt from the others
+		void _EncodeRotation(const QUATERNION& rotation, uint16* pOut)
+		{
+			QUATERNION q = rotation;
+			q.Normalise();
+
+			const float c[4] = { q.w, q.x, q.y, q.z };
+			uint32 iMax = 0;
+			for (uint32 i = 1; i < 4; ++i)
+			{
+				if (fabsf(c[i]) > fabsf(c[iMax]))
+					iMax = i;
+			}
+
+			const float fSign = c[iMax] < 0 ? -1.0f : 1.0f;
+			uint64 bits = iMax;
+			uint32 shift = 2;
+
+			for (uint32 i = 0; i < 4; ++i)
+			{
+				if (i == iMax)
+					continue;
+
+				// The others are within +-1/sqrt(2)
+				const float v = Clamp(c[i] * fSign * SQRT2 * 0.5f + 0.5f, 0.0f, 1.0f);
+				bits |= (uint64)(v * 32767 + 0.5f) << shift;
+				shift += 15;
+			}
+
+			pOut[0] = (uint16)bits;
+			pOut[1] = (uint16)(bits >> 16);
+			pOut[2] = (uint16)(bits >> 32);
+		}
+
+		QUATERNION _DecodeRotation(const uint16* pIn)
+		{
+			uint64 bits = (uint64)pIn[0] | ((uint64)pIn[1] << 16) | ((uint64)pIn[2] << 32);
+			const uint32 iMax = bits & 3;
+			bits >>= 2;
+
+			float c[4];
+			float fSumSq = 0;
+
+			for (uint32 i = 0; i < 4; ++i)
+			{
+				if (i == iMax)
+					continue;
+
+				c[i] = ((bits & 0x7fff) / 32767.0f * 2.0f - 1.0f) / SQRT2;
+				fSumSq += c[i] * c[i];
+				bits >>= 15;
+			}
+
+			c[iMax] = sqrtf(Max(0.0f, 1.0f - fSumSq));
+
+			return QUATERNION(c[0], c[1], c[2], c[3]);
+		}
+
+		uint16 _Quantize(float v, float fMin, float fExtent)
+		{
+			return fExtent > 0 ? (uint16)(Clamp((v - fMin) / fExtent, 0.0f, 1.0f) * 65535 + 0.5f) : 0;
+		}
+
+		float _Dequantize(uint16 q, float fMin, float fExtent)
+		{
+			return fMin + q / 65535.0f * fExtent;
+		}
+
+		void _CompressKeys(const std::vector<AnimKeyFrame>& keys, float fLength, float fMaxRotError, float fMaxTransError, SCompressedKeys& out)
+		{
+			const uint32 nKeys = keys.size();
+			if (nKeys == 0)
+			{
+				return;
+			}
+
+			VEC3 vMin = keys[0].translate, vMax = keys[0].translate;
+			for (uint32 i = 1; i < nKeys; ++i)
+			{
+				const VEC3& t = keys[i].translate;
+				vMin.Set(Min(vMin.x, t.x), Min(vMin.y, t.y), Min(vMin.z, t.z));
+				vMax.Set(Max(vMax.x, t.x), Max(vMax.y, t.y), Max(vMax.z, t.z));
+			}
+
+			out.fTimeScale = fLength / 65535;
+
+			// Most bones only rotate, a translation that doesn't move needs no stream
+			const bool bConstTrans = (vMax - vMin).GetLength() <= fMaxTransError;
+			if (bConstTrans)
+			{
+				out.vTransMin = (vMin + vMax) * 0.5f;
+				out.vTransExtent = VEC3::ZERO;
+			}
+			else
+			{
+				out.vTransMin = vMin;
+				out.vTransExtent = vMax - vMin;
+			}
+
+			// Quantize every key first, so the reduction below sees the quantization error as well
+			SCompressedKeys all = out;
+			all.times.resize(nKeys);
+			all.rotations.resize(nKeys * 3);
+			if (!bConstTrans)
+			{
+				all.translations.resize(nKeys * 3);
+			}
+
+			for (uint32 i = 0; i < nKeys; ++i)
+			{
+				const AnimKeyFrame& kf = keys[i];
+				all.times[i] = _Quantize(kf.m_fTime, 0, fLength);
+				_EncodeRotation(kf.rotate, &all.rotations[i * 3]);
+
+				if (!bConstTrans)
+				{
+					all.translations[i * 3 + 0] = _Quantize(kf.translate.x, vMin.x, out.vTransExtent.x);
+					all.translations[i * 3 + 1] = _Quantize(kf.translate.y, vMin.y, out.vTransExtent.y);
+					all.translations[i * 3 + 2] = _Quantize(kf.translate.z, vMin.z, out.vTransExtent.z);
+				}
+			}
+
+			std::vector<AnimKeyFrame> vecDecoded(nKeys);
+			for (uint32 i = 0; i < nKeys; ++i)
+			{
+				all.GetKey(i, vecDecoded[i]);
+			}
+
+			// Greedily extend each span until interpolating it misses one of the original keys inside
+			std::vector<uint32> vecKept(1, 0);
+			uint32 iLast = 0;
+
+			for (uint32 j = 2; j < nKeys; ++j)
+			{
+				for (uint32 k = iLast + 1; k < j; ++k)
+				{
+					AnimKeyFrame kf;
+					_Interpolate(vecDecoded[iLast], vecDecoded[j], keys[k].m_fTime, kf);
+
+					if (_RotationError(kf.rotate, keys[k].rotate) > fMaxRotError ||
+						(kf.translate - keys[k].translate).GetLength() > fMaxTransError)
+					{
+						iLast = j - 1;
+						vecKept.push_back(iLast);
+						break;
+					}
+				}
+			}
+
+			if (nKeys > 1)
+			{
+				vecKept.push_back(nKeys - 1);
+			}
+
+			for (uint32 i = 0; i < vecKept.size(); ++i)
+			{
+				const uint32 iKey = vecKept[i];
+				out.times.push_back(all.times[iKey]);
+				out.rotations.insert(out.rotations.end(), &all.rotations[iKey * 3], &all.rotations[iKey * 3] + 3);
+
+				if (!bConstTrans)
+				{
+					out.translations.insert(out.translations.end(), &all.translations[iKey * 3], &all.translations[iKey * 3] + 3);
+				}
+			}
+		}
+
+		// Normalized lerp, close enough to a slerp for blending poses and much cheaper
+		QUATERNION _Nlerp(float t, const QUATERNION& a, const QUATERNION& b)
+		{
+			QUATERNION q = a * (1 - t) + (a.Dot(b) < 0 ? -b : b) * t;
+			q.Normalise();
+
+			return q;
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void SSkeletonPose::Blend(const SSkeletonPose& a, const SSkeletonPose& b, float t, const float* pMask, SSkeletonPose& out, uint32 nBones)
+	{
+		_AST(nBones <= a.GetBoneCount() && nBones <= b.GetBoneCount() && nBones <= out.GetBoneCount());
+
+		for (uint32 i = 0; i < nBones; ++i)
+		{
+			const float w = pMask ? t * pMask[i] : t;
+
+			if (w <= 0)
+			{
+				out.rotations[i] = a.rotations[i];
+				out.translations[i] = a.translations[i];
+			}
+			else if (w >= 1)
+			{
+				out.rotations[i] = b.rotations[i];
+				out.translations[i] = b.translations[i];
+			}
+			else
+			{
+				out.rotations[i] = _Nlerp(w, a.rotations[i], b.rotations[i]);
+				out.translations[i] = a.translations[i] + w * (b.translations[i] - a.translations[i]);
+			}
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void SSkeletonPose::Blend(const SSkeletonPose* const* ppPoses, const float* pWeights, uint32 nPoses, SSkeletonPose& out, uint32 nBones)
+	{
+		_AST(nPoses > 0);
+
+		float fTotal = 0;
+		for (uint32 i = 0; i < nPoses; ++i)
+		{
+			fTotal += pWeights[i];
+		}
+
+		if (fTotal <= 0)
+		{
+			// Nothing to blend, same as the first one
+			if (&out != ppPoses[0])
+			{
+				out = *ppPoses[0];
+			}
+			return;
+		}
+
+		_AST(nBones <= ppPoses[0]->GetBoneCount() && nBones <= out.GetBoneCount());
+		const float fInvTotal = 1.0f / fTotal;
+
+		for (uint32 i = 0; i < nBones; ++i)
+		{
+			// Every rotation goes to the hemisphere of the first one, otherwise they cancel out
+			const QUATERNION& q0 = ppPoses[0]->rotations[i];
+			QUATERNION q = q0 * pWeights[0];
+			VEC3 t = ppPoses[0]->translations[i] * pWeights[0];
+
+			for (uint32 j = 1; j < nPoses; ++j)
+			{
+				const QUATERNION& qj = ppPoses[j]->rotations[i];
+				q = q + (q0.Dot(qj) < 0 ? -qj : qj) * pWeights[j];
+				t += ppPoses[j]->translations[i] * pWeights[j];
+			}
+
+			q.Normalise();
+			out.rotations[i] = q;
+			out.translations[i] = t * fInvTotal;
+		}
+	}
+	//------------------------------------------------------------------------------------
+	uint32 SkeletonAnim::AddBone(const STRING& name, const QUATERNION& rotation, const VEC3& translation)
+	{
+		const uint32 iBone = m_boneNames.size();
+
+		m_boneNames.push_back(name);
+		m_boneParents.push_back(-1);
+		m_boneIds.push_back(iBone);
+		m_bindPose.rotations.push_back(rotation);
+		m_bindPose.translations.push_back(translation);
+
+		return iBone;
+	}
+	//------------------------------------------------------------------------------------
+	void SkeletonAnim::SetParent(uint32 iBone, uint32 iParent)
+	{
+		_AST(m_boneParents[iBone] == -1 && "This bone already has a parent!");
+		m_boneParents[iBone] = iParent;
+	}
 	//------------------------------------------------------------------------------------
-	MAT44 SkeletonAnim::RecursUpdateBoneTransform(Bone* pBone)
+	void SkeletonAnim::BuildHierarchy()
 	{
-		MAT44 matParent = MAT44::IDENTITY;
+		const uint32 nBones = GetBoneCount();
+
+		// Sorting by depth puts every parent before its children
+		std::vector<uint32> vecDepth(nBones);
+		for (uint32 i = 0; i < nBones; ++i)
+		{
+			uint32 depth = 0;
+			for (int iParent = m_boneParents[i]; iParent != -1; iParent = m_boneParents[iParent])
+			{
+				++depth;
+				_AST(depth < nBones && "Cycle in the bone hierarchy!");
+			}
+			vecDepth[i] = depth;
+		}
+
+		std::vector<uint32> vecOrder(nBones);
+		for (uint32 i = 0; i < nBones; ++i)
+		{
+			vecOrder[i] = i;
+		}
+
+		std::stable_sort(vecOrder.begin(), vecOrder.end(), [&](uint32 a, uint32 b) { return vecDepth[a] < vecDepth[b]; });
 
-		if (pBone->m_pParent)
+		std::vector<uint32> vecNewIndex(nBones);
+		for (uint32 i = 0; i < nBones; ++i)
 		{
-			matParent = RecursUpdateBoneTransform(pBone->m_pParent);
+			vecNewIndex[vecOrder[i]] = i;
 		}
 
-		pBone->m_matCombine = pBone->m_matLocal * matParent;
+		std::vector<STRING> names(nBones);
+		std::vector<int> parents(nBones);
+		std::vector<uint32> ids(nBones);
+		SSkeletonPose bindPose;
+		bindPose.Resize(nBones);
 
-		return pBone->m_matCombine;
+		for (uint32 i = 0; i < nBones; ++i)
+		{
+			const uint32 iOld = vecOrder[i];
+			const int iOldParent = m_boneParents[iOld];
+
+			names[i] = m_boneNames[iOld];
+			parents[i] = iOldParent == -1 ? -1 : (int)vecNewIndex[iOldParent];
+			ids[i] = m_boneIds[iOld];
+			bindPose.rotations[i] = m_bindPose.rotations[iOld];
+			bindPose.translations[i] = m_bindPose.translations[iOld];
+		}
+
+		m_boneNames.swap(names);
+		m_boneParents.swap(parents);
+		m_boneIds.swap(ids);
+		m_bindPose = bindPose;
+
+		m_boneDepths.resize(nBones);
+		for (uint32 i = 0; i < nBones; ++i)
+		{
+			m_boneDepths[i] = vecDepth[vecOrder[i]];
+		}
+
+		for (uint32 iClip = 0; iClip < m_vecAnims.size(); ++iClip)
+		{
+			AnimClip* pClip = m_vecAnims[iClip];
+
+			for (uint32 iTrack = 0; iTrack < pClip->m_tracks.size(); ++iTrack)
+			{
+				AnimTrack* pTrack = pClip->m_tracks[iTrack];
+				pTrack->m_boneId = vecNewIndex[pTrack->m_boneId];
+			}
+
+			// In bone order too, so a bone LOD only walks the tracks up to its last bone
+			std::sort(pClip->m_tracks.begin(), pClip->m_tracks.end(), [](const AnimTrack* a, const AnimTrack* b) { return a->m_boneId < b->m_boneId; });
+		}
+
+		std::vector<MAT44> vecModel(nBones);
+		m_invBindPose.resize(nBones);
+
+		if (nBones > 0)
+		{
+			ComputeModelTransforms(m_bindPose, &vecModel[0], nBones);
+		}
+
+		for (uint32 i = 0; i < nBones; ++i)
+		{
+			m_invBindPose[i] = vecModel[i].Inverse();
+		}
+
+		// Fingers and faces go first, then forearms and the like
+		const uint32 nMaxDepth = nBones > 0 ? m_boneDepths.back() : 0;
+		std::vector<uint32> lodDepths;
+		lodDepths.push_back(nMaxDepth * 3 / 4);
+		lodDepths.push_back(nMaxDepth / 2);
+
+		SetBoneLodDepths(lodDepths);
 	}
+	//------------------------------------------------------------------------------------
+	void SkeletonAnim::SetBoneLodDepths(const std::vector<uint32>& depths)
+	{
+		const uint32 nBones = GetBoneCount();
 
+		m_lodBoneCounts.assign(1, nBones);
+
+		for (uint32 i = 0; i < depths.size(); ++i)
+		{
+			// Depths never decrease along the array, the bones of a level are a prefix of it
+			const uint32 nCount = std::upper_bound(m_boneDepths.begin(), m_boneDepths.end(), depths[i]) - m_boneDepths.begin();
+			m_lodBoneCounts.push_back(Min(nCount, m_lodBoneCounts.back()));
+		}
+	}
 	//------------------------------------------------------------------------------------
-	AnimKeyFrame AnimTrack::GetKf(float fTime)
+	void SkeletonAnim::GetBindPose(SSkeletonPose& pose) const
 	{
-		AnimKeyFrame* pA = nullptr;
-		AnimKeyFrame* pB = nullptr;
+		pose.rotations.assign(m_bindPose.rotations.begin(), m_bindPose.rotations.end());
+		pose.translations.assign(m_bindPose.translations.begin(), m_bindPose.translations.end());
+	}
+	//------------------------------------------------------------------------------------
+	int SkeletonAnim::GetBoneIndex(const STRING& name) const
+	{
+		auto iter = std::find(m_boneNames.begin(), m_boneNames.end(), name);
 
-		for (uint32 i = 1; i < m_vecKeyFrames.size(); ++i)
+		return iter != m_boneNames.end() ? (int)(iter - m_boneNames.begin()) : -1;
+	}
+	//------------------------------------------------------------------------------------
+	void SkeletonAnim::BuildBoneMask(const STRING& rootBone, std::vector<float>& mask) const
+	{
+		const uint32 nBones = GetBoneCount();
+		mask.assign(nBones, 0.0f);
+
+		const int iRoot = GetBoneIndex(rootBone);
+		if (iRoot == -1)
 		{
-			if (fTime <= m_vecKeyFrames[i].m_fTime)
+			return;
+		}
+
+		// Parents come first, so a descendant always finds its parent done
+		mask[iRoot] = 1.0f;
+		for (uint32 i = iRoot + 1; i < nBones; ++i)
+		{
+			const int iParent = m_boneParents[i];
+			if (iParent != -1 && mask[iParent] > 0)
 			{
-				pB = &m_vecKeyFrames[i];
-				pA = &m_vecKeyFrames[i - 1];
-				break;
+				mask[i] = 1.0f;
 			}
 		}
+	}
+	//------------------------------------------------------------------------------------
+	void SkeletonAnim::ComputeModelTransforms(const SSkeletonPose& pose, MAT44* pModel, uint32 nBones) const
+	{
+		_AST(nBones <= GetBoneCount() && pose.GetBoneCount() == GetBoneCount());
 
-		float t = fTime - pA->m_fTime;
-		AnimKeyFrame lerpKf;
-		lerpKf.translate = pA->translate + t * (pB->translate - pA->translate);
-		lerpKf.rotate = QUATERNION::Slerp(t, pA->rotate, pB->rotate);
+		const QUATERNION* pRotations = &pose.rotations[0];
+		const VEC3* pTranslations = &pose.translations[0];
+		const int* pParents = &m_boneParents[0];
 
-		return lerpKf;
+		for (uint32 i = 0; i < nBones; ++i)
+		{
+			MAT44 matLocal;
+			matLocal.FromQuaternion(pRotations[i]);
+			matLocal.SetTranslation(pTranslations[i]);
+
+			// Parents come first, so pModel[parent] is already final
+			const int iParent = pParents[i];
+			if (iParent == -1)
+			{
+				pModel[i] = matLocal;
+			}
+			else
+			{
+				pModel[i] = Common::Multiply_Mat44_By_Mat44(matLocal, pModel[iParent]);
+			}
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void SkeletonAnim::ComputeSkinPalette(const MAT44* pModel, MAT44* pPalette, uint32 nBones) const
+	{
+		const uint32 nAllBones = GetBoneCount();
+		_AST(nBones <= nAllBones);
+
+		if (nBones > 0)
+		{
+			Common::Multiply_Mat44Array_By_Mat44(pPalette, &m_invBindPose[0], pModel, nBones);
+		}
+
+		// inverse bind[i] * (bind[i] * inverse bind[ancestor] * model[ancestor]) is the palette of the ancestor,
+		// a skipped parent already holds it
+		for (uint32 i = nBones; i < nAllBones; ++i)
+		{
+			pPalette[i] = pPalette[m_boneParents[i]];
+		}
+	}
+
+	//------------------------------------------------------------------------------------
+	void SkeletonAnim::CompressClips(float fMaxRotError, float fMaxTransError)
+	{
+		for (uint32 i = 0; i < m_vecAnims.size(); ++i)
+		{
+			AnimClip* pCompressed = m_vecAnims[i]->CreateCompressed(fMaxRotError, fMaxTransError);
+			delete m_vecAnims[i];
+			m_vecAnims[i] = pCompressed;
+		}
 	}
+#if USE_BENCHMARK
 	//------------------------------------------------------------------------------------
-	void AnimState::Update(float dt)
+	void SkeletonAnim::BenchmarkClips(std::vector<SAnimBenchResult>& results, uint32 nFrames, float fMaxRotError, float fMaxTransError) const
 	{
+		results.clear();
+
+		const float dt = 1.0f / 60;
+
+		for (uint32 iClip = 0; iClip < m_vecAnims.size(); ++iClip)
+		{
+			const AnimClip* pClip = m_vecAnims[iClip];
+			if (pClip->m_tracks.empty() || pClip->m_tracks[0]->IsCompressed())
+			{
+				continue;
+			}
+
+			std::unique_ptr<AnimClip> pCompressed(pClip->CreateCompressed(fMaxRotError, fMaxTransError));
+			const uint32 nTracks = pClip->m_tracks.size();
+
+			// Same times as AnimState::Update() would give
+			std::vector<float> vecTimes(nFrames);
+			float fTime = 0;
+			for (uint32 i = 0; i < nFrames; ++i)
+			{
+				fTime += dt;
+				if (fTime > pClip->m_fLength)
+					fTime = 0;
+				vecTimes[i] = fTime;
+			}
+
+			std::vector<AnimKeyFrame> vecRaw(nFrames * nTracks), vecCompressed(nFrames * nTracks);
+			std::vector<uint32> vecCursors;
+
+			SAnimBenchResult res;
+			res.name = pClip->m_name;
+			res.nRawBytes = pClip->GetByteSize();
+			res.nCompressedBytes = pCompressed->GetByteSize();
+
+			res.fScanMs = TimeMs([&]()
+			{
+				for (uint32 i = 0; i < nFrames; ++i)
+					for (uint32 j = 0; j < nTracks; ++j)
+						vecRaw[i * nTracks + j] = pClip->m_tracks[j]->GetKf(vecTimes[i]);
+			});
+
+			vecCursors.assign(nTracks, 0);
+			res.fCursorMs = TimeMs([&]()
+			{
+				for (uint32 i = 0; i < nFrames; ++i)
+					for (uint32 j = 0; j < nTracks; ++j)
+						pClip->m_tracks[j]->Sample(vecTimes[i], vecCursors[j], vecRaw[i * nTracks + j]);
+			});
+
+			vecCursors.assign(nTracks, 0);
+			res.fCompressedMs = TimeMs([&]()
+			{
+				for (uint32 i = 0; i < nFrames; ++i)
+					for (uint32 j = 0; j < nTracks; ++j)
+						pCompressed->m_tracks[j]->Sample(vecTimes[i], vecCursors[j], vecCompressed[i * nTracks + j]);
+			});
+
+			res.fMaxRotError = res.fMaxTransError = 0;
+			for (uint32 i = 0; i < vecRaw.size(); ++i)
+			{
+				res.fMaxRotError = Max(res.fMaxRotError, _RotationError(vecRaw[i].rotate, vecCompressed[i].rotate));
+				res.fMaxTransError = Max(res.fMaxTransError, (vecRaw[i].translate - vecCompressed[i].translate).GetLength());
+			}
+
+			results.push_back(res);
+		}
+	}
+#endif
+	//------------------------------------------------------------------------------------
+	void SCompressedKeys::GetKey(uint32 i, AnimKeyFrame& kf) const
+	{
+		kf.m_fTime = GetTime(i);
+		kf.rotate = _DecodeRotation(&rotations[i * 3]);
+
+		if (translations.empty())
+		{
+			kf.translate = vTransMin;
+		}
+		else
+		{
+			const uint16* pTrans = &translations[i * 3];
+			kf.translate.Set(
+				_Dequantize(pTrans[0], vTransMin.x, vTransExtent.x),
+				_Dequantize(pTrans[1], vTransMin.y, vTransExtent.y),
+				_Dequantize(pTrans[2], vTransMin.z, vTransExtent.z));
+		}
+	}
+	//------------------------------------------------------------------------------------
+	AnimKeyFrame AnimTrack::GetKf(float fTime) const
+	{
+		uint32 cursor = 0;
+		AnimKeyFrame kf;
+		Sample(fTime, cursor, kf);
+
+		return kf;
+	}
+	//------------------------------------------------------------------------------------
+	void AnimTrack::Sample(float fTime, uint32& cursor, AnimKeyFrame& kf) const
+	{
+		if (IsCompressed())
+		{
+			const uint32 nKeys = m_compressed.GetKeyCount();
+			_AST(nKeys > 0);
+
+			cursor = _SeekKey([this](uint32 i) { return m_compressed.GetTime(i); }, nKeys, fTime, cursor);
+
+			AnimKeyFrame a, b;
+			m_compressed.GetKey(cursor, a);
+			m_compressed.GetKey(Min(cursor + 1, nKeys - 1), b);
+			_Interpolate(a, b, fTime, kf);
+		}
+		else
+		{
+			const uint32 nKeys = m_vecKeyFrames.size();
+			const AnimKeyFrame* pKeys = &m_vecKeyFrames[0];
+
+			cursor = _SeekKey([pKeys](uint32 i) { return pKeys[i].m_fTime; }, nKeys, fTime, cursor);
+			_Interpolate(pKeys[cursor], pKeys[Min(cursor + 1, nKeys - 1)], fTime, kf);
+		}
+	}
+	//------------------------------------------------------------------------------------
+	uint32 AnimTrack::GetByteSize() const
+	{
+		return sizeof(AnimTrack) + m_vecKeyFrames.size() * sizeof(AnimKeyFrame) + (m_compressed.times.size() +
+			m_compressed.rotations.size() + m_compressed.translations.size()) * sizeof(uint16);
+	}
+	//------------------------------------------------------------------------------------
+	AnimClip* AnimClip::CreateCompressed(float fMaxRotError, float fMaxTransError) const
+	{
+		AnimClip* pClip = new AnimClip;
+		pClip->m_name = m_name;
+		pClip->m_fLength = m_fLength;
+
+		for (uint32 i = 0; i < m_tracks.size(); ++i)
+		{
+			const AnimTrack* pSrc = m_tracks[i];
+			AnimTrack* pTrack = new AnimTrack;
+			pTrack->m_boneId = pSrc->m_boneId;
+
+			if (pSrc->IsCompressed())
+			{
+				pTrack->m_compressed = pSrc->m_compressed;
+			}
+			else
+			{
+				_CompressKeys(pSrc->m_vecKeyFrames, m_fLength, fMaxRotError, fMaxTransError, pTrack->m_compressed);
+			}
+
+			pClip->m_tracks.push_back(pTrack);
+		}
+
+		return pClip;
+	}
+	//------------------------------------------------------------------------------------
+	uint32 AnimClip::GetByteSize() const
+	{
+		uint32 nBytes = sizeof(AnimClip);
+
+		for (uint32 i = 0; i < m_tracks.size(); ++i)
+		{
+			nBytes += m_tracks[i]->GetByteSize();
+		}
+
+		return nBytes;
+	}
+	//------------------------------------------------------------------------------------
+	void AnimState::Play(AnimClip* pAnim, bool bLoop)
+	{
+		m_pAnim = pAnim;
+		m_fAnimTime = 0.0f;
+		m_bLoop = bLoop;
+		m_fWeight = m_fTargetWeight = 1.0f;
+		m_fFadeSpeed = 0;
+		m_cursors.assign(pAnim ? pAnim->m_tracks.size() : 0, 0);
+	}
+	//------------------------------------------------------------------------------------
+	void AnimState::FadeTo(float fTarget, float fTime)
+	{
+		m_fTargetWeight = fTarget;
+
+		if (fTime > 0)
+		{
+			m_fFadeSpeed = fabsf(fTarget - m_fWeight) / fTime;
+		}
+		else
+		{
+			m_fWeight = fTarget;
+			m_fFadeSpeed = 0;
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void AnimState::Advance(float dt)
+	{
+		if (m_fWeight < m_fTargetWeight)
+		{
+			m_fWeight = Min(m_fWeight + m_fFadeSpeed * dt, m_fTargetWeight);
+		}
+		else if (m_fWeight > m_fTargetWeight)
+		{
+			m_fWeight = Max(m_fWeight - m_fFadeSpeed * dt, m_fTargetWeight);
+		}
+
 		if (m_pAnim)
 		{
 			m_fAnimTime += dt;
@@ -58,32 +741,160 @@ namespace Neo
 			{
 				if (m_bLoop)
 				{
-					m_fAnimTime = 0.0f;
+					// A model skipped for a while advances by several loops at once
+					m_fAnimTime = m_pAnim->m_fLength > 0 ? fmod(m_fAnimTime, m_pAnim->m_fLength) : 0.0f;
 				}
 				else
 				{
 					m_pAnim = nullptr;
 				}
 			}
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void AnimState::Sample(const SSkeletonPose& basePose, SSkeletonPose& out, uint32 nBones)
+	{
+		_AST(m_pAnim);
+
+		// m_pAnim may have been set without Play()
+		if (m_cursors.size() != m_pAnim->m_tracks.size())
+		{
+			m_cursors.assign(m_pAnim->m_tracks.size(), 0);
+		}
+
+		out.rotations.assign(basePose.rotations.begin(), basePose.rotations.end());
+		out.translations.assign(basePose.translations.begin(), basePose.translations.end());
+
+		const SSkeletonPose& bindPose = m_pSkeleton->m_bindPose;
+
+		for (uint32 i = 0; i < m_pAnim->m_tracks.size(); ++i)
+		{
+			AnimTrack* pTrack = m_pAnim->m_tracks[i];
+			const uint32 iBone = pTrack->m_boneId;
 
-			for (uint32 i = 0; i < m_pAnim->m_tracks.size(); ++i)
+			// Tracks are in bone order
+			if (iBone >= nBones)
 			{
-				AnimTrack* pTrack = m_pAnim->m_tracks[i];
-				Bone* pBone = m_pSkeleton->m_vecBones[pTrack->m_boneId];
+				break;
+			}
+
+			const QUATERNION& bindRot = bindPose.rotations[iBone];
+
+			// Keyframes are relative to the bind pose, same as the matrix kf * bind
+			AnimKeyFrame kf;
+			pTrack->Sample(m_fAnimTime, m_cursors[i], kf);
+			out.translations[iBone] = bindRot.Rotate(kf.translate) + bindPose.translations[iBone];
+			out.rotations[iBone] = bindRot * kf.rotate;
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void AnimLayer::Init(SkeletonAnim* pSkel)
+	{
+		m_pSkeleton = pSkel;
+
+		m_states.resize(1);
+		m_states[0].m_pSkeleton = pSkel;
+	}
+	//------------------------------------------------------------------------------------
+	void AnimLayer::Play(AnimClip* pAnim, bool bLoop, float fFadeTime)
+	{
+		if (fFadeTime <= 0)
+		{
+			m_states.resize(1);
+			m_states[0].Play(pAnim, bLoop);
+			return;
+		}
 
-				AnimKeyFrame kf = pTrack->GetKf(m_fAnimTime);
-				MAT44 matAnim;
-				matAnim.FromQuaternion(kf.rotate);
-				matAnim.SetTranslation(kf.translate);
+		// Each one reaches 0 at the same time, so the total stays the same while the new one goes to 1
+		for (uint32 i = 0; i < m_states.size(); ++i)
+		{
+			m_states[i].FadeTo(0, fFadeTime);
+		}
+
+		AnimState state;
+		state.m_pSkeleton = m_pSkeleton;
+		state.Play(pAnim, bLoop);
+		state.m_fWeight = 0;
+		state.FadeTo(1, fFadeTime);
+
+		m_states.push_back(state);
+	}
+	//------------------------------------------------------------------------------------
+	void AnimLayer::Advance(float dt)
+	{
+		for (uint32 i = 0; i < m_states.size(); ++i)
+		{
+			m_states[i].Advance(dt);
+		}
+
+		// Drop the ones faded out or done, the current one stays for GetCurrent()
+		for (uint32 i = 0; i + 1 < m_states.size(); )
+		{
+			const AnimState& state = m_states[i];
 
-				pBone->m_matLocal = matAnim * pBone->m_matLocal;
+			if (!state.m_pAnim || (state.m_fWeight <= 0 && state.m_fTargetWeight <= 0))
+			{
+				m_states.erase(m_states.begin() + i);
+			}
+			else
+			{
+				++i;
 			}
 		}
 	}
+	//------------------------------------------------------------------------------------
+	void AnimLayer::Apply(SSkeletonPose& pose, uint32 nBones)
+	{
+		m_blendPoses.clear();
+		m_blendWeights.clear();
+
+		float fTotal = 0;
+
+		for (uint32 i = 0; i < m_states.size(); ++i)
+		{
+			AnimState& state = m_states[i];
+
+			if (state.m_pAnim && state.m_fWeight > 0)
+			{
+				state.Sample(pose, state.m_pose, nBones);
+
+				m_blendPoses.push_back(&state.m_pose);
+				m_blendWeights.push_back(state.m_fWeight);
+				fTotal += state.m_fWeight;
+			}
+		}
+
+		if (m_blendPoses.empty() || m_fWeight <= 0)
+		{
+			return;
+		}
+
+		// Fading in from nothing, the layers below make up the rest
+		if (fTotal < 1)
+		{
+			m_blendPoses.push_back(&pose);
+			m_blendWeights.push_back(1 - fTotal);
+		}
+
+		const float* pMask = m_mask.empty() ? nullptr : &m_mask[0];
+		_AST(!pMask || m_mask.size() == pose.GetBoneCount());
+
+		if (m_blendPoses.size() == 1)
+		{
+			SSkeletonPose::Blend(pose, *m_blendPoses[0], m_fWeight, pMask, pose, nBones);
+		}
+		else
+		{
+			m_pose.Resize(pose.GetBoneCount());
+			SSkeletonPose::Blend(&m_blendPoses[0], &m_blendWeights[0], m_blendPoses.size(), m_pose, nBones);
+			SSkeletonPose::Blend(pose, m_pose, m_fWeight, pMask, pose, nBones);
+		}
+	}
 
 	//------------------------------------------------------------------------------------
 	SkeletonDebugger::SkeletonDebugger()
-		:m_pMesh(nullptr)
+		:m_pModel(nullptr)
+		,m_pMesh(nullptr)
 	{
 		m_pMtl = MaterialManager::GetSingleton().NewMaterial("Mtl_DebugBone", eVertexType_General);
 
@@ -154,53 +965,54 @@ namespace Neo
 	//------------------------------------------------------------------------------------
 	void SkeletonDebugger::AttachToSkinModel(SkinModel* pModel)
 	{
-		m_pSkeleton = pModel->GetSkeleton();
-		m_matWorld = pModel->GetWorldMatrix();
+		m_pModel = pModel;
 
-		uint32 nBones = pModel->GetSkeleton()->m_vecBones.size();
+		const SkeletonAnim* pSkeleton = pModel->GetSkeleton();
+		uint32 nBones = pSkeleton->GetBoneCount();
+
+		// Longest child of each bone
+		std::vector<float> vecMaxLen(nBones, 0.0f);
+		for (uint32 i = 0; i < nBones; ++i)
+		{
+			const int iParent = pSkeleton->m_boneParents[i];
+			if (iParent != -1)
+			{
+				// If the length is zero, no point in creating the bone representation
+				float length = pSkeleton->m_bindPose.translations[i].GetLength();
+				if (length < 0.00001f)
+					continue;
+
+				vecMaxLen[iParent] = std::max<float>(vecMaxLen[iParent], length);
+			}
+		}
 
 		m_vecEntity.resize(nBones);
 
 		for (uint32 i = 0; i < nBones; ++i)
 		{
-			Bone* pBone = m_pSkeleton->m_vecBones[i];
-
 			Entity* pEntity = new Entity(m_pMesh);
 			pEntity->SetCastShadow(false);
 			pEntity->SetMaterial(m_pMtl);
 
 			m_vecEntity[i] = pEntity;
 
-			float fMaxLen = 0;
-			for (uint32 iChild = 0; iChild < pBone->m_vecChilds.size(); ++iChild)
-			{
-				VEC3 v = pBone->m_vecChilds[iChild]->m_matBindPose.GetTranslation().GetVec3();
-
-				// If the length is zero, no point in creating the bone representation
-				float length = v.GetLength();
-				if (length < 0.00001f)
-					continue;
-
-				fMaxLen = std::max<float>(fMaxLen, length);
-			}
-
-			if (fMaxLen >= 1e-05)
+			if (vecMaxLen[i] >= 1e-05)
 			{
-				pEntity->SetScale(fMaxLen);
+				pEntity->SetScale(vecMaxLen[i]);
 			}
 		}
 	}
 	//------------------------------------------------------------------------------------
 	void SkeletonDebugger::Render()
 	{
+		const MAT44& matWorld = m_pModel->GetWorldMatrix();
+
 		for (uint32 i = 0; i < m_vecEntity.size(); ++i)
 		{
-			MAT44 mat = m_pSkeleton->m_vecBones[i]->m_matInvBindPos.Inverse();
-
 			MAT44 matScale;
 			matScale.SetScale(m_vecEntity[i]->GetScale());	
 
-			m_vecEntity[i]->SetWorldMatrix(matScale * mat * m_pSkeleton->m_vecBones[i]->m_matCombine * m_matWorld);
+			m_vecEntity[i]->SetWorldMatrix(matScale * m_pModel->GetBoneTransform(i) * matWorld);
 
 			m_vecEntity[i]->Render();
 		}
@@ -211,80 +1023,228 @@ namespace Neo
 		: Entity(pMesh)
 		, m_pSkeleton(pSkel)
 		, m_pSkelRender(nullptr)
+		, m_nPaletteOffset(0)
+		, m_iBoneLod(0)
+		, m_nEvaluatedBones(0)
+		, m_fUpdateInterval(0)
+		, m_fPendingTime(0)
+		, m_fUpdateTimer(0)
 	{
-		m_animState[eAnimPart_Base].m_pSkeleton = pSkel;
-		m_animState[eAnimPart_Top].m_pSkeleton = pSkel;
-
-		for (uint32 i = 0; i < m_pSkeleton->m_vecBones.size(); ++i)
+		for (uint32 i = 0; i < eAnimPart_Count; ++i)
 		{
-			Bone* pBone = m_pSkeleton->m_vecBones[i];
+			m_layers[i].Init(pSkel);
+		}
+
+		const uint32 nBones = m_pSkeleton->GetBoneCount();
+		m_pSkeleton->GetBindPose(m_pose);
+		m_boneTransforms.resize(nBones);
+		m_skinPalette.resize(nBones);
 
-			m_pSkeleton->RecursUpdateBoneTransform(pBone);
-			pBone->m_matInvBindPos = pBone->m_matCombine.Inverse();
+		if (nBones > 0)
+		{
+			m_pSkeleton->ComputeModelTransforms(m_pose, &m_boneTransforms[0], nBones);
+			m_pSkeleton->ComputeSkinPalette(&m_boneTransforms[0], &m_skinPalette[0], nBones);
 		}
 	}
 	//------------------------------------------------------------------------------------
 	SkinModel::~SkinModel()
 	{
-		SAFE_DELETE(m_pSkeleton);
 		SAFE_DELETE(m_pSkelRender);
 	}
 	//------------------------------------------------------------------------------------
-	void SkinModel::PlayAnimation(eAnimPart part, const STRING& name, bool bLoop)
+	void SkinModel::PlayAnimation(eAnimPart part, const STRING& name, bool bLoop, float fFadeTime)
 	{
+		AnimClip* pAnim = m_layers[part].GetCurrent().m_pAnim;
+
 		for (uint32 i = 0; i < m_pSkeleton->m_vecAnims.size(); ++i)
 		{
 			if (m_pSkeleton->m_vecAnims[i]->m_name == name)
 			{
-				m_animState[part].m_pAnim = m_pSkeleton->m_vecAnims[i];
+				pAnim = m_pSkeleton->m_vecAnims[i];
 				break;
 			}
 		}
 
-		m_animState[part].m_fAnimTime = 0.0f;
-		m_animState[part].m_bLoop = bLoop;
+		m_layers[part].Play(pAnim, bLoop, fFadeTime);
+	}
+	//------------------------------------------------------------------------------------
+	void SkinModel::SetPartMask(eAnimPart part, const STRING& rootBone)
+	{
+		std::vector<float> mask;
+		m_pSkeleton->BuildBoneMask(rootBone, mask);
+
+		m_layers[part].SetMask(mask);
 	}
 	//------------------------------------------------------------------------------------
-	void SkinModel::Update(float dt)
+	void SkinModel::UpdateAnimation(float dt)
 	{
-		cBufferSkin& cSkin = g_env.pRenderer->GetSkinCB();
+		m_nEvaluatedBones = 0;
 
-		for (uint32 i = 0; i < m_pSkeleton->m_vecBones.size(); ++i)
+		if (m_boneTransforms.empty())
 		{
-			Bone* pBone = m_pSkeleton->m_vecBones[i];
-			pBone->m_matLocal = pBone->m_matBindPose;
+			return;
 		}
 
-		m_animState[eAnimPart_Base].Update(dt);
-		m_animState[eAnimPart_Top].Update(dt);
+		const uint32 nBones = m_pSkeleton->GetLodBoneCount(m_iBoneLod);
+
+		m_pSkeleton->GetBindPose(m_pose);
 
-		for (uint32 i = 0; i < m_pSkeleton->m_vecBones.size(); ++i)
+		// Everything stays local until the layers are done
+		for (uint32 i = 0; i < eAnimPart_Count; ++i)
 		{
-			Bone* pBone = m_pSkeleton->m_vecBones[i];
-			pBone->m_bMatCombineValid = false;
-			m_pSkeleton->RecursUpdateBoneTransform(pBone);
+			m_layers[i].Advance(dt);
+			m_layers[i].Apply(m_pose, nBones);
 		}
 
-		Entity::Update(dt);
+		m_pSkeleton->ComputeModelTransforms(m_pose, &m_boneTransforms[0], nBones);
+		m_pSkeleton->ComputeSkinPalette(&m_boneTransforms[0], &m_skinPalette[0], nBones);
+
+		m_nEvaluatedBones = nBones;
 	}
 	//------------------------------------------------------------------------------------
-	void SkinModel::Render()
+	bool SkinModel::_SelectLod(const Camera* pCamera, uint32 iStagger)
+	{
+		const SAnimLodLevel* pLevel = nullptr;
+
+		if (!GetVisible())
+		{
+			// Its shadow may still be seen, the coarsest level is enough for that
+			if (!GetCastShadow())
+			{
+				return false;
+			}
+
+			pLevel = &s_animLodLevels.back();
+		}
+		else
+		{
+			const AABB& aabb = GetWorldAABB();
+			const float fRadius = aabb.GetSize().GetLength() * 0.5f;
+			const float fDistance = (aabb.GetCenter() - pCamera->GetPos()).GetLength();
+
+			// Diameter over the height of the frustum at that distance
+			const float fScreenSize = fDistance > fRadius ? fRadius / (fDistance * tanf(pCamera->GetFov() * 0.5f)) : 1.0f;
+
+			pLevel = &s_animLodLevels.back();
+			for (uint32 i = 0; i < s_animLodLevels.size(); ++i)
+			{
+				if (fScreenSize >= s_animLodLevels[i].fMinScreenSize)
+				{
+					pLevel = &s_animLodLevels[i];
+					break;
+				}
+			}
+		}
+
+		if (pLevel->fUpdateInterval != m_fUpdateInterval)
+		{
+			// Spread the models switching together over a few frames
+			m_fUpdateInterval = pLevel->fUpdateInterval;
+			m_fUpdateTimer = Min(m_fUpdateTimer, m_fUpdateInterval * (iStagger & 3) * 0.25f);
+		}
+
+		m_iBoneLod = pLevel->iBoneLod;
+
+		return true;
+	}
+	//------------------------------------------------------------------------------------
+	void SkinModel::SetAnimLodLevels(const std::vector<SAnimLodLevel>& levels)
+	{
+		_AST(!levels.empty());
+		s_animLodLevels = levels;
+	}
+	//------------------------------------------------------------------------------------
+	void SkinModel::UpdateAnimations(SkinModel** ppModels, uint32 nModels, float dt, const Camera* pCamera, SAnimUpdateStats* pStats)
 	{
-		cBufferSkin& cSkin = g_env.pRenderer->GetSkinCB();
+		JobSystem::GetSingleton().ParallelFor(nModels, ANIMATION_UPDATE_GRAIN, [ppModels, dt, pCamera](uint32 nBegin, uint32 nEnd)
+		{
+			for (uint32 i = nBegin; i < nEnd; ++i)
+			{
+				SkinModel* pModel = ppModels[i];
 
-		for (uint32 i = 0; i < m_pSkeleton->m_vecBones.size(); ++i)
+				// Skipped models keep their time so their clips and crossfades stay in sync,
+				// however long they were skipped they're evaluated once when they come back
+				pModel->m_fPendingTime += dt;
+				pModel->m_fUpdateTimer += dt;
+
+				if (pCamera)
+				{
+					if (!pModel->_SelectLod(pCamera, i) || pModel->m_fUpdateTimer < pModel->m_fUpdateInterval)
+					{
+						pModel->m_nEvaluatedBones = 0;
+						continue;
+					}
+				}
+
+				pModel->UpdateAnimation(pModel->m_fPendingTime);
+				pModel->m_fPendingTime = 0;
+				pModel->m_fUpdateTimer = 0;
+			}
+		});
+
+		if (pStats)
 		{
-			Bone* pBone = m_pSkeleton->m_vecBones[i];
+			*pStats = SAnimUpdateStats();
+			pStats->nModels = nModels;
 
-			if (!pBone->m_bMatCombineValid)
+			for (uint32 i = 0; i < nModels; ++i)
 			{
-				pBone->m_matCombine = pBone->m_matInvBindPos * pBone->m_matCombine;
-				pBone->m_bMatCombineValid = true;
+				const SkinModel* pModel = ppModels[i];
+
+				pStats->nBonesTotal += pModel->m_pSkeleton->GetBoneCount();
+				pStats->nBonesEvaluated += pModel->m_nEvaluatedBones;
+
+				if (pModel->m_nEvaluatedBones > 0)
+					++pStats->nEvaluated;
+				else if (!pModel->GetVisible() && !pModel->GetCastShadow())
+					++pStats->nCulled;
 			}
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void SkinModel::UploadPalettes(SkinModel** ppModels, uint32 nModels)
+	{
+		uint32 nMatrices = 0;
 
-			cSkin.matSkin[pBone->m_id] = pBone->m_matCombine.Transpose();
+		for (uint32 i = 0; i < nModels; ++i)
+		{
+			ppModels[i]->m_nPaletteOffset = nMatrices;
+			nMatrices += ppModels[i]->GetPaletteSize();
 		}
 
+		if (nMatrices == 0)
+		{
+			return;
+		}
+
+		MAT44* pPalette = g_env.pRenderer->BeginSkinPalettes(nMatrices);
+
+		// Ranges don't overlap, so the copies go in parallel too
+		JobSystem::GetSingleton().ParallelFor(nModels, ANIMATION_UPDATE_GRAIN, [ppModels, pPalette](uint32 nBegin, uint32 nEnd)
+		{
+			for (uint32 i = nBegin; i < nEnd; ++i)
+			{
+				ppModels[i]->_WritePalette(pPalette + ppModels[i]->m_nPaletteOffset);
+			}
+		});
+
+		g_env.pRenderer->EndSkinPalettes();
+	}
+	//------------------------------------------------------------------------------------
+	void SkinModel::_WritePalette(MAT44* pDst) const
+	{
+		const uint32* pBoneIds = &m_pSkeleton->m_boneIds[0];
+
+		for (uint32 i = 0; i < m_skinPalette.size(); ++i)
+		{
+			_AST(pBoneIds[i] < m_skinPalette.size());
+			pDst[pBoneIds[i]] = m_skinPalette[i].Transpose();
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void SkinModel::Render()
+	{
+		g_env.pRenderer->GetSkinCB().paletteOffset = m_nPaletteOffset;
 		g_env.pRenderer->UpdateSkinCBuffer();
 
 		Entity::Render();
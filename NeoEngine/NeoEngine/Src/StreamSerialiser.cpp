@@ -0,0 +1,367 @@
+#include "stdafx.h"
+#include "StreamSerialiser.h"
+
+namespace Neo
+{
+	// id, version, length
+	const uint32 StreamSerialiser::CHUNK_HEADER_SIZE = sizeof(uint32) + sizeof(uint16) + sizeof(uint32);
+
+	// Longest run a single control byte of the packer can describe.
+	static const uint32 PACK_MAX_RUN = 129;
+	static const uint32 PACK_MAX_LITERAL = 128;
+
+	//------------------------------------------------------------------------------------
+	// Byte plane shuffle followed by a byte delta, then PackBits:
+	// control 0..127 is followed by control+1 literal bytes, 128..255 repeats the next byte control-126 times.
+	static void _PackBytes(const uint8* pSrc, uint32 nBytes, uint32 nElemSize, std::vector<uint8>& out)
+	{
+		std::vector<uint8> planes(nBytes);
+		const uint32 nElems = nBytes / nElemSize;
+		const uint32 nShuffled = nElems * nElemSize;
+
+		for (uint32 b = 0; b < nElemSize; ++b)
+		{
+			uint8* pPlane = &planes[0] + b * nElems;
+			for (uint32 i = 0; i < nElems; ++i)
+				pPlane[i] = pSrc[i * nElemSize + b];
+		}
+		for (uint32 i = nShuffled; i < nBytes; ++i)
+			planes[i] = pSrc[i];
+
+		uint8 prev = 0;
+		for (uint32 i = 0; i < nBytes; ++i)
+		{
+			const uint8 cur = planes[i];
+			planes[i] = (uint8)(cur - prev);
+			prev = cur;
+		}
+
+		out.clear();
+		out.reserve(nBytes / 2 + 16);
+
+		uint32 i = 0;
+		while (i < nBytes)
+		{
+			uint32 run = 1;
+			while (i + run < nBytes && run < PACK_MAX_RUN && planes[i + run] == planes[i])
+				++run;
+
+			if (run >= 2)
+			{
+				out.push_back((uint8)(run + 126));
+				out.push_back(planes[i]);
+				i += run;
+				continue;
+			}
+
+			// Literals up to the next run of at least 3, a run of 2 costs as much as the literals
+			uint32 nLiteral = 1;
+			while (i + nLiteral < nBytes && nLiteral < PACK_MAX_LITERAL)
+			{
+				const uint32 j = i + nLiteral;
+				if (j + 2 < nBytes && planes[j] == planes[j + 1] && planes[j] == planes[j + 2])
+					break;
+				++nLiteral;
+			}
+
+			out.push_back((uint8)(nLiteral - 1));
+			out.insert(out.end(), planes.begin() + i, planes.begin() + i + nLiteral);
+			i += nLiteral;
+		}
+	}
+	//------------------------------------------------------------------------------------
+	static bool _UnpackBytes(const uint8* pSrc, uint32 nPacked, uint32 nElemSize, uint8* pDest, uint32 nBytes)
+	{
+		std::vector<uint8> planes(nBytes);
+
+		uint32 iSrc = 0, iDest = 0;
+		while (iSrc < nPacked && iDest < nBytes)
+		{
+			const uint8 ctrl = pSrc[iSrc++];
+			if (ctrl < 128)
+			{
+				const uint32 nLiteral = ctrl + 1u;
+				if (iSrc + nLiteral > nPacked || iDest + nLiteral > nBytes)
+					return false;
+				memcpy(&planes[iDest], pSrc + iSrc, nLiteral);
+				iSrc += nLiteral;
+				iDest += nLiteral;
+			}
+			else
+			{
+				const uint32 run = ctrl - 126u;
+				if (iSrc >= nPacked || iDest + run > nBytes)
+					return false;
+				memset(&planes[iDest], pSrc[iSrc++], run);
+				iDest += run;
+			}
+		}
+
+		if (iDest != nBytes)
+			return false;
+
+		uint8 prev = 0;
+		for (uint32 i = 0; i < nBytes; ++i)
+		{
+			prev = (uint8)(prev + planes[i]);
+			planes[i] = prev;
+		}
+
+		const uint32 nElems = nBytes / nElemSize;
+		const uint32 nShuffled = nElems * nElemSize;
+
+		for (uint32 b = 0; b < nElemSize; ++b)
+		{
+			const uint8* pPlane = &planes[0] + b * nElems;
+			for (uint32 i = 0; i < nElems; ++i)
+				pDest[i * nElemSize + b] = pPlane[i];
+		}
+		for (uint32 i = nShuffled; i < nBytes; ++i)
+			pDest[i] = planes[i];
+
+		return true;
+	}
+	//------------------------------------------------------------------------------------
+	StreamSerialiser::StreamSerialiser(const STRING& filename, eMode mode, uint32 nOffset)
+		: m_nFileSize(0)
+		, m_bRead(mode == eMode_Read)
+		, m_bError(false)
+	{
+		std::ios_base::openmode flags = std::ios_base::binary;
+		flags |= m_bRead ? std::ios_base::in : (std::ios_base::out | std::ios_base::trunc);
+
+		m_file.open(filename.c_str(), flags);
+		m_bError = !m_file.is_open();
+
+		if (!m_bError && m_bRead)
+		{
+			m_file.seekg(0, std::ios_base::end);
+			m_nFileSize = (uint32)m_file.tellg();
+			seek(0);
+		}
+
+		if (!m_bError && nOffset)
+			seek(nOffset);
+	}
+	//------------------------------------------------------------------------------------
+	StreamSerialiser::~StreamSerialiser()
+	{
+		// Chunks left open would have a wrong length
+		_AST(m_chunkStack.empty());
+		m_file.close();
+	}
+	//------------------------------------------------------------------------------------
+	uint32 StreamSerialiser::tell()
+	{
+		return m_bRead ? (uint32)m_file.tellg() : (uint32)m_file.tellp();
+	}
+	//------------------------------------------------------------------------------------
+	void StreamSerialiser::seek(uint32 pos)
+	{
+		m_file.clear();
+
+		if (m_bRead)
+			m_file.seekg(pos);
+		else
+			m_file.seekp(pos);
+	}
+	//------------------------------------------------------------------------------------
+	void StreamSerialiser::writeChunkBegin(uint32 id, uint16 version)
+	{
+		_AST(!m_bRead);
+
+		Chunk c;
+		c.id = id;
+		c.version = version;
+		c.offset = tell();
+		m_chunkStack.push_back(c);
+
+		// Length is patched by writeChunkEnd
+		write(&c.id);
+		write(&c.version);
+		write(&c.length);
+	}
+	//------------------------------------------------------------------------------------
+	void StreamSerialiser::writeChunkEnd(uint32 id)
+	{
+		_AST(!m_chunkStack.empty() && m_chunkStack.back().id == id);
+
+		Chunk& c = m_chunkStack.back();
+		const uint32 endPos = tell();
+		c.length = endPos - c.offset - CHUNK_HEADER_SIZE;
+
+		seek(c.offset + sizeof(uint32) + sizeof(uint16));
+		write(&c.length);
+		seek(endPos);
+
+		m_chunkStack.pop_back();
+	}
+	//------------------------------------------------------------------------------------
+	const StreamSerialiser::Chunk* StreamSerialiser::readChunkBegin(uint32 id, uint16 maxVersion)
+	{
+		_AST(m_bRead);
+
+		// Reading the header of another chunk is no error, but an earlier one must stay
+		const bool bWasError = m_bError;
+
+		Chunk c;
+		c.offset = tell();
+		read(&c.id);
+		read(&c.version);
+		read(&c.length);
+
+		if (m_bError || c.id != id || c.version > maxVersion)
+		{
+			m_bError = bWasError;
+			seek(c.offset);
+			return nullptr;
+		}
+
+		m_chunkStack.push_back(c);
+		m_lastChunk = c;
+
+		return &m_lastChunk;
+	}
+	//------------------------------------------------------------------------------------
+	void StreamSerialiser::readChunkEnd(uint32 id)
+	{
+		_AST(!m_chunkStack.empty() && m_chunkStack.back().id == id);
+
+		const Chunk& c = m_chunkStack.back();
+		seek(c.offset + CHUNK_HEADER_SIZE + c.length);
+
+		m_chunkStack.pop_back();
+	}
+	//------------------------------------------------------------------------------------
+	uint32 StreamSerialiser::peekNextChunkID()
+	{
+		const uint32 pos = tell();
+		uint32 id = 0;
+
+		if (!m_file.read((char*)&id, sizeof(id)))
+			id = 0;
+
+		seek(pos);
+
+		return id;
+	}
+	//------------------------------------------------------------------------------------
+	bool StreamSerialiser::isEndOfChunk(uint32 id)
+	{
+		_AST(!m_chunkStack.empty() && m_chunkStack.back().id == id);
+
+		const Chunk& c = m_chunkStack.back();
+		return tell() >= c.offset + CHUNK_HEADER_SIZE + c.length;
+	}
+	//------------------------------------------------------------------------------------
+	uint32 StreamSerialiser::getOffsetFromChunkStart()
+	{
+		if (m_chunkStack.empty())
+			return 0;
+
+		return tell() - m_chunkStack.back().offset - CHUNK_HEADER_SIZE;
+	}
+	//------------------------------------------------------------------------------------
+	void StreamSerialiser::write(const STRING* pStr)
+	{
+		const uint32 len = (uint32)pStr->size();
+		write(&len);
+		if (len)
+			writeData(pStr->c_str(), 1, len);
+	}
+	//------------------------------------------------------------------------------------
+	void StreamSerialiser::read(STRING* pStr)
+	{
+		uint32 len = 0;
+		read(&len);
+
+		pStr->resize(len);
+		if (len)
+			readData(&(*pStr)[0], 1, len);
+	}
+	//------------------------------------------------------------------------------------
+	void StreamSerialiser::writeCompressed(const void* pData, uint32 nBytes, uint32 nElemSize)
+	{
+		_AST(nElemSize > 0);
+
+		std::vector<uint8> packed;
+		if (nBytes)
+			_PackBytes((const uint8*)pData, nBytes, nElemSize, packed);
+
+		const uint32 nPacked = (uint32)packed.size();
+		write(&nBytes);
+		write(&nElemSize);
+		write(&nPacked);
+		if (nPacked)
+			writeData(&packed[0], 1, nPacked);
+	}
+	//------------------------------------------------------------------------------------
+	bool StreamSerialiser::readCompressed(void* pData, uint32 nBytes)
+	{
+		uint32 nRawBytes = 0, nElemSize = 0, nPacked = 0;
+		read(&nRawBytes);
+		read(&nElemSize);
+		read(&nPacked);
+
+		if (m_bError || nRawBytes != nBytes || nElemSize == 0)
+		{
+			m_bError = true;
+			return false;
+		}
+
+		if (!nBytes)
+			return true;
+
+		// Check the sizes before trusting them with an allocation: the packed bytes must be in the
+		// chunk, and no more than all literals, and a run of PACK_MAX_RUN takes 2 of them.
+		const uint32 nMaxPacked = nBytes + (nBytes + PACK_MAX_LITERAL - 1) / PACK_MAX_LITERAL;
+		if (nPacked > getRemainingBytes() || nPacked > nMaxPacked ||
+			(uint64)nBytes > (uint64)((nPacked + 1) / 2) * PACK_MAX_RUN)
+		{
+			m_bError = true;
+			return false;
+		}
+
+		std::vector<uint8> packed(nPacked);
+		if (nPacked)
+			readData(&packed[0], 1, nPacked);
+
+		if (m_bError || !_UnpackBytes(packed.empty() ? nullptr : &packed[0], nPacked, nElemSize, (uint8*)pData, nBytes))
+		{
+			m_bError = true;
+			return false;
+		}
+
+		return true;
+	}
+	//------------------------------------------------------------------------------------
+	void StreamSerialiser::writeData(const void* pData, size_t size, size_t count)
+	{
+		_AST(!m_bRead);
+
+		if (!m_file.write((const char*)pData, size * count))
+			m_bError = true;
+	}
+	//------------------------------------------------------------------------------------
+	void StreamSerialiser::readData(void* pData, size_t size, size_t count)
+	{
+		_AST(m_bRead);
+
+		if (!m_file.read((char*)pData, size * count))
+			m_bError = true;
+	}
+	//------------------------------------------------------------------------------------
+	uint32 StreamSerialiser::getRemainingBytes()
+	{
+		const uint32 pos = tell();
+		uint32 end = m_nFileSize;
+
+		if (!m_chunkStack.empty())
+		{
+			const Chunk& c = m_chunkStack.back();
+			end = std::min(end, c.offset + CHUNK_HEADER_SIZE + c.length);
+		}
+
+		return pos < end ? end - pos : 0;
+	}
+}
@@ -11,6 +11,10 @@
 #include "MaterialManager.h"
 #include "Renderer.h"
 #include "PixelBox.h"
+#include "JobSystem.h"
+#include "StreamSerialiser.h"
+#include "TextureManager.h"
+#include "Terrain/TerrainRenderQueue.h"
 
 
 namespace Neo
@@ -32,6 +36,9 @@ namespace Neo
 		, mCompositeMapDiffuse(SColor::WHITE)
 		, mCompositeMapDistance(4000)
 		, mUseVertexCompressionWhenAvailable(true)
+		, mUseLightMap(false)
+		, mUseCompactVertices(false)
+		, mEditable(false)
 	{
 		mLightMapDir = VEC3(1, -1, 0);
 		mLightMapDir.Normalize();
@@ -62,6 +69,12 @@ namespace Neo
 	const uint8 Terrain::DERIVED_DATA_LIGHTMAP = 4;
 	// This MUST match the bitwise OR of all the types above with no extra bits!
 	const uint8 Terrain::DERIVED_DATA_ALL = 7;
+	// Rows of quads processed by one job when calculating height deltas
+	static const uint32 HEIGHT_DELTA_ROW_GRAIN = 1;
+	// Rows of texels processed by one job when calculating normals
+	static const uint32 NORMAL_ROW_GRAIN = 16;
+	// Lines swept by one job when calculating the lightmap
+	static const uint32 LIGHTMAP_LINE_GRAIN = 16;
 
 	//---------------------------------------------------------------------
 	Terrain::Terrain()
@@ -108,6 +121,8 @@ namespace Neo
 		, mCompositeMapUpdateCountdown(0)
 		, mLastMillis(0)
 		, mLodMorphRequired(false)
+		, mUseCompactVertices(false)
+		, mEditable(false)
 		, mNormalMapRequired(false)
 		, mLightMapRequired(false)
 		, mLightMapShadowsOnly(true)
@@ -118,7 +133,16 @@ namespace Neo
 		, mLastViewportHeight(0)
 		, mCustomGpuBufferAllocator(0)
 		, mLodManager(0)
+		, mLodInvalid(true)
+		, mLodCFactor(0)
+		, mLodHighestLoaded(-1)
+		, mMaterial(nullptr)
+		, mWireframe(false)
+		, mRenderQueue(nullptr)
 		, mTerrainNormalMap(nullptr)
+		, mColourMap(nullptr)
+		, mLightmap(nullptr)
+		, mCompositeMap(nullptr)
 		, mCompositeMapDirtyRectLightmapUpdate(false)
 
 	{
@@ -147,6 +171,7 @@ namespace Neo
 		freeGPUResources();
 		freeCPUResources();
 
+		SAFE_DELETE(mRenderQueue);
 		SAFE_DELETE(m_pConstantBuf);
 	}
 	//---------------------------------------------------------------------
@@ -189,506 +214,394 @@ namespace Neo
 			return mQuadTree->getBoundingRadius();
 	}
 	//---------------------------------------------------------------------
-//	void Terrain::save(const STRING& filename)
-//	{
-//		// force to load highest lod, or quadTree may contain hole
-//		load(0, true);
-//
-//#if OGRE_PLATFORM == OGRE_PLATFORM_APPLE_IOS
-//		DataStreamPtr stream = Root::getSingleton().createFileStream(iOSDocumentsDirectory() + "/" + filename,
-//			_getDerivedResourceGroup(), true);
-//#else
-//		DataStreamPtr stream = Root::getSingleton().createFileStream(filename,
-//			_getDerivedResourceGroup(), true);
-//#endif
-//		StreamSerialiser ser(stream);
-//		save(ser);
-//	}
-	//---------------------------------------------------------------------
-	//void Terrain::save(StreamSerialiser& stream)
-	//{
-	//	// wait for any queued processes to finish
-	//	waitForDerivedProcesses();
+	void Terrain::save(const STRING& filename)
+	{
+		// force to load highest lod, or quadTree may contain hole
+		load(0, true);
 
-	//	if (mHeightDataModified)
-	//	{
-	//		// When modifying, for efficiency we only increase the max deltas at each LOD,
-	//		// we never reduce them (since that would require re-examining more samples)
-	//		// Since we now save this data in the file though, we need to make sure we've
-	//		// calculated the optimal
-	//		Rect rect;
-	//		rect.top = 0; rect.bottom = mSize;
-	//		rect.left = 0; rect.right = mSize;
-	//		calculateHeightDeltas(rect);
-	//		finaliseHeightDeltas(rect, false);
-	//	}
+		StreamSerialiser stream(filename, StreamSerialiser::eMode_Write);
+		if (!stream.isValid())
+		{
+			_AST(0 && "Can't open the terrain file for writing, Terrain::save");
+			return;
+		}
 
-	//	stream.writeChunkBegin(TERRAIN_CHUNK_ID, TERRAIN_CHUNK_VERSION);
+		save(stream);
+	}
+	//---------------------------------------------------------------------
+	void Terrain::save(StreamSerialiser& stream)
+	{
+		// wait for any queued processes to finish
+		waitForDerivedProcesses();
 
-	//	stream.writeChunkBegin(TERRAINGENERALINFO_CHUNK_ID, TERRAINGENERALINFO_CHUNK_VERSION);
-	//	uint8 align = (uint8)mAlign;
-	//	stream.write(&align);
+		if (mHeightDataModified)
+		{
+			// When modifying, for efficiency we only increase the max deltas at each LOD,
+			// we never reduce them (since that would require re-examining more samples)
+			// Since we now save this data in the file though, we need to make sure we've
+			// calculated the optimal
+			Rect rect;
+			rect.top = 0; rect.bottom = mSize;
+			rect.left = 0; rect.right = mSize;
+			calculateHeightDeltas(rect, mDeltaData);
+			finaliseHeightDeltas(rect, false);
+		}
 
-	//	stream.write(&mSize);
-	//	stream.write(&mWorldSize);
-	//	stream.write(&mMaxBatchSize);
-	//	stream.write(&mMinBatchSize);
-	//	stream.write(&mPos);
-	//	stream.writeChunkEnd(TERRAINGENERALINFO_CHUNK_ID);
+		stream.writeChunkBegin(TERRAIN_CHUNK_ID, TERRAIN_CHUNK_VERSION);
 
-	//	TerrainLodManager::saveLodData(stream, this);
+		stream.writeChunkBegin(TERRAINGENERALINFO_CHUNK_ID, TERRAINGENERALINFO_CHUNK_VERSION);
+		uint8 align = (uint8)mAlign;
+		stream.write(&align);
 
-	//	// start compressing
-	//	stream.startDeflate();
+		stream.write(&mSize);
+		stream.write(&mWorldSize);
+		stream.write(&mMaxBatchSize);
+		stream.write(&mMinBatchSize);
+		stream.write(&mPos);
+		stream.writeChunkEnd(TERRAINGENERALINFO_CHUNK_ID);
 
-	//	writeLayerDeclaration(mLayerDecl, stream);
+		TerrainLodManager::saveLodData(stream, this);
 
-	//	// Layers
-	//	checkLayers(false);
-	//	uint8 numLayers = (uint8)mLayers.size();
-	//	writeLayerInstanceList(mLayers, stream);
+		writeLayerDeclaration(mLayerDecl, stream);
 
-	//	// Packed layer blend data
-	//	if (!mCpuBlendMapStorage.empty())
-	//	{
-	//		// save from CPU data if it's there, it means GPU data was never created
-	//		stream.write(&mLayerBlendMapSize);
+		// Layers
+		checkLayers(false);
+		writeLayerInstanceList(mLayers, stream);
 
-	//		// load packed CPU data
-	//		int numBlendTex = getBlendTextureCount(numLayers);
-	//		for (int i = 0; i < numBlendTex; ++i)
-	//		{
-	//			PixelFormat fmt = getBlendTextureFormat(i, numLayers);
-	//			size_t channels = PixelUtil::getNumElemBytes(fmt);
-	//			size_t dataSz = channels * mLayerBlendMapSize * mLayerBlendMapSize;
-	//			uint8* pData = mCpuBlendMapStorage[i];
-	//			stream.write(pData, dataSz);
-	//		}
-	//	}
-	//	else
-	//	{
-	//		if (mLayerBlendMapSize != mLayerBlendMapSizeActual)
-	//		{
-	//			LogManager::getSingleton().stream() <<
-	//				"WARNING: blend maps were requested at a size larger than was supported "
-	//				"on this hardware, which means the quality has been degraded";
-	//		}
-	//		stream.write(&mLayerBlendMapSizeActual);
-	//		uint8* tmpData = (uint8*)OGRE_MALLOC(mLayerBlendMapSizeActual * mLayerBlendMapSizeActual * 4, MEMCATEGORY_GENERAL);
-	//		uint8 texIndex = 0;
-	//		for (TexturePtrList::iterator i = mBlendTextureList.begin(); i != mBlendTextureList.end(); ++i, ++texIndex)
-	//		{
-	//			// Must blit back in CPU format!
-	//			PixelFormat cpuFormat = getBlendTextureFormat(texIndex, getLayerCount());
-	//			PixelBox dst(mLayerBlendMapSizeActual, mLayerBlendMapSizeActual, 1, cpuFormat, tmpData);
-	//			(*i)->getBuffer()->blitToMemory(dst);
-	//			size_t dataSz = PixelUtil::getNumElemBytes((*i)->getFormat()) *
-	//				mLayerBlendMapSizeActual * mLayerBlendMapSizeActual;
-	//			stream.write(tmpData, dataSz);
-	//		}
-	//		OGRE_FREE(tmpData, MEMCATEGORY_GENERAL);
-	//	}
+		// Packed layer blend data, every blend texture is A8R8G8B8
+		if (!mCpuBlendMapStorage.empty())
+		{
+			// save from CPU data if it's there, it means GPU data was never created
+			stream.write(&mLayerBlendMapSize);
 
-	//	// other data
-	//	// normals
-	//	if (mNormalMapRequired)
-	//	{
-	//		stream.writeChunkBegin(TERRAINDERIVEDDATA_CHUNK_ID, TERRAINDERIVEDDATA_CHUNK_VERSION);
-	//		STRING normalDataType("normalmap");
-	//		stream.write(&normalDataType);
-	//		stream.write(&mSize);
-	//		if (mCpuTerrainNormalMap)
-	//		{
-	//			// save from CPU data if it's there, it means GPU data was never created
-	//			stream.write((uint8*)mCpuTerrainNormalMap->data, mSize * mSize * 3);
-	//		}
-	//		else
-	//		{
-	//			uint8* tmpData = (uint8*)OGRE_MALLOC(mSize * mSize * 3, MEMCATEGORY_GENERAL);
-	//			PixelBox dst(mSize, mSize, 1, PF_BYTE_RGB, tmpData);
-	//			mTerrainNormalMap->getBuffer()->blitToMemory(dst);
-	//			stream.write(tmpData, mSize * mSize * 3);
-	//			OGRE_FREE(tmpData, MEMCATEGORY_GENERAL);
-	//		}
-	//		stream.writeChunkEnd(TERRAINDERIVEDDATA_CHUNK_ID);
-	//	}
+			uint8 numBlendTex = (uint8)mCpuBlendMapStorage.size();
+			stream.write(&numBlendTex);
+			for (uint8 i = 0; i < numBlendTex; ++i)
+				stream.writeCompressed(mCpuBlendMapStorage[i], mLayerBlendMapSize * mLayerBlendMapSize * 4, 4);
+		}
+		else
+		{
+			stream.write(&mLayerBlendMapSizeActual);
 
-	//	// colourmap
-	//	if (mGlobalColourMapEnabled)
-	//	{
-	//		stream.writeChunkBegin(TERRAINDERIVEDDATA_CHUNK_ID, TERRAINDERIVEDDATA_CHUNK_VERSION);
-	//		STRING colourDataType("colourmap");
-	//		stream.write(&colourDataType);
-	//		stream.write(&mGlobalColourMapSize);
-	//		if (mCpuColourMapStorage)
-	//		{
-	//			// save from CPU data if it's there, it means GPU data was never created
-	//			stream.write(mCpuColourMapStorage, mGlobalColourMapSize * mGlobalColourMapSize * 3);
-	//		}
-	//		else
-	//		{
-	//			uint8* tmpData = (uint8*)OGRE_MALLOC(mGlobalColourMapSize * mGlobalColourMapSize * 3, MEMCATEGORY_GENERAL);
-	//			PixelBox dst(mGlobalColourMapSize, mGlobalColourMapSize, 1, PF_BYTE_RGB, tmpData);
-	//			mColourMap->getBuffer()->blitToMemory(dst);
-	//			stream.write(tmpData, mGlobalColourMapSize * mGlobalColourMapSize * 3);
-	//			OGRE_FREE(tmpData, MEMCATEGORY_GENERAL);
-	//		}
-	//		stream.writeChunkEnd(TERRAINDERIVEDDATA_CHUNK_ID);
+			uint8 numBlendTex = (uint8)mBlendTextureList.size();
+			stream.write(&numBlendTex);
 
-	//	}
+			const uint32 rowBytes = mLayerBlendMapSizeActual * 4;
+			std::vector<uint8> tmpData(rowBytes * mLayerBlendMapSizeActual);
+			for (TexturePtrList::iterator i = mBlendTextureList.begin(); i != mBlendTextureList.end(); ++i)
+			{
+				uint32 pitch = 0;
+				const uint8* pSrc = (const uint8*)(*i)->Lock(eLockMode_ReadOnly, &pitch);
+				for (uint16 y = 0; y < mLayerBlendMapSizeActual; ++y)
+					memcpy(&tmpData[y * rowBytes], pSrc + y * pitch, rowBytes);
+				(*i)->Unlock();
 
-	//	// lightmap
-	//	if (mLightMapRequired)
-	//	{
-	//		stream.writeChunkBegin(TERRAINDERIVEDDATA_CHUNK_ID, TERRAINDERIVEDDATA_CHUNK_VERSION);
-	//		STRING lightmapDataType("lightmap");
-	//		stream.write(&lightmapDataType);
-	//		stream.write(&mLightmapSize);
-	//		if (mCpuLightmapStorage)
-	//		{
-	//			// save from CPU data if it's there, it means GPU data was never created
-	//			stream.write(mCpuLightmapStorage, mLightmapSize * mLightmapSize);
-	//		}
-	//		else
-	//		{
-	//			uint8* tmpData = (uint8*)OGRE_MALLOC(mLightmapSize * mLightmapSize, MEMCATEGORY_GENERAL);
-	//			PixelBox dst(mLightmapSize, mLightmapSize, 1, PF_L8, tmpData);
-	//			mLightmap->getBuffer()->blitToMemory(dst);
-	//			stream.write(tmpData, mLightmapSize * mLightmapSize);
-	//			OGRE_FREE(tmpData, MEMCATEGORY_GENERAL);
-	//		}
-	//		stream.writeChunkEnd(TERRAINDERIVEDDATA_CHUNK_ID);
-	//	}
+				stream.writeCompressed(&tmpData[0], (uint32)tmpData.size(), 4);
+			}
+		}
 
-	//	// composite map
-	//	if (mCompositeMapRequired)
-	//	{
-	//		stream.writeChunkBegin(TERRAINDERIVEDDATA_CHUNK_ID, TERRAINDERIVEDDATA_CHUNK_VERSION);
-	//		STRING compositeMapDataType("compositemap");
-	//		stream.write(&compositeMapDataType);
-	//		stream.write(&mCompositeMapSize);
-	//		if (mCpuCompositeMapStorage)
-	//		{
-	//			// save from CPU data if it's there, it means GPU data was never created
-	//			stream.write(mCpuCompositeMapStorage, mCompositeMapSize * mCompositeMapSize * 4);
-	//		}
-	//		else
-	//		{
-	//			// composite map is 4 channel, 3x diffuse, 1x specular mask
-	//			uint8* tmpData = (uint8*)OGRE_MALLOC(mCompositeMapSize * mCompositeMapSize * 4, MEMCATEGORY_GENERAL);
-	//			PixelBox dst(mCompositeMapSize, mCompositeMapSize, 1, PF_BYTE_RGBA, tmpData);
-	//			mCompositeMap->getBuffer()->blitToMemory(dst);
-	//			stream.write(tmpData, mCompositeMapSize * mCompositeMapSize * 4);
-	//			OGRE_FREE(tmpData, MEMCATEGORY_GENERAL);
-	//		}
-	//		stream.writeChunkEnd(TERRAINDERIVEDDATA_CHUNK_ID);
-	//	}
+		// other data
+		// normals, the GPU copy isn't readable so calculate them again if the CPU copy is gone
+		if (mNormalMapRequired)
+		{
+			stream.writeChunkBegin(TERRAINDERIVEDDATA_CHUNK_ID, TERRAINDERIVEDDATA_CHUNK_VERSION);
+			STRING normalDataType("normalmap");
+			stream.write(&normalDataType);
+			stream.write(&mSize);
 
-	//	// write the quadtree
-	//	mQuadTree->save(stream);
+			PixelBox* pNormals = mCpuTerrainNormalMap;
+			if (!pNormals)
+			{
+				Rect finalRect;
+				pNormals = calculateNormals(Rect(0, 0, mSize, mSize), finalRect);
+			}
+			stream.writeCompressed(pNormals->GetDataPointer(), mSize * mSize * 4, 4);
 
-	//	// stop compressing
-	//	stream.stopDeflate();
+			if (pNormals != mCpuTerrainNormalMap)
+				delete pNormals;
 
-	//	stream.writeChunkEnd(TERRAIN_CHUNK_ID);
+			stream.writeChunkEnd(TERRAINDERIVEDDATA_CHUNK_ID);
+		}
 
-	//	mModified = false;
-	//	mHeightDataModified = false;
+		// lightmap, same as the normals
+		if (mLightMapRequired)
+		{
+			stream.writeChunkBegin(TERRAINDERIVEDDATA_CHUNK_ID, TERRAINDERIVEDDATA_CHUNK_VERSION);
+			STRING lightmapDataType("lightmap");
+			stream.write(&lightmapDataType);
+			stream.write(&mLightmapSizeActual);
 
-	//}
-	//---------------------------------------------------------------------
-	//void Terrain::writeLayerDeclaration(const TerrainLayerDeclaration& decl, StreamSerialiser& stream)
-	//{
-	//	// Layer declaration
-	//	stream.writeChunkBegin(TERRAINLAYERDECLARATION_CHUNK_ID, TERRAINLAYERDECLARATION_CHUNK_VERSION);
-	//	//  samplers
-	//	uint8 numSamplers = (uint8)decl.samplers.size();
-	//	stream.write(&numSamplers);
-	//	for (TerrainLayerSamplerList::const_iterator i = decl.samplers.begin();
-	//	i != decl.samplers.end(); ++i)
-	//	{
-	//		const TerrainLayerSampler& sampler = *i;
-	//		stream.writeChunkBegin(TERRAINLAYERSAMPLER_CHUNK_ID, TERRAINLAYERSAMPLER_CHUNK_VERSION);
-	//		stream.write(&sampler.alias);
-	//		uint8 pixFmt = (uint8)sampler.format;
-	//		stream.write(&pixFmt);
-	//		stream.writeChunkEnd(TERRAINLAYERSAMPLER_CHUNK_ID);
-	//	}
-	//	//  elements
-	//	uint8 numElems = (uint8)decl.elements.size();
-	//	stream.write(&numElems);
-	//	for (TerrainLayerSamplerElementList::const_iterator i = decl.elements.begin();
-	//	i != decl.elements.end(); ++i)
-	//	{
-	//		const TerrainLayerSamplerElement& elem = *i;
-	//		stream.writeChunkBegin(TERRAINLAYERSAMPLERELEMENT_CHUNK_ID, TERRAINLAYERSAMPLERELEMENT_CHUNK_VERSION);
-	//		stream.write(&elem.source);
-	//		uint8 sem = (uint8)elem.semantic;
-	//		stream.write(&sem);
-	//		stream.write(&elem.elementStart);
-	//		stream.write(&elem.elementCount);
-	//		stream.writeChunkEnd(TERRAINLAYERSAMPLERELEMENT_CHUNK_ID);
-	//	}
-	//	stream.writeChunkEnd(TERRAINLAYERDECLARATION_CHUNK_ID);
-	//}
-	////---------------------------------------------------------------------
-	//bool Terrain::readLayerDeclaration(StreamSerialiser& stream, TerrainLayerDeclaration& targetdecl)
-	//{
-	//	if (!stream.readChunkBegin(TERRAINLAYERDECLARATION_CHUNK_ID, TERRAINLAYERDECLARATION_CHUNK_VERSION))
-	//		return false;
-	//	//  samplers
-	//	uint8 numSamplers;
-	//	stream.read(&numSamplers);
-	//	targetdecl.samplers.resize(numSamplers);
-	//	for (uint8 s = 0; s < numSamplers; ++s)
-	//	{
-	//		if (!stream.readChunkBegin(TERRAINLAYERSAMPLER_CHUNK_ID, TERRAINLAYERSAMPLER_CHUNK_VERSION))
-	//			return false;
+			const uint32 lightmapBytes = mLightmapSizeActual * mLightmapSizeActual;
+			if (mCpuLightmapStorage)
+			{
+				// save from CPU data if it's there, it means GPU data was never created
+				stream.writeCompressed(mCpuLightmapStorage, lightmapBytes, 1);
+			}
+			else
+			{
+				Rect finalRect;
+				PixelBox* pLightmap = calculateLightmap(Rect(0, 0, mSize, mSize), Rect(0, 0, 0, 0), finalRect);
+				stream.writeCompressed(pLightmap->GetDataPointer(), lightmapBytes, 1);
+				delete pLightmap;
+			}
 
-	//		stream.read(&(targetdecl.samplers[s].alias));
-	//		uint8 pixFmt;
-	//		stream.read(&pixFmt);
-	//		targetdecl.samplers[s].format = (PixelFormat)pixFmt;
-	//		stream.readChunkEnd(TERRAINLAYERSAMPLER_CHUNK_ID);
-	//	}
-	//	//  elements
-	//	uint8 numElems;
-	//	stream.read(&numElems);
-	//	targetdecl.elements.resize(numElems);
-	//	for (uint8 e = 0; e < numElems; ++e)
-	//	{
-	//		if (!stream.readChunkBegin(TERRAINLAYERSAMPLERELEMENT_CHUNK_ID, TERRAINLAYERSAMPLERELEMENT_CHUNK_VERSION))
-	//			return false;
+			stream.writeChunkEnd(TERRAINDERIVEDDATA_CHUNK_ID);
+		}
 
-	//		stream.read(&(targetdecl.elements[e].source));
-	//		uint8 sem;
-	//		stream.read(&sem);
-	//		targetdecl.elements[e].semantic = (TerrainLayerSamplerSemantic)sem;
-	//		stream.read(&(targetdecl.elements[e].elementStart));
-	//		stream.read(&(targetdecl.elements[e].elementCount));
-	//		stream.readChunkEnd(TERRAINLAYERSAMPLERELEMENT_CHUNK_ID);
-	//	}
-	//	stream.readChunkEnd(TERRAINLAYERDECLARATION_CHUNK_ID);
+		// write the quadtree
+		mQuadTree->save(stream);
 
-	//	return true;
-	//}
-	////---------------------------------------------------------------------
-	//void Terrain::writeLayerInstanceList(const Terrain::LayerInstanceList& layers, StreamSerialiser& stream)
-	//{
-	//	uint8 numLayers = (uint8)layers.size();
-	//	stream.write(&numLayers);
-	//	for (LayerInstanceList::const_iterator i = layers.begin(); i != layers.end(); ++i)
-	//	{
-	//		const LayerInstance& inst = *i;
-	//		stream.writeChunkBegin(TERRAINLAYERINSTANCE_CHUNK_ID, TERRAINLAYERINSTANCE_CHUNK_VERSION);
-	//		stream.write(&inst.worldSize);
-	//		for (StringVector::const_iterator t = inst.textureNames.begin();
-	//		t != inst.textureNames.end(); ++t)
-	//		{
-	//			stream.write(&(*t));
-	//		}
-	//		stream.writeChunkEnd(TERRAINLAYERINSTANCE_CHUNK_ID);
-	//	}
+		stream.writeChunkEnd(TERRAIN_CHUNK_ID);
 
-	//}
-	////---------------------------------------------------------------------
-	//bool Terrain::readLayerInstanceList(StreamSerialiser& stream, size_t numSamplers, Terrain::LayerInstanceList& targetlayers)
-	//{
-	//	uint8 numLayers;
-	//	stream.read(&numLayers);
-	//	targetlayers.resize(numLayers);
-	//	for (uint8 l = 0; l < numLayers; ++l)
-	//	{
-	//		if (!stream.readChunkBegin(TERRAINLAYERINSTANCE_CHUNK_ID, TERRAINLAYERINSTANCE_CHUNK_VERSION))
-	//			return false;
-	//		stream.read(&targetlayers[l].worldSize);
-	//		targetlayers[l].textureNames.resize(numSamplers);
-	//		for (size_t t = 0; t < numSamplers; ++t)
-	//		{
-	//			stream.read(&(targetlayers[l].textureNames[t]));
-	//		}
-	//		stream.readChunkEnd(TERRAINLAYERINSTANCE_CHUNK_ID);
-	//	}
+		mModified = false;
+		mHeightDataModified = false;
+	}
+	//---------------------------------------------------------------------
+	void Terrain::writeLayerDeclaration(const TerrainLayerDeclaration& decl, StreamSerialiser& stream)
+	{
+		// Layer declaration
+		stream.writeChunkBegin(TERRAINLAYERDECLARATION_CHUNK_ID, TERRAINLAYERDECLARATION_CHUNK_VERSION);
+		//  samplers
+		uint8 numSamplers = (uint8)decl.samplers.size();
+		stream.write(&numSamplers);
+		for (TerrainLayerSamplerList::const_iterator i = decl.samplers.begin();
+		i != decl.samplers.end(); ++i)
+		{
+			const TerrainLayerSampler& sampler = *i;
+			stream.writeChunkBegin(TERRAINLAYERSAMPLER_CHUNK_ID, TERRAINLAYERSAMPLER_CHUNK_VERSION);
+			stream.write(&sampler.alias);
+			uint8 pixFmt = (uint8)sampler.format;
+			stream.write(&pixFmt);
+			stream.writeChunkEnd(TERRAINLAYERSAMPLER_CHUNK_ID);
+		}
+		//  elements
+		uint8 numElems = (uint8)decl.elements.size();
+		stream.write(&numElems);
+		for (TerrainLayerSamplerElementList::const_iterator i = decl.elements.begin();
+		i != decl.elements.end(); ++i)
+		{
+			const TerrainLayerSamplerElement& elem = *i;
+			stream.writeChunkBegin(TERRAINLAYERSAMPLERELEMENT_CHUNK_ID, TERRAINLAYERSAMPLERELEMENT_CHUNK_VERSION);
+			stream.write(&elem.source);
+			uint8 sem = (uint8)elem.semantic;
+			stream.write(&sem);
+			stream.write(&elem.elementStart);
+			stream.write(&elem.elementCount);
+			stream.writeChunkEnd(TERRAINLAYERSAMPLERELEMENT_CHUNK_ID);
+		}
+		stream.writeChunkEnd(TERRAINLAYERDECLARATION_CHUNK_ID);
+	}
+	//---------------------------------------------------------------------
+	bool Terrain::readLayerDeclaration(StreamSerialiser& stream, TerrainLayerDeclaration& targetdecl)
+	{
+		if (!stream.readChunkBegin(TERRAINLAYERDECLARATION_CHUNK_ID, TERRAINLAYERDECLARATION_CHUNK_VERSION))
+			return false;
+		//  samplers
+		uint8 numSamplers;
+		stream.read(&numSamplers);
+		targetdecl.samplers.resize(numSamplers);
+		for (uint8 s = 0; s < numSamplers; ++s)
+		{
+			if (!stream.readChunkBegin(TERRAINLAYERSAMPLER_CHUNK_ID, TERRAINLAYERSAMPLER_CHUNK_VERSION))
+				return false;
+
+			stream.read(&(targetdecl.samplers[s].alias));
+			uint8 pixFmt;
+			stream.read(&pixFmt);
+			targetdecl.samplers[s].format = (ePixelFormat)pixFmt;
+			stream.readChunkEnd(TERRAINLAYERSAMPLER_CHUNK_ID);
+		}
+		//  elements
+		uint8 numElems;
+		stream.read(&numElems);
+		targetdecl.elements.resize(numElems);
+		for (uint8 e = 0; e < numElems; ++e)
+		{
+			if (!stream.readChunkBegin(TERRAINLAYERSAMPLERELEMENT_CHUNK_ID, TERRAINLAYERSAMPLERELEMENT_CHUNK_VERSION))
+				return false;
+
+			stream.read(&(targetdecl.elements[e].source));
+			uint8 sem;
+			stream.read(&sem);
+			targetdecl.elements[e].semantic = (TerrainLayerSamplerSemantic)sem;
+			stream.read(&(targetdecl.elements[e].elementStart));
+			stream.read(&(targetdecl.elements[e].elementCount));
+			stream.readChunkEnd(TERRAINLAYERSAMPLERELEMENT_CHUNK_ID);
+		}
+		stream.readChunkEnd(TERRAINLAYERDECLARATION_CHUNK_ID);
 
-	//	return true;
-	//}
+		return true;
+	}
 	//---------------------------------------------------------------------
-	//bool Terrain::prepare(const STRING& filename)
-	//{
-	//	DataStreamPtr stream = ResourceGroupManager::getSingleton().openResource(filename, _getDerivedResourceGroup());
+	void Terrain::writeLayerInstanceList(const Terrain::LayerInstanceList& layers, StreamSerialiser& stream)
+	{
+		uint8 numLayers = (uint8)layers.size();
+		stream.write(&numLayers);
+		for (LayerInstanceList::const_iterator i = layers.begin(); i != layers.end(); ++i)
+		{
+			const LayerInstance& inst = *i;
+			stream.writeChunkBegin(TERRAINLAYERINSTANCE_CHUNK_ID, TERRAINLAYERINSTANCE_CHUNK_VERSION);
+			stream.write(&inst.worldSize);
+			for (StringVector::const_iterator t = inst.textureNames.begin();
+			t != inst.textureNames.end(); ++t)
+			{
+				stream.write(&(*t));
+			}
+			stream.writeChunkEnd(TERRAINLAYERINSTANCE_CHUNK_ID);
+		}
 
-	//	return prepare(stream);
-	//}
-	////---------------------------------------------------------------------
-	//bool Terrain::prepare(DataStreamPtr& stream)
-	//{
-	//	freeLodData();
-	//	mLodManager = OGRE_NEW TerrainLodManager(this, stream);
-	//	StreamSerialiser ser(stream);
-	//	return prepare(ser);
-	//}
-	////---------------------------------------------------------------------
-	//bool Terrain::prepare(StreamSerialiser& stream)
-	//{
-	//	mPrepareInProgress = true;
+	}
+	//---------------------------------------------------------------------
+	bool Terrain::readLayerInstanceList(StreamSerialiser& stream, size_t numSamplers, Terrain::LayerInstanceList& targetlayers)
+	{
+		uint8 numLayers;
+		stream.read(&numLayers);
+		targetlayers.resize(numLayers);
+		for (uint8 l = 0; l < numLayers; ++l)
+		{
+			if (!stream.readChunkBegin(TERRAINLAYERINSTANCE_CHUNK_ID, TERRAINLAYERINSTANCE_CHUNK_VERSION))
+				return false;
+			stream.read(&targetlayers[l].worldSize);
+			targetlayers[l].textureNames.resize(numSamplers);
+			for (size_t t = 0; t < numSamplers; ++t)
+			{
+				stream.read(&(targetlayers[l].textureNames[t]));
+			}
+			stream.readChunkEnd(TERRAINLAYERINSTANCE_CHUNK_ID);
+		}
 
-	//	freeTemporaryResources();
-	//	freeCPUResources();
+		return true;
+	}
+	//---------------------------------------------------------------------
+	bool Terrain::prepare(const STRING& filename)
+	{
+		StreamSerialiser stream(filename, StreamSerialiser::eMode_Read);
+		if (!stream.isValid())
+			return false;
 
-	//	if (mLodManager == NULL)
-	//	{
-	//		mLodManager = OGRE_NEW TerrainLodManager(this);
-	//	}
+		return prepare(stream, filename);
+	}
+	//---------------------------------------------------------------------
+	bool Terrain::prepare(StreamSerialiser& stream, const STRING& filename)
+	{
+		mPrepareInProgress = true;
+		waitForDerivedProcesses();
+		freeTemporaryResources();
+		freeLodData();
+		freeCPUResources();
 
-	//	copyGlobalOptions();
-
-	//	const StreamSerialiser::Chunk *mainChunk = stream.readChunkBegin(TERRAIN_CHUNK_ID, TERRAIN_CHUNK_VERSION);
-	//	if (!mainChunk)
-	//		return false;
-
-	//	if (mainChunk->version > 1)
-	//		stream.readChunkBegin(Terrain::TERRAINGENERALINFO_CHUNK_ID, Terrain::TERRAINGENERALINFO_CHUNK_VERSION);
-	//	uint8 align;
-	//	stream.read(&align);
-	//	mAlign = (Alignment)align;
-	//	stream.read(&mSize);
-	//	stream.read(&mWorldSize);
-
-	//	stream.read(&mMaxBatchSize);
-	//	stream.read(&mMinBatchSize);
-	//	stream.read(&mPos);
-	//	mRootNode->setPosition(mPos);
-	//	updateBaseScale();
-	//	determineLodLevels();
-
-	//	if (mainChunk->version > 1)
-	//		stream.readChunkEnd(Terrain::TERRAINGENERALINFO_CHUNK_ID);
-
-	//	size_t numVertices = mSize * mSize;
-	//	mHeightData = OGRE_ALLOC_T(float, numVertices, MEMCATEGORY_GEOMETRY);
-	//	mDeltaData = OGRE_ALLOC_T(float, numVertices, MEMCATEGORY_GEOMETRY);
-	//	// As we may not load full data, so we should make it clean first
-	//	memset(mHeightData, 0.0f, sizeof(float)*numVertices);
-	//	memset(mDeltaData, 0.0f, sizeof(float)*numVertices);
-
-	//	if (mainChunk->version > 1)
-	//	{
-	//		// skip height/delta data
-	//		for (int i = 0; i < mNumLodLevels; i++)
-	//		{
-	//			stream.readChunkBegin(TerrainLodManager::TERRAINLODDATA_CHUNK_ID, TerrainLodManager::TERRAINLODDATA_CHUNK_VERSION);
-	//			stream.readChunkEnd(TerrainLodManager::TERRAINLODDATA_CHUNK_ID);
-	//		}
+		// LOD data is read from this chunk again when it's streamed in
+		mLodManager = new TerrainLodManager(this, filename, stream.tell());
 
-	//		// start uncompressing
-	//		stream.startDeflate(mainChunk->length - stream.getOffsetFromChunkStart());
-	//	}
-	//	else
-	//	{
-	//		stream.read(mHeightData, numVertices);
-	//	}
+		copyGlobalOptions();
 
-	//	// Layer declaration
-	//	if (!readLayerDeclaration(stream, mLayerDecl))
-	//		return false;
-	//	checkDeclaration();
+		const StreamSerialiser::Chunk *mainChunk = stream.readChunkBegin(TERRAIN_CHUNK_ID, TERRAIN_CHUNK_VERSION);
+		if (!mainChunk)
+			return false;
+
+		if (!stream.readChunkBegin(Terrain::TERRAINGENERALINFO_CHUNK_ID, Terrain::TERRAINGENERALINFO_CHUNK_VERSION))
+			return false;
+		uint8 align;
+		stream.read(&align);
+		mAlign = (Alignment)align;
+		stream.read(&mSize);
+		stream.read(&mWorldSize);
+
+		stream.read(&mMaxBatchSize);
+		stream.read(&mMinBatchSize);
+		VEC3 pos;
+		stream.read(&pos);
+		setPosition(pos);
+		updateBaseScale();
+		determineLodLevels();
 
+		stream.readChunkEnd(Terrain::TERRAINGENERALINFO_CHUNK_ID);
 
-	//	// Layers
-	//	if (!readLayerInstanceList(stream, mLayerDecl.samplers.size(), mLayers))
-	//		return false;
-	//	deriveUVMultipliers();
+		size_t numVertices = mSize * mSize;
+		mHeightData = new float[numVertices];
+		mDeltaData = new float[numVertices];
+		// As we may not load full data, so we should make it clean first
+		memset(mHeightData, 0, sizeof(float) * numVertices);
+		memset(mDeltaData, 0, sizeof(float) * numVertices);
 
-	//	// Packed layer blend data
-	//	uint8 numLayers = (uint8)mLayers.size();
-	//	stream.read(&mLayerBlendMapSize);
-	//	mLayerBlendMapSizeActual = mLayerBlendMapSize; // for now, until we check
-	//												   // load packed CPU data
-	//	int numBlendTex = getBlendTextureCount(numLayers);
-	//	for (int i = 0; i < numBlendTex; ++i)
-	//	{
-	//		PixelFormat fmt = getBlendTextureFormat(i, numLayers);
-	//		size_t channels = PixelUtil::getNumElemBytes(fmt);
-	//		size_t dataSz = channels * mLayerBlendMapSize * mLayerBlendMapSize;
-	//		uint8* pData = (uint8*)OGRE_MALLOC(dataSz, MEMCATEGORY_RESOURCE);
-	//		stream.read(pData, dataSz);
-	//		mCpuBlendMapStorage.push_back(pData);
-	//	}
+		// skip height/delta data, load() streams it in
+		TerrainLodManager::skipLodData(stream, mNumLodLevels);
 
-	//	// derived data
-	//	while (!stream.isEndOfChunk(TERRAIN_CHUNK_ID) &&
-	//		stream.peekNextChunkID() == TERRAINDERIVEDDATA_CHUNK_ID)
-	//	{
-	//		stream.readChunkBegin(TERRAINDERIVEDDATA_CHUNK_ID, TERRAINDERIVEDDATA_CHUNK_VERSION);
-	//		// name
-	//		STRING name;
-	//		stream.read(&name);
-	//		uint16 sz;
-	//		stream.read(&sz);
-	//		if (name == "normalmap")
-	//		{
-	//			mNormalMapRequired = true;
-	//			uint8* pData = static_cast<uint8*>(OGRE_MALLOC(sz * sz * 3, MEMCATEGORY_GENERAL));
-	//			mCpuTerrainNormalMap = OGRE_NEW PixelBox(sz, sz, 1, PF_BYTE_RGB, pData);
+		// Layer declaration
+		if (!readLayerDeclaration(stream, mLayerDecl))
+			return false;
+		checkDeclaration();
 
-	//			stream.read(pData, sz * sz * 3);
 
-	//		}
-	//		else if (name == "colourmap")
-	//		{
-	//			mGlobalColourMapEnabled = true;
-	//			mGlobalColourMapSize = sz;
-	//			mCpuColourMapStorage = static_cast<uint8*>(OGRE_MALLOC(sz * sz * 3, MEMCATEGORY_GENERAL));
-	//			stream.read(mCpuColourMapStorage, sz * sz * 3);
-	//		}
-	//		else if (name == "lightmap")
-	//		{
-	//			mLightMapRequired = true;
-	//			mLightmapSize = sz;
-	//			mCpuLightmapStorage = static_cast<uint8*>(OGRE_MALLOC(sz * sz, MEMCATEGORY_GENERAL));
-	//			stream.read(mCpuLightmapStorage, sz * sz);
-	//		}
-	//		else if (name == "compositemap")
-	//		{
-	//			mCompositeMapRequired = true;
-	//			mCompositeMapSize = sz;
-	//			mCpuCompositeMapStorage = static_cast<uint8*>(OGRE_MALLOC(sz * sz * 4, MEMCATEGORY_GENERAL));
-	//			stream.read(mCpuCompositeMapStorage, sz * sz * 4);
-	//		}
-
-	//		stream.readChunkEnd(TERRAINDERIVEDDATA_CHUNK_ID);
+		// Layers
+		if (!readLayerInstanceList(stream, mLayerDecl.samplers.size(), mLayers))
+			return false;
+		deriveUVMultipliers();
 
+		// Packed layer blend data
+		stream.read(&mLayerBlendMapSize);
+		mLayerBlendMapSizeActual = mLayerBlendMapSize; // for now, until we check
+		uint8 numBlendTex;
+		stream.read(&numBlendTex);
+		// load packed CPU data
+		const uint32 blendBytes = mLayerBlendMapSize * mLayerBlendMapSize * 4;
+		for (uint8 i = 0; i < numBlendTex; ++i)
+		{
+			uint8* pData = new uint8[blendBytes];
+			stream.readCompressed(pData, blendBytes);
+			mCpuBlendMapStorage.push_back(pData);
+		}
 
-	//	}
+		// derived data
+		while (!stream.isEndOfChunk(TERRAIN_CHUNK_ID) &&
+			stream.peekNextChunkID() == TERRAINDERIVEDDATA_CHUNK_ID)
+		{
+			stream.readChunkBegin(TERRAINDERIVEDDATA_CHUNK_ID, TERRAINDERIVEDDATA_CHUNK_VERSION);
+			// name
+			STRING name;
+			stream.read(&name);
+			uint16 sz;
+			stream.read(&sz);
+			if (name == "normalmap")
+			{
+				mNormalMapRequired = true;
+				mCpuTerrainNormalMap = new PixelBox(sz, sz, 4);
+				stream.readCompressed(mCpuTerrainNormalMap->GetDataPointer(), sz * sz * 4);
+			}
+			else if (name == "lightmap")
+			{
+				// load() asks for a shadows only lightmap, which is what was saved
+				mLightMapRequired = true;
+				mLightMapShadowsOnly = true;
+				mLightmapSize = mLightmapSizeActual = sz;
+				mCpuLightmapStorage = new uint8[sz * sz];
+				stream.readCompressed(mCpuLightmapStorage, sz * sz);
+			}
 
-	//	if (mainChunk->version == 1)
-	//	{
-	//		// Load delta data
-	//		mDeltaData = OGRE_ALLOC_T(float, numVertices, MEMCATEGORY_GEOMETRY);
-	//		stream.read(mDeltaData, numVertices);
-	//	}
+			stream.readChunkEnd(TERRAINDERIVEDDATA_CHUNK_ID);
+		}
 
-	//	// Create & load quadtree
-	//	mQuadTree = OGRE_NEW TerrainQuadTreeNode(this, 0, 0, 0, mSize, mNumLodLevels - 1, 0, 0);
-	//	mQuadTree->prepare(stream);
+		// Create & load quadtree
+		mQuadTree = new TerrainQuadTreeNode(this, 0, 0, 0, mSize, mNumLodLevels - 1, 0, 0);
+		mQuadTree->prepare(stream);
 
-	//	// stop uncompressing
-	//	if (mainChunk->version > 1)
-	//		stream.stopDeflate();
+		stream.readChunkEnd(TERRAIN_CHUNK_ID);
 
-	//	stream.readChunkEnd(TERRAIN_CHUNK_ID);
+		if (!stream.isValid())
+			return false;
 
-	//	mModified = false;
-	//	mHeightDataModified = false;
+		mModified = false;
+		mHeightDataModified = false;
 
-	//	mPrepareInProgress = false;
+		mPrepareInProgress = false;
 
-	//	return true;
-	//}
+		return true;
+	}
 	//---------------------------------------------------------------------
 	bool Terrain::prepare(const ImportData& importData)
 	{
 		mPrepareInProgress = true;
+		waitForDerivedProcesses();
 		freeTemporaryResources();
 		freeLodData();
 		freeCPUResources();
@@ -813,7 +726,7 @@ namespace Neo
 		Rect rect;
 		rect.top = 0; rect.bottom = mSize;
 		rect.left = 0; rect.right = mSize;
-		calculateHeightDeltas(rect);
+		calculateHeightDeltas(rect, mDeltaData);
 		finaliseHeightDeltas(rect, true);
 
 		distributeVertexData();
@@ -840,6 +753,8 @@ namespace Neo
 		mLightmapSizeActual = mLightmapSize; // for now, until we check
 		mCompositeMapSize = opts.getCompositeMapSize();
 		mCompositeMapSizeActual = mCompositeMapSize; // for now, until we check
+		mUseCompactVertices = opts._getUseCompactVertices();
+		mEditable = opts.getEditable();
 
 	}
 	//---------------------------------------------------------------------
@@ -950,10 +865,29 @@ namespace Neo
 
 		*/
 
-		uint16 depth = mTreeDepth;
+		VertexDataLayoutList layout;
+		getVertexDataLayout(mSize, mMaxBatchSize, mMinBatchSize, layout);
+
+		for (size_t i = 0; i < layout.size(); ++i)
+		{
+			const VertexDataLayout& vd = layout[i];
+			mQuadTree->assignVertexData(vd.treeDepthStart, vd.treeDepthEnd, vd.resolution, vd.size);
+		}
+	}
+	//---------------------------------------------------------------------
+	void Terrain::getVertexDataLayout(uint16 size, uint16 maxBatchSize, uint16 minBatchSize, VertexDataLayoutList& layout)
+	{
+		layout.clear();
+
+		// as determineLodLevels()
+		const uint16 numLodLevelsPerLeafNode = (uint16)(log2f(maxBatchSize - 1.0f) - log2f(minBatchSize - 1.0f) + 1.0f);
+		const uint16 numLodLevels = (uint16)(log2f(size - 1.0f) - log2f(minBatchSize - 1.0f) + 1.0f);
+		const uint16 treeDepth = numLodLevels - numLodLevelsPerLeafNode + 1;
+
+		uint16 depth = treeDepth;
 		uint16 prevdepth = depth;
-		uint16 currresolution = mSize;
-		uint16 bakedresolution = mSize;
+		uint16 currresolution = size;
+		uint16 bakedresolution = size;
 		uint16 targetSplits = (bakedresolution - 1) / (TERRAIN_MAX_BATCH_SIZE - 1);
 		while (depth-- && targetSplits)
 		{
@@ -963,8 +897,12 @@ namespace Neo
 				// vertex data goes at this level, at bakedresolution
 				// applies to all lower levels (except those with a closer vertex data)
 				// determine physical size (as opposed to resolution)
-				uint32 sz = ((bakedresolution - 1) / splits) + 1;
-				mQuadTree->assignVertexData(depth, prevdepth, bakedresolution, sz);
+				VertexDataLayout vd;
+				vd.treeDepthStart = depth;
+				vd.treeDepthEnd = prevdepth;
+				vd.resolution = bakedresolution;
+				vd.size = ((bakedresolution - 1) / splits) + 1;
+				layout.push_back(vd);
 
 				// next set to look for
 				bakedresolution = ((currresolution - 1) >> 1) + 1;
@@ -981,34 +919,33 @@ namespace Neo
 		// Always assign vertex data to the top of the tree
 		if (prevdepth > 0)
 		{
-			mQuadTree->assignVertexData(0, 1, bakedresolution, bakedresolution);
+			VertexDataLayout vd;
+			vd.treeDepthStart = 0;
+			vd.treeDepthEnd = 1;
+			vd.resolution = bakedresolution;
+			vd.size = bakedresolution;
+			layout.push_back(vd);
 		}
 	}
 	//---------------------------------------------------------------------
-	//void Terrain::load(const STRING& filename)
-	//{
-	//	if (prepare(filename))
-	//		load();
-	//	else
-	//		OGRE_EXCEPT(Exception::ERR_INTERNAL_ERROR,
-	//			"Error while preparing " + filename + ", see log for details",
-	//			__FUNCTION__);
-	//}
-	//---------------------------------------------------------------------
-	//void Terrain::load(StreamSerialiser& stream)
-	//{
-	//	if (prepare(stream))
-	//		load();
-	//	else
-	//		OGRE_EXCEPT(Exception::ERR_INTERNAL_ERROR,
-	//			"Error while preparing from stream, see log for details",
-	//			__FUNCTION__);
-	//}
+	void Terrain::load(const STRING& filename)
+	{
+		if (prepare(filename))
+			load();
+		else
+			_AST(0 && "Error while preparing the terrain file, Terrain::load");
+	}
 	//---------------------------------------------------------------------
 	void Terrain::load(int lodLevel, bool synchronous)
 	{
 		if (mQuadTree)
+		{
+			// Something to show at once, the finer LODs are streamed in behind it
+			if (!synchronous && mLodManager->hasLodFile() && getHighestLodLoaded() == -1)
+				mLodManager->updateToLodLevel(-1, true);
+
 			mLodManager->updateToLodLevel(lodLevel, synchronous);
+		}
 
 		if (mIsLoaded || mGenerateMaterialInProgress)
 			return;
@@ -1021,9 +958,12 @@ namespace Neo
 
 		_setMorphRequired(false);
 		_setNormalMapRequired(true);
-		_setLightMapRequired(false, false);
+		_setLightMapRequired(g_env.pSceneMgr->GetTerrainOptions()->getUseLightMap(), true);
 		_setCompositeMapRequired(false);
 
+		mIsLoaded = true;
+		mLodInvalid = true;
+
 		//mGenerateMaterialInProgress = true;
 		//GenerateMaterialRequest req;
 		//req.terrain = this;
@@ -1044,6 +984,11 @@ namespace Neo
 		if (mQuadTree)
 			mQuadTree->unload();
 
+		mDrawList.clear();
+		mLodInvalid = true;
+		// holds the textures of this load
+		SAFE_RELEASE(mMaterial);
+
 		// free own buffers if used, but not custom
 		mDefaultGpuBufferAllocator.freeAllBuffers();
 
@@ -1779,6 +1724,8 @@ namespace Neo
 		{
 			mQuadTree->updateVertexData(true, false, mDirtyGeometryRect, false);
 			mDirtyGeometryRect.SetNull();
+			// node bounds changed
+			mLodInvalid = true;
 		}
 
 		// propagate changes
@@ -1791,11 +1738,17 @@ namespace Neo
 		{
 			mQuadTree->updateVertexData(true, false, mDirtyGeometryRect, false);
 			mDirtyGeometryRect.SetNull();
+			mLodInvalid = true;
 		}
 	}
 	//---------------------------------------------------------------------
 	void Terrain::updateDerivedData(bool synchronous, uint8 typeMask)
 	{
+		// collect a finished background update first, it may be all we're waiting for
+		processDerivedDataResponse();
+		if (synchronous)
+			waitForDerivedProcesses();
+
 		if (!mDirtyDerivedDataRect.IsNull() || !mDirtyLightmapFromNeighboursRect.IsNull())
 		{
 			mModified = true;
@@ -1828,7 +1781,7 @@ namespace Neo
 		mDerivedDataUpdateInProgress = true;
 		mDerivedUpdatePendingMask = 0;
 
-		DerivedDataRequest req;
+		DerivedDataRequest& req = mDerivedDataRequest;
 		req.terrain = this;
 		req.dirtyRect = rect;
 		req.lightmapExtraDirtyRect = lightmapExtraRect;
@@ -1838,36 +1791,67 @@ namespace Neo
 		if (!mLightMapRequired)
 			req.typeMask = req.typeMask & ~DERIVED_DATA_LIGHTMAP;
 
-		//Root::getSingleton().getWorkQueue()->addRequest(
-		//	mWorkQueueChannel, WORKQUEUE_DERIVED_DATA_REQUEST,
-		//	Any(req), 0, synchronous);
+		// The job never writes mDeltaData, which is read for the vertex data meanwhile
+		if (req.typeMask & DERIVED_DATA_DELTAS)
+			mDerivedDataResponse.deltaData.assign(mDeltaData, mDeltaData + mSize * mSize);
+
+		// Only one background task per Terrain instance is in flight at once,
+		// further requests are merged into mDerivedUpdatePendingMask meanwhile.
+		// A whole pass takes several frames, so it stays out of the frame's job waits
+		JobSystem::GetSingleton().RunBackground([this]() { handleDerivedDataRequest(); }, &mDerivedDataJobs);
 
-		DerivedDataResponse ddres;
+		if (synchronous)
+			waitForDerivedProcesses();
+	}
+	//---------------------------------------------------------------------
+	void Terrain::handleDerivedDataRequest()
+	{
+		const DerivedDataRequest& req = mDerivedDataRequest;
+		DerivedDataResponse& ddres = mDerivedDataResponse;
+		ddres.terrain = this;
 		ddres.remainingTypeMask = req.typeMask & DERIVED_DATA_ALL;
+		ddres.normalMapBox = 0;
+		ddres.lightMapBox = 0;
 
-		// Do only ONE type of task per background iteration, in order of priority
-		// this means we return faster, can abort faster and we repeat less redundant calcs
-		// we don't do this as separate requests, because we only want one background
-		// task per Terrain instance in flight at once
+		// Every requested type is done in this one pass, each of them splits
+		// its work over the job system itself
 		if (req.typeMask & DERIVED_DATA_DELTAS)
 		{
-			ddres.deltaUpdateRect = calculateHeightDeltas(req.dirtyRect);
+			ddres.deltaUpdateRect = calculateHeightDeltas(req.dirtyRect, &ddres.deltaData[0]);
 			ddres.remainingTypeMask &= ~DERIVED_DATA_DELTAS;
 		}
-		else if (req.typeMask & DERIVED_DATA_NORMALS)
+		if (req.typeMask & DERIVED_DATA_NORMALS)
 		{
 			ddres.normalMapBox = calculateNormals(req.dirtyRect, ddres.normalUpdateRect);
 			ddres.remainingTypeMask &= ~DERIVED_DATA_NORMALS;
 		}
-		else if (req.typeMask & DERIVED_DATA_LIGHTMAP)
+		if (req.typeMask & DERIVED_DATA_LIGHTMAP)
 		{
 			ddres.lightMapBox = calculateLightmap(req.dirtyRect, req.lightmapExtraDirtyRect, ddres.lightmapUpdateRect);
 			ddres.remainingTypeMask &= ~DERIVED_DATA_LIGHTMAP;
 		}
+	}
+	//---------------------------------------------------------------------
+	void Terrain::handleDerivedDataResponse()
+	{
+		std::vector<float> deltaData;
+		deltaData.swap(mDerivedDataResponse.deltaData);
+		// copies, the next update issued below reuses them
+		const DerivedDataRequest req = mDerivedDataRequest;
+		const DerivedDataResponse ddres = mDerivedDataResponse;
 
 		if ((req.typeMask & DERIVED_DATA_DELTAS) &&
 			!(ddres.remainingTypeMask & DERIVED_DATA_DELTAS))
-			finaliseHeightDeltas(ddres.deltaUpdateRect, false);
+		{
+			// take over the deltas the job calculated
+			const Rect& rect = ddres.deltaUpdateRect;
+			for (long y = rect.top; y < rect.bottom; ++y)
+			{
+				memcpy(mDeltaData + y * mSize + rect.left, &deltaData[y * mSize + rect.left],
+					sizeof(float) * rect.GetWidth());
+			}
+			finaliseHeightDeltas(rect, false);
+		}
 		if ((req.typeMask & DERIVED_DATA_NORMALS) &&
 			!(ddres.remainingTypeMask & DERIVED_DATA_NORMALS))
 		{
@@ -1917,14 +1901,20 @@ namespace Neo
 		}
 	}
 	//---------------------------------------------------------------------
+	void Terrain::processDerivedDataResponse()
+	{
+		if (mDerivedDataUpdateInProgress && mDerivedDataJobs.nPending == 0)
+			handleDerivedDataResponse();
+	}
+	//---------------------------------------------------------------------
 	void Terrain::waitForDerivedProcesses()
 	{
-		//while (mDerivedDataUpdateInProgress || mGenerateMaterialInProgress || mPrepareInProgress)
-		//{
-		//	// we need to wait for this to finish
-		//	OGRE_THREAD_SLEEP(50);
-		//	Root::getSingleton().getWorkQueue()->processResponses();
-		//}
+		// finalising may issue the next update, so keep going until there's none
+		while (mDerivedDataUpdateInProgress)
+		{
+			JobSystem::GetSingleton().Wait(&mDerivedDataJobs);
+			handleDerivedDataResponse();
+		}
 	}
 	//---------------------------------------------------------------------
 	void Terrain::freeCPUResources()
@@ -1937,6 +1927,8 @@ namespace Neo
 
 		delete mQuadTree;
 		mQuadTree = 0;
+		mDrawList.clear();
+		mLodInvalid = true;
 
 		SAFE_DELETE(mCpuTerrainNormalMap);
 		SAFE_DELETE_ARRAY(mCpuColourMapStorage);
@@ -1956,6 +1948,7 @@ namespace Neo
 		SAFE_RELEASE(mLightmap);
 		SAFE_RELEASE(mCompositeMap);
 		SAFE_RELEASE(mTerrainNormalMap);
+		SAFE_RELEASE(mMaterial);
 	}
 	//---------------------------------------------------------------------
 	void Terrain::freeLodData()
@@ -1967,7 +1960,7 @@ namespace Neo
 		}
 	}
 	//---------------------------------------------------------------------
-	Rect Terrain::calculateHeightDeltas(const Rect& rect)
+	Rect Terrain::calculateHeightDeltas(const Rect& rect, float* deltaData)
 	{
 		Rect clampedRect(rect);
 		clampedRect.left = std::max(0, clampedRect.left);
@@ -1979,6 +1972,11 @@ namespace Neo
 
 		mQuadTree->preDeltaCalculation(clampedRect);
 
+		// Deltas of the current level, the quadtree is told about them afterwards node
+		// by node, since notifyDelta() from many threads would race on the same nodes
+		std::vector<float> deltaField;
+		std::vector<TerrainQuadTreeNode*> lodNodes;
+
 		/// Iterate over target levels, 
 		for (int targetLevel = 1; targetLevel < mNumLodLevels; ++targetLevel)
 		{
@@ -2009,113 +2007,135 @@ namespace Neo
 			if (lodRect.bottom % step)
 				lodRect.bottom += step - (lodRect.bottom % step);
 
-			for (long j = lodRect.top; j < lodRect.bottom - step; j += step)
+			const int numRows = lodRect.GetHeight() / step - 1;
+			if (numRows <= 0)
+				continue;
+
+			// Points not visited keep the lowest value so they never raise a node's max
+			const Rect fieldRect(lodRect.left, lodRect.top, std::min(lodRect.right, (int)mSize), std::min(lodRect.bottom, (int)mSize));
+			const int fieldWidth = fieldRect.GetWidth();
+			deltaField.assign(fieldWidth * fieldRect.GetHeight(), -FLT_MAX);
+			float* pField = &deltaField[0];
+
+			// Each row of quads writes its own rows of vertices, both in the field and deltaData
+			JobSystem::GetSingleton().ParallelFor(numRows, HEIGHT_DELTA_ROW_GRAIN, [&](uint32 nBegin, uint32 nEnd)
 			{
-				for (long i = lodRect.left; i < lodRect.right - step; i += step)
+				for (long j = lodRect.top + (long)nBegin * step; j < lodRect.top + (long)nEnd * step; j += step)
 				{
-					// Form planes relating to the lower detail tris to be produced
-					// For even tri strip rows, they are this shape:
-					// 2---3
-					// | / |
-					// 0---1
-					// For odd tri strip rows, they are this shape:
-					// 2---3
-					// | \ |
-					// 0---1
-
-					VEC3 v0, v1, v2, v3;
-					getPointAlign(i, j, ALIGN_X_Y, &v0);
-					getPointAlign(i + step, j, ALIGN_X_Y, &v1);
-					getPointAlign(i, j + step, ALIGN_X_Y, &v2);
-					getPointAlign(i + step, j + step, ALIGN_X_Y, &v3);
-
-					PLANE t1, t2;
-					bool backwardTri = false;
-					// Odd or even in terms of target level
-					if ((j / step) % 2 == 0)
-					{
-						t1.Redefine(v0, v1, v3);
-						t2.Redefine(v0, v3, v2);
-					}
-					else
+					for (long i = lodRect.left; i < lodRect.right - step; i += step)
 					{
-						t1.Redefine(v1, v3, v2);
-						t2.Redefine(v0, v1, v2);
-						backwardTri = true;
-					}
-
-					// include the bottommost row of vertices if this is the last row
-					int yubound = (j == (mSize - step) ? step : step - 1);
-					for (int y = 0; y <= yubound; y++)
-					{
-						// include the rightmost col of vertices if this is the last col
-						int xubound = (i == (mSize - step) ? step : step - 1);
-						for (int x = 0; x <= xubound; x++)
+						// Form planes relating to the lower detail tris to be produced
+						// For even tri strip rows, they are this shape:
+						// 2---3
+						// | / |
+						// 0---1
+						// For odd tri strip rows, they are this shape:
+						// 2---3
+						// | \ |
+						// 0---1
+
+						VEC3 v0, v1, v2, v3;
+						getPointAlign(i, j, ALIGN_X_Y, &v0);
+						getPointAlign(i + step, j, ALIGN_X_Y, &v1);
+						getPointAlign(i, j + step, ALIGN_X_Y, &v2);
+						getPointAlign(i + step, j + step, ALIGN_X_Y, &v3);
+
+						PLANE t1, t2;
+						bool backwardTri = false;
+						// Odd or even in terms of target level
+						if ((j / step) % 2 == 0)
 						{
-							int fulldetailx = static_cast<int>(i + x);
-							int fulldetaily = static_cast<int>(j + y);
-							if (fulldetailx % step == 0 &&
-								fulldetaily % step == 0)
-							{
-								// Skip, this one is a vertex at this level
-								continue;
-							}
-
-							float ypct = (float)y / (float)step;
-							float xpct = (float)x / (float)step;
+							t1.Redefine(v0, v1, v3);
+							t2.Redefine(v0, v3, v2);
+						}
+						else
+						{
+							t1.Redefine(v1, v3, v2);
+							t2.Redefine(v0, v1, v2);
+							backwardTri = true;
+						}
 
-							//interpolated height
-							VEC3 actualPos;
-							getPointAlign(fulldetailx, fulldetaily, ALIGN_X_Y, &actualPos);
-							float interp_h;
-							// Determine which tri we're on 
-							if ((xpct > ypct && !backwardTri) ||
-								(xpct > (1 - ypct) && backwardTri))
-							{
-								// Solve for x/z
-								interp_h =
-									(-t1.n.x * actualPos.x
-										- t1.n.y * actualPos.y
-										- t1.d) / t1.n.z;
-							}
-							else
+						// include the bottommost row of vertices if this is the last row
+						int yubound = (j == (mSize - step) ? step : step - 1);
+						for (int y = 0; y <= yubound; y++)
+						{
+							// include the rightmost col of vertices if this is the last col
+							int xubound = (i == (mSize - step) ? step : step - 1);
+							for (int x = 0; x <= xubound; x++)
 							{
-								// Second tri
-								interp_h =
-									(-t2.n.x * actualPos.x
-										- t2.n.y * actualPos.y
-										- t2.d) / t2.n.z;
-							}
+								int fulldetailx = static_cast<int>(i + x);
+								int fulldetaily = static_cast<int>(j + y);
+								if (fulldetailx % step == 0 &&
+									fulldetaily % step == 0)
+								{
+									// Skip, this one is a vertex at this level
+									continue;
+								}
+
+								float ypct = (float)y / (float)step;
+								float xpct = (float)x / (float)step;
+
+								//interpolated height
+								VEC3 actualPos;
+								getPointAlign(fulldetailx, fulldetaily, ALIGN_X_Y, &actualPos);
+								float interp_h;
+								// Determine which tri we're on 
+								if ((xpct > ypct && !backwardTri) ||
+									(xpct > (1 - ypct) && backwardTri))
+								{
+									// Solve for x/z
+									interp_h =
+										(-t1.n.x * actualPos.x
+											- t1.n.y * actualPos.y
+											- t1.d) / t1.n.z;
+								}
+								else
+								{
+									// Second tri
+									interp_h =
+										(-t2.n.x * actualPos.x
+											- t2.n.y * actualPos.y
+											- t2.d) / t2.n.z;
+								}
+
+								float actual_h = actualPos.z;
+								float delta = interp_h - actual_h;
+
+								// max(delta) is the worst case scenario at this LOD
+								// compared to the original heightmap
+
+								// tell the quadtree about this, see notifyDeltas below
+								pField[(fulldetaily - fieldRect.top) * fieldWidth + fulldetailx - fieldRect.left] = delta;
+
+
+								// If this vertex is being removed at this LOD, 
+								// then save the height difference since that's the move
+								// it will need to make. Vertices to be removed at this LOD
+								// are halfway between the steps, but exclude those that
+								// would have been eliminated at earlier levels
+								int halfStep = step / 2;
+								if (
+									((fulldetailx % step) == halfStep && (fulldetaily % halfStep) == 0) ||
+									((fulldetaily % step) == halfStep && (fulldetailx % halfStep) == 0))
+								{
+									// Save height difference 
+									deltaData[fulldetailx + (fulldetaily * mSize)] = delta;
+								}
 
-							float actual_h = actualPos.z;
-							float delta = interp_h - actual_h;
-
-							// max(delta) is the worst case scenario at this LOD
-							// compared to the original heightmap
-
-							// tell the quadtree about this 
-							mQuadTree->notifyDelta(fulldetailx, fulldetaily, sourceLevel, delta);
-
-
-							// If this vertex is being removed at this LOD, 
-							// then save the height difference since that's the move
-							// it will need to make. Vertices to be removed at this LOD
-							// are halfway between the steps, but exclude those that
-							// would have been eliminated at earlier levels
-							int halfStep = step / 2;
-							if (
-								((fulldetailx % step) == halfStep && (fulldetaily % halfStep) == 0) ||
-								((fulldetaily % step) == halfStep && (fulldetailx % halfStep) == 0))
-							{
-								// Save height difference 
-								mDeltaData[fulldetailx + (fulldetaily * mSize)] = delta;
 							}
 
 						}
+					} // i
+				} // j
+			});
 
-					}
-				} // i
-			} // j
+			lodNodes.clear();
+			mQuadTree->getNodesForLod(sourceLevel, fieldRect, lodNodes);
+			JobSystem::GetSingleton().ParallelFor(lodNodes.size(), 1, [&](uint32 nBegin, uint32 nEnd)
+			{
+				for (uint32 n = nBegin; n < nEnd; ++n)
+					lodNodes[n]->notifyDeltas(sourceLevel, fieldRect, pField);
+			});
 
 		} // targetLevel
 
@@ -2137,6 +2157,8 @@ namespace Neo
 		mQuadTree->finaliseDeltaValues(clampedRect);
 		// delta vertex data
 		mQuadTree->updateVertexData(false, true, clampedRect, cpuData);
+		// transition distances changed
+		mLodInvalid = true;
 	}
 
 	//---------------------------------------------------------------------
@@ -2169,206 +2191,261 @@ namespace Neo
 			// CFactor = A / T
 			float cFactor = A / T;
 
-			mQuadTree->calculateCurrentLod(cFactor);
+			// The LODs kept by the nodes are only valid for the same error terms and loaded LOD levels
+			const int highestLodLoaded = getHighestLodLoaded();
+			const bool force = mLodInvalid || !Common::Equal(cFactor, mLodCFactor) || highestLodLoaded != mLodHighestLoaded;
+			mLodInvalid = false;
+			mLodCFactor = cFactor;
+			mLodHighestLoaded = highestLodLoaded;
+
+			Camera* cam = g_env.pSceneMgr->GetCamera();
+			mLodStats = LodStats();
+			mQuadTree->calculateCurrentLod(cFactor, cam->GetPos() - getPosition(), force, mLodStats);
+
+			// Same LODs seen from the same view, last frame's draw list still holds
+			if (force || mLodStats.numLodChanges || mDrawList.empty() ||
+				memcmp(&mDrawListView, &cam->GetViewMatrix(), sizeof(MAT44)) ||
+				memcmp(&mDrawListProj, &cam->GetProjMatrix(), sizeof(MAT44)))
+			{
+				mDrawList.clear();
+				mQuadTree->buildDrawList(*cam, getPosition(), mDrawList, mLodStats);
+				mDrawListView = cam->GetViewMatrix();
+				mDrawListProj = cam->GetProjMatrix();
+				++mLodStats.numDrawListRebuilds;
+			}
+			mLodStats.numDrawRecords = (uint32)mDrawList.size();
 		}
 	}
 	//---------------------------------------------------------------------
-	//std::pair<bool, VEC3> Terrain::rayIntersects(const Ray& ray,
-	//	bool cascadeToNeighbours /* = false */, float distanceLimit /* = 0 */)
-	//{
-	//	typedef std::pair<bool, VEC3> Result;
-	//	// first step: convert the ray to a local vertex space
-	//	// we assume terrain to be in the x-z plane, with the [0,0] vertex
-	//	// at origin and a plane distance of 1 between vertices.
-	//	// This makes calculations easier.
-	//	VEC3 rayOrigin = ray.getOrigin() - getPosition();
-	//	VEC3 rayDirection = ray.getDirection();
-	//	// change alignment
-	//	VEC3 tmp;
-	//	switch (getAlignment())
-	//	{
-	//	case ALIGN_X_Y:
-	//		std::swap(rayOrigin.y, rayOrigin.z);
-	//		std::swap(rayDirection.y, rayDirection.z);
-	//		break;
-	//	case ALIGN_Y_Z:
-	//		// x = z, z = y, y = -x
-	//		tmp.x = rayOrigin.z;
-	//		tmp.z = rayOrigin.y;
-	//		tmp.y = -rayOrigin.x;
-	//		rayOrigin = tmp;
-	//		tmp.x = rayDirection.z;
-	//		tmp.z = rayDirection.y;
-	//		tmp.y = -rayDirection.x;
-	//		rayDirection = tmp;
-	//		break;
-	//	case ALIGN_X_Z:
-	//		// already in X/Z but values increase in -Z
-	//		rayOrigin.z = -rayOrigin.z;
-	//		rayDirection.z = -rayDirection.z;
-	//		break;
-	//	}
-	//	// readjust coordinate origin
-	//	rayOrigin.x += mWorldSize / 2;
-	//	rayOrigin.z += mWorldSize / 2;
-	//	// scale down to vertex level
-	//	rayOrigin.x /= mScale;
-	//	rayOrigin.z /= mScale;
-	//	rayDirection.x /= mScale;
-	//	rayDirection.z /= mScale;
-	//	rayDirection.normalise();
-	//	Ray localRay(rayOrigin, rayDirection);
-
-	//	// test if the ray actually hits the terrain's bounds
-	//	float maxHeight = getMaxHeight();
-	//	float minHeight = getMinHeight();
-
-	//	AxisAlignedBox aabb(VEC3(0, minHeight, 0), VEC3(mSize, maxHeight, mSize));
-	//	std::pair<bool, float> aabbTest = localRay.intersects(aabb);
-	//	if (!aabbTest.first)
-	//	{
-	//		if (cascadeToNeighbours)
-	//		{
-	//			OGRE_LOCK_RW_MUTEX_READ(mNeighbourMutex);
-	//			Terrain* neighbour = raySelectNeighbour(ray, distanceLimit);
-	//			if (neighbour)
-	//				return neighbour->rayIntersects(ray, cascadeToNeighbours, distanceLimit);
-	//		}
-	//		return Result(false, VEC3());
-	//	}
-	//	// get intersection point and move inside
-	//	VEC3 cur = localRay.getPoint(aabbTest.second);
+	namespace
+	{
+		// Node bounds in grid space, padded so rays grazing a flat node still reach its quads
+		bool _RayNodeBounds(const TerrainQuadTreeNode* pNode, const RAY& ray, float& tNear, float& tFar)
+		{
+			const float fLast = (float)(pNode->getSize() - 1);
 
-	//	// now check every quad the ray touches
-	//	int quadX = std::min(std::max(static_cast<int>(cur.x), 0), (int)mSize - 2);
-	//	int quadZ = std::min(std::max(static_cast<int>(cur.z), 0), (int)mSize - 2);
-	//	int flipX = (rayDirection.x < 0 ? 0 : 1);
-	//	int flipZ = (rayDirection.z < 0 ? 0 : 1);
-	//	int xDir = (rayDirection.x < 0 ? -1 : 1);
-	//	int zDir = (rayDirection.z < 0 ? -1 : 1);
+			AABB bounds;
+			bounds.m_minCorner = VEC3(pNode->getXOffset(), pNode->getYOffset(), pNode->getMinHeight() - 1e-3f);
+			bounds.m_maxCorner = VEC3(pNode->getXOffset() + fLast, pNode->getYOffset() + fLast, pNode->getMaxHeight() + 1e-3f);
 
-	//	Result result(true, VEC3::ZERO);
-	//	float dummyHighValue = (float)mSize * 10000.0f;
+			return ray.Intersects(bounds, tNear, tFar);
+		}
+		//---------------------------------------------------------------------
+		/* Intersect the two triangles of quad (x, y), split as in getHeightAtTerrainPosition:
+			even     odd
+			3---2   3---2
+			| / |   | \ |
+			0---1   0---1
+		*/
+		bool _RayQuad(const float* pHeights, uint16 size, long x, long y, const RAY& ray, float tEnter, float tExit, float tMax, float& tHit)
+		{
+			const float* pQuad = pHeights + y * size + x;
+			const float h0 = pQuad[0], h1 = pQuad[1], h2 = pQuad[size + 1], h3 = pQuad[size];
+
+			// Most quads are rejected on the height range of the ray inside them
+			const float hEnter = ray.m_origin.z + ray.m_dir.z * tEnter;
+			const float hExit = ray.m_origin.z + ray.m_dir.z * tExit;
+			if (Min(hEnter, hExit) > Max(Max(h0, h1), Max(h2, h3)) ||
+				Max(hEnter, hExit) < Min(Min(h0, h1), Min(h2, h3)))
+				return false;
+
+			// Quad local coords, u and v in [0, 1]. Each triangle is the plane h = a + b * u + c * v
+			const float ou = ray.m_origin.x - x;
+			const float ov = ray.m_origin.y - y;
+			const bool bOdd = (y % 2) != 0;
+
+			float a[2], b[2], c[2];
+			if (bOdd)
+			{
+				// 0-1-3 below the diagonal, 1-2-3 above
+				a[0] = h0;				b[0] = h1 - h0;		c[0] = h3 - h0;
+				a[1] = h1 + h3 - h2;	b[1] = h2 - h3;		c[1] = h2 - h1;
+			}
+			else
+			{
+				// 0-1-2 right of the diagonal, 0-2-3 left
+				a[0] = h0;				b[0] = h1 - h0;		c[0] = h2 - h1;
+				a[1] = h0;				b[1] = h2 - h3;		c[1] = h3 - h0;
+			}
 
+			bool bHit = false;
+			for (int i = 0; i < 2; ++i)
+			{
+				const float g0 = ray.m_origin.z - (a[i] + b[i] * ou + c[i] * ov);
+				const float g1 = ray.m_dir.z - (b[i] * ray.m_dir.x + c[i] * ray.m_dir.y);
+				if (g1 == 0)
+					continue;
+
+				const float t = -g0 / g1;
+				if (t < 0 || t > tMax || (bHit && t >= tHit))
+					continue;
+
+				const float u = ou + ray.m_dir.x * t;
+				const float v = ov + ray.m_dir.y * t;
+				if (u < -1e-4f || u > 1 + 1e-4f || v < -1e-4f || v > 1 + 1e-4f)
+					continue;
+
+				const bool bFirst = bOdd ? (u + v <= 1) : (u >= v);
+				if (bFirst != (i == 0))
+					continue;
+
+				tHit = t;
+				bHit = true;
+			}
 
-	//	while (cur.y >= (minHeight - 1e-3) && cur.y <= (maxHeight + 1e-3))
-	//	{
-	//		if (quadX < 0 || quadX >= (int)mSize - 1 || quadZ < 0 || quadZ >= (int)mSize - 1)
-	//			break;
-
-	//		result = checkQuadIntersection(quadX, quadZ, localRay);
-	//		if (result.first)
-	//			break;
-
-	//		// determine next quad to test
-	//		float xDist = Math::RealEqual(rayDirection.x, 0.0) ? dummyHighValue :
-	//			(quadX - cur.x + flipX) / rayDirection.x;
-	//		float zDist = Math::RealEqual(rayDirection.z, 0.0) ? dummyHighValue :
-	//			(quadZ - cur.z + flipZ) / rayDirection.z;
-	//		if (xDist < zDist)
-	//		{
-	//			quadX += xDir;
-	//			cur += rayDirection * xDist;
-	//		}
-	//		else
-	//		{
-	//			quadZ += zDir;
-	//			cur += rayDirection * zDist;
-	//		}
+			return bHit;
+		}
+		//---------------------------------------------------------------------
+		// Walk the quads of a leaf along the ray in order, so the first hit is the nearest
+		bool _RayLeaf(const float* pHeights, uint16 size, const TerrainQuadTreeNode* pNode, const RAY& ray, float tNear, float tFar, float& tHit)
+		{
+			const long x0 = pNode->getXOffset();
+			const long y0 = pNode->getYOffset();
+			const long x1 = x0 + pNode->getSize() - 2;
+			const long y1 = y0 + pNode->getSize() - 2;
+
+			const VEC3 start = ray.GetPoint(tNear);
+			long x = Clamp((long)floorf(start.x), x0, x1);
+			long y = Clamp((long)floorf(start.y), y0, y1);
+
+			const long stepX = ray.m_dir.x > 0 ? 1 : -1;
+			const long stepY = ray.m_dir.y > 0 ? 1 : -1;
+			const float tDeltaX = ray.m_dir.x != 0 ? fabsf(1.0f / ray.m_dir.x) : FLT_MAX;
+			const float tDeltaY = ray.m_dir.y != 0 ? fabsf(1.0f / ray.m_dir.y) : FLT_MAX;
+			float tNextX = ray.m_dir.x != 0 ? (x + (stepX > 0 ? 1 : 0) - ray.m_origin.x) / ray.m_dir.x : FLT_MAX;
+			float tNextY = ray.m_dir.y != 0 ? (y + (stepY > 0 ? 1 : 0) - ray.m_origin.y) / ray.m_dir.y : FLT_MAX;
+
+			float tEnter = tNear;
+			for (;;)
+			{
+				const float tExit = Min(Min(tNextX, tNextY), tFar);
 
-	//	}
+				if (_RayQuad(pHeights, size, x, y, ray, tEnter, tExit, tFar, tHit))
+					return true;
 
-	//	if (result.first)
-	//	{
-	//		// transform the point of intersection back to world space
-	//		result.second.x *= mScale;
-	//		result.second.z *= mScale;
-	//		result.second.x -= mWorldSize / 2;
-	//		result.second.z -= mWorldSize / 2;
-	//		switch (getAlignment())
-	//		{
-	//		case ALIGN_X_Y:
-	//			std::swap(result.second.y, result.second.z);
-	//			break;
-	//		case ALIGN_Y_Z:
-	//			// z = x, y = z, x = -y
-	//			tmp.x = -rayOrigin.y;
-	//			tmp.y = rayOrigin.z;
-	//			tmp.z = rayOrigin.x;
-	//			rayOrigin = tmp;
-	//			break;
-	//		case ALIGN_X_Z:
-	//			result.second.z = -result.second.z;
-	//			break;
-	//		}
-	//		result.second += getPosition();
-	//	}
-	//	else if (cascadeToNeighbours)
-	//	{
-	//		Terrain* neighbour = raySelectNeighbour(ray, distanceLimit);
-	//		if (neighbour)
-	//			result = neighbour->rayIntersects(ray, cascadeToNeighbours, distanceLimit);
-	//	}
-	//	return result;
-	//}
+				if (tExit >= tFar)
+					return false;
+
+				tEnter = tExit;
+				if (tNextX < tNextY)
+				{
+					x += stepX;
+					tNextX += tDeltaX;
+				}
+				else
+				{
+					y += stepY;
+					tNextY += tDeltaY;
+				}
+
+				if (x < x0 || x > x1 || y < y0 || y > y1)
+					return false;
+			}
+		}
+		//---------------------------------------------------------------------
+		// [tNear, tFar] is the part of the ray in the node, tBest shrinks as hits are found
+		bool _RayNode(const float* pHeights, uint16 size, const TerrainQuadTreeNode* pNode, const RAY& ray, float tNear, float tFar, float& tBest)
+		{
+			if (pNode->isLeaf())
+			{
+				float tHit;
+				if (!_RayLeaf(pHeights, size, pNode, ray, tNear, Min(tFar, tBest), tHit))
+					return false;
+
+				tBest = tHit;
+				return true;
+			}
+
+			// Children nearest first, the ones starting behind a hit are skipped
+			const TerrainQuadTreeNode* children[4];
+			float childNear[4], childFar[4];
+			int nChildren = 0;
+
+			for (unsigned short i = 0; i < 4; ++i)
+			{
+				const TerrainQuadTreeNode* pChild = pNode->getChild(i);
+				float t0, t1;
+
+				if (!_RayNodeBounds(pChild, ray, t0, t1) || t0 > tBest)
+					continue;
+
+				int j = nChildren++;
+				for (; j > 0 && childNear[j - 1] > t0; --j)
+				{
+					children[j] = children[j - 1];
+					childNear[j] = childNear[j - 1];
+					childFar[j] = childFar[j - 1];
+				}
+				children[j] = pChild;
+				childNear[j] = t0;
+				childFar[j] = t1;
+			}
+
+			bool bHit = false;
+			for (int i = 0; i < nChildren && childNear[i] <= tBest; ++i)
+			{
+				bHit |= _RayNode(pHeights, size, children[i], ray, childNear[i], childFar[i], tBest);
+			}
+
+			return bHit;
+		}
+	}
+	//---------------------------------------------------------------------
+	std::pair<bool, VEC3> Terrain::rayIntersects(const RAY& ray,
+		bool cascadeToNeighbours /* = false */, float distanceLimit /* = 0 */) const
+	{
+		// Grid rays share the parameter of the world ray, so the limit is one value for all terrains
+		float tMax = FLT_MAX;
+		const float fDirLength = ray.m_dir.GetLength();
+		if (distanceLimit > 0 && fDirLength > 0)
+			tMax = distanceLimit / fDirLength;
+
+		const Terrain* pTerrain = this;
+		while (pTerrain)
+		{
+			RAY gridRay;
+			float t;
+
+			pTerrain->getGridRay(ray, &gridRay);
+			if (pTerrain->rayIntersectsGrid(gridRay, tMax, &t))
+				return std::pair<bool, VEC3>(true, ray.GetPoint(t));
+
+			if (!cascadeToNeighbours)
+				break;
+
+			// Always further along the ray, so this ends
+			pTerrain = pTerrain->raySelectNeighbour(ray, distanceLimit);
+		}
+
+		return std::pair<bool, VEC3>(false, VEC3::ZERO);
+	}
 	//---------------------------------------------------------------------
-	//std::pair<bool, VEC3> Terrain::checkQuadIntersection(int x, int z, const Ray& ray)
-	//{
-	//	// build the two planes belonging to the quad's triangles
-	//	VEC3 v1((float)x, *getHeightData(x, z), (float)z);
-	//	VEC3 v2((float)x + 1, *getHeightData(x + 1, z), (float)z);
-	//	VEC3 v3((float)x, *getHeightData(x, z + 1), (float)z + 1);
-	//	VEC3 v4((float)x + 1, *getHeightData(x + 1, z + 1), (float)z + 1);
-
-	//	Plane p1, p2;
-	//	bool oddRow = false;
-	//	if (z % 2)
-	//	{
-	//		/* odd
-	//		3---4
-	//		| \ |
-	//		1---2
-	//		*/
-	//		p1.redefine(v2, v4, v3);
-	//		p2.redefine(v1, v2, v3);
-	//		oddRow = true;
-	//	}
-	//	else
-	//	{
-	//		/* even
-	//		3---4
-	//		| / |
-	//		1---2
-	//		*/
-	//		p1.redefine(v1, v2, v4);
-	//		p2.redefine(v1, v4, v3);
-	//	}
+	void Terrain::getGridRay(const RAY& ray, RAY* outRay) const
+	{
+		const VEC3 origin = convertWorldToTerrainAxes(ray.m_origin - mPos);
+		const VEC3 dir = convertWorldToTerrainAxes(ray.m_dir);
+		const float fInvScale = 1.0f / mScale;
 
-	//	// Test for intersection with the two planes. 
-	//	// Then test that the intersection points are actually
-	//	// still inside the triangle (with a small error margin)
-	//	// Also check which triangle it is in
-	//	std::pair<bool, float> planeInt = ray.intersects(p1);
-	//	if (planeInt.first)
-	//	{
-	//		VEC3 where = ray.getPoint(planeInt.second);
-	//		VEC3 rel = where - v1;
-	//		if (rel.x >= -0.01 && rel.x <= 1.01 && rel.z >= -0.01 && rel.z <= 1.01 // quad bounds
-	//			&& ((rel.x >= rel.z && !oddRow) || (rel.x >= (1 - rel.z) && oddRow))) // triangle bounds
-	//			return std::pair<bool, VEC3>(true, where);
-	//	}
-	//	planeInt = ray.intersects(p2);
-	//	if (planeInt.first)
-	//	{
-	//		VEC3 where = ray.getPoint(planeInt.second);
-	//		VEC3 rel = where - v1;
-	//		if (rel.x >= -0.01 && rel.x <= 1.01 && rel.z >= -0.01 && rel.z <= 1.01 // quad bounds
-	//			&& ((rel.x <= rel.z && !oddRow) || (rel.x <= (1 - rel.z) && oddRow))) // triangle bounds
-	//			return std::pair<bool, VEC3>(true, where);
-	//	}
+		outRay->m_origin = VEC3((origin.x - mBase) * fInvScale, (origin.y - mBase) * fInvScale, origin.z);
+		outRay->m_dir = VEC3(dir.x * fInvScale, dir.y * fInvScale, dir.z);
+	}
+	//---------------------------------------------------------------------
+	bool Terrain::rayIntersectsGrid(const RAY& gridRay, float tMax, float* outT) const
+	{
+		if (!mQuadTree || !mHeightData)
+			return false;
 
-	//	return std::pair<bool, VEC3>(false, VEC3());
-	//}
+		float tNear, tFar;
+		if (!_RayNodeBounds(mQuadTree, gridRay, tNear, tFar) || tNear > tMax)
+			return false;
+
+		float tBest = tMax;
+		if (!_RayNode(mHeightData, mSize, mQuadTree, gridRay, tNear, tFar, tBest))
+			return false;
+
+		*outT = tBest;
+		return true;
+	}
 	//---------------------------------------------------------------------
 	void Terrain::checkLayers(bool includeGPUResources)
 	{
@@ -3120,49 +3197,178 @@ namespace Neo
 		//	4---P---0
 		//  | / | \ |
 		//	5---6---7
+		// each of the 8 triangles adds its unit normal, the sum is normalised
 
-		PLANE plane;
-		for (long y = widenedRect.top; y < widenedRect.bottom; ++y)
+		// encode as RGB, object space
+		// invert the Y to deal with image space
+		auto storeNormal = [pData, &widenedRect](long x, long y, const VEC3& normal)
+		{
+			long storeX = x - widenedRect.left;
+			long storeY = widenedRect.bottom - y - 1;
+
+			uint8* pStore = pData + ((storeY * widenedRect.GetWidth()) + storeX) * 4;
+			*pStore++ = static_cast<uint8>((normal.x + 1.0f) * 0.5f * 255.0f);
+			*pStore++ = static_cast<uint8>((normal.y + 1.0f) * 0.5f * 255.0f);
+			*pStore++ = static_cast<uint8>((normal.z + 1.0f) * 0.5f * 255.0f);
+			*pStore++ = 255;
+		};
+
+		// On the outer border the points may come from the neighbours
+		auto calculateBorderNormal = [this, &storeNormal](long x, long y)
+		{
+			VEC3 cumulativeNormal = VEC3::ZERO;
+
+			// Build points to sample
+			VEC3 centrePoint;
+			VEC3 adjacentPoints[8];
+			getPointFromSelfOrNeighbour(x, y, &centrePoint);
+			getPointFromSelfOrNeighbour(x + 1, y, &adjacentPoints[0]);
+			getPointFromSelfOrNeighbour(x + 1, y + 1, &adjacentPoints[1]);
+			getPointFromSelfOrNeighbour(x, y + 1, &adjacentPoints[2]);
+			getPointFromSelfOrNeighbour(x - 1, y + 1, &adjacentPoints[3]);
+			getPointFromSelfOrNeighbour(x - 1, y, &adjacentPoints[4]);
+			getPointFromSelfOrNeighbour(x - 1, y - 1, &adjacentPoints[5]);
+			getPointFromSelfOrNeighbour(x, y - 1, &adjacentPoints[6]);
+			getPointFromSelfOrNeighbour(x + 1, y - 1, &adjacentPoints[7]);
+
+			PLANE plane;
+			for (int i = 0; i < 8; ++i)
+			{
+				plane.Redefine(centrePoint, adjacentPoints[i], adjacentPoints[(i + 1) % 8]);
+				cumulativeNormal += plane.n;
+			}
+
+			// normalise & store normal
+			cumulativeNormal.Normalize();
+			storeNormal(x, y, cumulativeNormal);
+		};
+
+		// Inside, the heights are read straight from this tile. Working in terrain
+		// space with the grid spacing divided out, dh[i] being the height of point i
+		// minus the centre, every triangle normal has z = mScale and x, y made of
+		// height differences only, see addTriangle below
+		const long offsets[8] = { 1, mSize + 1, mSize, mSize - 1, -1, -mSize - 1, -mSize, -mSize + 1 };
+
+		auto calculateInteriorNormal = [&](long x, long y)
 		{
-			for (long x = widenedRect.left; x < widenedRect.right; ++x)
+			const float* pHeight = mHeightData + y * mSize + x;
+			float dh[8];
+			for (int i = 0; i < 8; ++i)
+				dh[i] = pHeight[offsets[i]] - *pHeight;
+
+			VEC3 cumulativeNormal = VEC3::ZERO;
+			auto addTriangle = [&](float nx, float ny)
+			{
+				VEC3 n(nx, ny, mScale);
+				n.Normalize();
+				cumulativeNormal += n;
+			};
+			addTriangle(-dh[0], dh[0] - dh[1]);
+			addTriangle(dh[2] - dh[1], -dh[2]);
+			addTriangle(dh[3] - dh[2], -dh[2]);
+			addTriangle(dh[4], dh[4] - dh[3]);
+			addTriangle(dh[4], dh[5] - dh[4]);
+			addTriangle(dh[5] - dh[6], dh[6]);
+			addTriangle(dh[6] - dh[7], dh[6]);
+			addTriangle(-dh[0], dh[7] - dh[0]);
+
+			cumulativeNormal.Normalize();
+			VEC3 normal;
+			convertTerrainToWorldAxes(mAlign, cumulativeNormal, &normal);
+			storeNormal(x, y, normal);
+		};
+
+		const long interiorLeft = std::max(widenedRect.left, 1);
+		const long interiorRight = std::min(widenedRect.right, mSize - 1);
+
+		JobSystem::GetSingleton().ParallelFor(widenedRect.GetHeight(), NORMAL_ROW_GRAIN, [&](uint32 nBegin, uint32 nEnd)
+		{
+			for (long y = widenedRect.top + nBegin; y < widenedRect.top + (long)nEnd; ++y)
 			{
-				VEC3 cumulativeNormal = VEC3::ZERO;
-
-				// Build points to sample
-				VEC3 centrePoint;
-				VEC3 adjacentPoints[8];
-				getPointFromSelfOrNeighbour(x, y, &centrePoint);
-				getPointFromSelfOrNeighbour(x + 1, y, &adjacentPoints[0]);
-				getPointFromSelfOrNeighbour(x + 1, y + 1, &adjacentPoints[1]);
-				getPointFromSelfOrNeighbour(x, y + 1, &adjacentPoints[2]);
-				getPointFromSelfOrNeighbour(x - 1, y + 1, &adjacentPoints[3]);
-				getPointFromSelfOrNeighbour(x - 1, y, &adjacentPoints[4]);
-				getPointFromSelfOrNeighbour(x - 1, y - 1, &adjacentPoints[5]);
-				getPointFromSelfOrNeighbour(x, y - 1, &adjacentPoints[6]);
-				getPointFromSelfOrNeighbour(x + 1, y - 1, &adjacentPoints[7]);
-
-				for (int i = 0; i < 8; ++i)
+				long x = widenedRect.left;
+				if (y == 0 || y == mSize - 1)
 				{
-					plane.Redefine(centrePoint, adjacentPoints[i], adjacentPoints[(i + 1) % 8]);
-					cumulativeNormal += plane.n;
+					for (; x < widenedRect.right; ++x)
+						calculateBorderNormal(x, y);
+					continue;
 				}
 
-				// normalise & store normal
-				cumulativeNormal.Normalize();
+				for (; x < interiorLeft; ++x)
+					calculateBorderNormal(x, y);
+
+#if USE_SIMD == 1
+				// 4 texels per iteration
+				const __m128 vScale = _mm_set1_ps(mScale);
+				const __m128 vScaleSq = _mm_mul_ps(vScale, vScale);
+				const __m128 vZero = _mm_setzero_ps();
+				const __m128 vOne = _mm_set1_ps(1.0f);
+				const __m128 vHalf = _mm_set1_ps(0.5f);
+				const __m128 v255 = _mm_set1_ps(255.0f);
+				const __m128i vAlpha = _mm_set1_epi32(0xFF000000);
 
-				// encode as RGB, object space
-				// invert the Y to deal with image space
-				long storeX = x - widenedRect.left;
-				long storeY = widenedRect.bottom - y - 1;
+				for (; x + 4 <= interiorRight; x += 4)
+				{
+					const float* pHeight = mHeightData + y * mSize + x;
+					const __m128 vCentre = _mm_loadu_ps(pHeight);
+					__m128 vDh[8];
+					for (int i = 0; i < 8; ++i)
+						vDh[i] = _mm_sub_ps(_mm_loadu_ps(pHeight + offsets[i]), vCentre);
+
+					// unit normals summed with a shared 1 / length, z is scaled once at the end
+					__m128 vSumX = vZero, vSumY = vZero, vSumZ = vZero;
+					auto addTriangle = [&](__m128 vNx, __m128 vNy)
+					{
+						const __m128 vInvLength = _mm_div_ps(vOne, _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vNx, vNx), _mm_mul_ps(vNy, vNy)), vScaleSq)));
+						vSumX = _mm_add_ps(vSumX, _mm_mul_ps(vNx, vInvLength));
+						vSumY = _mm_add_ps(vSumY, _mm_mul_ps(vNy, vInvLength));
+						vSumZ = _mm_add_ps(vSumZ, vInvLength);
+					};
+					addTriangle(_mm_sub_ps(vZero, vDh[0]), _mm_sub_ps(vDh[0], vDh[1]));
+					addTriangle(_mm_sub_ps(vDh[2], vDh[1]), _mm_sub_ps(vZero, vDh[2]));
+					addTriangle(_mm_sub_ps(vDh[3], vDh[2]), _mm_sub_ps(vZero, vDh[2]));
+					addTriangle(vDh[4], _mm_sub_ps(vDh[4], vDh[3]));
+					addTriangle(vDh[4], _mm_sub_ps(vDh[5], vDh[4]));
+					addTriangle(_mm_sub_ps(vDh[5], vDh[6]), vDh[6]);
+					addTriangle(_mm_sub_ps(vDh[6], vDh[7]), vDh[6]);
+					addTriangle(_mm_sub_ps(vZero, vDh[0]), _mm_sub_ps(vDh[7], vDh[0]));
+					vSumZ = _mm_mul_ps(vSumZ, vScale);
+
+					const __m128 vLength = _mm_sqrt_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(vSumX, vSumX), _mm_mul_ps(vSumY, vSumY)), _mm_mul_ps(vSumZ, vSumZ)));
+					vSumX = _mm_div_ps(vSumX, vLength);
+					vSumY = _mm_div_ps(vSumY, vLength);
+					vSumZ = _mm_div_ps(vSumZ, vLength);
+
+					// to object space, see convertTerrainToWorldAxes()
+					__m128 vR, vG, vB;
+					switch (mAlign)
+					{
+					case ALIGN_X_Z:
+						vR = vSumX; vG = vSumZ; vB = _mm_sub_ps(vZero, vSumY);
+						break;
+					case ALIGN_Y_Z:
+						vR = vSumZ; vG = vSumY; vB = _mm_sub_ps(vZero, vSumX);
+						break;
+					default:
+						vR = vSumX; vG = vSumY; vB = vSumZ;
+						break;
+					}
 
-				uint8* pStore = pData + ((storeY * widenedRect.GetWidth()) + storeX) * 4;
-				*pStore++ = static_cast<uint8>((cumulativeNormal.x + 1.0f) * 0.5f * 255.0f);
-				*pStore++ = static_cast<uint8>((cumulativeNormal.y + 1.0f) * 0.5f * 255.0f);
-				*pStore++ = static_cast<uint8>((cumulativeNormal.z + 1.0f) * 0.5f * 255.0f);
-				*pStore++ = 255;
+					const __m128i vRi = _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(_mm_add_ps(vR, vOne), vHalf), v255));
+					const __m128i vGi = _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(_mm_add_ps(vG, vOne), vHalf), v255));
+					const __m128i vBi = _mm_cvttps_epi32(_mm_mul_ps(_mm_mul_ps(_mm_add_ps(vB, vOne), vHalf), v255));
+					const __m128i vPixels = _mm_or_si128(_mm_or_si128(vRi, _mm_slli_epi32(vGi, 8)), _mm_or_si128(_mm_slli_epi32(vBi, 16), vAlpha));
 
+					const long storeY = widenedRect.bottom - y - 1;
+					_mm_storeu_si128((__m128i*)(pData + ((storeY * widenedRect.GetWidth()) + x - widenedRect.left) * 4), vPixels);
+				}
+#endif
+				for (; x < interiorRight; ++x)
+					calculateInteriorNormal(x, y);
+
+				for (; x < widenedRect.right; ++x)
+					calculateBorderNormal(x, y);
 			}
-		}
+		});
 
 		finalRect = widenedRect;
 
@@ -3184,13 +3390,8 @@ namespace Neo
 			{
 				// content of normalsBox is already inverted in Y, but rect is still 
 				// in terrain space for dealing with sub-rect, so invert
-				//Image::Box dstBox;
-				//dstBox.left = static_cast<uint32>(rect.left);
-				//dstBox.right = static_cast<uint32>(rect.right);
-				//dstBox.top = static_cast<uint32>(mSize - rect.bottom);
-				//dstBox.bottom = static_cast<uint32>(mSize - rect.top);
-				//mTerrainNormalMap->UpdateRegion(*normalsBox, dstBox);
-				_AST(0);
+				Rect dstRect(rect.left, mSize - rect.bottom, rect.right, mSize - rect.top);
+				mTerrainNormalMap->UpdateRegion(nullptr, &dstRect, normalsBox);
 			}
 		}
 
@@ -3207,167 +3408,198 @@ namespace Neo
 	void Terrain::widenRectByVector(const VEC3& vec, const Rect& inRect,
 		float minHeight, float maxHeight, Rect& outRect)
 	{
-		_AST(0);
-		//outRect = inRect;
-
-		//Plane p;
-		//switch (getAlignment())
-		//{
-		//case ALIGN_X_Y:
-		//	p.redefine(VEC3::UNIT_Z, VEC3(0, 0, vec.z < 0.0 ? minHeight : maxHeight));
-		//	break;
-		//case ALIGN_X_Z:
-		//	p.redefine(VEC3::UNIT_Y, VEC3(0, vec.y < 0.0 ? minHeight : maxHeight, 0));
-		//	break;
-		//case ALIGN_Y_Z:
-		//	p.redefine(VEC3::UNIT_X, VEC3(vec.x < 0.0 ? minHeight : maxHeight, 0, 0));
-		//	break;
-		//}
-		//float verticalVal = vec.dotProduct(p.normal);
-
-		//if (Math::RealEqual(verticalVal, 0.0))
-		//	return;
+		outRect = inRect;
+		if (inRect.IsNull())
+			return;
 
-		//VEC3 corners[4];
-		//float startHeight = verticalVal < 0.0 ? maxHeight : minHeight;
-		//getPoint(inRect.left, inRect.top, startHeight, &corners[0]);
-		//getPoint(inRect.right - 1, inRect.top, startHeight, &corners[1]);
-		//getPoint(inRect.left, inRect.bottom - 1, startHeight, &corners[2]);
-		//getPoint(inRect.right - 1, inRect.bottom - 1, startHeight, &corners[3]);
+		// Anything between the heights can only reach as far as the vector travels
+		// going from maxHeight down to minHeight
+		const VEC3 terrainVec = convertWorldToTerrainAxes(vec);
+		const float horizLength = sqrtf(terrainVec.x * terrainVec.x + terrainVec.y * terrainVec.y);
+		if (terrainVec.z >= 0 || horizLength < -terrainVec.z * 1.0e-3f)
+			return;
 
-		//for (int i = 0; i < 4; ++i)
-		//{
-		//	Ray ray(corners[i] + mPos, vec);
-		//	std::pair<bool, float> rayHit = ray.intersects(p);
-		//	if (rayHit.first)
-		//	{
-		//		VEC3 pt = ray.getPoint(rayHit.second);
-		//		// convert back to terrain point
-		//		VEC3 terrainHitPos;
-		//		getTerrainPosition(pt, &terrainHitPos);
-		//		// build rectangle which has rounded down & rounded up values
-		//		// remember right & bottom are exclusive
-		//		Rect mergeRect(
-		//			(long)(terrainHitPos.x * (mSize - 1)),
-		//			(long)(terrainHitPos.y * (mSize - 1)),
-		//			(long)(terrainHitPos.x * (float)(mSize - 1) + 0.5) + 1,
-		//			(long)(terrainHitPos.y * (float)(mSize - 1) + 0.5) + 1
-		//			);
-		//		outRect.merge(mergeRect);
-		//	}
-		//}
+		// in terrain points, not further than a whole tile
+		float distance = (maxHeight - minHeight) * horizLength / -terrainVec.z / mScale;
+		distance = std::min(distance, (float)(mSize - 1));
+		const float dx = terrainVec.x / horizLength * distance;
+		const float dy = terrainVec.y / horizLength * distance;
+
+		// build rectangle which has rounded down & rounded up values
+		// remember right & bottom are exclusive
+		Rect mergeRect(
+			inRect.left + (int)floorf(dx),
+			inRect.top + (int)floorf(dy),
+			inRect.right + (int)ceilf(dx),
+			inRect.bottom + (int)ceilf(dy)
+			);
+		outRect.Merge(mergeRect);
 	}
 	//---------------------------------------------------------------------
 	PixelBox* Terrain::calculateLightmap(const Rect& rect, const Rect& extraTargetRect, Rect& outFinalRect)
 	{
-		_AST(0);
-		return nullptr;
-
 		// as well as calculating the lighting changes for the area that is
 		// dirty, we also need to calculate the effect on casting shadow on
 		// other areas. To do this, we project the dirt rect by the light direction
 		// onto the minimum height
+		const VEC3& lightVec = g_env.pSceneMgr->GetTerrainOptions()->getLightMapDirection();
+		Rect widenedRect;
+		widenRectByVector(lightVec, rect, widenedRect);
+
+		// merge in the extra area (e.g. from neighbours)
+		widenedRect.Merge(extraTargetRect);
+
+		// widenedRect now contains terrain point space version of the area we
+		// need to calculate. However, we need to calculate in lightmap image space
+		const int lightmapSize = mLightmapSizeActual;
+		const float terrainToLightmapScale = (float)(lightmapSize - 1) / (float)(mSize - 1);
+		widenedRect.left = (int)floorf(widenedRect.left * terrainToLightmapScale);
+		widenedRect.top = (int)floorf(widenedRect.top * terrainToLightmapScale);
+		widenedRect.right = (int)ceilf((widenedRect.right - 1) * terrainToLightmapScale) + 1;
+		widenedRect.bottom = (int)ceilf((widenedRect.bottom - 1) * terrainToLightmapScale) + 1;
+
+		// clamp 
+		widenedRect.left = std::max(0, widenedRect.left);
+		widenedRect.top = std::max(0, widenedRect.top);
+		widenedRect.right = std::min(lightmapSize, widenedRect.right);
+		widenedRect.bottom = std::min(lightmapSize, widenedRect.bottom);
+
+		if (widenedRect.GetWidth() <= 0 || widenedRect.GetHeight() <= 0)
+		{
+			outFinalRect.SetNull();
+			return nullptr;
+		}
 
+		outFinalRect = widenedRect;
 
-		//const VEC3& lightVec = TerrainGlobalOptions::getSingleton().getLightMapDirection();
-		//Ogre::Rect widenedRect;
-		//widenRectByVector(lightVec, rect, widenedRect);
-
-		//// merge in the extra area (e.g. from neighbours)
-		//widenedRect.merge(extraTargetRect);
-
-		//// widenedRect now contains terrain point space version of the area we
-		//// need to calculate. However, we need to calculate in lightmap image space
-		//float terrainToLightmapScale = (float)mLightmapSizeActual / (float)mSize;
-		//widenedRect.left = (long)(widenedRect.left * terrainToLightmapScale);
-		//widenedRect.right = (long)(widenedRect.right * terrainToLightmapScale);
-		//widenedRect.top = (long)(widenedRect.top * terrainToLightmapScale);
-		//widenedRect.bottom = (long)(widenedRect.bottom * terrainToLightmapScale);
-
-		//// clamp 
-		//widenedRect.left = std::max(0L, widenedRect.left);
-		//widenedRect.top = std::max(0L, widenedRect.top);
-		//widenedRect.right = std::min((long)mLightmapSizeActual, widenedRect.right);
-		//widenedRect.bottom = std::min((long)mLightmapSizeActual, widenedRect.bottom);
-
-		//outFinalRect = widenedRect;
-
-		//// allocate memory (L8)
-		//uint8* pData = static_cast<uint8*>(
-		//	OGRE_MALLOC(widenedRect.width() * widenedRect.height(), MEMCATEGORY_GENERAL));
-
-		//PixelBox* pixbox = OGRE_NEW PixelBox(static_cast<uint32>(widenedRect.width()),
-		//	static_cast<uint32>(widenedRect.height()), 1, PF_L8, pData);
-
-		//float heightPad = (getMaxHeight() - getMinHeight()) * 1.0e-3f;
-
-		//for (long y = widenedRect.top; y < widenedRect.bottom; ++y)
-		//{
-		//	for (long x = widenedRect.left; x < widenedRect.right; ++x)
-		//	{
-		//		float litVal = 1.0f;
-
-		//		// convert to terrain space (not points, allow this to go between points)
-		//		float Tx = (float)x / (float)(mLightmapSizeActual - 1);
-		//		float Ty = (float)y / (float)(mLightmapSizeActual - 1);
-
-		//		// get world space point
-		//		// add a little height padding to stop shadowing self
-		//		VEC3 wpos = VEC3::ZERO;
-		//		getPosition(Tx, Ty, getHeightAtTerrainPosition(Tx, Ty) + heightPad, &wpos);
-		//		wpos += getPosition();
-		//		// build ray, cast backwards along light direction
-		//		Ray ray(wpos, -lightVec);
-
-		//		// Cascade into neighbours when casting, but don't travel further
-		//		// than world size
-		//		std::pair<bool, VEC3> rayHit = rayIntersects(ray, true, mWorldSize);
-
-		//		if (rayHit.first)
-		//			litVal = 0.0f;
-
-		//		// encode as L8
-		//		// invert the Y to deal with image space
-		//		long storeX = x - widenedRect.left;
-		//		long storeY = widenedRect.bottom - y - 1;
+		// allocate memory (L8), everything is lit until the sweep finds a shadow
+		PixelBox* pixbox = new PixelBox(widenedRect.GetWidth(), widenedRect.GetHeight(), 1);
+		uint8* pData = (uint8*)pixbox->GetDataPointer();
+		const int pitch = pixbox->GetPitch();
+		memset(pData, 255, pitch * widenedRect.GetHeight());
 
-		//		uint8* pStore = pData + ((storeY * widenedRect.width()) + storeX);
-		//		*pStore = (unsigned char)(litVal * 255.0);
+		// z is up in terrain space
+		const VEC3 terrainLightVec = convertWorldToTerrainAxes(lightVec);
+		const float horizLength = sqrtf(terrainLightVec.x * terrainLightVec.x + terrainLightVec.y * terrainLightVec.y);
+		if (terrainLightVec.z >= 0)
+		{
+			// light from below the horizon
+			memset(pData, 0, pitch * widenedRect.GetHeight());
+			return pixbox;
+		}
+		if (horizLength < -terrainLightVec.z * 1.0e-3f)
+		{
+			// light from straight above, nothing casts a shadow
+			return pixbox;
+		}
 
-		//	}
-		//}
+		// Horizon sweep: lines follow the light through the height field, carrying the
+		// height of the highest shadow ray above the current point, which is lit if it
+		// isn't below that. The lines advance one texel at a time along the major axis
+		// (u) of the light and slope along the other one (v), so each line is O(N)
+		// instead of a ray cast per texel.
+		const bool majorX = fabsf(terrainLightVec.x) >= fabsf(terrainLightVec.y);
+		const float majorLight = majorX ? terrainLightVec.x : terrainLightVec.y;
+		const float minorLight = majorX ? terrainLightVec.y : terrainLightVec.x;
+		const int stepU = majorLight > 0 ? 1 : -1;
+		const float slope = minorLight / fabsf(majorLight);
+
+		// the shadow ray drops this much from one step to the next
+		const float stepWorldSize = mWorldSize / (float)(lightmapSize - 1) * sqrtf(1.0f + slope * slope);
+		const float stepDrop = stepWorldSize * -terrainLightVec.z / horizLength;
+
+		// Shadows may be cast from as far as the height range allows, including
+		// neighbours, but not from further than the next tile
+		float minHeight = getMinHeight();
+		float maxHeight = getMaxHeight();
+		for (int i = 0; i < (int)NEIGHBOUR_COUNT; ++i)
+		{
+			const Terrain* neighbour = getNeighbour(static_cast<NeighbourIndex>(i));
+			if (neighbour)
+				maxHeight = std::max(maxHeight, neighbour->getMaxHeight());
+		}
+		const int reach = std::min((int)ceilf((maxHeight - minHeight) / stepDrop), lightmapSize - 1);
+		// add a little height padding to stop shadowing self
+		const float heightPad = (maxHeight - minHeight) * 1.0e-3f;
+
+		// Every line starts reach steps ahead of the target area, at the same u. Lines
+		// differ by whole texels in v, so at any u they cover each texel exactly once
+		// and can be swept in parallel.
+		const int u0 = majorX ? widenedRect.left : widenedRect.top;
+		const int u1 = majorX ? widenedRect.right : widenedRect.bottom;
+		const int v0 = majorX ? widenedRect.top : widenedRect.left;
+		const int v1 = majorX ? widenedRect.bottom : widenedRect.right;
+		const int uStart = stepU > 0 ? u0 - reach : u1 - 1 + reach;
+		const int numSteps = reach + (u1 - u0);
+		auto offsetV = [slope](int step) { return (int)floorf(slope * step + 0.5f); };
+		const int firstOffsetV = offsetV(reach);
+		const int lastOffsetV = offsetV(numSteps - 1);
+		const int lineBegin = v0 - std::max(firstOffsetV, lastOffsetV);
+		const int lineEnd = v1 - std::min(firstOffsetV, lastOffsetV);
+		const float lightmapToTerrainScale = (float)(mSize - 1) / (float)(lightmapSize - 1);
+
+		JobSystem::GetSingleton().ParallelFor(lineEnd - lineBegin, LIGHTMAP_LINE_GRAIN, [&](uint32 nBegin, uint32 nEnd)
+		{
+			for (int line = lineBegin + (int)nBegin; line < lineBegin + (int)nEnd; ++line)
+			{
+				float shadowHeight = -FLT_MAX;
+				for (int step = 0; step < numSteps; ++step)
+				{
+					const int u = uStart + step * stepU;
+					const float v = line + slope * step;
+
+					// bilinear height at the exact position on the line
+					const float px = (majorX ? u : v) * lightmapToTerrainScale;
+					const float py = (majorX ? v : u) * lightmapToTerrainScale;
+					const float fx = floorf(px), fy = floorf(py);
+					const long ix = (long)fx, iy = (long)fy;
+					const float tx = px - fx, ty = py - fy;
+					const float height =
+						(getHeightFromSelfOrNeighbour(ix, iy) * (1 - tx) + getHeightFromSelfOrNeighbour(ix + 1, iy) * tx) * (1 - ty) +
+						(getHeightFromSelfOrNeighbour(ix, iy + 1) * (1 - tx) + getHeightFromSelfOrNeighbour(ix + 1, iy + 1) * tx) * ty;
+
+					const bool lit = height + heightPad >= shadowHeight;
+					shadowHeight = std::max(shadowHeight, height) - stepDrop;
+
+					// steps ahead of the target area only build up the horizon
+					const int texelV = line + offsetV(step);
+					if (step < reach || texelV < v0 || texelV >= v1)
+						continue;
+
+					// encode as L8
+					// invert the Y to deal with image space
+					const long storeX = (majorX ? u : texelV) - widenedRect.left;
+					const long storeY = widenedRect.bottom - (majorX ? texelV : u) - 1;
+					pData[storeY * pitch + storeX] = lit ? 255 : 0;
+				}
+			}
+		});
 
-		//return pixbox;
+		return pixbox;
 	}
 	//---------------------------------------------------------------------
 	void Terrain::finaliseLightmap(const Rect& rect, PixelBox* lightmapBox)
 	{
-		_AST(0);
-		//createOrDestroyGPULightmap();
-		//// deal with race condition where lm has been disabled while we were working!
-		//if (!mLightmap.isNull())
-		//{
-		//	// blit the normals into the texture
-		//	if (rect.left == 0 && rect.top == 0 && rect.bottom == mLightmapSizeActual && rect.right == mLightmapSizeActual)
-		//	{
-		//		mLightmap->getBuffer()->blitFromMemory(*lightmapBox);
-		//	}
-		//	else
-		//	{
-		//		// content of PixelBox is already inverted in Y, but rect is still 
-		//		// in terrain space for dealing with sub-rect, so invert
-		//		Image::Box dstBox;
-		//		dstBox.left = static_cast<uint32>(rect.left);
-		//		dstBox.right = static_cast<uint32>(rect.right);
-		//		dstBox.top = static_cast<uint32>(mLightmapSizeActual - rect.bottom);
-		//		dstBox.bottom = static_cast<uint32>(mLightmapSizeActual - rect.top);
-		//		mLightmap->getBuffer()->blitFromMemory(*lightmapBox, dstBox);
-		//	}
-		//}
+		createOrDestroyGPULightmap();
+		// deal with race condition where lm has been disabled while we were working!
+		if (mLightmap && lightmapBox)
+		{
+			// blit the lightmap into the texture
+			if (rect.left == 0 && rect.top == 0 && rect.bottom == mLightmapSizeActual && rect.right == mLightmapSizeActual)
+			{
+				mLightmap->UpdateRegion(nullptr, nullptr, lightmapBox);
+			}
+			else
+			{
+				// content of PixelBox is already inverted in Y, but rect is still 
+				// in terrain space for dealing with sub-rect, so invert
+				Rect dstRect(rect.left, mLightmapSizeActual - rect.bottom, rect.right, mLightmapSizeActual - rect.top);
+				mLightmap->UpdateRegion(nullptr, &dstRect, lightmapBox);
+			}
+		}
 
-		//// delete memory
-		//OGRE_FREE(lightmapBox->data, MEMCATEGORY_GENERAL);
-		//delete(lightmapBox);
+		// delete memory
+		SAFE_DELETE(lightmapBox);
 	}
 	//---------------------------------------------------------------------
 	void Terrain::updateCompositeMap()
@@ -3463,42 +3695,27 @@ namespace Neo
 	//---------------------------------------------------------------------
 	void Terrain::createOrDestroyGPULightmap()
 	{
-		//if (mLightMapRequired && mLightmap.isNull())
-		//{
-		//	// create
-		//	mLightmap = TextureManager::getSingleton().createManual(
-		//		mMaterialName + "/lm", _getDerivedResourceGroup(),
-		//		TEX_TYPE_2D, mLightmapSize, mLightmapSize, 0, PF_L8, TU_STATIC);
-
-		//	mLightmapSizeActual = mLightmap->getWidth();
-
-		//	if (mCpuLightmapStorage)
-		//	{
-		//		// Load cached data
-		//		PixelBox src(mLightmapSize, mLightmapSize, 1, PF_L8, mCpuLightmapStorage);
-		//		mLightmap->getBuffer()->blitFromMemory(src);
-		//		// release CPU copy, don't need it anymore
-		//		OGRE_FREE(mCpuLightmapStorage, MEMCATEGORY_RESOURCE);
-		//		mCpuLightmapStorage = 0;
+		if (mLightMapRequired && !mLightmap)
+		{
+			// create from cached data, or initialise to full-bright
+			std::vector<uint8> fullBright;
+			const char* pData = (const char*)mCpuLightmapStorage;
+			if (!pData)
+			{
+				fullBright.resize(mLightmapSize * mLightmapSize, 255);
+				pData = (const char*)&fullBright[0];
+			}
 
-		//	}
-		//	else
-		//	{
-		//		// initialise to full-bright
-		//		Box box(0, 0, mLightmapSizeActual, mLightmapSizeActual);
-		//		HardwarePixelBufferSharedPtr buf = mLightmap->getBuffer();
-		//		uint8* pInit = static_cast<uint8*>(buf->lock(box, HardwarePixelBuffer::HBL_DISCARD).data);
-		//		memset(pInit, 255, mLightmapSizeActual * mLightmapSizeActual);
-		//		buf->unlock();
+			mLightmap = g_env.pRenderer->GetRenderSys()->CreateTextureManual(mLightmapSize, mLightmapSize, pData, ePF_L8, 0, false);
+			mLightmapSizeActual = mLightmapSize;
 
-		//	}
-		//}
-		//else if (!mLightMapRequired && !mLightmap.isNull())
-		//{
-		//	// destroy
-		//	TextureManager::getSingleton().remove(mLightmap->getHandle());
-		//	mLightmap.setNull();
-		//}
+			// release CPU copy, don't need it anymore
+			SAFE_DELETE_ARRAY(mCpuLightmapStorage);
+		}
+		else if (!mLightMapRequired && mLightmap)
+		{
+			SAFE_RELEASE(mLightmap);
+		}
 	}
 	//---------------------------------------------------------------------
 	void Terrain::createOrDestroyGPUCompositeMap()
@@ -3627,56 +3844,52 @@ namespace Neo
 		// Shadows across edge - possible effect extends based on the projection of the
 		//   neighbour AABB along the light direction (worst case scenario)
 
-		//if (!mDirtyGeometryRectForNeighbours.isNull())
-		//{
-		//	Rect dirtyRectForNeighbours(mDirtyGeometryRectForNeighbours);
-		//	mDirtyGeometryRectForNeighbours.setNull();
-		//	// calculate light update rectangle
-		//	const VEC3& lightVec = TerrainGlobalOptions::getSingleton().getLightMapDirection();
-		//	Rect lightmapRect;
-		//	widenRectByVector(lightVec, dirtyRectForNeighbours, getMinHeight(), getMaxHeight(), lightmapRect);
-
-		//	for (int i = 0; i < (int)NEIGHBOUR_COUNT; ++i)
-		//	{
-		//		NeighbourIndex ni = static_cast<NeighbourIndex>(i);
-		//		Terrain* neighbour = getNeighbour(ni);
-		//		if (!neighbour)
-		//			continue;
-
-		//		// Intersect the incoming rectangles with the edge regions related to this neighbour
-		//		Rect edgeRect;
-		//		getEdgeRect(ni, 2, &edgeRect);
-		//		Rect heightEdgeRect = edgeRect.intersect(dirtyRectForNeighbours);
-		//		Rect lightmapEdgeRect = edgeRect.intersect(lightmapRect);
-
-		//		if (!heightEdgeRect.isNull() || !lightmapRect.isNull())
-		//		{
-		//			// ok, we have something valid to pass on
-		//			Rect neighbourHeightEdgeRect, neighbourLightmapEdgeRect;
-		//			if (!heightEdgeRect.isNull())
-		//				getNeighbourEdgeRect(ni, heightEdgeRect, &neighbourHeightEdgeRect);
-		//			if (!lightmapRect.isNull())
-		//				getNeighbourEdgeRect(ni, lightmapEdgeRect, &neighbourLightmapEdgeRect);
+		// Only the shadows are passed on for now, heights and normals at the
+		// edges are not matched between tiles.
+		if (!mDirtyGeometryRectForNeighbours.IsNull())
+		{
+			Rect dirtyRectForNeighbours(mDirtyGeometryRectForNeighbours);
+			mDirtyGeometryRectForNeighbours.SetNull();
+			// calculate light update rectangle
+			const VEC3& lightVec = g_env.pSceneMgr->GetTerrainOptions()->getLightMapDirection();
+			Rect lightmapRect;
+			widenRectByVector(lightVec, dirtyRectForNeighbours, getMinHeight(), getMaxHeight(), lightmapRect);
+
+			for (int i = 0; i < (int)NEIGHBOUR_COUNT; ++i)
+			{
+				NeighbourIndex ni = static_cast<NeighbourIndex>(i);
+				Terrain* neighbour = getNeighbour(ni);
+				if (!neighbour || !neighbour->mLightMapRequired)
+					continue;
 
-		//			neighbour->neighbourModified(getOppositeNeighbour(ni),
-		//				neighbourHeightEdgeRect, neighbourLightmapEdgeRect);
+				// Intersect the incoming rectangles with the edge regions related to this neighbour
+				Rect edgeRect;
+				getEdgeRect(ni, 2, &edgeRect);
+				Rect lightmapEdgeRect = edgeRect.Intersect(lightmapRect);
 
-		//		}
+				if (!lightmapEdgeRect.IsNull())
+				{
+					// ok, we have something valid to pass on
+					Rect neighbourLightmapEdgeRect;
+					getNeighbourEdgeRect(ni, lightmapEdgeRect, &neighbourLightmapEdgeRect);
 
-		//	}
-		//}
+					neighbour->neighbourModified(getOppositeNeighbour(ni),
+						Rect(0, 0, 0, 0), neighbourLightmapEdgeRect);
+				}
+			}
+		}
 	}
 	//---------------------------------------------------------------------
 	void Terrain::neighbourModified(NeighbourIndex index, const Rect& edgerect, const Rect& shadowrect)
 	{
 		// We can safely assume that we would not have been contacted if it wasn't 
 		// important
-		//const Terrain* neighbour = getNeighbour(index);
-		//if (!neighbour)
-		//	return; // bogus request
+		const Terrain* neighbour = getNeighbour(index);
+		if (!neighbour)
+			return; // bogus request
 
 		//bool updateGeom = false;
-		//uint8 updateDerived = 0;
+		uint8 updateDerived = 0;
 
 
 		//if (!edgerect.isNull())
@@ -3719,24 +3932,24 @@ namespace Neo
 		//	}
 		//}
 
-		//if (!shadowrect.isNull())
-		//{
-		//	// update shadows
-		//	// here we need to widen the rect passed in based on the min/max height 
-		//	// of the *neighbour*
-		//	const VEC3& lightVec = TerrainGlobalOptions::getSingleton().getLightMapDirection();
-		//	Rect widenedRect;
-		//	widenRectByVector(lightVec, shadowrect, neighbour->getMinHeight(), neighbour->getMaxHeight(), widenedRect);
-
-		//	// set the special-case lightmap dirty rectangle
-		//	mDirtyLightmapFromNeighboursRect.merge(widenedRect);
-		//	updateDerived |= DERIVED_DATA_LIGHTMAP;
-		//}
+		if (!shadowrect.IsNull())
+		{
+			// update shadows
+			// here we need to widen the rect passed in based on the min/max height 
+			// of the *neighbour*
+			const VEC3& lightVec = g_env.pSceneMgr->GetTerrainOptions()->getLightMapDirection();
+			Rect widenedRect;
+			widenRectByVector(lightVec, shadowrect, neighbour->getMinHeight(), neighbour->getMaxHeight(), widenedRect);
+
+			// set the special-case lightmap dirty rectangle
+			mDirtyLightmapFromNeighboursRect.Merge(widenedRect);
+			updateDerived |= DERIVED_DATA_LIGHTMAP;
+		}
 
 		//if (updateGeom)
 		//	updateGeometry();
-		//if (updateDerived)
-		//	updateDerivedData(false, updateDerived);
+		if (updateDerived)
+			updateDerivedData(false, updateDerived);
 	}
 	//---------------------------------------------------------------------
 	void Terrain::getEdgeRect(NeighbourIndex index, long range, Rect* outRect) const
@@ -3913,6 +4126,28 @@ namespace Neo
 		}
 	}
 	//---------------------------------------------------------------------
+	float Terrain::getHeightFromSelfOrNeighbour(long x, long y) const
+	{
+		if (x >= 0 && y >= 0 && x < mSize && y < mSize)
+			return mHeightData[y * mSize + x];
+
+		long nx, ny;
+		NeighbourIndex ni = NEIGHBOUR_EAST;
+		getNeighbourPointOverflow(x, y, &ni, &nx, &ny);
+		Terrain* neighbour = getNeighbour(ni);
+		if (neighbour && neighbour->getHeightData())
+		{
+			// adjust to make it relative to our position
+			VEC3 offset = convertWorldToTerrainAxes(neighbour->getPosition() - getPosition());
+			return neighbour->getHeightAtPoint(nx, ny) + offset.z;
+		}
+		else
+		{
+			// use our own height after all, just clamp
+			return getHeightAtPoint(x, y);
+		}
+	}
+	//---------------------------------------------------------------------
 	void Terrain::getNeighbourPointOverflow(long x, long y, NeighbourIndex *outindex, long *outx, long *outy) const
 	{
 		if (x < 0)
@@ -3954,78 +4189,41 @@ namespace Neo
 			*outy = y;
 	}
 	//---------------------------------------------------------------------
-	//Terrain* Terrain::raySelectNeighbour(const Ray& ray, float distanceLimit /* = 0 */)
-	//{
-	//	Ray modifiedRay(ray.getOrigin(), ray.getDirection());
-	//	// Move back half a square - if we're on the edge of the AABB we might
-	//	// miss the intersection otherwise; it's ok for everywhere else since
-	//	// we want the far intersection anyway
-	//	modifiedRay.setOrigin(modifiedRay.getPoint(-mWorldSize / mSize * 0.5f));
-
-	//	// transform into terrain space
-	//	VEC3 tPos, tDir;
-	//	convertPosition(WORLD_SPACE, modifiedRay.getOrigin(), TERRAIN_SPACE, tPos);
-	//	convertDirection(WORLD_SPACE, modifiedRay.getDirection(), TERRAIN_SPACE, tDir);
-	//	// Discard rays with no lateral component
-	//	if (Math::RealEqual(tDir.x, 0.0f, 1e-4) && Math::RealEqual(tDir.y, 0.0f, 1e-4))
-	//		return 0;
-
-	//	Ray terrainRay(tPos, tDir);
-	//	// Intersect with boundary planes 
-	//	// Only collide with the positive (exit) side of the plane, because we may be
-	//	// querying from a point outside ourselves if we've cascaded more than once
-	//	float dist = std::numeric_limits<float>::max();
-	//	std::pair<bool, float> intersectResult;
-	//	if (tDir.x < 0.0f)
-	//	{
-	//		intersectResult = Math::intersects(terrainRay, Plane(VEC3::UNIT_X, VEC3::ZERO));
-	//		if (intersectResult.first && intersectResult.second < dist)
-	//			dist = intersectResult.second;
-	//	}
-	//	else if (tDir.x > 0.0f)
-	//	{
-	//		intersectResult = Math::intersects(terrainRay, Plane(VEC3::NEGATIVE_UNIT_X, VEC3(1, 0, 0)));
-	//		if (intersectResult.first && intersectResult.second < dist)
-	//			dist = intersectResult.second;
-	//	}
-	//	if (tDir.y < 0.0f)
-	//	{
-	//		intersectResult = Math::intersects(terrainRay, Plane(VEC3::UNIT_Y, VEC3::ZERO));
-	//		if (intersectResult.first && intersectResult.second < dist)
-	//			dist = intersectResult.second;
-	//	}
-	//	else if (tDir.y > 0.0f)
-	//	{
-	//		intersectResult = Math::intersects(terrainRay, Plane(VEC3::NEGATIVE_UNIT_Y, VEC3(0, 1, 0)));
-	//		if (intersectResult.first && intersectResult.second < dist)
-	//			dist = intersectResult.second;
-	//	}
+	Terrain* Terrain::raySelectNeighbour(const RAY& ray, float distanceLimit /* = 0 */) const
+	{
+		RAY gridRay;
+		getGridRay(ray, &gridRay);
 
+		const VEC3& o = gridRay.m_origin;
+		const VEC3& d = gridRay.m_dir;
 
-	//	// discard out of range
-	//	if (dist * mWorldSize > distanceLimit)
-	//		return 0;
+		// Discard rays with no lateral component
+		if (d.x == 0 && d.y == 0)
+			return 0;
 
-	//	VEC3 terrainIntersectPos = terrainRay.getPoint(dist);
-	//	float x = terrainIntersectPos.x;
-	//	float y = terrainIntersectPos.y;
-	//	float dx = tDir.x;
-	//	float dy = tDir.y;
+		// Where the ray leaves our footprint, heights don't matter
+		const float fEdge = (float)(mSize - 1);
+		const float tExitX = d.x > 0 ? (fEdge - o.x) / d.x : (d.x < 0 ? -o.x / d.x : FLT_MAX);
+		const float tExitY = d.y > 0 ? (fEdge - o.y) / d.y : (d.y < 0 ? -o.y / d.y : FLT_MAX);
+		const float tExit = Min(tExitX, tExitY);
 
-	//	// Never return diagonal directions, we will navigate those recursively anyway
-	//	if (Math::RealEqual(x, 1.0f, 1e-4f) && dx > 0)
-	//		return getNeighbour(NEIGHBOUR_EAST);
-	//	else if (Math::RealEqual(x, 0.0f, 1e-4f) && dx < 0)
-	//		return getNeighbour(NEIGHBOUR_WEST);
-	//	else if (Math::RealEqual(y, 1.0f, 1e-4f) && dy > 0)
-	//		return getNeighbour(NEIGHBOUR_NORTH);
-	//	else if (Math::RealEqual(y, 0.0f, 1e-4f) && dy < 0)
-	//		return getNeighbour(NEIGHBOUR_SOUTH);
+		if (tExit < 0)
+			return 0;
 
+		// The ray may pass beside us entirely
+		const VEC3 exitPos = gridRay.GetPoint(tExit);
+		if (exitPos.x < -1e-3f || exitPos.x > fEdge + 1e-3f || exitPos.y < -1e-3f || exitPos.y > fEdge + 1e-3f)
+			return 0;
 
+		if (distanceLimit > 0 && tExit * ray.m_dir.GetLength() > distanceLimit)
+			return 0;
 
-	//	return 0;
-	//}
+		// Never return diagonal directions, we will navigate those through the sides anyway
+		if (tExitX <= tExitY)
+			return getNeighbour(d.x > 0 ? NEIGHBOUR_EAST : NEIGHBOUR_WEST);
+		else
+			return getNeighbour(d.y > 0 ? NEIGHBOUR_NORTH : NEIGHBOUR_SOUTH);
+	}
 	//---------------------------------------------------------------------
 	//void Terrain::_dumpTextures(const STRING& prefix, const STRING& suffix)
 	//{
@@ -4072,10 +4270,77 @@ namespace Neo
 	void Terrain::UpdateLod()
 	{
 		calculateCurrentLod();
-		mQuadTree->CreateEntity();
+		CreateLodEntities();
+	}
+	//------------------------------------------------------------------------------------
+	void Terrain::CreateLodEntities()
+	{
+		// hand finished derived data and streamed LODs over before the new vertex data is used
+		processDerivedDataResponse();
+		mLodManager->processLoadResponse();
+
+		// a LOD streamed in or out, the draw list may refer to index data which is gone
+		if (mLodInvalid || getHighestLodLoaded() != mLodHighestLoaded)
+			calculateCurrentLod();
+
+		if (!mMaterial)
+			createMaterial();
+	}
+	//------------------------------------------------------------------------------------
+	void Terrain::createMaterial()
+	{
+		static uint32 iMat = 0;
+		++iMat;
+		char szMatName[64];
+		sprintf_s(szMatName, 64, "Mtl_Terrain_%d", iMat);
+
+		mMaterial = MaterialManager::GetSingleton().NewMaterial(szMatName,
+			_getUseCompactVertices() ? eVertexType_TerrainCompact : eVertexType_Terrain);
+
+		mMaterial->SetTexture(0, getTerrainNormalMap());
+		mMaterial->SetTexture(1, getLayerBlendTexture(0));
+
+		SSamplerDesc& samDesc = mMaterial->GetSamplerStateDesc(0);
+		samDesc.AddressU = eTextureAddressMode_WRAP;
+		samDesc.AddressV = eTextureAddressMode_WRAP;
+		samDesc.Filter = SF_MIN_MAG_MIP_LINEAR;
+		mMaterial->SetSamplerStateDesc(0, samDesc);
+		mMaterial->SetSamplerStateDesc(1, samDesc);
+
+		for (uint32 i = 0; i < getLayerCount(); ++i)
+		{
+			mMaterial->SetTexture(2+i*2, TextureManager::GetSingleton().LoadTexture(getLayerTextureName(i, 0), eTextureType_2D, 0, true));
+			mMaterial->SetTexture(2+i*2+1, TextureManager::GetSingleton().LoadTexture(getLayerTextureName(i, 1)));
+
+			mMaterial->SetSamplerStateDesc(2 + i * 2, samDesc);
+			mMaterial->SetSamplerStateDesc(2 + i * 2 + 1, samDesc);
+		}
+
+		mMaterial->InitShader("Terrain", eShader_Terrain, 0, nullptr, "VS_GBuffer", "PS_GBuffer");
+
+		if (mWireframe)
+			mMaterial->SetFillMode(eFill_Wireframe);
+	}
+	//------------------------------------------------------------------------------------
+	void Terrain::enableWireframe(bool b)
+	{
+		mWireframe = b;
+
+		if (mMaterial)
+			mMaterial->SetFillMode(b ? eFill_Wireframe : eFill_Solid);
 	}
 	//------------------------------------------------------------------------------------
 	void Terrain::Render()
+	{
+		if (!mRenderQueue)
+			mRenderQueue = new TerrainRenderQueue;
+
+		mRenderQueue->clear();
+		mRenderQueue->addTerrain(this);
+		mRenderQueue->render(g_env.pRenderer->GetRenderSys());
+	}
+	//------------------------------------------------------------------------------------
+	void Terrain::_setRenderState()
 	{
 		getPointTransform(&m_cbTerrain.posIndexToObjectSpace);
 		m_cbTerrain.posIndexToObjectSpace = m_cbTerrain.posIndexToObjectSpace.Transpose();
@@ -4091,7 +4356,13 @@ namespace Neo
 		m_pConstantBuf->UpdateBuf(&m_cbTerrain);
 		m_pConstantBuf->Apply(10, true);
 
-		mQuadTree->Render();
+		// the terrain position comes with each patch, the normals need no transform
+		cBufferMaterial& cbMaterial = g_env.pRenderer->GetMaterialCB();
+		cbMaterial.matWorld = MAT44::IDENTITY;
+		cbMaterial.matWorldIT = MAT44::IDENTITY;
+		cbMaterial.matInvWorld = MAT44::IDENTITY;
+
+		mMaterial->Activate();
 	}
 	//---------------------------------------------------------------------
 	void Terrain::setGpuBufferAllocator(GpuBufferAllocator* alloc)
@@ -4111,32 +4382,14 @@ namespace Neo
 			return &mDefaultGpuBufferAllocator;
 	}
 	//---------------------------------------------------------------------
-	size_t Terrain::getPositionBufVertexSize() const
+	size_t Terrain::getVertexSize(bool compact)
 	{
-		size_t sz = 0;
-		if (/*_getUseVertexCompression()*/true)
-		{
-			// short2 position
-			sz += sizeof(short) * 2;
-			// float1 height
-			sz += sizeof(float);
-		}
-		else
-		{
-			// float3 position
-			sz += sizeof(float) * 3;
-			// float2 uv
-			sz += sizeof(float) * 2;
-		}
+		// short2 position, ushort height, ushort delta and LOD threshold
+		if (compact)
+			return sizeof(STerrainCompactVertex);
 
-		return sz;
-
-	}
-	//---------------------------------------------------------------------
-	size_t Terrain::getDeltaBufVertexSize() const
-	{
-		// float2(delta, deltaLODthreshold)
-		return sizeof(float) * 2;
+		// short2 position, float1 height, float2(delta, deltaLODthreshold)
+		return sizeof(STerrainVertex);
 	}
 	//---------------------------------------------------------------------
 	size_t Terrain::_getNumIndexesForBatchSize(uint16 batchSize)
@@ -4363,7 +4616,7 @@ namespace Neo
 			Rect rect;
 			rect.top = 0; rect.bottom = mSize;
 			rect.left = 0; rect.right = mSize;
-			calculateHeightDeltas(rect);
+			calculateHeightDeltas(rect, mDeltaData);
 			finaliseHeightDeltas(rect, true);
 
 			if (mIsLoaded)
@@ -4386,35 +4639,72 @@ namespace Neo
 		freeAllBuffers();
 	}
 	//---------------------------------------------------------------------
-	void Terrain::DefaultGpuBufferAllocator::allocateVertexBuffers(Terrain* forTerrain,
-		size_t numVertices, VertexBuffer** destPos, VertexBuffer** destDelta)
+	void Terrain::DefaultGpuBufferAllocator::allocateVertexData(Terrain* forTerrain,
+		size_t numVertices, ShaderResourceBuffer** destBuf, uint32& baseVertex)
 	{
-		*destPos = getVertexBuffer(mFreePosBufList, forTerrain->getPositionBufVertexSize(), numVertices);
-		*destDelta = getVertexBuffer(mFreeDeltaBufList, forTerrain->getDeltaBufVertexSize(), numVertices);
+		const size_t vertexSize = getVertexSize(forTerrain->_getUseCompactVertices());
+		++mStats.numInUse;
 
+		VRangeBucketMap::iterator i = mFreeRanges.find(bucketKey(vertexSize, numVertices));
+		if (i != mFreeRanges.end() && !i->second.empty())
+		{
+			const VertexRange& range = i->second.back();
+			*destBuf = range.buf;
+			baseVertex = range.baseVertex;
+			i->second.pop_back();
+
+			++mStats.numHits;
+			--mStats.numPooled;
+			mStats.bytesPooled -= vertexSize * numVertices;
+			return;
+		}
+
+		// Didn't find one?
+		++mStats.numMisses;
+		const VertexRange range = createVertexBuffer(vertexSize, numVertices);
+		*destBuf = range.buf;
+		baseVertex = range.baseVertex;
 	}
 	//---------------------------------------------------------------------
-	VertexBuffer* Terrain::DefaultGpuBufferAllocator::getVertexBuffer(
-		VBufList& list, size_t vertexSize, size_t numVertices)
+	Terrain::DefaultGpuBufferAllocator::VertexRange Terrain::DefaultGpuBufferAllocator::createVertexBuffer(
+		size_t vertexSize, size_t numVertices)
 	{
-		size_t sz = vertexSize * numVertices;
-		for (VBufList::iterator i = list.begin(); i != list.end(); ++i)
+		const size_t numRanges = std::max<size_t>(VERTICES_PER_BUFFER / numVertices, 1);
+
+		VertexRange range;
+		range.buf = g_env.pRenderer->GetRenderSys()->CreateShaderResourceBuffer(
+			(uint32)(numRanges * numVertices), (uint32)vertexSize, 0);
+		mVertexBufs.push_back(range.buf);
+
+		// handed out from the back, the first range goes to the caller and the next ones follow it
+		VRangeList& ranges = mFreeRanges[bucketKey(vertexSize, numVertices)];
+		for (size_t i = numRanges - 1; i > 0; --i)
 		{
-			if ((*i)->GetStride() == sz)
-			{
-				VertexBuffer* ret = *i;
-				list.erase(i);
-				return ret;
-			}
+			range.baseVertex = (uint32)(i * numVertices);
+			ranges.push_back(range);
 		}
-		// Didn't find one?
-		return g_env.pRenderer->GetRenderSys()->CreateVertexBuffer(sz, vertexSize, nullptr, 0);
+		mStats.numPooled += (uint32)(numRanges - 1);
+		mStats.bytesPooled += (numRanges - 1) * numVertices * vertexSize;
+
+		range.baseVertex = 0;
+		return range;
 	}
 	//---------------------------------------------------------------------
-	void Terrain::DefaultGpuBufferAllocator::freeVertexBuffers(VertexBuffer* posbuf, VertexBuffer* deltabuf)
+	void Terrain::DefaultGpuBufferAllocator::freeVertexData(ShaderResourceBuffer* buf, uint32 baseVertex, size_t numVertices)
 	{
-		mFreePosBufList.push_back(posbuf);
-		mFreeDeltaBufList.push_back(deltabuf);
+		// nodes whose vertex data never reached the GPU free null buffers
+		if (!buf)
+			return;
+
+		VertexRange range;
+		range.buf = buf;
+		range.baseVertex = baseVertex;
+		mFreeRanges[bucketKey(buf->GetStride(), numVertices)].push_back(range);
+
+		_AST(mStats.numInUse > 0);
+		--mStats.numInUse;
+		++mStats.numPooled;
+		mStats.bytesPooled += buf->GetStride() * numVertices;
 	}
 	//---------------------------------------------------------------------
 	IndexBuffer* Terrain::DefaultGpuBufferAllocator::getSharedIndexBuffer(uint16 batchSize,
@@ -4437,6 +4727,7 @@ namespace Neo
 			ret->Unlock();
 
 			mSharedIBufMap[hsh] = ret;
+			mStats.bytesShared += nIndexCount * sizeof(DWORD);
 			return ret;
 		}
 		else
@@ -4447,16 +4738,61 @@ namespace Neo
 	//---------------------------------------------------------------------
 	void Terrain::DefaultGpuBufferAllocator::freeAllBuffers()
 	{
-		mFreePosBufList.clear();
-		mFreeDeltaBufList.clear();
+		// buffers still in use would be released under the terrain, rather keep them all
+		if (mStats.numInUse != 0)
+		{
+			_AST(0 && "Free the vertex data of all terrains first");
+			return;
+		}
+
+		for (size_t i = 0; i < mVertexBufs.size(); ++i)
+			delete mVertexBufs[i];
+		for (IBufMap::iterator i = mSharedIBufMap.begin(); i != mSharedIBufMap.end(); ++i)
+			delete i->second;
+
+		mVertexBufs.clear();
+		mFreeRanges.clear();
 		mSharedIBufMap.clear();
+
+		mStats.numPooled = 0;
+		mStats.bytesPooled = 0;
+		mStats.bytesShared = 0;
 	}
 	//---------------------------------------------------------------------
 	void Terrain::DefaultGpuBufferAllocator::warmStart(size_t numInstances, uint16 terrainSize, uint16 maxBatchSize,
-		uint16 minBatchSize)
+		uint16 minBatchSize, bool compact)
 	{
-		// TODO
+		VertexDataLayoutList layout;
+		Terrain::getVertexDataLayout(terrainSize, maxBatchSize, minBatchSize, layout);
+
+		const size_t vertexSize = Terrain::getVertexSize(compact);
+
+		for (size_t i = 0; i < layout.size(); ++i)
+		{
+			const VertexDataLayout& vd = layout[i];
+			const size_t numVertices = TerrainQuadTreeNode::_getNumVertices(vd.size, vd.treeDepthEnd - vd.treeDepthStart);
+			// every node at the start depth holds one set of this vertex data
+			const size_t numRanges = numInstances * ((size_t)1 << (2 * vd.treeDepthStart));
+
+			VRangeList& ranges = mFreeRanges[bucketKey(vertexSize, numVertices)];
 
+			while (ranges.size() < numRanges)
+			{
+				// the first range of a new buffer is handed out, pool it as well
+				VertexRange range = createVertexBuffer(vertexSize, numVertices);
+				ranges.push_back(range);
+				++mStats.numPreallocated;
+				++mStats.numPooled;
+				mStats.bytesPooled += vertexSize * numVertices;
+			}
+		}
+	}
+	//---------------------------------------------------------------------
+	void Terrain::DefaultGpuBufferAllocator::resetStats()
+	{
+		mStats.numHits = 0;
+		mStats.numMisses = 0;
+		mStats.numPreallocated = 0;
 	}
 	//---------------------------------------------------------------------
 	uint32 Terrain::DefaultGpuBufferAllocator::hashIndexBuffer(uint16 batchSize,
@@ -4490,6 +4826,46 @@ namespace Neo
 			mLodManager->updateToLodLevel(lodLevel);
 	}
 	//---------------------------------------------------------------------
+	size_t Terrain::getMemoryUsage() const
+	{
+		const size_t numVertices = (size_t)mSize * mSize;
+		size_t bytes = 0;
+
+		if (mHeightData)
+			bytes += numVertices * sizeof(float);
+		if (mDeltaData)
+			bytes += numVertices * sizeof(float);
+
+		// RGBA8 blend maps, on the CPU until load() and on the GPU afterwards
+		const size_t blendMapBytes = (size_t)mLayerBlendMapSize * mLayerBlendMapSize * 4;
+		bytes += (mCpuBlendMapStorage.size() + mBlendTextureList.size()) * blendMapBytes;
+
+		if (mCpuTerrainNormalMap)
+			bytes += numVertices * 4;
+		if (mTerrainNormalMap)
+			bytes += numVertices * 4;
+		if (mCpuLightmapStorage)
+			bytes += (size_t)mLightmapSizeActual * mLightmapSizeActual;
+		if (mLightmap)
+			bytes += (size_t)mLightmapSizeActual * mLightmapSizeActual;
+
+		int highestLod = getHighestLodLoaded();
+		const int targetLod = getTargetLodLevel();
+		if (targetLod >= 0 && (highestLod < 0 || targetLod < highestLod))
+			highestLod = targetLod;
+
+		if (highestLod >= 0 && highestLod < mNumLodLevels)
+		{
+			const size_t res = getResolutionAtLod((uint16)highestLod);
+			bytes += res * res * getVertexSize(mUseCompactVertices);
+			// the CPU copy stays for editing
+			if (mEditable)
+				bytes += res * res * (sizeof(STerrainPosVertex) + sizeof(STerrainDeltaVertex));
+		}
+
+		return bytes;
+	}
+	//---------------------------------------------------------------------
 	void Terrain::removeFromNeighbours()
 	{
 		// We are reading the list of neighbours here
@@ -1,5 +1,10 @@
 #include "stdafx.h"
 #include "Terrain/TerrainGroup.h"
+#include "Terrain/TerrainPaging.h"
+#include "Terrain/TerrainRenderQueue.h"
+#include "Renderer.h"
+#include "AABB.h"
+#include "JobSystem.h"
 
 namespace Neo
 {
@@ -8,6 +13,9 @@ namespace Neo
 	const uint16 TerrainGroup::CHUNK_VERSION = 1;
 	uint32 TerrainGroup::LoadRequest::loadingTaskNum = 0;
 
+	// Rays tested by one job of the batched rayIntersects
+	static const uint32 RAY_QUERY_GRAIN = 64;
+
 	//---------------------------------------------------------------------
 	TerrainGroup::TerrainGroup(Terrain::Alignment align, uint16 terrainSize, float terrainWorldSize)
 		: mAlignment(align)
@@ -16,6 +24,9 @@ namespace Neo
 		, mOrigin(VEC3::ZERO)
 		, mFilenamePrefix("terrain")
 		, mFilenameExtension("dat")
+		, mPaging(nullptr)
+		, mRenderQueue(nullptr)
+		, mWireframe(false)
 	{
 		mDefaultImportData.terrainAlign = align;
 		mDefaultImportData.terrainSize = terrainSize;
@@ -38,6 +49,9 @@ namespace Neo
 		, mOrigin(VEC3::ZERO)
 		, mFilenamePrefix("terrain")
 		, mFilenameExtension("dat")
+		, mPaging(nullptr)
+		, mRenderQueue(nullptr)
+		, mWireframe(false)
 	{
 		mDefaultImportData.terrainAlign = mAlignment;
 		mDefaultImportData.terrainSize = 0;
@@ -67,6 +81,8 @@ namespace Neo
 		//	Root::getSingleton().getWorkQueue()->processResponses();
 		//}
 
+		SAFE_DELETE(mPaging);
+		SAFE_DELETE(mRenderQueue);
 		removeAllTerrains();
 
 		//WorkQueue* wq = Root::getSingleton().getWorkQueue();
@@ -80,17 +96,86 @@ namespace Neo
 		for (TerrainSlotMap::iterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
 		{
 			Terrain* t = i->second->instance;
-			t->UpdateLod();
+			if (t && t->isLoaded())
+				t->UpdateLod();
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void TerrainGroup::CalculateLod()
+	{
+		for (TerrainSlotMap::iterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
+		{
+			Terrain* t = i->second->instance;
+			if (t && t->isLoaded())
+				t->CalculateLod();
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void TerrainGroup::CreateLodEntities()
+	{
+		for (TerrainSlotMap::iterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
+		{
+			Terrain* t = i->second->instance;
+			if (t && t->isLoaded())
+				t->CreateLodEntities();
 		}
 	}
 	//---------------------------------------------------------------------
 	void TerrainGroup::Render()
 	{
+		if (!mRenderQueue)
+			mRenderQueue = new TerrainRenderQueue;
+
+		mRenderQueue->clear();
+
 		for (TerrainSlotMap::iterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
 		{
 			Terrain* t = i->second->instance;
-			t->Render();
+			if (t && t->isLoaded())
+				mRenderQueue->addTerrain(t);
 		}
+
+		mRenderQueue->render(g_env.pRenderer->GetRenderSys());
+	}
+	//---------------------------------------------------------------------
+	void TerrainGroup::enableWireframe(bool b)
+	{
+		mWireframe = b;
+
+		// the terrains still loading get it too, their material applies it once created
+		for (TerrainSlotMap::iterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
+		{
+			Terrain* t = i->second->instance;
+			if (t)
+				t->enableWireframe(b);
+		}
+	}
+	//---------------------------------------------------------------------
+	Terrain::LodStats TerrainGroup::getLodStats() const
+	{
+		Terrain::LodStats stats;
+		for (TerrainSlotMap::const_iterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
+		{
+			const Terrain* t = i->second->instance;
+			if (t && t->isLoaded())
+				stats += t->getLodStats();
+		}
+		return stats;
+	}
+	//------------------------------------------------------------------------------------
+	void TerrainGroup::UpdatePaging(const Camera& cam)
+	{
+		processLoadResponses();
+
+		if (mPaging)
+			mPaging->update(cam);
+	}
+	//---------------------------------------------------------------------
+	void TerrainGroup::setPaging(TerrainPaging* paging)
+	{
+		if (mPaging != paging)
+			SAFE_DELETE(mPaging);
+		mPaging = paging;
 	}
 
 	//---------------------------------------------------------------------
@@ -255,24 +340,23 @@ namespace Neo
 					else
 						filename = generateFilename(slot->x, slot->y);
 
-					_AST(0);
-			//		t->save(filename);
+					t->save(filename);
 				}
 			}	
 		}
 	}
 	//---------------------------------------------------------------------
-	void TerrainGroup::loadTerrain(long x, long y, bool synchronous /*= false*/)
+	void TerrainGroup::loadTerrain(long x, long y, bool synchronous /*= false*/, int lodLevel /*= 0*/)
 	{
 		TerrainSlot* slot = getTerrainSlot(x, y, false);
 		if (slot)
 		{
-			loadTerrainImpl(slot, synchronous);
+			loadTerrainImpl(slot, synchronous, lodLevel);
 		}
 
 	}
 	//---------------------------------------------------------------------
-	void TerrainGroup::loadTerrainImpl(TerrainSlot* slot, bool synchronous)
+	void TerrainGroup::loadTerrainImpl(TerrainSlot* slot, bool synchronous, int lodLevel)
 	{
 		if (!slot->instance && (!slot->def.filename.empty() || slot->def.importData))
 		{
@@ -280,76 +364,121 @@ namespace Neo
 			slot->instance = new Terrain;
 			// Use shared pool of buffers
 			slot->instance->setGpuBufferAllocator(&mBufferAllocator);
+			slot->instance->enableWireframe(mWireframe);
+			slot->loadLodLevel = lodLevel;
 
-			//LoadRequest req;
-			//req.slot = slot;
-			//req.origin = this;
-			//++LoadRequest::loadingTaskNum;
-			//Root::getSingleton().getWorkQueue()->addRequest(
-			//	mWorkQueueChannel, WORKQUEUE_LOAD_REQUEST, 
-			//	Any(req), 0, synchronous);
+			if (synchronous)
+			{
+				handleLoadRequest(slot);
+				handleLoadResponse(slot, true);
+			}
+			else
+			{
+				// prepare only fills CPU data of the new instance, the GPU part waits for processLoadResponses().
+				// It reads the file, so it goes to a background thread the frame's job waits never run
+				mLoadingSlots.push_back(slot);
+				JobSystem::GetSingleton().RunBackground([this, slot]() { handleLoadRequest(slot); }, &slot->prepareJobs);
+			}
+		}
+	}
+	//---------------------------------------------------------------------
+	void TerrainGroup::handleLoadRequest(TerrainSlot* slot)
+	{
+		TerrainSlotDefinition& def = slot->def;
+		Terrain* t = slot->instance;
+		_AST(t && "Terrain instance should have been constructed in the main thread");
 
-			TerrainSlotDefinition& def = slot->def;
-			Terrain* t = slot->instance;
-			_AST(t && "Terrain instance should have been constructed in the main thread");
+		slot->prepareSucceeded = false;
 
-			try
+		try
+		{
+			if (!def.filename.empty())
 			{
-				//if (!def.filename.empty())
-				//	t->prepare(def.filename);
-				//else
-				{
-					_AST(def.importData && "No import data or file name");
-					t->prepare(*def.importData);
-					// if this worked, we can destroy the input data to save space
-					def.freeImportData();
-				}
-	
+				slot->prepareSucceeded = t->prepare(def.filename);
 			}
-			catch (std::exception&)
+			else
 			{
-				_AST(0);
+				_AST(def.importData && "No import data or file name");
+				slot->prepareSucceeded = t->prepare(*def.importData);
+				// if this worked, we can destroy the input data to save space
+				def.freeImportData();
 			}
 
-			// do final load now we've prepared in the background
-			// we must set the position
-			t->setPosition(getTerrainSlotPosition(slot->x, slot->y));
+		}
+		catch (std::exception&)
+		{
+			_AST(0);
+		}
+	}
+	//---------------------------------------------------------------------
+	void TerrainGroup::handleLoadResponse(TerrainSlot* slot, bool synchronous)
+	{
+		if (!slot->prepareSucceeded)
+		{
+			_AST(0 && "Failed to prepare the terrain");
+			slot->freeInstance();
+			return;
+		}
+
+		Terrain* t = slot->instance;
+
+		// do final load now we've prepared in the background
+		// we must set the position
+		t->setPosition(getTerrainSlotPosition(slot->x, slot->y));
 
-			// the LOD will be auto-updated, then load lowest LOD
-			//if (mAutoUpdateLod)
-			//	t->load(-1, false);
-			//else
-				t->load(0, true);
+		// a terrain from a file shows its coarsest LOD now and streams the rest in unless asked to wait
+		const int lodLevel = std::min(slot->loadLodLevel, t->getNumLodLevels() - 1);
+		t->load(lodLevel, synchronous || slot->def.filename.empty());
 
-			// hook up with neighbours
-			for (int i = -1; i <= 1; ++i)
+		// hook up with neighbours
+		for (int i = -1; i <= 1; ++i)
+		{
+			for (int j = -1; j <= 1; ++j)
 			{
-				for (int j = -1; j <= 1; ++j)
-				{
-					if (i != 0 || j != 0)
-						connectNeighbour(slot, i, j);
-				}
+				if (i != 0 || j != 0)
+					connectNeighbour(slot, i, j);
+			}
 
+		}
+	}
+	//---------------------------------------------------------------------
+	void TerrainGroup::processLoadResponses()
+	{
+		for (size_t i = 0; i < mLoadingSlots.size(); )
+		{
+			TerrainSlot* slot = mLoadingSlots[i];
+			if (slot->prepareJobs.nPending > 0)
+			{
+				++i;
+				continue;
 			}
+
+			mLoadingSlots[i] = mLoadingSlots.back();
+			mLoadingSlots.pop_back();
+
+			// The instance may have been unloaded, or unloaded and loaded again, while it was prepared
+			if (slot->instance && !slot->instance->isLoaded())
+				handleLoadResponse(slot, false);
 		}
 	}
 	//---------------------------------------------------------------------
-	//void TerrainGroup::increaseLodLevel(long x, long y, bool synchronous /* = false */)
-	//{
-	//	TerrainSlot* slot = getTerrainSlot(x, y, false);
-	//	if (slot && slot->instance)
-	//	{
-	//		slot->instance->increaseLodLevel(synchronous);
-	//	}
-	//}
-	//void TerrainGroup::decreaseLodLevel(long x, long y)
-	//{
-	//	TerrainSlot* slot = getTerrainSlot(x, y, false);
-	//	if (slot && slot->instance)
-	//	{
-	//		slot->instance->decreaseLodLevel();
-	//	}
-	//}
+	void TerrainGroup::increaseLodLevel(long x, long y, bool synchronous /* = false */)
+	{
+		TerrainSlot* slot = getTerrainSlot(x, y, false);
+		if (slot && slot->instance && slot->instance->isLoaded())
+		{
+			slot->instance->increaseLodLevel(synchronous);
+		}
+	}
+	//---------------------------------------------------------------------
+	void TerrainGroup::decreaseLodLevel(long x, long y)
+	{
+		TerrainSlot* slot = getTerrainSlot(x, y, false);
+		if (slot && slot->instance && slot->instance->isLoaded())
+		{
+			slot->instance->decreaseLodLevel();
+		}
+	}
 	////---------------------------------------------------------------------
 	//void TerrainGroup::setAutoUpdateLod(TerrainAutoUpdateLod* updater)
 	//{
@@ -397,6 +526,7 @@ namespace Neo
 		TerrainSlotMap::iterator i = mTerrainSlots.find(key);
 		if (i != mTerrainSlots.end())
 		{
+			mLoadingSlots.erase(std::remove(mLoadingSlots.begin(), mLoadingSlots.end(), i->second), mLoadingSlots.end());
 			delete i->second;
 			mTerrainSlots.erase(i);
 		}
@@ -409,6 +539,7 @@ namespace Neo
 			delete i->second;
 		}
 		mTerrainSlots.clear();
+		mLoadingSlots.clear();
 		// Also clear buffer pools, if we're clearing completely may not be representative
 		mBufferAllocator.freeAllBuffers();
 	}
@@ -459,142 +590,135 @@ namespace Neo
 	//---------------------------------------------------------------------
 	TerrainGroup::RayResult TerrainGroup::rayIntersects(const RAY& ray, float distanceLimit /* = 0*/) const 
 	{
-		_AST(0);
-		return RayResult(false, 0, VEC3::ZERO);
-
-		//long curr_x, curr_z;
-		//convertWorldPositionToTerrainSlot(ray.getOrigin(), &curr_x, &curr_z);
-		//TerrainSlot* slot = getTerrainSlot(curr_x, curr_z);
-		//RayResult result(false, 0, VEC3::ZERO);
-
-		//VEC3 tmp, localRayDir, centreOrigin, offset;
-		//// get the middle of the current tile
-		//convertTerrainSlotToWorldPosition(curr_x, curr_z, &centreOrigin);
-		//offset = ray.getOrigin() - centreOrigin;
-		//localRayDir = ray.getDirection();
-		//switch (getAlignment())
-		//{
-		//case Terrain::ALIGN_X_Y:
-		//	std::swap(localRayDir.y, localRayDir.z);
-		//	std::swap(offset.y, offset.z);
-		//	break;
-		//case Terrain::ALIGN_Y_Z:
-		//	// x = z, z = y, y = -x
-		//	tmp.x = localRayDir.z; 
-		//	tmp.z = localRayDir.y; 
-		//	tmp.y = -localRayDir.x; 
-		//	localRayDir = tmp;
-		//	tmp.x = offset.z; 
-		//	tmp.z = offset.y; 
-		//	tmp.y = -offset.x; 
-		//	offset = tmp;
-		//	break;
-		//case Terrain::ALIGN_X_Z:
-		//	// already in X/Z but values increase in -Z
-		//	localRayDir.z = -localRayDir.z;
-		//	offset.z = -offset.z;
-		//	break;
-		//}
-		//// Normalise the offset  based on the world size of a square, and rebase to the bottom left
-		//offset /= mTerrainWorldSize;
-		//offset += 0.5f;
-		//// this is our counter moving away from the 'current' square
-		//VEC3 inc(Math::Abs(localRayDir.x), Math::Abs(localRayDir.y), Math::Abs(localRayDir.z));
-		//long xdir = localRayDir.x > 0.0f ? 1 : -1;
-		//long zdir = localRayDir.z > 0.0f ? 1 : -1;
-
-		//// We're always counting from 0 to 1 regardless of what direction we're heading
-		//if (xdir < 0)
-		//	offset.x = 1.0f - offset.x;
-		//if (zdir < 0)
-		//	offset.z = 1.0f - offset.z;
-
-		//// find next slot
-		//bool keepSearching = true;
-		//int numGaps = 0;
-		//while(keepSearching)
-		//{
-		//	if (Math::RealEqual(inc.x, 0.0f) && Math::RealEqual(inc.z, 0.0f))
-		//		keepSearching = false;
-
-  //          while ( (!slot || !slot->instance) && keepSearching)
-		//	{
-		//		++numGaps;
-		//		/// if we don't find any filled slot in 6 traversals, give up
-		//		if (numGaps > 6)
-		//		{
-		//			keepSearching = false;
-		//			break;
-		//		}
-		//		// find next slot
-		//		VEC3 oldoffset = offset;
-		//		while (offset.x < 1.0f && offset.z < 1.0f)
-		//			offset += inc;
-		//		if (offset.x >= 1.0f && offset.z >= 1.0f)
-		//		{
-		//			// We crossed a corner, need to figure out which we passed first
-		//			float diffz = 1.0f - oldoffset.z;
-		//			float diffx = 1.0f - oldoffset.x;
-		//			float distz = diffz / inc.z;
-		//			float distx = diffx / inc.x;
-		//			if (distx < distz)
-		//			{
-		//				curr_x += xdir;
-		//				offset.x -= 1.0f;
-		//			}
-		//			else
-		//			{
-		//				curr_z += zdir;
-		//				offset.z -= 1.0f;
-		//			}
-
-		//		}
-		//		else if (offset.x >= 1.0f)
-		//		{
-		//			curr_x += xdir;
-		//			offset.x -= 1.0f;
-		//		}
-		//		else if (offset.z >= 1.0f)
-		//		{
-		//			curr_z += zdir;
-		//			offset.z -= 1.0f;
-		//		}
-		//		if (distanceLimit)
-		//		{
-		//			VEC3 worldPos;
-		//			convertTerrainSlotToWorldPosition(curr_x, curr_z, &worldPos);
-		//			if (ray.getOrigin().distance(worldPos) > distanceLimit)
-		//			{
-		//				keepSearching = false;
-		//				break;
-		//			}
-		//		}
-		//		slot = getTerrainSlot(curr_x, curr_z);
-		//	}
-		//	if (slot && slot->instance)
-		//	{
-		//		numGaps = 0;
-		//		// don't cascade into neighbours
-		//		std::pair<bool, VEC3> raypair = slot->instance->rayIntersects(ray, false, distanceLimit);
-		//		if (raypair.first)
-		//		{
-		//			keepSearching = false;
-		//			result.hit = true;
-		//			result.terrain = slot->instance;
-		//			result.position = raypair.second;
-		//		}
-		//		else
-		//		{
-		//			// not this one, trigger search for another slot
-		//			slot = 0;
-		//		}
-		//	}
+		long minX, minY, maxX, maxY;
+		if (!getLoadedSlotRange(&minX, &minY, &maxX, &maxY))
+			return RayResult(false, 0, VEC3::ZERO);
 
-		//}
+		return rayIntersectsSlots(ray, distanceLimit, minX, minY, maxX, maxY);
+	}
+	//---------------------------------------------------------------------
+	void TerrainGroup::rayIntersects(const RAY* pRays, uint32 nRays, RayResult* pResults, float distanceLimit /* = 0*/) const
+	{
+		long minX, minY, maxX, maxY;
+		if (!getLoadedSlotRange(&minX, &minY, &maxX, &maxY))
+		{
+			std::fill(pResults, pResults + nRays, RayResult(false, 0, VEC3::ZERO));
+			return;
+		}
+
+		JobSystem::GetSingleton().ParallelFor(nRays, RAY_QUERY_GRAIN, [=](uint32 nBegin, uint32 nEnd)
+		{
+			for (uint32 i = nBegin; i < nEnd; ++i)
+			{
+				pResults[i] = rayIntersectsSlots(pRays[i], distanceLimit, minX, minY, maxX, maxY);
+			}
+		});
+	}
+	//---------------------------------------------------------------------
+	bool TerrainGroup::getLoadedSlotRange(long* minX, long* minY, long* maxX, long* maxY) const
+	{
+		bool bAny = false;
+
+		for (ConstTerrainIterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
+		{
+			const TerrainSlot* slot = i->second;
+			if (!slot->instance || !slot->instance->isLoaded())
+				continue;
+
+			if (!bAny)
+			{
+				*minX = *maxX = slot->x;
+				*minY = *maxY = slot->y;
+				bAny = true;
+			}
+			else
+			{
+				*minX = std::min(*minX, slot->x);
+				*minY = std::min(*minY, slot->y);
+				*maxX = std::max(*maxX, slot->x);
+				*maxY = std::max(*maxY, slot->y);
+			}
+		}
+
+		return bAny;
+	}
+	//---------------------------------------------------------------------
+	TerrainGroup::RayResult TerrainGroup::rayIntersectsSlots(const RAY& ray, float distanceLimit,
+		long minX, long minY, long maxX, long maxY) const
+	{
+		RayResult result(false, 0, VEC3::ZERO);
+
+		// Ray in slot space, slot (x, y) covers [x, x + 1] * [y, y + 1]
+		VEC3 origin, dir;
+		Terrain::convertWorldToTerrainAxes(mAlignment, ray.m_origin - mOrigin, &origin);
+		Terrain::convertWorldToTerrainAxes(mAlignment, ray.m_dir, &dir);
+
+		const float fInvSize = 1.0f / mTerrainWorldSize;
+		const RAY slotRay(VEC3(origin.x * fInvSize + 0.5f, origin.y * fInvSize + 0.5f, 0), VEC3(dir.x * fInvSize, dir.y * fInvSize, 0));
+
+		// Only walk the slots that can hold a terrain
+		AABB range;
+		range.m_minCorner = VEC3((float)minX, (float)minY, -1);
+		range.m_maxCorner = VEC3((float)maxX + 1, (float)maxY + 1, 1);
 
+		float tNear, tFar;
+		if (!slotRay.Intersects(range, tNear, tFar))
+			return result;
 
-		//return result;
+		const float fDirLength = ray.m_dir.GetLength();
+		if (distanceLimit > 0 && fDirLength > 0)
+		{
+			tFar = std::min(tFar, distanceLimit / fDirLength);
+			if (tNear > tFar)
+				return result;
+		}
+
+		const VEC3 start = slotRay.GetPoint(tNear);
+		long x = Clamp((long)floorf(start.x), minX, maxX);
+		long y = Clamp((long)floorf(start.y), minY, maxY);
+
+		const long stepX = slotRay.m_dir.x > 0 ? 1 : -1;
+		const long stepY = slotRay.m_dir.y > 0 ? 1 : -1;
+		const float tDeltaX = slotRay.m_dir.x != 0 ? fabsf(1.0f / slotRay.m_dir.x) : FLT_MAX;
+		const float tDeltaY = slotRay.m_dir.y != 0 ? fabsf(1.0f / slotRay.m_dir.y) : FLT_MAX;
+		float tNextX = slotRay.m_dir.x != 0 ? (x + (stepX > 0 ? 1 : 0) - slotRay.m_origin.x) / slotRay.m_dir.x : FLT_MAX;
+		float tNextY = slotRay.m_dir.y != 0 ? (y + (stepY > 0 ? 1 : 0) - slotRay.m_origin.y) / slotRay.m_dir.y : FLT_MAX;
+
+		// Slots in the order the ray passes them, each terrain does its own exact test
+		for (;;)
+		{
+			const TerrainSlot* slot = getTerrainSlot(x, y);
+			if (slot && slot->instance && slot->instance->isLoaded())
+			{
+				std::pair<bool, VEC3> hit = slot->instance->rayIntersects(ray, false, distanceLimit);
+				if (hit.first)
+				{
+					result.hit = true;
+					result.terrain = slot->instance;
+					result.position = hit.second;
+					break;
+				}
+			}
 
+			if (std::min(tNextX, tNextY) > tFar)
+				break;
+
+			if (tNextX < tNextY)
+			{
+				x += stepX;
+				tNextX += tDeltaX;
+			}
+			else
+			{
+				y += stepY;
+				tNextY += tDeltaY;
+			}
+
+			if (x < minX || x > maxX || y < minY || y > maxY)
+				break;
+		}
+
+		return result;
 	}
 	//---------------------------------------------------------------------
 	void TerrainGroup::boxIntersects(const AABB& box, TerrainList* resultList) const
@@ -653,7 +777,7 @@ namespace Neo
 	{
 		for (TerrainSlotMap::const_iterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
 		{
-			if (i->second->instance && i->second->instance->isDerivedDataUpdateInProgress())
+			if (i->second->instance && i->second->instance->isLoaded() && i->second->instance->isDerivedDataUpdateInProgress())
 				return true;
 		}
 		return false;
@@ -799,13 +923,10 @@ namespace Neo
 	//---------------------------------------------------------------------
 	STRING TerrainGroup::generateFilename(long x, long y) const
 	{
-		_AST(0);
-		return "";
-		//StringUtil::StrStreamType str;
-		//str << mFilenamePrefix << "_" << 
-		//	std::setw(8) << std::setfill('0') << std::hex << packIndex(x, y) << 
-		//	"." << mFilenameExtension;
-		//return str.str();
+		char szBuf[16];
+		sprintf_s(szBuf, sizeof(szBuf), "_%08x.", packIndex(x, y));
+
+		return mFilenamePrefix + szBuf + mFilenameExtension;
 	}
 	//---------------------------------------------------------------------
 	VEC3 TerrainGroup::getTerrainSlotPosition(long x, long y)
@@ -844,7 +965,7 @@ namespace Neo
 	{
 		for (TerrainSlotMap::iterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
 		{
-			if (i->second->instance)
+			if (i->second->instance && i->second->instance->isLoaded())
 				i->second->instance->freeTemporaryResources();
 		}
 	}
@@ -853,7 +974,7 @@ namespace Neo
 	{
 		for (TerrainSlotMap::iterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
 		{
-			if (i->second->instance)
+			if (i->second->instance && i->second->instance->isLoaded())
 				i->second->instance->update();
 		}
 	}
@@ -862,7 +983,7 @@ namespace Neo
 	{
 		for (TerrainSlotMap::iterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
 		{
-			if (i->second->instance)
+			if (i->second->instance && i->second->instance->isLoaded())
 				i->second->instance->updateGeometry();
 		}
 	}
@@ -871,8 +992,21 @@ namespace Neo
 	{
 		for (TerrainSlotMap::iterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
 		{
-			if (i->second->instance)
-				i->second->instance->updateDerivedData();
+			if (i->second->instance && i->second->instance->isLoaded())
+				i->second->instance->updateDerivedData(synchronous, typeMask);
+		}
+	}
+	//---------------------------------------------------------------------
+	void TerrainGroup::dirtyLightmaps()
+	{
+		for (TerrainSlotMap::iterator i = mTerrainSlots.begin(); i != mTerrainSlots.end(); ++i)
+		{
+			Terrain* t = i->second->instance;
+			if (t && t->isLoaded() && t->getLightmap())
+			{
+				t->dirtyLightmap();
+				t->updateDerivedData(false, Terrain::DERIVED_DATA_LIGHTMAP);
+			}
 		}
 	}
 	//---------------------------------------------------------------------
@@ -1035,6 +1169,8 @@ namespace Neo
 	//---------------------------------------------------------------------
 	void TerrainGroup::TerrainSlot::freeInstance()
 	{
+		// the instance may still be prepared by a job
+		JobSystem::GetSingleton().Wait(&prepareJobs);
 		delete instance;
 		instance = 0;
 	}
@@ -2,6 +2,7 @@
 #include "Terrain/TerrainLodManager.h"
 #include "Terrain/Terrain.h"
 #include "Terrain/TerrainQuadTreeNode.h"
+#include "StreamSerialiser.h"
 
 namespace Neo
 {
@@ -11,19 +12,19 @@ namespace Neo
 
 	TerrainLodManager::TerrainLodManager(Terrain* t)
 		: mTerrain(t)
+		, mStreamOffset(0)
+		, mLoadRequest(0, 0, 0, 0)
 	{
 		init();
-		//mDataStream = stream;
-		//mStreamOffset = mDataStream.isNull() ? 0 : mDataStream->tell();
 	}
 
-	TerrainLodManager::TerrainLodManager(Terrain* t, const STRING& filename)
-		: mTerrain(t), mStreamOffset(0)
+	TerrainLodManager::TerrainLodManager(Terrain* t, const STRING& filename, uint32 nOffset)
+		: mTerrain(t)
+		, mFilename(filename)
+		, mStreamOffset(nOffset)
+		, mLoadRequest(0, 0, 0, 0)
 	{
 		init();
-
-		//if(!filename.empty() && filename.length() > 0)
-		//	mDataStream = Root::getSingleton().openFileStream(filename, mTerrain->_getDerivedResourceGroup());
 	}
 
 	void TerrainLodManager::init()
@@ -33,111 +34,104 @@ namespace Neo
 		mTargetLodLevel = -1;
 		mIncreaseLodLevelInProgress = false;
 		mLastRequestSynchronous = false;
+		mLoadSucceeded = false;
 		mLodInfoTable = 0;
-
-		//WorkQueue* wq = Root::getSingleton().getWorkQueue();
-		//mWorkQueueChannel = wq->getChannel("Ogre/TerrainLodManager");
-		//wq->addRequestHandler(mWorkQueueChannel, this);
-		//wq->addResponseHandler(mWorkQueueChannel, this);
 	}
 
 	TerrainLodManager::~TerrainLodManager()
 	{
-		waitForDerivedProcesses();
-		//WorkQueue* wq = Root::getSingleton().getWorkQueue();
-		//wq->removeRequestHandler(mWorkQueueChannel, this);
-		//wq->removeResponseHandler(mWorkQueueChannel, this);
+		// Only let the job finish, the terrain is being torn down so nothing is loaded to the GPU
+		JobSystem::GetSingleton().Wait(&mLoadJobs);
+		mIncreaseLodLevelInProgress = false;
 
 		if (mLodInfoTable)
 			delete []mLodInfoTable;
 	}
+	//---------------------------------------------------------------------
+	void TerrainLodManager::handleRequest()
+	{
+		const LoadLodRequest& lreq = mLoadRequest;
+
+		// read data from file into temporary height & delta buffers, the terrain
+		// is only touched by the main thread in handleResponse()
+		mLoadSucceeded = true;
+		if (lreq.currentPreparedLod > lreq.requestedLod)
+			mLoadSucceeded = readLodData(lreq.currentPreparedLod - 1, lreq.requestedLod, mLoadedLods);
+	}
+	//---------------------------------------------------------------------
+	void TerrainLodManager::handleResponse()
+	{
+		const LoadLodRequest lreq = mLoadRequest;
+		LodsData lods;
+		lods.swap(mLoadedLods);
+
+		mIncreaseLodLevelInProgress = false;
+
+		if (!mLoadSucceeded)
+		{
+			_AST(0 && "Failed to prepare and load terrain LOD");
+			return;
+		}
 
-	//bool TerrainLodManager::canHandleRequest(const WorkQueue::Request* req, const WorkQueue* srcQ)
-	//{
-	//	LoadLodRequest lreq = any_cast<LoadLodRequest>(req->getData());
-	//	if (lreq.requestee != this)
-	//		return false;
-	//	return RequestHandler::canHandleRequest(req, srcQ);
-	//}
-	////---------------------------------------------------------------------
-	//bool TerrainLodManager::canHandleResponse(const WorkQueue::Response* res, const WorkQueue* srcQ)
-	//{
-	//	LoadLodRequest lreq = any_cast<LoadLodRequest>(res->getRequest()->getData());
-	//	return (lreq.requestee == this);
-	//}
-
-	//WorkQueue::Response* TerrainLodManager::handleRequest(const WorkQueue::Request* req, const WorkQueue* srcQ)
-	//{
-	//	LoadLodRequest lreq = any_cast<LoadLodRequest>(req->getData());
-	//	// read data from file into temporary height & delta buffer
-	//	try {
-	//		if(mHighestLodPrepared>mTargetLodLevel)
-	//			readLodData(mHighestLodPrepared-1, mTargetLodLevel);
-	//	} catch (Exception& e) {
-	//		return OGRE_NEW WorkQueue::Response(req, false, Any(), e.getFullDescription());
-	//	}
-
-	//	int lastTreeStart = -1;
-	//	for( int level=mHighestLodLoaded-1; level>=mTargetLodLevel; --level )
-	//	{
-	//		LodInfo& lodinfo = getLodInfo(level);
-	//		// skip re-assign
-	//		if(lastTreeStart != (int)lodinfo.treeStart)
-	//		{
-	//			mTerrain->getQuadTree()->assignVertexData(lodinfo.treeStart, lodinfo.treeEnd,
-	//					lodinfo.resolution, lodinfo.size);
-	//			lastTreeStart = lodinfo.treeStart;
-	//		}
-	//	}
-	//	return OGRE_NEW WorkQueue::Response(req, true, Any());
-	//}
-
- //   void TerrainLodManager::handleResponse(const WorkQueue::Response* res, const WorkQueue* srcQ)
-	//{
-	//	const WorkQueue::Request* req = res->getRequest();
-	//	// No response data, just request
-	//	LoadLodRequest lreq = any_cast<LoadLodRequest>(req->getData());
-
-	//	mIncreaseLodLevelInProgress = false;
-
-	//	if (res->succeeded())
-	//	{
-	//		// no others update LOD status
-	//		if(mHighestLodPrepared == mHighestLodPrepared && mHighestLodLoaded == mHighestLodLoaded )
-	//		{
-	//			if( mTargetLodLevel < mHighestLodPrepared )
-	//				mHighestLodPrepared = mTargetLodLevel;
-
-	//			int lastTreeStart = -1;
-	//			for( int level = mHighestLodLoaded-1; level>=mTargetLodLevel && level>=mTargetLodLevel; --level )
-	//			{
-	//				LodInfo& lodinfo = getLodInfo(level);
-	//				// skip re-load
-	//				if(lastTreeStart != (int)lodinfo.treeStart)
-	//				{
-	//					mTerrain->getQuadTree()->load(lodinfo.treeStart, lodinfo.treeEnd);
-	//					lastTreeStart = lodinfo.treeStart;
-	//				}
-	//				--mHighestLodLoaded;
-	//			}
-	//		}
-
-	//		// has streamed in new data, should update terrain
-	//		if(mHighestLodPrepared>mTargetLodLevel)
-	//		{
-	//			mTerrain->dirty();
-	//			mTerrain->updateGeometryWithoutNotifyNeighbours();
-	//		}
-
-	//		// there are new requests
-	//		if(mHighestLodLoaded != mTargetLodLevel)
-	//			updateToLodLevel(mTargetLodLevel,mLastRequestSynchronous);
-	//	}
-	//	else
-	//	{
-	//		LogManager::getSingleton().stream(LML_CRITICAL) << "Failed to prepare and load terrain LOD: " << res->getMessages();
-	//	}
-	//}
+		for (size_t level = 0; level < lods.size(); ++level)
+		{
+			if (!lods[level].empty())
+				fillBufferAtLod(level, &lods[level][0], lods[level].size());
+		}
+
+		int lastTreeStart = -1;
+		for (int level = lreq.currentLoadedLod - 1; level >= lreq.requestedLod; --level)
+		{
+			LodInfo& lodinfo = getLodInfo(level);
+			// skip re-assign
+			if (lastTreeStart != (int)lodinfo.treeStart)
+			{
+				mTerrain->getQuadTree()->assignVertexData(lodinfo.treeStart, lodinfo.treeEnd,
+					lodinfo.resolution, lodinfo.size);
+				lastTreeStart = lodinfo.treeStart;
+			}
+		}
+
+		// no others update LOD status
+		if (lreq.currentPreparedLod == mHighestLodPrepared && lreq.currentLoadedLod == mHighestLodLoaded)
+		{
+			if (lreq.requestedLod < mHighestLodPrepared)
+				mHighestLodPrepared = lreq.requestedLod;
+
+			int lastTreeStart = -1;
+			for (int level = mHighestLodLoaded - 1; level >= lreq.requestedLod; --level)
+			{
+				LodInfo& lodinfo = getLodInfo(level);
+				// skip re-load
+				if (lastTreeStart != (int)lodinfo.treeStart)
+				{
+					mTerrain->getQuadTree()->load(lodinfo.treeStart, lodinfo.treeEnd);
+					lastTreeStart = lodinfo.treeStart;
+				}
+				--mHighestLodLoaded;
+			}
+		}
+
+		// has streamed in new data, should update terrain
+		if (lreq.currentPreparedLod > lreq.requestedLod)
+		{
+			// Only the geometry changed, derived data came with the terrain so don't dirty() it
+			uint16 size = mTerrain->getSize();
+			mTerrain->mDirtyGeometryRect.Merge(Rect(0, 0, size, size));
+			mTerrain->updateGeometryWithoutNotifyNeighbours();
+		}
+
+		// there are new requests
+		if (mHighestLodLoaded != mTargetLodLevel)
+			updateToLodLevel(mTargetLodLevel, mLastRequestSynchronous);
+	}
+	//---------------------------------------------------------------------
+	void TerrainLodManager::processLoadResponse()
+	{
+		if (mIncreaseLodLevelInProgress && mLoadJobs.nPending == 0)
+			handleResponse();
+	}
+	//---------------------------------------------------------------------
 	void TerrainLodManager::buildLodInfoTable()
 	{
 		uint16 numLodLevels = mTerrain->getNumLodLevels();
@@ -233,73 +227,21 @@ namespace Neo
 		// need loading
 		if(mTargetLodLevel<mHighestLodLoaded)
 		{
-			// no task is running
+			// no task is running, otherwise its response issues the next one
 			if (!mIncreaseLodLevelInProgress)
 			{
 				mIncreaseLodLevelInProgress = true;
 
-				//LoadLodRequest req(this,mHighestLodPrepared,mHighestLodLoaded,mTargetLodLevel);
-				//Root::getSingleton().getWorkQueue()->addRequest(
-				//	mWorkQueueChannel, WORKQUEUE_LOAD_LOD_DATA_REQUEST,
-				//	Any(req), 0, synchronous);
-
-				// read data from file into temporary height & delta buffer
-				if (mHighestLodPrepared > mTargetLodLevel)
-				{
-					readLodData(mHighestLodPrepared - 1, mTargetLodLevel);
-				}
-
-				int lastTreeStart = -1;
-				for (int level = mHighestLodLoaded - 1; level >= mTargetLodLevel; --level)
-				{
-					LodInfo& lodinfo = getLodInfo(level);
-					// skip re-assign
-					if (lastTreeStart != (int)lodinfo.treeStart)
-					{
-						mTerrain->getQuadTree()->assignVertexData(lodinfo.treeStart, lodinfo.treeEnd,
-							lodinfo.resolution, lodinfo.size);
-						lastTreeStart = lodinfo.treeStart;
-					}
-				}
-
-				mIncreaseLodLevelInProgress = false;
-
-				// no others update LOD status
-				if (mHighestLodPrepared == mHighestLodPrepared && mHighestLodLoaded == mHighestLodLoaded)
-				{
-					if (mTargetLodLevel < mHighestLodPrepared)
-						mHighestLodPrepared = mTargetLodLevel;
-
-					int lastTreeStart = -1;
-					for (int level = mHighestLodLoaded - 1; level >= mTargetLodLevel && level >= mTargetLodLevel; --level)
-					{
-						LodInfo& lodinfo = getLodInfo(level);
-						// skip re-load
-						if (lastTreeStart != (int)lodinfo.treeStart)
-						{
-							mTerrain->getQuadTree()->load(lodinfo.treeStart, lodinfo.treeEnd);
-							lastTreeStart = lodinfo.treeStart;
-						}
-						--mHighestLodLoaded;
-					}
-				}
-
-				// has streamed in new data, should update terrain
-				if (mHighestLodPrepared > mTargetLodLevel)
-				{
-					mTerrain->dirty();
-					mTerrain->updateGeometryWithoutNotifyNeighbours();
-				}
-
-				// there are new requests
-				if (mHighestLodLoaded != mTargetLodLevel)
-					updateToLodLevel(mTargetLodLevel, mLastRequestSynchronous);
+				mLoadRequest = LoadLodRequest(this, mHighestLodPrepared, mHighestLodLoaded, mTargetLodLevel);
+				// reading the file takes a while, keep it out of the frame's job waits
+				JobSystem::GetSingleton().RunBackground([this]() { handleRequest(); }, &mLoadJobs);
 			}
-			else if(synchronous)
+
+			if(synchronous)
 				waitForDerivedProcesses();
 		}
-		// need unloading
-		else if(mTargetLodLevel>mHighestLodLoaded)
+		// need unloading, unless a load is touching the vertex data. Its response comes back here.
+		else if(mTargetLodLevel>mHighestLodLoaded && !mIncreaseLodLevelInProgress)
 		{
 			for( int level=mHighestLodLoaded; level<mTargetLodLevel; level++ )
 			{
@@ -314,71 +256,67 @@ namespace Neo
 	}
 
 	// save each LOD level separately compressed so seek is possible
-	//void TerrainLodManager::saveLodData(StreamSerialiser& stream, Terrain* terrain)
-	//{
-	//	uint16 numLodLevels = terrain->getNumLodLevels();
-
-	//	LodsData lods;
-	//	separateData(terrain->mHeightData, terrain->getSize(), numLodLevels, lods);
-	//	separateData(terrain->mDeltaData, terrain->getSize(), numLodLevels, lods);
-
-	//	for (int level = numLodLevels - 1; level >=0; level--)
-	//	{
-	//		stream.writeChunkBegin(TERRAINLODDATA_CHUNK_ID, TERRAINLODDATA_CHUNK_VERSION);
-	//		stream.startDeflate();
-	//		stream.write(&(lods[level][0]), lods[level].size());
-	//		stream.stopDeflate();
-	//		stream.writeChunkEnd(TERRAINLODDATA_CHUNK_ID);
-	//	}
-	//}
-
-	void TerrainLodManager::readLodData(uint16 lowerLodBound, uint16 higherLodBound)
+	void TerrainLodManager::saveLodData(StreamSerialiser& stream, Terrain* terrain)
+	{
+		uint16 numLodLevels = terrain->getNumLodLevels();
+
+		LodsData lods;
+		separateData(terrain->mHeightData, terrain->getSize(), numLodLevels, lods);
+		separateData(terrain->mDeltaData, terrain->getSize(), numLodLevels, lods);
+
+		for (int level = numLodLevels - 1; level >=0; level--)
+		{
+			stream.writeChunkBegin(TERRAINLODDATA_CHUNK_ID, TERRAINLODDATA_CHUNK_VERSION);
+			stream.writeCompressed(&(lods[level][0]), lods[level].size() * sizeof(float), sizeof(float));
+			stream.writeChunkEnd(TERRAINLODDATA_CHUNK_ID);
+		}
+	}
+	//---------------------------------------------------------------------
+	void TerrainLodManager::skipLodData(StreamSerialiser& stream, uint16 numLodLevels)
 	{
-	//	if(mDataStream.isNull()) // No file to read from
-	//		return;
-
-	//	uint16 numLodLevels = mTerrain->getNumLodLevels();
-	//	mDataStream->seek(mStreamOffset);
-	//	StreamSerialiser stream(mDataStream);
-
- //       const StreamSerialiser::Chunk *mainChunk = stream.readChunkBegin(Terrain::TERRAIN_CHUNK_ID, Terrain::TERRAIN_CHUNK_VERSION);
-
- //       if(mainChunk->version > 1)
- //       {
- //           // skip the general information
- //           stream.readChunkBegin(Terrain::TERRAINGENERALINFO_CHUNK_ID, Terrain::TERRAINGENERALINFO_CHUNK_VERSION);
- //           stream.readChunkEnd(Terrain::TERRAINGENERALINFO_CHUNK_ID);
-
- //           // skip the previous lod data
- //           for(int skip=numLodLevels-1-lowerLodBound; skip>0; skip--)
- //           {
- //               stream.readChunkBegin(TERRAINLODDATA_CHUNK_ID, TERRAINLODDATA_CHUNK_VERSION);
- //               stream.readChunkEnd(TERRAINLODDATA_CHUNK_ID);
- //           }
-
- //           // uncompress
- //           uint32 maxSize = 2 * mTerrain->getGeoDataSizeAtLod(higherLodBound);
- //           float *lodData = OGRE_ALLOC_T(float, maxSize, MEMCATEGORY_GENERAL);
-
- //           for(int level=lowerLodBound; level>=higherLodBound; level-- )
- //           {
- //               // both height data and delta data
- //               uint32 dataSize = 2 * mTerrain->getGeoDataSizeAtLod(level);
-
- //               // reach and read the target lod data
- //               const StreamSerialiser::Chunk *c = stream.readChunkBegin(TERRAINLODDATA_CHUNK_ID,
- //                       TERRAINLODDATA_CHUNK_VERSION);
- //               stream.startDeflate(c->length);
- //               stream.read(lodData, dataSize);
- //               stream.stopDeflate();
- //               stream.readChunkEnd(TERRAINLODDATA_CHUNK_ID);
-
- //               fillBufferAtLod(level, lodData, dataSize);
- //           }
- //           stream.readChunkEnd(Terrain::TERRAIN_CHUNK_ID);
-
- //           OGRE_FREE(lodData, MEMCATEGORY_GENERAL);
- //       }
+		for (int i = 0; i < numLodLevels; i++)
+		{
+			if (!stream.readChunkBegin(TERRAINLODDATA_CHUNK_ID, TERRAINLODDATA_CHUNK_VERSION))
+				break;
+			stream.readChunkEnd(TERRAINLODDATA_CHUNK_ID);
+		}
+	}
+	//---------------------------------------------------------------------
+	bool TerrainLodManager::readLodData(uint16 lowerLodBound, uint16 higherLodBound, LodsData& lods)
+	{
+		if(mFilename.empty()) // No file to read from
+			return true;
+
+		uint16 numLodLevels = mTerrain->getNumLodLevels();
+		StreamSerialiser stream(mFilename, StreamSerialiser::eMode_Read, mStreamOffset);
+
+		if (!stream.readChunkBegin(Terrain::TERRAIN_CHUNK_ID, Terrain::TERRAIN_CHUNK_VERSION))
+			return false;
+
+		// skip the general information
+		if (!stream.readChunkBegin(Terrain::TERRAINGENERALINFO_CHUNK_ID, Terrain::TERRAINGENERALINFO_CHUNK_VERSION))
+			return false;
+		stream.readChunkEnd(Terrain::TERRAINGENERALINFO_CHUNK_ID);
+
+		// skip the previous lod data
+		skipLodData(stream, numLodLevels - 1 - lowerLodBound);
+
+		lods.resize(numLodLevels);
+		for(int level=lowerLodBound; level>=higherLodBound; level-- )
+		{
+			// both height data and delta data
+			LodData& lodData = lods[level];
+			lodData.resize(2 * mTerrain->getGeoDataSizeAtLod(level));
+
+			// reach and read the target lod data
+			if (!stream.readChunkBegin(TERRAINLODDATA_CHUNK_ID, TERRAINLODDATA_CHUNK_VERSION))
+				return false;
+			if (!stream.readCompressed(&lodData[0], lodData.size() * sizeof(float)))
+				return false;
+			stream.readChunkEnd(TERRAINLODDATA_CHUNK_ID);
+		}
+
+		return true;
 	}
 	void TerrainLodManager::fillBufferAtLod(uint32 lodLevel, const float* data, uint32 dataSize )
 	{
@@ -407,13 +345,14 @@ namespace Neo
 				break;
 		}
 	}
+	//---------------------------------------------------------------------
 	void TerrainLodManager::waitForDerivedProcesses()
 	{
-		//while (mIncreaseLodLevelInProgress)
-		//{
-		//	// we need to wait for this to finish
-		//	OGRE_THREAD_SLEEP(50);
-		//	Root::getSingleton().getWorkQueue()->processResponses();
-		//}
+		// the response may issue the next load, so keep going until there's none
+		while (mIncreaseLodLevelInProgress)
+		{
+			JobSystem::GetSingleton().Wait(&mLoadJobs);
+			handleResponse();
+		}
 	}
 }
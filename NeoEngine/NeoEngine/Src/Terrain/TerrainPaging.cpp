@@ -0,0 +1,238 @@
+#include "stdafx.h"
+#include "Terrain/TerrainPaging.h"
+#include "Camera.h"
+#include "SceneManager.h"
+
+namespace Neo
+{
+	// How much nearer a slot straight in front of the camera counts than one beside it (and further one behind)
+	static const float VIEW_DIRECTION_WEIGHT = 0.25f;
+
+	//---------------------------------------------------------------------
+	TerrainPaging::TerrainPaging(TerrainGroup* group)
+		: mGroup(group)
+		, mLoadRadius(2.0f)
+		, mHoldRadius(3.0f)
+		, mLodDistance(1.5f)
+		, mMemoryBudget(0)
+		, mMemoryUsage(0)
+		, mTerrainMemory(0)
+		, mMaxConcurrentLoads(2)
+		, mCameraSlotX(0)
+		, mCameraSlotY(0)
+		, mPending(true)
+		, mWarmStarted(false)
+		, mWarmCompact(false)
+	{
+		_AST(mGroup);
+	}
+	//---------------------------------------------------------------------
+	TerrainPaging::~TerrainPaging()
+	{
+	}
+	//---------------------------------------------------------------------
+	void TerrainPaging::setPageRadius(float loadRadius, float holdRadius)
+	{
+		_AST(holdRadius >= loadRadius && "The hold radius is the load radius plus the hysteresis");
+		mLoadRadius = loadRadius;
+		mHoldRadius = std::max(holdRadius, loadRadius);
+		mPending = true;
+		mWarmStarted = false;
+	}
+	//---------------------------------------------------------------------
+	void TerrainPaging::setMemoryBudget(size_t bytes)
+	{
+		mMemoryBudget = bytes;
+		mPending = true;
+	}
+	//---------------------------------------------------------------------
+	void TerrainPaging::setMaxConcurrentLoads(uint32 n)
+	{
+		mMaxConcurrentLoads = std::max(n, 1u);
+		mPending = true;
+	}
+	//---------------------------------------------------------------------
+	void TerrainPaging::setLodDistance(float slots)
+	{
+		mLodDistance = slots;
+		mPending = true;
+	}
+	//---------------------------------------------------------------------
+	void TerrainPaging::update(const Camera& cam)
+	{
+		long camX, camY;
+		mGroup->convertWorldPositionToTerrainSlot(cam.GetPos(), &camX, &camY);
+
+		// Nothing changes until the camera enters another slot, or a load finishes
+		if (!mPending && mGroup->mLoadingSlots.empty() && camX == mCameraSlotX && camY == mCameraSlotY)
+			return;
+
+		mCameraSlotX = camX;
+		mCameraSlotY = camY;
+
+		// Terrains take the vertex format of the global options when they load, a changed one misses the pool
+		if (!mWarmStarted || mWarmCompact != g_env.pSceneMgr->GetTerrainOptions()->_getUseCompactVertices())
+			warmStart();
+
+		// Camera and view direction in slot units, slot (0,0) is centred at the origin
+		VEC3 camPos, camDir;
+		Terrain::convertWorldToTerrainAxes(mGroup->getAlignment(), cam.GetPos() - mGroup->getOrigin(), &camPos);
+		Terrain::convertWorldToTerrainAxes(mGroup->getAlignment(), cam.GetDirection(), &camDir);
+		camPos /= mGroup->getTerrainWorldSize();
+		camDir.z = 0;
+		if (camDir.GetLength() > 1e-3f)
+			camDir.Normalize();
+		else
+			camDir = VEC3::ZERO;
+
+		mLoadCandidates.clear();
+		mLoadedSlots.clear();
+		mMemoryUsage = 0;
+
+		for (TerrainGroup::TerrainSlotMap::iterator i = mGroup->mTerrainSlots.begin(); i != mGroup->mTerrainSlots.end(); ++i)
+		{
+			TerrainGroup::TerrainSlot* slot = i->second;
+			Terrain* t = slot->instance;
+
+			// Not paged, but it takes from the budget all the same
+			if (slot->def.filename.empty())
+			{
+				if (t && t->isLoaded())
+					mMemoryUsage += t->getMemoryUsage();
+				continue;
+			}
+
+			// In flight, counted below
+			if (t && !t->isLoaded())
+				continue;
+
+			SPageSlot page;
+			page.slot = slot;
+
+			const float dx = (float)(slot->x - camX);
+			const float dy = (float)(slot->y - camY);
+			page.distance = sqrtf(dx * dx + dy * dy);
+
+			const float fx = slot->x - camPos.x;
+			const float fy = slot->y - camPos.y;
+			const float len = sqrtf(fx * fx + fy * fy);
+			const float facing = len > 1e-3f ? (fx * camDir.x + fy * camDir.y) / len : 0.0f;
+			page.priority = len * (1.0f - VIEW_DIRECTION_WEIGHT * facing);
+
+			if (!t)
+			{
+				if (page.distance <= mLoadRadius)
+					mLoadCandidates.push_back(page);
+			}
+			else if (page.distance > mHoldRadius)
+			{
+				slot->freeInstance();
+			}
+			else
+			{
+				const int lodLevel = std::min(calculateLodLevel(page.distance), t->getNumLodLevels() - 1);
+				TerrainLodManager* lodManager = t->getLodManager();
+				if (lodManager->hasLodFile() && lodManager->getTargetLodLevel() != lodLevel)
+					lodManager->updateToLodLevel(lodLevel);
+
+				const size_t bytes = t->getMemoryUsage();
+				mTerrainMemory = std::max(mTerrainMemory, bytes);
+				mMemoryUsage += bytes;
+				mLoadedSlots.push_back(page);
+			}
+		}
+
+		const size_t terrainMemory = estimateTerrainMemory();
+		uint32 numLoading = (uint32)mGroup->mLoadingSlots.size();
+		mMemoryUsage += numLoading * terrainMemory;
+
+		std::sort(mLoadCandidates.begin(), mLoadCandidates.end());
+		// Furthest first, these make room for the nearer ones
+		std::sort(mLoadedSlots.rbegin(), mLoadedSlots.rend());
+
+		size_t nextUnload = 0;
+
+		// Over budget, give up the slots only kept by the hold radius
+		while (mMemoryBudget && mMemoryUsage > mMemoryBudget &&
+			nextUnload < mLoadedSlots.size() && mLoadedSlots[nextUnload].distance > mLoadRadius)
+		{
+			TerrainGroup::TerrainSlot* slot = mLoadedSlots[nextUnload++].slot;
+			mMemoryUsage -= std::min(mMemoryUsage, slot->instance->getMemoryUsage());
+			slot->freeInstance();
+		}
+
+		bool overBudget = false;
+		size_t nextLoad = 0;
+
+		for (; nextLoad < mLoadCandidates.size() && numLoading < mMaxConcurrentLoads; ++nextLoad)
+		{
+			const SPageSlot& page = mLoadCandidates[nextLoad];
+
+			// Make room by unloading terrains further away than this one
+			while (mMemoryBudget && mMemoryUsage + terrainMemory > mMemoryBudget &&
+				nextUnload < mLoadedSlots.size() && mLoadedSlots[nextUnload].priority > page.priority)
+			{
+				TerrainGroup::TerrainSlot* slot = mLoadedSlots[nextUnload++].slot;
+				mMemoryUsage -= std::min(mMemoryUsage, slot->instance->getMemoryUsage());
+				slot->freeInstance();
+			}
+
+			if (mMemoryBudget && mMemoryUsage + terrainMemory > mMemoryBudget)
+			{
+				overBudget = true;
+				break;
+			}
+
+			mGroup->loadTerrainImpl(page.slot, false, calculateLodLevel(page.distance));
+
+			++numLoading;
+			mMemoryUsage += terrainMemory;
+		}
+
+		// Out of load slots, the rest waits for the next update. Over budget only the camera can change things.
+		mPending = !overBudget && nextLoad < mLoadCandidates.size();
+	}
+	//---------------------------------------------------------------------
+	void TerrainPaging::warmStart()
+	{
+		mWarmStarted = true;
+		mWarmCompact = g_env.pSceneMgr->GetTerrainOptions()->_getUseCompactVertices();
+
+		const Terrain::ImportData& importData = mGroup->getDefaultImportSettings();
+		if (!mGroup->getTerrainSize() || !importData.maxBatchSize || !importData.minBatchSize)
+			return;
+
+		// Paging in and out of the hold radius then only moves buffers between terrains
+		const long radius = (long)mHoldRadius;
+		size_t numSlots = 0;
+		for (long y = -radius; y <= radius; ++y)
+		{
+			for (long x = -radius; x <= radius; ++x)
+			{
+				if (sqrtf((float)(x * x + y * y)) <= mHoldRadius)
+					++numSlots;
+			}
+		}
+
+		mGroup->getGpuBufferAllocator().warmStart(numSlots, mGroup->getTerrainSize(),
+			importData.maxBatchSize, importData.minBatchSize, mWarmCompact);
+	}
+	//---------------------------------------------------------------------
+	int TerrainPaging::calculateLodLevel(float distance) const
+	{
+		if (mLodDistance <= 0)
+			return 0;
+
+		return (int)(distance / mLodDistance);
+	}
+	//---------------------------------------------------------------------
+	size_t TerrainPaging::estimateTerrainMemory() const
+	{
+		if (mTerrainMemory)
+			return mTerrainMemory;
+
+		// Nothing loaded yet: heights, deltas and the normal map, and as much again for the vertex data
+		const size_t numVertices = (size_t)mGroup->getTerrainSize() * mGroup->getTerrainSize();
+		return numVertices * (sizeof(float) * 2 + 4) * 2;
+	}
+}
@@ -3,17 +3,15 @@
 #include "Terrain/Terrain.h"
 #include "Buffer.h"
 #include "Mesh.h"
-#include "Entity.h"
-#include "MaterialManager.h"
-#include "Material.h"
 #include "Renderer.h"
 #include "Camera.h"
 #include "SceneManager.h"
+#include "StreamSerialiser.h"
 
 namespace Neo
 {
-	unsigned short TerrainQuadTreeNode::POSITION_BUFFER = 0;
-	unsigned short TerrainQuadTreeNode::DELTA_BUFFER = 1;
+	unsigned short TerrainQuadTreeNode::VERTEX_DATA_SLOT = 13;
+	unsigned short TerrainQuadTreeNode::PATCH_BUFFER = 0;
 
 	//---------------------------------------------------------------------
 	TerrainQuadTreeNode::TerrainQuadTreeNode(Terrain* terrain, 
@@ -33,10 +31,12 @@ namespace Neo
         , mCurrentLod(-1)
 		, mLodTransition(0)
 		, mChildWithMaxHeightDelta(0)
+		, mCalcChildWithMaxHeightDelta(0)
 		, mSelfOrChildRendered(false)
+		, mLodCameraPos(VEC3::ZERO)
+		, mLodSlack(-1)
 		, mNodeWithVertexData(0)
 		, mVertexDataRecord(0)
-		, mEntity(nullptr)
 	{
 		// Ĳһֱ,ֱϸlod
 		if (terrain->getMaxBatchSize() < size)
@@ -148,51 +148,52 @@ namespace Neo
 
 	}
 	//---------------------------------------------------------------------
-	//void TerrainQuadTreeNode::prepare(StreamSerialiser& stream)
-	//{
-	//	// load LOD data we need
-	//	for (LodLevelList::iterator i = mLodLevels.begin(); i != mLodLevels.end(); ++i)
-	//	{
-	//		LodLevel* ll = *i;
-	//		// only read 'calc' and then copy to final (separation is only for
-	//		// real-time calculation
-	//		// Basically this is what finaliseHeightDeltas does in calc path
-	//		stream.read(&ll->calcMaxHeightDelta);
-	//		ll->maxHeightDelta = ll->calcMaxHeightDelta;
-	//		ll->lastCFactor = 0;
-	//	}
-
-	//	if (!isLeaf())
-	//	{
-	//		for (int i = 0; i < 4; ++i)
-	//			mChildren[i]->prepare(stream);
-	//	}
-
-	//	// If this is the root, do the post delta calc to finish
-	//	if (!mParent)
-	//	{
-	//		Rect rect;
-	//		rect.top = mOffsetY; rect.bottom = mBoundaryY;
-	//		rect.left = mOffsetX; rect.right = mBoundaryX;
-	//		postDeltaCalculation(rect);
-	//	}
-	//}
-	////---------------------------------------------------------------------
-	//void TerrainQuadTreeNode::save(StreamSerialiser& stream)
-	//{
-	//	// save LOD data we need
-	//	for (LodLevelList::iterator i = mLodLevels.begin(); i != mLodLevels.end(); ++i)
-	//	{
-	//		LodLevel* ll = *i;
-	//		stream.write(&ll->maxHeightDelta);
-	//	}
-
-	//	if (!isLeaf())
-	//	{
-	//		for (int i = 0; i < 4; ++i)
-	//			mChildren[i]->save(stream);
-	//	}
-	//}
+	void TerrainQuadTreeNode::prepare(StreamSerialiser& stream)
+	{
+		// load LOD data we need
+		for (LodLevelList::iterator i = mLodLevels.begin(); i != mLodLevels.end(); ++i)
+		{
+			LodLevel* ll = *i;
+			// only read 'calc' and then copy to final (separation is only for
+			// real-time calculation
+			// Basically this is what finaliseHeightDeltas does in calc path
+			stream.read(&ll->calcMaxHeightDelta);
+			ll->maxHeightDelta = ll->calcMaxHeightDelta;
+			ll->lastCFactor = 0;
+		}
+
+		if (!isLeaf())
+		{
+			for (int i = 0; i < 4; ++i)
+				mChildren[i]->prepare(stream);
+		}
+
+		// If this is the root, do the post delta calc to finish
+		if (!mParent)
+		{
+			Rect rect;
+			rect.top = mOffsetY; rect.bottom = mBoundaryY;
+			rect.left = mOffsetX; rect.right = mBoundaryX;
+			postDeltaCalculation(rect);
+			finaliseDeltaValues(rect);
+		}
+	}
+	//---------------------------------------------------------------------
+	void TerrainQuadTreeNode::save(StreamSerialiser& stream)
+	{
+		// save LOD data we need
+		for (LodLevelList::iterator i = mLodLevels.begin(); i != mLodLevels.end(); ++i)
+		{
+			LodLevel* ll = *i;
+			stream.write(&ll->maxHeightDelta);
+		}
+
+		if (!isLeaf())
+		{
+			for (int i = 0; i < 4; ++i)
+				mChildren[i]->save(stream);
+		}
+	}
 	//---------------------------------------------------------------------
 	void TerrainQuadTreeNode::load()
 	{
@@ -228,8 +229,7 @@ namespace Neo
 				mChildren[i]->unload();
 
 		destroyGpuVertexData();
-
-		SAFE_DELETE(mEntity);
+		destroyGpuIndexData();
 	}
 
 	void TerrainQuadTreeNode::unload(uint16 treeDepthStart, uint16 treeDepthEnd)
@@ -242,9 +242,7 @@ namespace Neo
 				mChildren[i]->unload(treeDepthStart, treeDepthEnd);
 
 		if (mDepth >= treeDepthStart && mDepth < treeDepthEnd)
-		{
 			destroyGpuVertexData();
-		}
 	}
 	//---------------------------------------------------------------------
 	void TerrainQuadTreeNode::unprepare()
@@ -327,6 +325,43 @@ namespace Neo
 		}
 	}
 	//---------------------------------------------------------------------
+	void TerrainQuadTreeNode::getNodesForLod(uint16 lod, const Rect& rect, std::vector<TerrainQuadTreeNode*>& outNodes)
+	{
+		if (rect.left >= mBoundaryX || rect.right <= mOffsetX
+			|| rect.top >= mBoundaryY || rect.bottom <= mOffsetY)
+			return;
+
+		if (lod >= mBaseLod && lod < mBaseLod + mLodLevels.size())
+			outNodes.push_back(this);
+
+		// children handle higher detail levels only
+		if (!isLeaf() && lod < mBaseLod)
+		{
+			for (int i = 0; i < 4; ++i)
+				mChildren[i]->getNodesForLod(lod, rect, outNodes);
+		}
+	}
+	//---------------------------------------------------------------------
+	void TerrainQuadTreeNode::notifyDeltas(uint16 lod, const Rect& rect, const float* deltas)
+	{
+		_AST(lod >= mBaseLod && lod < mBaseLod + mLodLevels.size());
+
+		const int left = std::max<int>(rect.left, mOffsetX);
+		const int right = std::min<int>(rect.right, mBoundaryX);
+		const int top = std::max<int>(rect.top, mOffsetY);
+		const int bottom = std::min<int>(rect.bottom, mBoundaryY);
+		const int stride = rect.GetWidth();
+
+		float maxDelta = mLodLevels[lod - mBaseLod]->calcMaxHeightDelta;
+		for (int y = top; y < bottom; ++y)
+		{
+			const float* pRow = deltas + (y - rect.top) * stride - rect.left;
+			for (int x = left; x < right; ++x)
+				maxDelta = std::max(maxDelta, pRow[x]);
+		}
+		mLodLevels[lod - mBaseLod]->calcMaxHeightDelta = maxDelta;
+	}
+	//---------------------------------------------------------------------
 	void TerrainQuadTreeNode::postDeltaCalculation(const Rect& rect)
 	{
 		if (rect.left <= mBoundaryX || rect.right > mOffsetX
@@ -360,7 +395,7 @@ namespace Neo
 				// otherwise we could have some crossover problems
 				// for a non-leaf, there is only one LOD level
 				mLodLevels[0]->calcMaxHeightDelta = std::max(mLodLevels[0]->calcMaxHeightDelta, maxChildDelta * (float)1.05);
-				mChildWithMaxHeightDelta = childWithMaxHeightDelta;
+				mCalcChildWithMaxHeightDelta = childWithMaxHeightDelta;
 
 			}
 			else
@@ -396,6 +431,7 @@ namespace Neo
 					child->finaliseDeltaValues(rect);
 				}
 
+				mChildWithMaxHeightDelta = mCalcChildWithMaxHeightDelta;
 			}
 
 			// Self
@@ -474,16 +510,20 @@ namespace Neo
 				updateRect.bottom = std::min(updateRect.bottom, rect.bottom);
 
 				// update the GPU buffer directly
-				// TODO: do we have no use for CPU vertex data after initial load?
-				// if so, destroy it to free RAM, this should be fast enough to 
-				// to direct
 				if(!cpuData)
 				{
-					if(mVertexDataRecord->gpuPosVertexBuf == NULL) 
+					if(mVertexDataRecord->gpuVertexBuf == NULL) 
 						createGpuVertexData();
 				}
 
 				updateVertexBuffer(updateRect);
+
+				// Once loaded only an editable terrain still has the CPU copy to patch
+				if (mVertexDataRecord->gpuVertexBuf && mVertexDataRecord->cpuVertexPosData)
+				{
+					mVertexDataRecord->gpuVertexDataDirty = true;
+					updateGpuVertexData();
+				}
 			}
 
 			// pass on to children
@@ -519,28 +559,17 @@ namespace Neo
 			destroyCpuVertexData();
 
 			// Calculate number of vertices
-			// Base geometry size * size
-			size_t baseNumVerts = (size_t)(mVertexDataRecord->size * mVertexDataRecord->size);
-			size_t numVerts = baseNumVerts;
-			// Now add space for skirts
-			// Skirts will be rendered as copies of the edge vertices translated downwards
-			// Some people use one big fan with only 3 vertices at the bottom, 
-			// but this requires creating them much bigger that necessary, meaning
-			// more unnecessary overdraw, so we'll use more vertices 
-			// You need 2^levels + 1 rows of full resolution (max 129) vertex copies, plus
-			// the same number of columns. There are common vertices at intersections
 			uint16 levels = mVertexDataRecord->treeLevels;
 			mVertexDataRecord->numSkirtRowsCols = (uint16)(pow(2, levels) + 1);
 			mVertexDataRecord->skirtRowColSkip = (mVertexDataRecord->size - 1) / (mVertexDataRecord->numSkirtRowsCols - 1);
-			numVerts += mVertexDataRecord->size * mVertexDataRecord->numSkirtRowsCols;
-			numVerts += mVertexDataRecord->size * mVertexDataRecord->numSkirtRowsCols;
+			size_t numVerts = _getNumVertices(mVertexDataRecord->size, levels);
 
 			// manually create CPU-side buffer
 			const uint32 nVertSizePos = sizeof(uint16) * 2 + sizeof(float);
 			const uint32 nVertSizeDelta = sizeof(float) * 2;
 
 			mVertexDataRecord->cpuVertexPosData = new char[nVertSizePos * numVerts];
-			mVertexDataRecord->cpuVertexDeltaData = new float[nVertSizeDelta * numVerts];
+			mVertexDataRecord->cpuVertexDeltaData = new char[nVertSizeDelta * numVerts];
 			mVertexDataRecord->cpuVertexCount= numVerts;
 
 			Rect updateRect(mOffsetX, mOffsetY, mBoundaryX, mBoundaryY);
@@ -549,6 +578,23 @@ namespace Neo
 		}
 	}
 	//----------------------------------------------------------------------
+	size_t TerrainQuadTreeNode::_getNumVertices(uint16 size, uint16 treeLevels)
+	{
+		// Base geometry size * size
+		size_t numVerts = (size_t)size * size;
+		// Now add space for skirts
+		// Skirts will be rendered as copies of the edge vertices translated downwards
+		// Some people use one big fan with only 3 vertices at the bottom, 
+		// but this requires creating them much bigger that necessary, meaning
+		// more unnecessary overdraw, so we'll use more vertices 
+		// You need 2^levels + 1 rows of full resolution (max 129) vertex copies, plus
+		// the same number of columns. There are common vertices at intersections
+		const size_t numSkirtRowsCols = (size_t)(1 << treeLevels) + 1;
+		numVerts += size * numSkirtRowsCols;
+		numVerts += size * numSkirtRowsCols;
+		return numVerts;
+	}
+	//----------------------------------------------------------------------
 	void TerrainQuadTreeNode::updateVertexBuffer(const Rect& rect)
 	{
 		_AST (rect.left >= mOffsetX && rect.right <= mBoundaryX && 
@@ -835,13 +881,13 @@ namespace Neo
 
 			if (mVertexDataRecord->cpuVertexPosData)
 			{
-				delete[]mVertexDataRecord->cpuVertexPosData;
+				delete[] static_cast<char*>(mVertexDataRecord->cpuVertexPosData);
 				mVertexDataRecord->cpuVertexPosData = nullptr;
 			}
 
 			if (mVertexDataRecord->cpuVertexDeltaData)
 			{
-				delete[]mVertexDataRecord->cpuVertexDeltaData;
+				delete[] static_cast<char*>(mVertexDataRecord->cpuVertexDeltaData);
 				mVertexDataRecord->cpuVertexDeltaData = nullptr;
 			}
 		}
@@ -871,41 +917,88 @@ namespace Neo
 	void TerrainQuadTreeNode::createGpuVertexData()
 	{
 		// TODO - mutex cpu data
-		if (mVertexDataRecord && mVertexDataRecord->cpuVertexPosData && !mVertexDataRecord->gpuPosVertexBuf)
+		if (mVertexDataRecord && mVertexDataRecord->cpuVertexPosData && !mVertexDataRecord->gpuVertexBuf)
 		{
-			// get new buffers
-			mTerrain->getGpuBufferAllocator()->allocateVertexBuffers(mTerrain, mVertexDataRecord->cpuVertexCount, 
-				&mVertexDataRecord->gpuPosVertexBuf, &mVertexDataRecord->gpuDeltaVertexBuf);
+			// get room in a shared buffer
+			mTerrain->getGpuBufferAllocator()->allocateVertexData(mTerrain, mVertexDataRecord->cpuVertexCount, 
+				&mVertexDataRecord->gpuVertexBuf, mVertexDataRecord->gpuBaseVertex);
 				
 			// copy data
-			mVertexDataRecord->gpuPosVertexBuf->UpdateBuf(mVertexDataRecord->cpuVertexPosData);
-			mVertexDataRecord->gpuDeltaVertexBuf->UpdateBuf(mVertexDataRecord->cpuVertexDeltaData);
+			uploadVertexData();
+			mVertexDataRecord->gpuVertexDataDirty = false;
 
-			// We don't need the CPU copy anymore
-			destroyCpuVertexData();
+			// We don't need the CPU copy anymore, unless edits have to reach the GPU
+			if (!mTerrain->isEditable())
+				destroyCpuVertexData();
 		}
 	}
 	//---------------------------------------------------------------------
 	void TerrainQuadTreeNode::updateGpuVertexData()
 	{
-		if (mVertexDataRecord && mVertexDataRecord->gpuVertexDataDirty)
+		if (mVertexDataRecord && mVertexDataRecord->gpuVertexDataDirty &&
+			mVertexDataRecord->gpuVertexBuf && mVertexDataRecord->cpuVertexPosData)
 		{
-			mVertexDataRecord->gpuPosVertexBuf->UpdateBuf(mVertexDataRecord->cpuVertexPosData);
-			mVertexDataRecord->gpuDeltaVertexBuf->UpdateBuf(mVertexDataRecord->cpuVertexDeltaData);
+			uploadVertexData();
 			mVertexDataRecord->gpuVertexDataDirty = false;
 		}
 	}
 	//---------------------------------------------------------------------
+	void TerrainQuadTreeNode::uploadVertexData()
+	{
+		VertexDataRecord* vdr = mVertexDataRecord;
+		const STerrainPosVertex* pPos = static_cast<const STerrainPosVertex*>(vdr->cpuVertexPosData);
+		const STerrainDeltaVertex* pDelta = static_cast<const STerrainDeltaVertex*>(vdr->cpuVertexDeltaData);
+
+		if (!mTerrain->_getUseCompactVertices())
+		{
+			// the shader reads both streams from one buffer
+			std::vector<STerrainVertex> vertices(vdr->cpuVertexCount);
+			for (uint32 i = 0; i < vdr->cpuVertexCount; ++i)
+			{
+				STerrainVertex& v = vertices[i];
+				v.pos[0] = pPos[i].pos[0];
+				v.pos[1] = pPos[i].pos[1];
+				v.height = pPos[i].height;
+				v.delta = pDelta[i].delta;
+			}
+
+			vdr->gpuVertexBuf->UpdateElements(&vertices[0], vdr->gpuBaseVertex, vdr->cpuVertexCount);
+			return;
+		}
+
+		// Quantize to the bounds of this node, the skirts hang below them
+		vdr->minHeight = getMinHeight() - mTerrain->getSkirtSize();
+		vdr->heightRange = std::max(getMaxHeight() - vdr->minHeight, 1e-3f);
+		const float heightScale = 65535.0f / vdr->heightRange;
+		const float deltaScale = 2047.0f / vdr->heightRange;
+
+		std::vector<STerrainCompactVertex> vertices(vdr->cpuVertexCount);
+
+		for (uint32 i = 0; i < vdr->cpuVertexCount; ++i)
+		{
+			STerrainCompactVertex& v = vertices[i];
+			v.pos[0] = pPos[i].pos[0];
+			v.pos[1] = pPos[i].pos[1];
+			v.height = (uint16)Clamp((pPos[i].height - vdr->minHeight) * heightScale + 0.5f, 0.0f, 65535.0f);
+
+			// the skirts never morph, their threshold of 99 saturates
+			const int delta = Clamp((int)floorf(pDelta[i].delta.x * deltaScale + 0.5f), -2047, 2047);
+			const int lodThreshold = Clamp((int)pDelta[i].delta.y + 1, 0, 15);
+			v.delta = (uint16)((lodThreshold << 12) | (delta & 0xfff));
+		}
+
+		vdr->gpuVertexBuf->UpdateElements(&vertices[0], vdr->gpuBaseVertex, vdr->cpuVertexCount);
+	}
+	//---------------------------------------------------------------------
 	void TerrainQuadTreeNode::destroyGpuVertexData()
 	{
 		if (mVertexDataRecord)
 		{
-			// Before we delete, free up the vertex buffers for someone else
-			mTerrain->getGpuBufferAllocator()->freeVertexBuffers(mVertexDataRecord->gpuPosVertexBuf, mVertexDataRecord->gpuDeltaVertexBuf);
-			delete mVertexDataRecord->gpuPosVertexBuf;
-			delete mVertexDataRecord->gpuDeltaVertexBuf;
-			mVertexDataRecord->gpuPosVertexBuf = 0;
-			mVertexDataRecord->gpuDeltaVertexBuf = 0;
+			// Free up the vertex data for someone else, the allocator owns the buffer
+			mTerrain->getGpuBufferAllocator()->freeVertexData(mVertexDataRecord->gpuVertexBuf,
+				mVertexDataRecord->gpuBaseVertex, mVertexDataRecord->cpuVertexCount);
+			mVertexDataRecord->gpuVertexBuf = 0;
+			mVertexDataRecord->gpuBaseVertex = 0;
 		}
 	}
 	//---------------------------------------------------------------------
@@ -934,7 +1027,7 @@ namespace Neo
 		{
 			LodLevel* ll = mLodLevels[lod];
 
-			delete ll->pIndexBuf;
+			// shared by the allocator, just drop the reference
 			ll->pIndexBuf = 0;
 		}
 	}
@@ -1027,8 +1120,21 @@ namespace Neo
 
 	}
 	//---------------------------------------------------------------------
-	bool TerrainQuadTreeNode::calculateCurrentLod(float cFactor)
+	bool TerrainQuadTreeNode::calculateCurrentLod(float cFactor, const VEC3& camPos, bool force, Terrain::LodStats& stats)
 	{
+		// Nothing this subtree depends on moved far enough to change its LOD
+		if (!force && mLodSlack >= 0 && (camPos - mLodCameraPos).GetLength() < mLodSlack)
+		{
+			++stats.numSubtreesSkipped;
+			return mSelfOrChildRendered;
+		}
+
+		++stats.numNodesVisited;
+		const int prevLod = mCurrentLod;
+		const float prevTransition = mLodTransition;
+		// How far the camera may move before this node's choice could change
+		float slack = FLT_MAX;
+
 		mSelfOrChildRendered = false;
 
 		// early-out
@@ -1046,8 +1152,12 @@ namespace Neo
 		{
 			for (int i = 0; i < 4; ++i)
 			{
-				if (mChildren[i]->calculateCurrentLod(cFactor))
+				TerrainQuadTreeNode* child = mChildren[i];
+				if (child->calculateCurrentLod(cFactor, camPos, force, stats))
 					++childRenderedCount;
+
+				// what is left of the child's slack, it may have been skipped
+				slack = std::min(slack, child->mLodSlack - (camPos - child->mLodCameraPos).GetLength());
 			}
 
 		}
@@ -1056,7 +1166,7 @@ namespace Neo
 		{
 
 			// no children were within their LOD ranges, so we should consider our own
-			VEC3 localPos = g_env.pSceneMgr->GetCamera()->GetPos() - mLocalCentre - mTerrain->getPosition();
+			VEC3 localPos = camPos - mLocalCentre;
 			float dist;
 			if (g_env.pSceneMgr->GetTerrainOptions()->getUseRayBoxDistanceCalculation())
 			{
@@ -1085,8 +1195,13 @@ namespace Neo
 			// distTransition = maxDelta * cFactor;
 			uint32 lodLvl = 0;
 			mCurrentLod = -1;
+			mLodTransition = 0;
 			for (LodLevelList::iterator i = mLodLevels.begin(); i != mLodLevels.end(); ++i, ++lodLvl)
 			{
+				// Still being streamed in, a coarser LOD of this node or an ancestor stands in
+				if ((int)(lodLvl + mBaseLod) < mTerrain->getHighestLodLoaded())
+					continue;
+
 				// If we have no parent, and this is the lowest LOD, we always render
 				// this is the 'last resort' so to speak, we always enoucnter this last
 				if (lodLvl+1 == mLodLevels.size() && !mParent)
@@ -1111,6 +1226,9 @@ namespace Neo
 						ll->lastTransitionDist = distTransition;
 					}
 
+					// dist changes no faster than the camera moves, the choice holds until it crosses distTransition
+					slack = std::min(slack, fabsf(distTransition - dist));
+
 					if (dist < distTransition)
 					{
 						// we're within range of this LOD
@@ -1156,8 +1274,11 @@ namespace Neo
 							// Pass both the transition % and target LOD (GLOBAL current + 1)
 							// this selectively applies the morph just to the
 							// vertices which would drop out at this LOD, even 
-							// while using the single shared vertex data
-							mTerrain->m_cbTerrain.lodMorph = VEC2(mLodTransition, mCurrentLod + mBaseLod + 1);
+							// while using the single shared vertex data.
+							// The draw list carries them to Render().
+
+							// the transition follows every move inside the morph region
+							slack = std::min(slack, std::max(0.0f, distRemain - distMorphRegion));
 						}
 						// since LODs are ordered from highest to lowest detail, 
 						// we can stop looking now
@@ -1173,38 +1294,84 @@ namespace Neo
 			// we should not render ourself
 			mCurrentLod = -1;
 			mSelfOrChildRendered = true; 
-			if (childRenderedCount < 4)
+		} // (childRenderedCount == 0)
+
+		if (!isLeaf())
+		{
+			// only *some* children decided to render on their own, but either 
+			// none or all need to render, so set the others manually to their lowest.
+			// Children set on an earlier call may have been skipped since, they're reset here.
+			const bool forceChildren = childRenderedCount > 0 && childRenderedCount < 4;
+			for (int i = 0; i < 4; ++i)
 			{
-				// only *some* children decided to render on their own, but either 
-				// none or all need to render, so set the others manually to their lowest
-				for (int i = 0; i < 4; ++i)
+				TerrainQuadTreeNode* child = mChildren[i];
+				if (!child->isSelfOrChildRenderedAtCurrentLod())
 				{
-					TerrainQuadTreeNode* child = mChildren[i];
-					if (!child->isSelfOrChildRenderedAtCurrentLod())
+					const int lod = forceChildren ? child->getLodCount()-1 : -1;
+					const float transition = forceChildren ? 1.0f : 0.0f;
+					if (child->getCurrentLod() != lod || child->getLodTransition() != transition)
 					{
-						child->setCurrentLod(child->getLodCount()-1);
-						child->setLodTransition(1.0);
+						child->setCurrentLod(lod);
+						child->setLodTransition(transition);
+						++stats.numLodChanges;
 					}
 				}
-			} // (childRenderedCount < 4)
+			}
+		}
 
-		} // (childRenderedCount == 0)
+		if (mCurrentLod != prevLod || mLodTransition != prevTransition)
+			++stats.numLodChanges;
 
+		mLodCameraPos = camPos;
+		mLodSlack = std::max(0.0f, slack);
 
 		return mSelfOrChildRendered;
 
 	}
 	//---------------------------------------------------------------------
+	void TerrainQuadTreeNode::buildDrawList(Camera& cam, const VEC3& terrainPos, Terrain::DrawList& drawList, Terrain::LodStats& stats)
+	{
+		if (!isRenderedAtCurrentLod() && !isSelfOrChildRenderedAtCurrentLod())
+			return;
+
+		// out of view, and so are the children
+		if (mAABB.IsFinite() && !mAABB.IsNull())
+		{
+			const VEC3 offset = terrainPos + mLocalCentre;
+			AABB worldBox(mAABB);
+			worldBox.m_minCorner += offset;
+			worldBox.m_maxCorner += offset;
+
+			if (cam.FrustumCullingAABB(worldBox))
+			{
+				++stats.numNodesCulled;
+				return;
+			}
+		}
+
+		if (isRenderedAtCurrentLod())
+		{
+			Terrain::DrawRecord rec;
+			rec.node = this;
+			rec.lod = (uint16)mCurrentLod;
+			rec.transition = mLodTransition;
+			drawList.push_back(rec);
+		}
+		else if (!isLeaf())
+		{
+			for (int i = 0; i < 4; ++i)
+				mChildren[i]->buildDrawList(cam, terrainPos, drawList, stats);
+		}
+	}
+	//---------------------------------------------------------------------
 	void TerrainQuadTreeNode::setCurrentLod(int lod)
 	{
 		 mCurrentLod = lod;
-		 mTerrain->m_cbTerrain.lodMorph = VEC2(mLodTransition, mCurrentLod + mBaseLod + 1);
 	}
 	//---------------------------------------------------------------------
 	void TerrainQuadTreeNode::setLodTransition(float t)
 	{
-		mLodTransition = t; 	
-		mTerrain->m_cbTerrain.lodMorph = VEC2(mLodTransition, mCurrentLod + mBaseLod + 1);
+		mLodTransition = t;
 	}
 	//---------------------------------------------------------------------
 	bool TerrainQuadTreeNode::isRenderedAtCurrentLod() const
@@ -1216,95 +1383,23 @@ namespace Neo
 	{
 		return mSelfOrChildRendered;
 	}
-	//------------------------------------------------------------------------------------
-	void TerrainQuadTreeNode::CreateEntity()
-	{
-		// Create the entity.
-		if (isRenderedAtCurrentLod() && !mEntity)
-		{
-			Mesh* pMesh = new Mesh;
-			SubMesh* pSubmesh = new SubMesh;
-
-			pMesh->SetPrimitiveType(ePrimitive_TriangleStrip);
-			pSubmesh->InitTerrainVertData(getVertexDataRecord()->gpuPosVertexBuf, getVertexDataRecord()->gpuDeltaVertexBuf,
-				mLodLevels[mCurrentLod]->pIndexBuf, mLodLevels[mCurrentLod]->nIndexCount);
-
-			pMesh->AddSubMesh(pSubmesh);
-			mEntity = new Entity(pMesh);
-			mEntity->SetCastShadow(false);
-
-			// vertex data is generated in terrain space
-			mEntity->SetPosition(mTerrain->getPosition());
-
-			static uint32 iMat = 0;
-			++iMat;
-			char szMatName[64];
-			sprintf_s(szMatName, 64, "Mtl_TerrainSector_%d", iMat);
-
-			Material* pMaterial = MaterialManager::GetSingleton().NewMaterial(szMatName, eVertexType_Terrain);
-
-			pMaterial->SetTexture(0, mTerrain->getTerrainNormalMap());
-			pMaterial->SetTexture(1, mTerrain->getLayerBlendTexture(0));
-
-			SSamplerDesc& samDesc = pMaterial->GetSamplerStateDesc(0);
-			samDesc.AddressU = eTextureAddressMode_WRAP;
-			samDesc.AddressV = eTextureAddressMode_WRAP;
-			samDesc.Filter = SF_MIN_MAG_MIP_LINEAR;
-			pMaterial->SetSamplerStateDesc(0, samDesc);
-			pMaterial->SetSamplerStateDesc(1, samDesc);
-
-			for (uint32 i = 0; i < mTerrain->getLayerCount(); ++i)
-			{
-				pMaterial->SetTexture(2+i*2, g_env.pRenderer->GetRenderSys()->LoadTexture(mTerrain->getLayerTextureName(i, 0), eTextureType_2D, 0, true));
-				pMaterial->SetTexture(2+i*2+1, g_env.pRenderer->GetRenderSys()->LoadTexture(mTerrain->getLayerTextureName(i, 1)));
-
-				pMaterial->SetSamplerStateDesc(2 + i * 2, samDesc);
-				pMaterial->SetSamplerStateDesc(2 + i * 2 + 1, samDesc);
-			}
-
-			pMaterial->InitShader("Terrain", eShader_Terrain, 0, nullptr, "VS_GBuffer", "PS_GBuffer");
-			mEntity->SetMaterial(pMaterial);
-		}
-
-		if (mChildren[0])
-		{
-			mChildren[0]->CreateEntity();
-			mChildren[1]->CreateEntity();
-			mChildren[2]->CreateEntity();
-			mChildren[3]->CreateEntity();
-		}
-	}
 	//---------------------------------------------------------------------
-	void TerrainQuadTreeNode::Render()
+	bool TerrainQuadTreeNode::getRenderData(uint16 lod, ShaderResourceBuffer** ppVertexBuf, uint32& baseVertex,
+		IndexBuffer** ppIndexBuf, uint32& nIndexCount, VEC2& heightRange) const
 	{
-		if (isRenderedAtCurrentLod())
-		{
-			mEntity->Render();
-		}
-
-		if (mChildren[0])
-		{
-			mChildren[0]->Render();
-			mChildren[1]->Render();
-			mChildren[2]->Render();
-			mChildren[3]->Render();
-		}
-	}
-	//---------------------------------------------------------------------
-	void TerrainQuadTreeNode::enableWireframe(bool b)
-	{
-		if (mEntity)
-		{
-			mEntity->GetMaterial()->SetFillMode(b ? eFill_Wireframe : eFill_Solid);
-		}
-
-		if (mChildren[0])
-		{
-			mChildren[0]->enableWireframe(b);
-			mChildren[1]->enableWireframe(b);
-			mChildren[2]->enableWireframe(b);
-			mChildren[3]->enableWireframe(b);
-		}
+		const VertexDataRecord* vdr = getVertexDataRecord();
+		const LodLevel* ll = mLodLevels[lod];
+		if (!vdr || !vdr->gpuVertexBuf || !ll->pIndexBuf)
+			return false;
+
+		*ppVertexBuf = vdr->gpuVertexBuf;
+		baseVertex = vdr->gpuBaseVertex;
+		*ppIndexBuf = ll->pIndexBuf;
+		nIndexCount = ll->nIndexCount;
+		// compact vertices are quantized per vertex data
+		heightRange = VEC2(vdr->minHeight, vdr->heightRange);
+
+		return true;
 	}
 	//---------------------------------------------------------------------
 	//float TerrainQuadTreeNode::getSquaredViewDepth(const Camera* cam) const
@@ -0,0 +1,366 @@
+#include "stdafx.h"
+#include "Terrain/TerrainRenderQueue.h"
+#include "Terrain/TerrainQuadTreeNode.h"
+#include "Terrain/TerrainGroup.h"
+#include "RenderSystem.h"
+#include "SceneManager.h"
+#include "Camera.h"
+#include <random>
+
+namespace Neo
+{
+	//---------------------------------------------------------------------
+	TerrainRenderQueue::TerrainRenderQueue()
+		: mPatchBuf(nullptr)
+	{
+	}
+	//---------------------------------------------------------------------
+	TerrainRenderQueue::~TerrainRenderQueue()
+	{
+		SAFE_DELETE(mPatchBuf);
+	}
+	//---------------------------------------------------------------------
+	void TerrainRenderQueue::clear()
+	{
+		mPatches.clear();
+		mBatches.clear();
+	}
+	//---------------------------------------------------------------------
+	void TerrainRenderQueue::addTerrain(Terrain* terrain)
+	{
+		const Terrain::DrawList& drawList = terrain->getDrawList();
+		const VEC3& terrainPos = terrain->getPosition();
+
+		for (Terrain::DrawList::const_iterator i = drawList.begin(); i != drawList.end(); ++i)
+		{
+			Patch p;
+			p.terrain = terrain;
+
+			VEC2 heightRange;
+			if (!i->node->getRenderData(i->lod, &p.vertexBuf, p.params.baseVertex, &p.indexBuf, p.numIndices, heightRange))
+				continue;
+
+			// Pass both the transition % and target LOD (GLOBAL current + 1), the morph
+			// only applies to the vertices which drop out at the next lower LOD
+			p.params.lodMorph = VEC2(i->transition, (float)(i->lod + i->node->getBaseLod() + 1));
+			p.params.heightRange = heightRange;
+			p.params.offset = terrainPos;
+
+			mPatches.push_back(p);
+		}
+	}
+	//---------------------------------------------------------------------
+	void TerrainRenderQueue::render(RenderSystem* pRenderSys)
+	{
+		mBatches.clear();
+		if (mPatches.empty())
+			return;
+
+		std::sort(mPatches.begin(), mPatches.end());
+
+		const uint32 numPatches = (uint32)mPatches.size();
+
+		// One instance buffer for all patches, it only grows
+		if (numPatches > mPatchParams.size())
+		{
+			SAFE_DELETE(mPatchBuf);
+			mPatchParams.resize(std::max<size_t>(numPatches, mPatchParams.size() * 2));
+			mPatchBuf = pRenderSys->CreateVertexBuffer((uint32)(sizeof(STerrainPatchInstance) * mPatchParams.size()),
+				sizeof(STerrainPatchInstance), nullptr, 0);
+		}
+
+		for (uint32 i = 0; i < numPatches; ++i)
+			mPatchParams[i] = mPatches[i].params;
+
+		mPatchBuf->UpdateBuf(&mPatchParams[0]);
+
+		// Runs of patches sharing vertex data buffer and index buffer are drawn together
+		for (uint32 i = 0; i < numPatches;)
+		{
+			const Patch& p = mPatches[i];
+
+			uint32 n = 1;
+			while (i + n < numPatches && mPatches[i + n].isSameBatch(p))
+				++n;
+
+			Batch b;
+			b.terrain = p.terrain;
+			b.vertexBuf = p.vertexBuf;
+			b.indexBuf = p.indexBuf;
+			b.numIndices = p.numIndices;
+			b.firstInstance = i;
+			b.numInstances = n;
+			mBatches.push_back(b);
+
+			i += n;
+		}
+
+		Terrain* curTerrain = nullptr;
+		ShaderResourceBuffer* curVertexBuf = nullptr;
+		for (BatchList::const_iterator i = mBatches.begin(); i != mBatches.end(); ++i)
+		{
+			if (i->terrain != curTerrain)
+			{
+				curTerrain = i->terrain;
+				curTerrain->_setRenderState();
+				// the GL backend takes the vertex layout from the first stream
+				mPatchBuf->m_vertType = curTerrain->_getUseCompactVertices() ? eVertexType_TerrainCompact : eVertexType_Terrain;
+			}
+
+			if (i->vertexBuf != curVertexBuf)
+			{
+				curVertexBuf = i->vertexBuf;
+				curVertexBuf->Apply(TerrainQuadTreeNode::VERTEX_DATA_SLOT, true);
+			}
+
+			pRenderSys->SetVertexBuffer(mPatchBuf, TerrainQuadTreeNode::PATCH_BUFFER, 0);
+
+			pRenderSys->DrawIndexed(ePrimitive_TriangleStrip, i->indexBuf, i->numIndices, 0, 0, i->numInstances, i->firstInstance);
+		}
+	}
+#if USE_BENCHMARK
+	//---------------------------------------------------------------------
+	namespace
+	{
+		// Buffer in system memory, for the recording render system
+		class SysMemBuffer : public Buffer
+		{
+		public:
+			SysMemBuffer(uint32 nSize, uint32 nStride) : m_data(nSize), m_nStride(nStride) {}
+
+			virtual void*	Lock() { return &m_data[0]; }
+			virtual void	Unlock() {}
+			virtual	void	UpdateBuf(void* pSrc) { memcpy(&m_data[0], pSrc, m_data.size()); }
+			virtual	void	UpdateBufRange(const void* pSrc, uint32 nOffset, uint32 nSize) { memcpy(&m_data[nOffset], pSrc, nSize); }
+			virtual void*	GetInternel() { return &m_data[0]; }
+			virtual uint32	GetStride() const { return m_nStride; }
+			virtual uint32	GetSize() const { return (uint32)m_data.size(); }
+
+		private:
+			std::vector<char>	m_data;
+			uint32				m_nStride;
+		};
+
+		// Records the draws of TerrainRenderQueue::render() with the patches of their instances,
+		// creates the instance buffer in system memory and ignores everything else
+		class DrawRecorder : public RenderSystem
+		{
+		public:
+			struct SDraw
+			{
+				IndexBuffer*	indexBuf;
+				uint32			nIndexCnt;
+				std::vector<STerrainPatchInstance>	instances;
+			};
+
+			DrawRecorder() : m_pPatchBuf(nullptr) {}
+
+			virtual	void			SetRenderTarget(RenderTarget**, Texture*, uint32, bool, bool, const SColor&) {}
+			virtual void			SetViewport(const SViewport*) {}
+			virtual void			SwapBuffer() {}
+			virtual Texture*		GetDepthBuffer() { return nullptr; }
+
+			virtual ConstantBuffer*	CreateConstantBuffer(uint32, uint32) { return nullptr; }
+			virtual VertexBuffer*	CreateVertexBuffer(uint32 nSize, uint32 nStride, const void* pData, uint32)
+			{
+				SysMemBuffer* pBuf = new SysMemBuffer(nSize, nStride);
+				if (pData)
+					pBuf->UpdateBufRange(pData, 0, nSize);
+				return new VertexBuffer(pBuf);
+			}
+			virtual IndexBuffer*	CreateIndexBuffer(uint32 nSize, const void* pData, uint32)
+			{
+				SysMemBuffer* pBuf = new SysMemBuffer(nSize, sizeof(uint32));
+				if (pData)
+					pBuf->UpdateBufRange(pData, 0, nSize);
+				return new IndexBuffer(pBuf);
+			}
+			virtual ShaderResourceBuffer*	CreateShaderResourceBuffer(uint32, uint32, uint32) { return nullptr; }
+			virtual void			SetTexture(uint32, Texture*, uint32) {}
+			virtual SamplerState*	CreateSamplerState(const SSamplerDesc&) { return nullptr; }
+			virtual void			SetSamplerState(uint32, SamplerState*, bool, bool, bool) {}
+			virtual Shader*			CreateShader(eShaderType, eRenderPhase, const STRING&, uint32, const STRING&, eVertexType, const std::vector<D3D_SHADER_MACRO>&) { return nullptr; }
+			virtual RenderTarget*	CreateRenderTarget(uint32, uint32, uint32, ePixelFormat, uint32) { return nullptr; }
+
+			virtual void			DrawIndexed(ePrimitive, IndexBuffer* indexBuf, uint32 nIndexCnt, uint32, uint32, uint32 nInstanced, uint32 nStartInstance)
+			{
+				SDraw draw;
+				draw.indexBuf = indexBuf;
+				draw.nIndexCnt = nIndexCnt;
+
+				if (m_pPatchBuf)
+				{
+					const STerrainPatchInstance* pInst = static_cast<const STerrainPatchInstance*>(m_pPatchBuf->GetInternel());
+					draw.instances.assign(pInst + nStartInstance, pInst + nStartInstance + nInstanced);
+				}
+
+				m_draws.push_back(draw);
+			}
+			virtual void			Draw(uint32, uint32) {}
+			virtual void			SetVertexBuffer(VertexBuffer* vertBuf, uint32 iStream, uint32)
+			{
+				if (iStream == TerrainQuadTreeNode::PATCH_BUFFER)
+					m_pPatchBuf = vertBuf;
+			}
+
+			virtual Texture*		LoadTexture(const STRING&, eTextureType, uint32, bool) { return nullptr; }
+			virtual Texture*		LoadTextureFromMemory(const STRING&, const void*, uint32, eTextureType, uint32, bool) { return nullptr; }
+			virtual Texture*		CreateTextureArray(const StringVector&, bool) { return nullptr; }
+			virtual Texture*		CreateTextureManual(uint32, uint32, const char*, ePixelFormat, uint32, bool) { return nullptr; }
+
+			virtual void*			CreateBlendState(const SStateBlendDesc&) { return nullptr; }
+			virtual void*			CreateRasterState(const SStateRasterDesc&) { return nullptr; }
+			virtual void*			CreateDepthState(const SStateDepthDesc&) { return nullptr; }
+			virtual	void			ApplyBlendState(SStateBlend*) {}
+			virtual	void			ApplyRasterState(SStateRaster*) {}
+			virtual	void			ApplyDepthState(SStateDepth*) {}
+
+			std::vector<SDraw>		m_draws;
+
+		private:
+			VertexBuffer*			m_pPatchBuf;
+		};
+
+		// What a patch is drawn with
+		struct SPatchKey
+		{
+			const void*		vertexBuf;
+			uint32			baseVertex;
+			const void*		indexBuf;
+			uint32			numIndices;
+
+			bool operator< (const SPatchKey& rhs) const
+			{
+				if (vertexBuf != rhs.vertexBuf)
+					return vertexBuf < rhs.vertexBuf;
+				if (baseVertex != rhs.baseVertex)
+					return baseVertex < rhs.baseVertex;
+				if (indexBuf != rhs.indexBuf)
+					return indexBuf < rhs.indexBuf;
+				return numIndices < rhs.numIndices;
+			}
+		};
+	}
+	//---------------------------------------------------------------------
+	bool RunTerrainRenderQueueTest(STerrainQueueTestResult& result, uint16 terrainSize, long nTerrainsPerSide)
+	{
+		memset(&result, 0, sizeof(result));
+
+		const float worldSize = (terrainSize - 1) * 4.0f;
+		TerrainGroup group(Terrain::ALIGN_X_Z, terrainSize, worldSize);
+
+		// bumpy enough for every LOD to have an error
+		std::mt19937 rng(1234);
+		std::uniform_real_distribution<float> heightDist(0, worldSize * 0.01f);
+		std::vector<float> heights((size_t)terrainSize * terrainSize);
+
+		for (long x = 0; x < nTerrainsPerSide; ++x)
+		{
+			for (long y = 0; y < nTerrainsPerSide; ++y)
+			{
+				for (size_t i = 0; i < heights.size(); ++i)
+					heights[i] = heightDist(rng);
+				group.defineTerrain(x, y, &heights[0]);
+			}
+		}
+		group.loadAllTerrains(true);
+
+		std::vector<Terrain*> terrains;
+		VEC3 centre(VEC3::ZERO);
+		for (long x = 0; x < nTerrainsPerSide; ++x)
+		{
+			for (long y = 0; y < nTerrainsPerSide; ++y)
+			{
+				Terrain* t = group.getTerrain(x, y);
+				if (t && t->isLoaded())
+				{
+					terrains.push_back(t);
+					centre = centre + t->getPosition();
+				}
+			}
+		}
+		result.nTerrains = (uint32)terrains.size();
+		if (terrains.empty())
+			return false;
+		centre = centre / (float)terrains.size();
+
+		// Look down on the whole group, from close enough for the finest LOD everywhere
+		Camera* cam = g_env.pSceneMgr->GetCamera();
+		TerrainGlobalOptions* opts = g_env.pSceneMgr->GetTerrainOptions();
+		const VEC3 oldPos = cam->GetPos();
+		const VEC3 oldDir = cam->GetDirection();
+		const float oldFarClip = cam->GetFarClip();
+		const float oldPixelError = opts->getMaxPixelError();
+
+		const float extent = worldSize * nTerrainsPerSide;
+		const float camHeight = extent * std::max(cam->GetAspectRatio(), 1.0f) / tanf(cam->GetFov() * 0.5f);
+		cam->SetPosition(centre + VEC3(0, camHeight, 0));
+		cam->SetDirection(VEC3(0, -1, 0.01f));
+		cam->SetFarClip(camHeight * 2);
+		cam->Update(0);
+		opts->setMaxPixelError(0.01f);
+
+		group.UpdateLod();
+
+		TerrainRenderQueue queue;
+		std::vector<SPatchKey> expected;
+		for (size_t i = 0; i < terrains.size(); ++i)
+		{
+			queue.addTerrain(terrains[i]);
+
+			const Terrain::DrawList& drawList = terrains[i]->getDrawList();
+			for (Terrain::DrawList::const_iterator j = drawList.begin(); j != drawList.end(); ++j)
+			{
+				ShaderResourceBuffer* pVertexBuf;
+				IndexBuffer* pIndexBuf;
+				SPatchKey key;
+				VEC2 heightRange;
+				if (!j->node->getRenderData(j->lod, &pVertexBuf, key.baseVertex, &pIndexBuf, key.numIndices, heightRange))
+					continue;
+
+				key.vertexBuf = pVertexBuf;
+				key.indexBuf = pIndexBuf;
+				expected.push_back(key);
+			}
+		}
+
+		DrawRecorder recorder;
+		queue.render(&recorder);
+
+		cam->SetPosition(oldPos);
+		cam->SetDirection(oldDir);
+		cam->SetFarClip(oldFarClip);
+		cam->Update(0);
+		opts->setMaxPixelError(oldPixelError);
+
+		// The draws go in the order of the batches, which know the vertex data buffer
+		const TerrainRenderQueue::BatchList& batches = queue.getBatches();
+		std::vector<SPatchKey> drawn;
+		for (size_t i = 0; i < recorder.m_draws.size() && i < batches.size(); ++i)
+		{
+			const DrawRecorder::SDraw& draw = recorder.m_draws[i];
+			for (size_t j = 0; j < draw.instances.size(); ++j)
+			{
+				SPatchKey key;
+				key.vertexBuf = batches[i].vertexBuf;
+				key.baseVertex = draw.instances[j].baseVertex;
+				key.indexBuf = draw.indexBuf;
+				key.numIndices = draw.nIndexCnt;
+				drawn.push_back(key);
+			}
+		}
+
+		std::sort(expected.begin(), expected.end());
+		std::sort(drawn.begin(), drawn.end());
+		std::vector<SPatchKey> diff;
+		std::set_symmetric_difference(expected.begin(), expected.end(), drawn.begin(), drawn.end(), std::back_inserter(diff));
+
+		result.nPatches = (uint32)expected.size();
+		result.nDraws = (uint32)recorder.m_draws.size();
+		result.nMismatches = (uint32)diff.size();
+
+		return result.nDraws == batches.size() && result.nMismatches == 0 &&
+			result.nPatches > 0 && result.nDraws * 4 <= result.nPatches;
+	}
+#endif
+}
@@ -11,6 +11,7 @@
 #include "ShadowMap.h"
 #include "AmbientCube.h"
 #include "MaterialManager.h"
+#include "TextureManager.h"
 #include "ObjMeshLoader.h"
 #include "MeshLoader.h"
 #include "SkinModel.h"
@@ -32,11 +33,17 @@ using namespace Neo;
 	m_scenes.push_back(pScene);										\
 }
 
+#define ADD_TEST_SCENE_PRELOAD($setupFunc, $enterFunc, $preloadFunc)	\
+{																	\
+	ADD_TEST_SCENE($setupFunc, $enterFunc);							\
+	m_scenes.back()->SetPreloadFunc($preloadFunc);					\
+}
+
 
 void SetupTestScene2(Scene* scene)
 {
 	Neo::Material* pMaterial = Neo::MaterialManager::GetSingleton().NewMaterial("Mtl_01");
-	pMaterial->SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("lion.bmp")));
+	pMaterial->SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("lion.bmp")));
 	pMaterial->InitShader(("Opaque"), eShader_Opaque, eShaderFlag_EnableClipPlane);
 
 	/// Create a cube to observe reflection
@@ -81,6 +88,13 @@ void EnterTestScene2(Scene* scene)
 }
 
 
+void PreloadTestScene3(Scene* scene)
+{
+	g_env.pSceneMgr->PreloadMesh(GetResPath("trees/Broadleaf_Low.mesh"));
+	g_env.pSceneMgr->PreloadTexture(GetResPath("trees/BroadleafBark.dds"), eTextureType_2D, 0, true);
+	g_env.pSceneMgr->PreloadTexture(GetResPath("trees/BroadleafLeaves.dds"), eTextureType_2D, 0, true);
+}
+
 void SetupTestScene3(Scene* scene)
 {
 	// Sun light
@@ -94,14 +108,14 @@ void SetupTestScene3(Scene* scene)
 	//bool bOk = g_env.pSceneMgr->GetAmbientCube()->GenerateHDRCubeMap(VEC3(0, 20, 0), GetResPath("tmp_cubemap.dds"), scene);
 	//_AST(bOk);
 
-	//Texture* pTexIrradiance = g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("sponza_ambientcube_diff.dds"), eTextureType_CubeMap);
-	//Texture* pTexRadiance = g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("sponza_ambientcube_spec.dds"), eTextureType_CubeMap);
+	//Texture* pTexIrradiance = TextureManager::GetSingleton().LoadTexture(GetResPath("sponza_ambientcube_diff.dds"), eTextureType_CubeMap);
+	//Texture* pTexRadiance = TextureManager::GetSingleton().LoadTexture(GetResPath("sponza_ambientcube_spec.dds"), eTextureType_CubeMap);
 
 	//g_env.pSceneMgr->GetAmbientCube()->SetupCubeMap(pTexIrradiance, pTexRadiance);
 
 	//// Some wood pallets
 	//Neo::Material* pMaterial = Neo::MaterialManager::GetSingleton().NewMaterial("Mtl_wood");
-	//pMaterial->SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("WoodPallet.dds"), eTextureType_2D, 0, true));
+	//pMaterial->SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("WoodPallet.dds"), eTextureType_2D, 0, true));
 	//pMaterial->InitShader(("Opaque"), eShader_Opaque);
 
 	//for (int i = 0; i < 5; ++i)
@@ -205,8 +219,8 @@ void SetupTestScene3(Scene* scene)
 
 	// Create tree
 	Neo::Material* pMtlTree = Neo::MaterialManager::GetSingleton().NewMaterial("Mtl_Broadleaf_Low", eVertexType_Instanced, 2);
-	pMtlTree->GetSubMaterial(0).SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("trees/BroadleafBark.dds"), eTextureType_2D, 0, true));
-	pMtlTree->GetSubMaterial(1).SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("trees/BroadleafLeaves.dds"), eTextureType_2D, 0, true));
+	pMtlTree->GetSubMaterial(0).SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("trees/BroadleafBark.dds"), eTextureType_2D, 0, true));
+	pMtlTree->GetSubMaterial(1).SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("trees/BroadleafLeaves.dds"), eTextureType_2D, 0, true));
 
 	D3D_SHADER_MACRO macro = { "TREE", "" };
 	pMtlTree->InitShader(("Opaque"), eShader_Opaque, 0, &macro);
@@ -242,6 +256,11 @@ void EnterTestScene3(Scene* scene)
 	pCamera->SetMoveSpeed(2.0f);
 }
 
+void PreloadTestScene4(Scene* scene)
+{
+	g_env.pSceneMgr->PreloadMesh(GetResPath("dragon.mesh"));
+}
+
 void SetupTestScene4(Scene* scene)
 {
 	// Sun light
@@ -249,8 +268,8 @@ void SetupTestScene4(Scene* scene)
 	g_env.pSceneMgr->SetShadowMapSize(512);
 
 	// Ambient cube
-	Texture* pTexIrradiance = g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("sponza_ambientcube_diff.dds"), eTextureType_CubeMap);
-	Texture* pTexRadiance = g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("sponza_ambientcube_spec.dds"), eTextureType_CubeMap);
+	Texture* pTexIrradiance = TextureManager::GetSingleton().LoadTexture(GetResPath("sponza_ambientcube_diff.dds"), eTextureType_CubeMap);
+	Texture* pTexRadiance = TextureManager::GetSingleton().LoadTexture(GetResPath("sponza_ambientcube_spec.dds"), eTextureType_CubeMap);
 
 	g_env.pSceneMgr->GetAmbientCube()->SetupCubeMap(pTexIrradiance, pTexRadiance);
 
@@ -262,14 +281,14 @@ void SetupTestScene4(Scene* scene)
 	pEntity->SetCastShadow(false);
 
 	Neo::Material* pMaterial = Neo::MaterialManager::GetSingleton().NewMaterial("Mtl_01");
-	pMaterial->SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("White1x1.dds")));
+	pMaterial->SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("White1x1.dds")));
 	pMaterial->InitShader(("Opaque"), eShader_Opaque);
 	pEntity->SetMaterial(pMaterial);
 
 
 	// Shadow caster
 	pMaterial = Neo::MaterialManager::GetSingleton().NewMaterial("Mtl_02");
-	pMaterial->SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("White1x1.dds")));
+	pMaterial->SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("White1x1.dds")));
 	pMaterial->GetSubMaterial(0).specular.Set(0.9f, 0.9f, 0.9f);
 	pMaterial->GetSubMaterial(0).glossiness = 0.7f;
 	pMaterial->InitShader(("Opaque"), eShader_Opaque);
@@ -301,8 +320,8 @@ void SetupTestScene5(Scene* scene)
 	g_env.pSceneMgr->SetShadowMapSize(512);
 
 	// Ambient cube
-	Texture* pTexIrradiance = g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("sponza_ambientcube_diff.dds"), eTextureType_CubeMap);
-	Texture* pTexRadiance = g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("sponza_ambientcube_spec.dds"), eTextureType_CubeMap);
+	Texture* pTexIrradiance = TextureManager::GetSingleton().LoadTexture(GetResPath("sponza_ambientcube_diff.dds"), eTextureType_CubeMap);
+	Texture* pTexRadiance = TextureManager::GetSingleton().LoadTexture(GetResPath("sponza_ambientcube_spec.dds"), eTextureType_CubeMap);
 
 	g_env.pSceneMgr->GetAmbientCube()->SetupCubeMap(pTexIrradiance, pTexRadiance);
 
@@ -320,7 +339,7 @@ void SetupTestScene5(Scene* scene)
 	sam.AddressV = eTextureAddressMode_WRAP;
 	pMaterial->SetSamplerStateDesc(0, sam);
 
-	pMaterial->SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("road002_diff.dds"), eTextureType_2D, 0, true));
+	pMaterial->SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("road002_diff.dds"), eTextureType_2D, 0, true));
 	pMaterial->InitShader(("Opaque"), eShader_Opaque);
 	pEntity->SetMaterial(pMaterial);
 
@@ -363,11 +382,11 @@ void SetupTestScene5(Scene* scene)
 	g_furOffsetNames.push_back("../../../Res/Fur/FurTexture/FurTextureOffset15.dds");
 
 	pMaterial = Neo::MaterialManager::GetSingleton().NewMaterial("Mtl_Fur");
-	pMaterial->SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("Fur/catColor.dds"), eTextureType_2D, eTextureUsage_VertexShader | eTextureUsage_GeometryShader, true));
+	pMaterial->SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("Fur/catColor.dds"), eTextureType_2D, eTextureUsage_VertexShader | eTextureUsage_GeometryShader, true));
 	pMaterial->SetTexture(3, g_env.pRenderer->GetRenderSys()->CreateTextureArray(g_furTextureNames, false));
 	pMaterial->SetTexture(4, g_env.pRenderer->GetRenderSys()->CreateTextureArray(g_furOffsetNames, false));
-	pMaterial->SetTexture(5, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("Fur/FurTexture/FurTextureFin.dds")));
-	pMaterial->SetTexture(6, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("Fur/FurTexture/FurTextureOffsetFin.dds")));
+	pMaterial->SetTexture(5, TextureManager::GetSingleton().LoadTexture(GetResPath("Fur/FurTexture/FurTextureFin.dds")));
+	pMaterial->SetTexture(6, TextureManager::GetSingleton().LoadTexture(GetResPath("Fur/FurTexture/FurTextureOffsetFin.dds")));
 
 	SSamplerDesc& samDesc = pMaterial->GetSamplerStateDesc(0);
 	samDesc.AddressU = eTextureAddressMode_WRAP;
@@ -423,6 +442,11 @@ void EnterTestScene5(Scene* scene)
 }
 
 
+void PreloadTestScene6(Scene* scene)
+{
+	g_env.pSceneMgr->PreloadMesh(GetResPath("sphere_group.obj"));
+}
+
 void SetupTestScene6(Scene* scene)
 {
 	// Sun light
@@ -473,8 +497,8 @@ void SetupTestScene6(Scene* scene)
 
 
 	Neo::Material* pMaterial = Neo::MaterialManager::GetSingleton().NewMaterial("Mtl_floor");
-	pMaterial->SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("road002_diff.dds"), eTextureType_2D, 0, true));
-	pMaterial->SetTexture(1, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("road002_ddn.dds")));
+	pMaterial->SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("road002_diff.dds"), eTextureType_2D, 0, true));
+	pMaterial->SetTexture(1, TextureManager::GetSingleton().LoadTexture(GetResPath("road002_ddn.dds")));
 
 	SSamplerDesc& samDesc = pMaterial->GetSamplerStateDesc(0);
 	pMaterial->SetSamplerStateDesc(0, samDesc);
@@ -487,8 +511,8 @@ void SetupTestScene6(Scene* scene)
 	//bool bOk = g_env.pSceneMgr->GetAmbientCube()->GenerateHDRCubeMap(VEC3(0, 10, 0), GetResPath("tmp_cubemap.dds"), scene);
 	//_AST(bOk);
 
-	Texture* pTexIrradiance = g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("sponza_ambientcube_diff.dds"), eTextureType_CubeMap);
-	Texture* pTexRadiance = g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("sponza_ambientcube_spec.dds"), eTextureType_CubeMap);
+	Texture* pTexIrradiance = TextureManager::GetSingleton().LoadTexture(GetResPath("sponza_ambientcube_diff.dds"), eTextureType_CubeMap);
+	Texture* pTexRadiance = TextureManager::GetSingleton().LoadTexture(GetResPath("sponza_ambientcube_spec.dds"), eTextureType_CubeMap);
 
 	g_env.pSceneMgr->GetAmbientCube()->SetupCubeMap(pTexIrradiance, pTexRadiance);
 
@@ -501,7 +525,7 @@ void SetupTestScene6(Scene* scene)
 
 	for (int i = 0; i < 10; ++i)
 	{
-		pMaterial->GetSubMaterial(i).SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("Black1x1.dds")));
+		pMaterial->GetSubMaterial(i).SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("Black1x1.dds")));
 		pMaterial->GetSubMaterial(i).glossiness = i / 9.0f;
 		pMaterial->GetSubMaterial(i).specular.Set(1,1,1);
 	}
@@ -522,7 +546,7 @@ void SetupTestScene6(Scene* scene)
 
 	for (int i = 0; i < 10; ++i)
 	{
-		pMaterial->GetSubMaterial(i).SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("black1x1.dds")));
+		pMaterial->GetSubMaterial(i).SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("black1x1.dds")));
 		pMaterial->GetSubMaterial(i).glossiness = i / 9.0f;
 		pMaterial->GetSubMaterial(i).specular.Set(1, 1, 1);
 		pMaterial->GetSubMaterial(i).anisotropicParam.Set(0.316f, 0, 0, 0);
@@ -539,7 +563,7 @@ void SetupTestScene6(Scene* scene)
 
 	for (int i = 0; i < 10; ++i)
 	{
-		pMaterial3->GetSubMaterial(i).SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("black1x1.dds")));
+		pMaterial3->GetSubMaterial(i).SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("black1x1.dds")));
 		pMaterial3->GetSubMaterial(i).glossiness = 0.8f;
 		pMaterial3->GetSubMaterial(i).specular.Set(1, 1, 1);
 		pMaterial3->GetSubMaterial(i).anisotropicParam.Set((3.16f-0.316f)/10*(i+1), 0, 0, 0);
@@ -574,8 +598,8 @@ void SetupTestScene7(Scene* scene)
 	//bOk = g_env.pSceneMgr->GetAmbientCube()->GenerateHDRCubeMap(VEC3(0, 5, 0), GetResPath("tmp_cubemap.dds"), scene);
 	//_AST(bOk);
 
-	Texture* pTexIrradiance = g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("sponza_ambientcube_diff.dds"), eTextureType_CubeMap);
-	Texture* pTexRadiance = g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("sponza_ambientcube_spec.dds"), eTextureType_CubeMap);
+	Texture* pTexIrradiance = TextureManager::GetSingleton().LoadTexture(GetResPath("sponza_ambientcube_diff.dds"), eTextureType_CubeMap);
+	Texture* pTexRadiance = TextureManager::GetSingleton().LoadTexture(GetResPath("sponza_ambientcube_spec.dds"), eTextureType_CubeMap);
 
 	g_env.pSceneMgr->GetAmbientCube()->SetupCubeMap(pTexIrradiance, pTexRadiance);
 
@@ -595,7 +619,7 @@ void SetupTestScene7(Scene* scene)
 
 		for (int i = 0; i < 10; ++i)
 		{
-			pMaterial->GetSubMaterial(i).SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("Black1x1.dds")));
+			pMaterial->GetSubMaterial(i).SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("Black1x1.dds")));
 			pMaterial->GetSubMaterial(i).glossiness = i / 9.0f;
 			pMaterial->GetSubMaterial(i).specular.Set(1, 1, 1);
 		}
@@ -616,6 +640,12 @@ void EnterTestScene7(Scene* scene)
 }
 
 
+void PreloadTestScene8(Scene* scene)
+{
+	g_env.pSceneMgr->PreloadMesh(GetResPath("cube.mesh"));
+	g_env.pSceneMgr->PreloadMesh(GetResPath("sphere.mesh"));
+}
+
 void SetupTestScene8(Scene* scene)
 {
 	// Sun light
@@ -650,7 +680,7 @@ void SetupTestScene8(Scene* scene)
 
 
 	Neo::Material* pMaterial = Neo::MaterialManager::GetSingleton().NewMaterial("Mtl_floor");
-	pMaterial->SetTexture(0, g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("White1x1.dds"), eTextureType_2D, 0, true));
+	pMaterial->SetTexture(0, TextureManager::GetSingleton().LoadTexture(GetResPath("White1x1.dds"), eTextureType_2D, 0, true));
 
 	SSamplerDesc& samDesc = pMaterial->GetSamplerStateDesc(0);
 	pMaterial->SetSamplerStateDesc(0, samDesc);
@@ -675,8 +705,8 @@ void SetupTestScene8(Scene* scene)
 	// Place some decals
 	{
 		Decal* pDecal = g_env.pSceneMgr->CreateDecal(VEC3(0, 0, 0), 30);
-		pDecal->Init(g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("decals/dirt_on_road_2_frost.dds"), eTextureType_2D, 0, true),
-			g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("decals/dirt_on_road_2_frost_ddn.dds")));
+		pDecal->Init(TextureManager::GetSingleton().LoadTexture(GetResPath("decals/dirt_on_road_2_frost.dds"), eTextureType_2D, 0, true),
+			TextureManager::GetSingleton().LoadTexture(GetResPath("decals/dirt_on_road_2_frost_ddn.dds")));
 	}
 
 	{
@@ -684,8 +714,8 @@ void SetupTestScene8(Scene* scene)
 		rot.FromAxisAngle(VEC3::NEG_UNIT_X, 90);
 
 		Decal* pDecal = g_env.pSceneMgr->CreateDecal(VEC3(-25, 4, -5), 15, rot);
-		pDecal->Init(g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("decals/dirt_on_road_2_frost.dds"), eTextureType_2D, 0, true),
-			g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("decals/dirt_on_road_2_frost_ddn.dds")));
+		pDecal->Init(TextureManager::GetSingleton().LoadTexture(GetResPath("decals/dirt_on_road_2_frost.dds"), eTextureType_2D, 0, true),
+			TextureManager::GetSingleton().LoadTexture(GetResPath("decals/dirt_on_road_2_frost_ddn.dds")));
 
 		pDecal->SetClipDistance(0.025f);
 	}
@@ -695,8 +725,8 @@ void SetupTestScene8(Scene* scene)
 		rot.FromAxisAngle(VEC3::UNIT_Y, 90);
 
 		Decal* pDecal = g_env.pSceneMgr->CreateDecal(VEC3(25, 1, -4), 7, rot);
-		pDecal->Init(g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("decals/dirt_on_road_2_frost.dds"), eTextureType_2D, 0, true),
-			g_env.pRenderer->GetRenderSys()->LoadTexture(GetResPath("decals/dirt_on_road_2_frost_ddn.dds")));
+		pDecal->Init(TextureManager::GetSingleton().LoadTexture(GetResPath("decals/dirt_on_road_2_frost.dds"), eTextureType_2D, 0, true),
+			TextureManager::GetSingleton().LoadTexture(GetResPath("decals/dirt_on_road_2_frost_ddn.dds")));
 	}
 }
 
@@ -718,22 +748,22 @@ namespace Neo
 		//ADD_TEST_SCENE(SetupTestScene2, EnterTestScene2);
 
 		////// Test Scene 3: Terrain
-		//ADD_TEST_SCENE(SetupTestScene3, EnterTestScene3);
+		//ADD_TEST_SCENE_PRELOAD(SetupTestScene3, EnterTestScene3, PreloadTestScene3);
 
 		//// Test Scene 4: Shadow testing
-		//ADD_TEST_SCENE(SetupTestScene4, EnterTestScene4);
+		//ADD_TEST_SCENE_PRELOAD(SetupTestScene4, EnterTestScene4, PreloadTestScene4);
 
 		// Test Scene 5: Fur and hair rendering
 		//ADD_TEST_SCENE(SetupTestScene5, EnterTestScene5);
 
 		//// Test Scene 6: Full HDR and physically-based deferred shading
-		ADD_TEST_SCENE(SetupTestScene6, EnterTestScene6);
+		ADD_TEST_SCENE_PRELOAD(SetupTestScene6, EnterTestScene6, PreloadTestScene6);
 
 		//// Test Scene 7: Sponza
 		//ADD_TEST_SCENE(SetupTestScene7, EnterTestScene7);
 
 		//// Test Scene 8: Decals
-		//ADD_TEST_SCENE(SetupTestScene8, EnterTestScene8);
+		//ADD_TEST_SCENE_PRELOAD(SetupTestScene8, EnterTestScene8, PreloadTestScene8);
 	}
 }
 
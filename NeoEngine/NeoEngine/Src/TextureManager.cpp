@@ -0,0 +1,182 @@
+#include "stdafx.h"
+#include "TextureManager.h"
+#include "Texture.h"
+#include "RenderSystem.h"
+#include "Renderer.h"
+
+namespace Neo
+{
+	// Unused textures kept around by default
+	static const uint32 DEFAULT_UNUSED_BUDGET = 64 * 1024 * 1024;
+
+	//------------------------------------------------------------------------------------
+	TextureManager::TextureManager()
+		: m_nResidentBytes(0)
+		, m_nUnusedBudget(DEFAULT_UNUSED_BUDGET)
+		, m_nTick(0)
+	{
+
+	}
+	//------------------------------------------------------------------------------------
+	TextureManager::~TextureManager()
+	{
+		Clear();
+	}
+	//------------------------------------------------------------------------------------
+	Texture* TextureManager::LoadTexture(const STRING& filename, eTextureType type, uint32 usage, bool bSRGB)
+	{
+		auto iter = _GetEntry(filename, type, usage, bSRGB);
+		STextureEntry& entry = iter->second;
+
+		// Don't wait for an async load of it, its upload then picks this one
+		if (!entry.pTexture)
+		{
+			_SetTexture(entry, g_env.pRenderer->GetRenderSys()->LoadTexture(filename, type, usage, bSRGB));
+
+			// Failed, keep the entry only for an async load still filling it
+			if (!entry.pTexture && entry.nReserved == 0)
+			{
+				m_textures.erase(iter);
+				return nullptr;
+			}
+		}
+
+		return entry.pTexture;
+	}
+	//------------------------------------------------------------------------------------
+	Texture* TextureManager::ReserveTexture(const STRING& filename, eTextureType type, uint32 usage, bool bSRGB)
+	{
+		STextureEntry& entry = _GetEntry(filename, type, usage, bSRGB)->second;
+
+		if (!entry.pTexture)
+		{
+			++entry.nReserved;
+		}
+
+		return entry.pTexture;
+	}
+	//------------------------------------------------------------------------------------
+	Texture* TextureManager::FillTexture(const STRING& filename, eTextureType type, uint32 usage, bool bSRGB, const void* pData, uint32 nSize)
+	{
+		// The entry may be gone if LoadTexture() filled it and it was released unused since
+		auto iter = _GetEntry(filename, type, usage, bSRGB);
+		STextureEntry& entry = iter->second;
+
+		if (entry.nReserved > 0)
+		{
+			--entry.nReserved;
+		}
+
+		if (!entry.pTexture && pData)
+		{
+			_SetTexture(entry, g_env.pRenderer->GetRenderSys()->LoadTextureFromMemory(filename, pData, nSize, type, usage, bSRGB));
+		}
+
+		Texture* pTexture = entry.pTexture;
+
+		if (!pTexture && entry.nReserved == 0)
+		{
+			m_textures.erase(iter);
+		}
+
+		return pTexture;
+	}
+	//------------------------------------------------------------------------------------
+	TextureManager::TextureContainer::iterator TextureManager::_GetEntry(const STRING& filename, eTextureType type, uint32 usage, bool bSRGB)
+	{
+		STextureKey key;
+		key.filename = filename;
+		key.type = type;
+		key.usage = usage;
+		key.bSRGB = bSRGB;
+
+		auto iter = m_textures.find(key);
+
+		if (iter == m_textures.end())
+		{
+			STextureEntry entry;
+			entry.pTexture = nullptr;
+			entry.nBytes = 0;
+			entry.nReserved = 0;
+
+			iter = m_textures.insert(std::make_pair(key, entry)).first;
+		}
+
+		iter->second.nLastUsed = m_nTick;
+
+		return iter;
+	}
+	//------------------------------------------------------------------------------------
+	void TextureManager::_SetTexture(STextureEntry& entry, Texture* pTexture)
+	{
+		if (!pTexture)
+		{
+			return;
+		}
+
+		entry.pTexture = pTexture;
+		entry.nBytes = pTexture->GetResidentBytes();
+		m_nResidentBytes += entry.nBytes;
+	}
+	//------------------------------------------------------------------------------------
+	void TextureManager::Update()
+	{
+		++m_nTick;
+
+		std::vector<TextureContainer::iterator> vecUnused;
+		uint32 nUnusedBytes = 0;
+
+		for (auto iter = m_textures.begin(); iter != m_textures.end(); ++iter)
+		{
+			STextureEntry& entry = iter->second;
+
+			// Reserved by an async load, nothing to release yet
+			if (!entry.pTexture)
+			{
+				continue;
+			}
+
+			if (entry.pTexture->GetRefCount() > 1)
+			{
+				entry.nLastUsed = m_nTick;
+			}
+			else
+			{
+				vecUnused.push_back(iter);
+				nUnusedBytes += entry.nBytes;
+			}
+		}
+
+		if (nUnusedBytes <= m_nUnusedBudget)
+		{
+			return;
+		}
+
+		std::sort(vecUnused.begin(), vecUnused.end(), [](const TextureContainer::iterator& a, const TextureContainer::iterator& b)
+		{
+			return a->second.nLastUsed < b->second.nLastUsed;
+		});
+
+		for (uint32 i = 0; i < vecUnused.size() && nUnusedBytes > m_nUnusedBudget; ++i)
+		{
+			STextureEntry& entry = vecUnused[i]->second;
+
+			nUnusedBytes -= entry.nBytes;
+			m_nResidentBytes -= entry.nBytes;
+			SAFE_RELEASE(entry.pTexture);
+
+			m_textures.erase(vecUnused[i]);
+		}
+	}
+	//------------------------------------------------------------------------------------
+	void TextureManager::Clear()
+	{
+		for (auto iter = m_textures.begin(); iter != m_textures.end(); ++iter)
+		{
+			SAFE_RELEASE(iter->second.pTexture);
+		}
+		m_textures.clear();
+
+		m_nResidentBytes = 0;
+	}
+}
@@ -92,6 +92,9 @@ namespace Neo
 		m_pCamera->SetManualControl(true);
 		m_pCamera->SetPosition(m_vAttachPos + pModel->GetPosition());
 
+		// Upper body clips only drive the bones from the waist up
+		m_pModel->SetPartMask(eAnimPart_Top, "Waist");
+
 		m_pStateMachine = new StateMachine(this);
 
 		CharIdleState::create(m_pStateMachine, "Idle");
@@ -1,6 +1,5 @@
 static const float PI = 3.141592657f;
 static const float fESMExponentialMultiplier = 80.0f;
-#define MAX_BONE_NUM	100
 
 
 struct gbuffer_output
@@ -48,9 +47,12 @@ cbuffer cbufferMaterial : register(b1)
 
 cbuffer cbufferSkin : register(b2)
 {
-	matrix	matSkin[MAX_BONE_NUM];
+	uint	skinPaletteOffset;		// First matrix of the model in gSkinPalette
 };
 
+// Skin matrices of every model drawn this frame
+StructuredBuffer<matrix> gSkinPalette : register(t12);
+
 struct PointLight 
 {
 	float3 position;
@@ -29,16 +29,16 @@ VS_OUTPUT VS( VS_INPUT IN )
 	int4 decodeIndices = D3DCOLORtoUBYTE4(IN.boneIndices).zyxw;
 
 	float4 vLocalPos = 
-		mul(IN.Pos, matSkin[decodeIndices.x]) * IN.boneWeights.x +
-		mul(IN.Pos, matSkin[decodeIndices.y]) * IN.boneWeights.y +
-		mul(IN.Pos, matSkin[decodeIndices.z]) * IN.boneWeights.z +
-		mul(IN.Pos, matSkin[decodeIndices.w]) * IN.boneWeights.w;
+		mul(IN.Pos, gSkinPalette[skinPaletteOffset + decodeIndices.x]) * IN.boneWeights.x +
+		mul(IN.Pos, gSkinPalette[skinPaletteOffset + decodeIndices.y]) * IN.boneWeights.y +
+		mul(IN.Pos, gSkinPalette[skinPaletteOffset + decodeIndices.z]) * IN.boneWeights.z +
+		mul(IN.Pos, gSkinPalette[skinPaletteOffset + decodeIndices.w]) * IN.boneWeights.w;
 
 	float4 vLocalNormal =
-		mul(IN.normal, matSkin[decodeIndices.x]) * IN.boneWeights.x +
-		mul(IN.normal, matSkin[decodeIndices.y]) * IN.boneWeights.y +
-		mul(IN.normal, matSkin[decodeIndices.z]) * IN.boneWeights.z +
-		mul(IN.normal, matSkin[decodeIndices.w]) * IN.boneWeights.w;
+		mul(IN.normal, gSkinPalette[skinPaletteOffset + decodeIndices.x]) * IN.boneWeights.x +
+		mul(IN.normal, gSkinPalette[skinPaletteOffset + decodeIndices.y]) * IN.boneWeights.y +
+		mul(IN.normal, gSkinPalette[skinPaletteOffset + decodeIndices.z]) * IN.boneWeights.z +
+		mul(IN.normal, gSkinPalette[skinPaletteOffset + decodeIndices.w]) * IN.boneWeights.w;
 
 	float4 vWorldPos = mul(vLocalPos, World);
 	float4 posH = mul(vWorldPos, ViewProj);
@@ -68,10 +68,10 @@ VS_OUTPUT_ShadowMapGen VS_ShadowMapGen(VS_INPUT IN)
 	int4 decodeIndices = D3DCOLORtoUBYTE4(IN.boneIndices).zyxw;
 
 	float4 vLocalPos =
-		mul(IN.Pos, matSkin[decodeIndices.x]) * IN.boneWeights.x +
-		mul(IN.Pos, matSkin[decodeIndices.y]) * IN.boneWeights.y +
-		mul(IN.Pos, matSkin[decodeIndices.z]) * IN.boneWeights.z +
-		mul(IN.Pos, matSkin[decodeIndices.w]) * IN.boneWeights.w;
+		mul(IN.Pos, gSkinPalette[skinPaletteOffset + decodeIndices.x]) * IN.boneWeights.x +
+		mul(IN.Pos, gSkinPalette[skinPaletteOffset + decodeIndices.y]) * IN.boneWeights.y +
+		mul(IN.Pos, gSkinPalette[skinPaletteOffset + decodeIndices.z]) * IN.boneWeights.z +
+		mul(IN.Pos, gSkinPalette[skinPaletteOffset + decodeIndices.w]) * IN.boneWeights.w;
 
 	float4 vWorldPos = mul(vLocalPos, World);
 	float4 posH = mul(vWorldPos, ViewProj);
@@ -5,16 +5,26 @@ cbuffer cbTerrain	:	register(b10)
 {
 	matrix		posIndexToObjectSpace;
 	float4		uvMul_0;
-	float2		lodMorph;
 	float		baseUVScale;
 };
 
 //--------------------------------------------------------------------------------------
+// Vertex data of all terrain nodes sharing the pooled buffer, indexed by baseVertex + SV_VertexID
+#ifdef COMPACT_VERTEX
+// x: posIndex (2 x int16), y: low 16 bits height 0-1 over heightRange,
+// high 16 bits: low 12 bits snorm delta over heightRange, high 4 bits LOD threshold + 1
+StructuredBuffer<uint2> terrainVertices : register(t13);
+#else
+// x: posIndex (2 x int16), y: height, zw: delta
+StructuredBuffer<uint4> terrainVertices : register(t13);
+#endif
+
 struct VS_INPUT
 {
-	int2 posIndex : POSITION;
-	float height : TEXCOORD0;
-	float2 delta : TEXCOORD1;
+	uint vertexId : SV_VertexID;
+	float4 patchParams : TEXCOORD0;	// per patch: xy = lodMorph, zw = heightRange (x = lowest height, y = range)
+	float3 patchOffset : TEXCOORD1;	// per patch: terrain position
+	uint baseVertex : TEXCOORD2;	// per patch: first vertex of the node in terrainVertices
 };
 
 struct VS_OUTPUT
@@ -31,15 +41,31 @@ VS_OUTPUT VS_GBuffer(VS_INPUT IN)
 {
 	VS_OUTPUT OUT = (VS_OUTPUT)0;
 
-	float4 pos = mul(float4(IN.posIndex.x, IN.posIndex.y, IN.height, 1), posIndexToObjectSpace);
-	pos = mul(pos, World);
+	float2 lodMorph = IN.patchParams.xy;
+#ifdef COMPACT_VERTEX
+	uint2 vert = terrainVertices[IN.baseVertex + IN.vertexId];
+	float2 heightRange = IN.patchParams.zw;
+	float height = heightRange.x + (vert.y & 0xffff) / 65535.0f * heightRange.y;
+	uint packedDelta = vert.y >> 16;
+	float2 delta;
+	delta.x = (asint(packedDelta << 20) >> 20) / 2047.0f * heightRange.y;
+	delta.y = (packedDelta >> 12) - 1.0f;
+#else
+	uint4 vert = terrainVertices[IN.baseVertex + IN.vertexId];
+	float height = asfloat(vert.y);
+	float2 delta = asfloat(vert.zw);
+#endif
+	float2 posIndex = float2(asint(vert.x << 16) >> 16, asint(vert.x) >> 16);
+
+	float4 pos = mul(float4(posIndex.x, posIndex.y, height, 1), posIndexToObjectSpace);
+	pos.xyz += IN.patchOffset.xyz;
 	OUT.oWPos = pos;
 
-	float toMorph = -min(0, sign(IN.delta.y - lodMorph.y));
-	pos.y += IN.delta.x * toMorph * lodMorph.x;
+	float toMorph = -min(0, sign(delta.y - lodMorph.y));
+	pos.y += delta.x * toMorph * lodMorph.x;
 	OUT.oPos = mul(pos, ViewProj);
 
-	float2 uv = float2(IN.posIndex.x * baseUVScale, 1.0 - (IN.posIndex.y * baseUVScale));
+	float2 uv = float2(posIndex.x * baseUVScale, 1.0 - (posIndex.y * baseUVScale));
 	OUT.oUV0.xy = uv.xy * uvMul_0.r;
 	OUT.oUV0.zw = uv.xy * uvMul_0.g;
 	OUT.oUV1.xy = uv.xy * uvMul_0.b;
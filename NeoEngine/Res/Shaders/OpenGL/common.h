@@ -40,7 +40,13 @@ uniform cbufferMaterial
 
 uniform cbufferSkin
 {
-	mat4	matSkin[MAX_BONE_NUM];
+	uint	skinPaletteOffset;		// First matrix of the model in gSkinPalette
+};
+
+// Skin matrices of every model drawn this frame, binding is SKIN_PALETTE_SLOT
+layout(std430, binding = 12) readonly buffer SkinPalette
+{
+	mat4	gSkinPalette[];
 };
 
 struct PointLight 
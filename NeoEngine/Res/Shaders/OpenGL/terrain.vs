@@ -3,14 +3,26 @@ uniform cbufferCustom0
 {
 	mat4		posIndexToObjectSpace;
 	vec4		uvMul_0;
-	vec2		lodMorph;
 	float		baseUVScale;
 };
 
 //--------------------------------------------------------------------------------------
-layout(location = 0) in vec2 posIndex;
-layout(location = 1) in float height;
-layout(location = 2) in vec2 delta;
+// Vertex data of all terrain nodes sharing the pooled buffer, indexed by baseVertex + gl_VertexID
+layout(std430, binding = 13) readonly buffer TerrainVertices
+{
+#ifdef COMPACT_VERTEX
+	// x: posIndex (2 x int16), y: low 16 bits height 0-1 over heightRange,
+	// high 16 bits: low 12 bits snorm delta over heightRange, high 4 bits LOD threshold + 1
+	uvec2 terrainVertices[];
+#else
+	// x: posIndex (2 x int16), y: height, zw: delta
+	uvec4 terrainVertices[];
+#endif
+};
+
+layout(location = 0) in vec4 patchParams;	// per patch: xy = lodMorph, zw = heightRange (x = lowest height, y = range)
+layout(location = 1) in vec3 patchOffset;	// per patch: terrain position
+layout(location = 2) in uint baseVertex;	// per patch: first vertex of the node in terrainVertices
 
 
 out vec4 oWPos;
@@ -24,12 +36,28 @@ out vec4 oUV1;
 //--------------------------------------------------------------------------------------
 void main()
 {
-	vec4 pos = vec4(posIndex.x, posIndex.y, height, 1) * posIndexToObjectSpace;
-	pos = pos * World;
+	vec2 lodMorph = patchParams.xy;
+#ifdef COMPACT_VERTEX
+	uvec2 vert = terrainVertices[baseVertex + uint(gl_VertexID)];
+	vec2 heightRange = patchParams.zw;
+	float vertHeight = heightRange.x + float(vert.y & 0xffffu) / 65535.0 * heightRange.y;
+	uint delta = vert.y >> 16;
+	vec2 vertDelta;
+	vertDelta.x = float(int(delta << 20) >> 20) / 2047.0 * heightRange.y;
+	vertDelta.y = float(delta >> 12) - 1.0;
+#else
+	uvec4 vert = terrainVertices[baseVertex + uint(gl_VertexID)];
+	float vertHeight = uintBitsToFloat(vert.y);
+	vec2 vertDelta = uintBitsToFloat(vert.zw);
+#endif
+	vec2 posIndex = vec2(float(int(vert.x << 16) >> 16), float(int(vert.x) >> 16));
+
+	vec4 pos = vec4(posIndex.x, posIndex.y, vertHeight, 1) * posIndexToObjectSpace;
+	pos.xyz += patchOffset.xyz;
 	oWPos = pos;
 
-	float toMorph = -min(0, sign(delta.y - lodMorph.y));
-	pos.y += delta.x * toMorph * lodMorph.x;
+	float toMorph = -min(0, sign(vertDelta.y - lodMorph.y));
+	pos.y += vertDelta.x * toMorph * lodMorph.x;
 	gl_Position = pos * ViewProj;
 
 	vec2 uv = vec2(posIndex.x * baseUVScale, 1.0 - (posIndex.y * baseUVScale));